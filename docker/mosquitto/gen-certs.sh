@@ -0,0 +1,41 @@
+#!/bin/sh
+# Test CA and certificate for the TLS listener of config/mosquitto.conf, and a copy of the CA for the firmware
+# (main/certs/ca.crt, embedded with ESP_MQTT_TLS). ECDSA P-256, the cheapest chain for the node to verify.
+#
+#   ./gen-certs.sh [broker host name or IP address ...]
+#
+# The certificate is issued for localhost and every name given, include the one in ESP_BROKER_URL. The CA is
+# only created once, run the script again to reissue the broker certificate for other names.
+set -e
+
+cd "$(dirname "$0")"
+out=config/certs
+firmware=../../main/certs
+mkdir -p "$out" "$firmware"
+
+cn=${1:-localhost}
+san="DNS:localhost,IP:127.0.0.1"
+for name in "$@"; do
+    case "$name" in
+        *[!0-9.]*) san="$san,DNS:$name" ;;
+        *) san="$san,IP:$name" ;;
+    esac
+done
+
+if [ ! -f "$out/ca.key" ]; then
+    openssl req -x509 -newkey ec -pkeyopt ec_paramgen_curve:prime256v1 -nodes -days 3650 \
+        -subj "/CN=esp32-temp test CA" -keyout "$out/ca.key" -out "$out/ca.crt"
+fi
+
+printf 'subjectAltName=%s\nextendedKeyUsage=serverAuth\n' "$san" > "$out/server.ext"
+openssl req -newkey ec -pkeyopt ec_paramgen_curve:prime256v1 -nodes -subj "/CN=$cn" \
+    -keyout "$out/server.key" -out "$out/server.csr"
+openssl x509 -req -in "$out/server.csr" -CA "$out/ca.crt" -CAkey "$out/ca.key" -CAcreateserial -days 825 \
+    -extfile "$out/server.ext" -out "$out/server.crt"
+rm "$out/server.csr" "$out/server.ext"
+
+# the broker runs as its own user in the container
+chmod 644 "$out/server.key"
+cp "$out/ca.crt" "$firmware/ca.crt"
+
+echo "broker certificate for $san, CA copied to main/certs/ca.crt"
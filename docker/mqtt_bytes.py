@@ -0,0 +1,85 @@
+#!/usr/bin/env python3
+"""Bytes on the wire per sample, with and without MQTT5 topic aliases.
+
+Topics are read from the defaults in main/Kconfig.projbuild (override them with --topic NAME=VALUE when your
+sdkconfig differs). Sizes are MQTT5 PUBLISH packets as esp-mqtt encodes them, no properties other than the topic
+alias. The firmware only aliases QoS0 publishes, so there are three columns: QoS1 with the full topic (the live
+values without ESP_MQTT_TOPIC_ALIAS), QoS0 with the full topic, and QoS0 aliased (the default with it). TCP/IP and
+TLS overhead is not included, it is the same in every column.
+
+    python3 docker/mqtt_bytes.py
+"""
+
+import argparse
+import re
+from pathlib import Path
+
+KCONFIG = Path(__file__).resolve().parent.parent / "main" / "Kconfig.projbuild"
+
+# Typical payloads of one sample, see publish_dht_values() / publish_battery_values()
+VALUE_PAYLOADS = {
+    "ESP_MQTT_TOPIC_TEMPERATURE": b"21.30",
+    "ESP_MQTT_TOPIC_HUMIDITY": b"45.20",
+    "ESP_MQTT_TOPIC_BATTERY_VOLTAGE": b"3.91",
+    "ESP_MQTT_TOPIC_BATTERY_SOC": b"87.50",
+}
+
+# CBOR frame with all four values, see payload.h
+FRAME_PAYLOAD_SIZE = 33
+
+TOPIC_ALIAS_PROPERTY_SIZE = 3   # identifier 0x23 + two byte alias
+
+
+def varint_size(value):
+    size = 1
+    while value >= 128:
+        value //= 128
+        size += 1
+    return size
+
+
+def publish_size(topic_len, payload_len, qos, alias=False):
+    properties = TOPIC_ALIAS_PROPERTY_SIZE if alias else 0
+    remaining = 2 + topic_len + (2 if qos else 0) + varint_size(properties) + properties + payload_len
+    return 1 + varint_size(remaining) + remaining
+
+
+def kconfig_topics():
+    text = KCONFIG.read_text()
+    pattern = re.compile(r'config (ESP_MQTT_TOPIC_\w+)\s+string[^\n]*\n(?:\s+depends on[^\n]*\n)?\s+default "([^"]*)"')
+    return dict(pattern.findall(text))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--topic", action="append", default=[], metavar="NAME=VALUE",
+                        help="override a topic, e.g. ESP_MQTT_TOPIC_TEMPERATURE=t")
+    args = parser.parse_args()
+
+    topics = kconfig_topics()
+    for override in args.topic:
+        name, value = override.split("=", 1)
+        topics[name] = value
+
+    print(f"{'message':<32} {'payload':>7} {'QoS1 full':>10} {'QoS0 full':>10} {'QoS0 aliased':>13}")
+
+    def sizes(topic, payload_len):
+        return (publish_size(len(topic), payload_len, 1), publish_size(len(topic), payload_len, 0),
+                publish_size(0, payload_len, 0, alias=True))
+
+    totals = [0, 0, 0]
+    for name, payload in VALUE_PAYLOADS.items():
+        row = sizes(topics[name].encode(), len(payload))
+        totals = [total + size for total, size in zip(totals, row)]
+        print(f"{name[len('ESP_MQTT_TOPIC_'):].lower():<32} {len(payload):>7} {row[0]:>10} {row[1]:>10} {row[2]:>13}")
+
+    print(f"{'per sample, per-value topics':<32} {'':>7} {totals[0]:>10} {totals[1]:>10} {totals[2]:>13}")
+
+    row = sizes(topics.get("ESP_MQTT_TOPIC_FRAME", "").encode(), FRAME_PAYLOAD_SIZE)
+    print(f"{'per sample, CBOR frame':<32} {FRAME_PAYLOAD_SIZE:>7} {row[0]:>10} {row[1]:>10} {row[2]:>13}")
+    print()
+    print("Aliased sizes are the steady state, the first publish per topic and connection also carries the topic.")
+
+
+if __name__ == "__main__":
+    main()
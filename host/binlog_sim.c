@@ -0,0 +1,233 @@
+/*
+ * Dumps the deferred log of the firmware over MQTT on the host: app_main() with the real sensor scheduler, MQTT
+ * event handler and mqtt_task, against the sensor and broker stand-ins of host/hal.
+ *
+ * A retained dump request waits on the broker when the node comes up, it has to be ignored. After 60 s a dump is
+ * requested and decoded with the formatter of tools/binlog_decode.c: the readings of the scripted sensors must come
+ * back as the lines ESP_LOGI would have printed, in chunks of whole records numbered without gaps. The second dump
+ * comes once the DHT22 readings filled CONFIG_ESP_BINLOG_SIZE twice over: it must start at the oldest record still
+ * there and report the overwritten ones.
+ * Exits with 1 if a check fails; without CONFIG_ESP_BINLOG (e.g. in duty-cycle mode) there is nothing to check.
+ *
+ *   binlog_sim [-v]
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "mqtt.h"
+#include "binlog.h"
+#include "sim.h"
+#include "test.h"
+
+#define FIRST_DUMP_S        60
+#define DHT_RECORD_SIZE     20          /*!< timestamp, ID word and three arguments */
+/* late enough for the DHT22 readings alone to have filled the ring twice, whatever its size */
+#define SECOND_DUMP_S       (FIRST_DUMP_S + 2 * (CONFIG_ESP_BINLOG_SIZE / DHT_RECORD_SIZE) * \
+                             CONFIG_ESP_DHT_SAMPLE_PERIOD_MS / 1000)
+
+void app_main(void);
+
+#if CONFIG_ESP_BINLOG
+typedef struct {
+    uint32_t chunks;
+    uint32_t records;
+    uint32_t first;             /*!< sequence number of the first record */
+    uint32_t overwritten;       /*!< of the first chunk */
+    uint32_t last_time_ms;
+    uint32_t dht_readings;      /*!< of sensor 0, with the scripted values */
+    uint32_t battery_readings;
+    bool malformed;             /*!< a chunk that does not decode to the byte */
+    bool gap;                   /*!< sequence numbers missing between chunks */
+    bool unordered;             /*!< timestamps going back */
+} dump_t;
+
+static bool dht_script(int64_t now_us, uint8_t data[5], void *ctx)
+{
+    dht_line_frame(dht_line_requests() % 2 ? 210 : 230, 500, data);
+    return true;
+}
+
+static void run_until(uint32_t *now_s, uint32_t second)
+{
+    while (*now_s < second) {
+        vTaskDelay(pdMS_TO_TICKS(1000));
+        (*now_s)++;
+    }
+}
+
+/* Decodes one chunk as binlog_decode does, the text checked against the scripted readings */
+static void decode_chunk(const mqtt_capture_t *capture, dump_t *dump, bool verbose)
+{
+    binlog_dump_header_t header;
+    size_t offset = sizeof(header);
+
+    if (capture->len < sizeof(header)) {
+        dump->malformed = true;
+        return;
+    }
+    memcpy(&header, capture->payload, sizeof(header));
+    if (header.magic != BINLOG_MAGIC || header.messages != BINLOG_MESSAGE_COUNT) {
+        dump->malformed = true;
+        return;
+    }
+
+    if (dump->chunks == 0) {
+        dump->first = header.first;
+        dump->overwritten = header.overwritten;
+    } else if (header.first != dump->first + dump->records) {
+        dump->gap = true;
+    }
+    dump->chunks++;
+
+    for (uint16_t i = 0; i < header.records; i++) {
+        uint32_t time_ms, word;
+        int32_t args[BINLOG_MAX_ARGS];
+        char text[160];
+
+        if (offset + 8 > capture->len) {
+            dump->malformed = true;
+            return;
+        }
+        memcpy(&time_ms, capture->payload + offset, 4);
+        memcpy(&word, capture->payload + offset + 4, 4);
+        offset += 8;
+
+        uint16_t id = word & 0xffff;
+        size_t argc = (word >> 16) & 0xff;
+        if (argc > BINLOG_MAX_ARGS || offset + argc * 4 > capture->len) {
+            dump->malformed = true;
+            return;
+        }
+        memcpy(args, capture->payload + offset, argc * 4);
+        offset += argc * 4;
+
+        if (binlog_format(id, args, argc, text, sizeof(text)) < 0) {
+            dump->malformed = true;
+            return;
+        }
+        if (verbose) {
+            printf("  (%" PRIu32 ") %s: %s\n", time_ms, binlog_messages[id].tag, text);
+        }
+
+        if (time_ms < dump->last_time_ms) {
+            dump->unordered = true;
+        }
+        dump->last_time_ms = time_ms;
+        dump->records++;
+        if (id == BINLOG_DHT_READING && (strcmp(text, "Sensor 0: Humidity: 50.00, temperature: 21.00°C") == 0 ||
+                                         strcmp(text, "Sensor 0: Humidity: 50.00, temperature: 23.00°C") == 0)) {
+            dump->dht_readings++;
+        } else if (id == BINLOG_BATTERY_READING && strcmp(text, "Voltage: 4.10, SOC: 90.00%") == 0) {
+            dump->battery_readings++;
+        }
+    }
+
+    if (offset != capture->len) {
+        dump->malformed = true;
+    }
+}
+
+/* The dump chunks captured since capture index from */
+static dump_t decode_dump(size_t *from, bool verbose)
+{
+    size_t count;
+    const mqtt_capture_t *captures = mqtt_fake_captured(&count);
+    dump_t dump = { 0 };
+
+    for (; *from < count; (*from)++) {
+        if (strcmp(captures[*from].topic, ESP_MQTT_TOPIC_LOG_DUMP) == 0) {
+            decode_chunk(&captures[*from], &dump, verbose);
+        }
+    }
+
+    printf("dump: %" PRIu32 " chunks, records %" PRIu32 "..%" PRIu32 ", %" PRIu32 " overwritten, %" PRIu32
+           " DHT22 and %" PRIu32 " battery readings\n", dump.chunks, dump.first, dump.first + dump.records,
+           dump.overwritten, dump.dht_readings, dump.battery_readings);
+    return dump;
+}
+
+static int run(bool verbose)
+{
+    uint32_t now_s = 0;
+    size_t seen = 0;
+    int failures = 0;
+
+    // left there by mistake, it would dump the ring on every connect
+    mqtt_fake_publish(ESP_MQTT_TOPIC_LOG, "", 1, true);
+    app_main();
+
+    run_until(&now_s, FIRST_DUMP_S);
+    dump_t retained = decode_dump(&seen, false);
+
+    mqtt_fake_publish(ESP_MQTT_TOPIC_LOG, NULL, 0, false);
+    run_until(&now_s, FIRST_DUMP_S + 1);
+    dump_t first = decode_dump(&seen, verbose);
+    uint32_t cycles = FIRST_DUMP_S * 1000 / CONFIG_ESP_DHT_SAMPLE_PERIOD_MS;
+
+    failures += expect(retained.chunks == 0, "retained request ignored");
+    failures += expect(first.chunks > 0 && !first.malformed, "dump decoded");
+    failures += expect(first.first == 0 && first.overwritten == 0 && !first.gap, "every record since boot");
+    failures += expect(first.dht_readings + 1 >= cycles && first.dht_readings <= cycles + 1,
+                       "DHT22 readings as ESP_LOGI printed them");
+    failures += expect(first.battery_readings > 0, "battery readings as ESP_LOGI printed them");
+    failures += expect(!first.unordered && first.last_time_ms <= (FIRST_DUMP_S + 1) * 1000, "records in time order");
+
+    run_until(&now_s, SECOND_DUMP_S);
+    mqtt_fake_publish(ESP_MQTT_TOPIC_LOG, NULL, 0, false);
+    run_until(&now_s, SECOND_DUMP_S + 1);
+    dump_t second = decode_dump(&seen, verbose);
+
+#if CONFIG_ESP_BINLOG_SIZE > BINLOG_DUMP_CHUNK_SIZE
+    failures += expect(second.chunks > 1 && !second.malformed && !second.gap, "wrapped ring dumped in chunks");
+#else
+    failures += expect(second.chunks == 1 && !second.malformed, "wrapped ring dumped in one chunk");
+#endif
+    failures += expect(second.overwritten > 0 && second.first == second.overwritten,
+                       "dump starts at the oldest record, overwritten ones reported");
+    // the battery reading is the smallest record, 4 words
+    failures += expect(second.records * 4 * 4 <= CONFIG_ESP_BINLOG_SIZE, "no more records than the ring holds");
+    failures += expect(second.last_time_ms + 2 * CONFIG_ESP_DHT_SAMPLE_PERIOD_MS > SECOND_DUMP_S * 1000,
+                       "latest records included");
+    failures += expect(mqtt_fake_stats()->protocol_errors == 0, "no protocol errors");
+
+    return failures;
+}
+#endif
+
+int main(int argc, char **argv)
+{
+    bool verbose = false;
+    int opt;
+
+    sim_init();
+
+    while ((opt = getopt(argc, argv, "v")) != -1) {
+        switch (opt) {
+            case 'v':
+                verbose = true;
+                sim_log_set_max_level(ESP_LOG_INFO);
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-v]\n", argv[0]);
+                return 2;
+        }
+    }
+
+#if CONFIG_ESP_BINLOG
+    dht_line_set_source(dht_script, NULL);
+    max17048_model_set(4100 * 64 / 5, 90 * 256);
+
+    return run(verbose) ? 1 : 0;
+#else
+    (void)verbose;
+    printf("deferred log is off (CONFIG_ESP_BINLOG), nothing to check\n");
+    return 0;
+#endif
+}
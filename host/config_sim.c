@@ -0,0 +1,285 @@
+/*
+ * Drives configuration messages through the firmware on the host: app_main() with the real MQTT event handler,
+ * mqtt_task, settings store and sensor scheduler, against the broker and NVS stand-ins of host/hal.
+ *
+ * The first run starts from an empty NVS. The broker holds a retained configuration that lowers the DHT22 rate,
+ * which the node has to pick up on its first connect. Later messages switch the live values from their default QoS
+ * to the other one (to QoS1 with topic aliases, which start them at QoS0, to QoS0 without), try a QoS out of range,
+ * an unknown key, malformed JSON and an oversized message, and finally change the sampling periods.
+ * Checks the sampling rate before and after each change, the QoS of the published values, that every rejected
+ * message left the settings as they were and that every message was answered on the state topic.
+ *
+ * -r boots again from the NVS file the first run left (-n), without the retained message, and checks that the node
+ * starts with the settings it was given before the reboot. Exits with 1 if a check fails; without
+ * CONFIG_ESP_REMOTE_CONFIG (e.g. in duty-cycle mode) there is nothing to check.
+ *
+ *   config_sim -n nvs.bin [-r] [-v]
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "mqtt.h"
+#include "remote_config.h"
+#include "sim.h"
+#include "test.h"
+
+#define RUN_S                   600
+#define REBOOT_RUN_S            300
+
+#define RETAINED_CONFIG         "{\"dht_period_ms\":10000}"
+
+/* The default QoS of the live values and the one the first message switches them to */
+#if CONFIG_ESP_MQTT_TOPIC_ALIAS && !CONFIG_ESP_DUTY_CYCLE_MODE
+#define QOS_BEFORE              0
+#define QOS_CHANGE              "{\"qos\": 1, \"deadband_temperature\": 0}"
+#else
+#define QOS_BEFORE              1
+#define QOS_CHANGE              "{\"qos\": 0, \"deadband_temperature\": 0}"
+#endif
+#define QOS_AFTER               (1 - QOS_BEFORE)
+#define FINAL_DHT_PERIOD_MS     20000
+
+/* The topic whose QoS is checked: with CONFIG_ESP_MQTT_FRAME alone the readings only go out as frames */
+#if CONFIG_ESP_MQTT_FRAME && !CONFIG_ESP_MQTT_FRAME_KEEP_TOPICS
+#define LIVE_TOPIC              ESP_MQTT_TOPIC_FRAME
+#else
+#define LIVE_TOPIC              ESP_MQTT_TOPIC_TEMPERATURE
+#endif
+
+typedef struct {
+    uint32_t second;
+    const char *message;
+    bool applied;               /*!< expected outcome */
+} config_step_t;
+
+static const config_step_t steps[] = {
+        { 120, QOS_CHANGE, true },
+        { 150, "{\"qos\":2}", false },
+        { 160, "{\"dht_period_ms\":2000,\"colour\":1}", false },
+        { 170, "{\"dht_period_ms\":", false },
+        { 175, NULL, false },   // larger than NODE_CONFIG_MESSAGE_MAX_SIZE
+        { 180, "{\"dht_period_ms\":20000,\"battery_period_ms\":60000}", true },
+};
+
+#define STEP_COUNT  (sizeof(steps) / sizeof(steps[0]))
+
+void app_main(void);
+
+#if CONFIG_ESP_REMOTE_CONFIG
+static bool dht_script(int64_t now_us, uint8_t data[5], void *ctx)
+{
+    // every reading moves by 2 °C, past any deadband, so every sample is published
+    dht_line_frame(dht_line_requests() % 2 ? 210 : 230, 500, data);
+    return true;
+}
+
+static bool payload_contains(const mqtt_capture_t *capture, const char *text)
+{
+    char payload[sizeof(capture->payload) + 1];
+
+    memcpy(payload, capture->payload, capture->len);
+    payload[capture->len] = '\0';
+    return strstr(payload, text) != NULL;
+}
+
+/* Runs until second, returns the DHT22 start signals at that time */
+static uint32_t run_until(uint32_t *now_s, uint32_t second)
+{
+    while (*now_s < second) {
+        vTaskDelay(pdMS_TO_TICKS(1000));
+        (*now_s)++;
+    }
+
+    return dht_line_requests();
+}
+
+static bool within(uint32_t value, uint32_t expected)
+{
+    return value + 1 >= expected && value <= expected + 1;
+}
+
+static int first_boot(void)
+{
+    static char oversized[NODE_CONFIG_MESSAGE_MAX_SIZE + 16];
+    uint32_t now_s = 0;
+    int failures = 0;
+
+    memset(oversized, ' ', sizeof(oversized));
+    oversized[0] = '{';
+    oversized[sizeof(oversized) - 1] = '}';
+
+    // left there by the operator before the node came up
+    mqtt_fake_publish(ESP_MQTT_TOPIC_CONFIG, RETAINED_CONFIG, strlen(RETAINED_CONFIG), true);
+    app_main();
+
+    uint32_t requests_60 = run_until(&now_s, 60);
+    uint32_t requests_120 = run_until(&now_s, 120);
+    uint32_t rejected_period = 0;
+
+    for (size_t i = 0; i < STEP_COUNT; i++) {
+        run_until(&now_s, steps[i].second);
+        if (steps[i].message != NULL) {
+            mqtt_fake_publish(ESP_MQTT_TOPIC_CONFIG, steps[i].message, strlen(steps[i].message), false);
+        } else {
+            mqtt_fake_publish(ESP_MQTT_TOPIC_CONFIG, oversized, sizeof(oversized), false);
+        }
+        run_until(&now_s, steps[i].second + 1);
+        if (!steps[i].applied && remote_config_get()->dht_period_ms != 10000) {
+            rejected_period++;
+        }
+    }
+
+    uint32_t requests_240 = run_until(&now_s, 240);
+    uint32_t requests_end = run_until(&now_s, RUN_S);
+
+    size_t count;
+    const mqtt_capture_t *captures = mqtt_fake_captured(&count);
+    uint32_t default_before = 0, other_before = 0, default_after = 0, other_after = 0;
+    uint32_t states = 0, applied = 0, qos1_aliased = 0, qos0_aliased = 0;
+    const mqtt_capture_t *last_state = NULL;
+    bool range_error = false, unknown_error = false, malformed_error = false, size_error = false;
+
+    for (size_t i = 0; i < count; i++) {
+        const mqtt_capture_t *capture = &captures[i];
+
+        if (capture->alias > 0) {
+            capture->qos > 0 ? qos1_aliased++ : qos0_aliased++;
+        }
+        if (strcmp(capture->topic, LIVE_TOPIC) == 0) {
+            if (capture->time_us < 120 * 1000000LL) {
+                capture->qos == QOS_BEFORE ? default_before++ : other_before++;
+            } else if (capture->time_us > 121 * 1000000LL) {
+                capture->qos == QOS_BEFORE ? default_after++ : other_after++;
+            }
+        } else if (strcmp(capture->topic, ESP_MQTT_TOPIC_CONFIG_STATE) == 0) {
+            states++;
+            applied += payload_contains(capture, "\"applied\":true") ? 1 : 0;
+            range_error |= payload_contains(capture, "\"error\":\"qos: out of range\"");
+            unknown_error |= payload_contains(capture, "\"error\":\"unknown key: colour\"");
+            malformed_error |= payload_contains(capture, "\"error\":\"malformed JSON");
+            size_error |= payload_contains(capture, "\"error\":\"message too large\"");
+            last_state = capture;
+        }
+    }
+
+    printf("DHT22 start signals: %" PRIu32 " in 60..120 s, %" PRIu32 " in 240..%u s\n", requests_120 - requests_60,
+           requests_end - requests_240, RUN_S);
+    printf("%s before the QoS change: %" PRIu32 " QoS%d, %" PRIu32 " QoS%d; after: %" PRIu32 " QoS%d, %" PRIu32
+           " QoS%d\n", LIVE_TOPIC, default_before, QOS_BEFORE, other_before, QOS_AFTER, default_after, QOS_BEFORE,
+           other_after, QOS_AFTER);
+    printf("configuration state: %" PRIu32 " publishes, %" PRIu32 " applied\n", states, applied);
+
+    failures += expect(within(requests_120 - requests_60, 6), "retained configuration applied on connect (10 s)");
+    failures += expect(default_before > 0 && other_before == 0, "default QoS before the change");
+    failures += expect(other_after > 0 && default_after == 0, "other QoS after the change");
+#if CONFIG_ESP_MQTT_TOPIC_ALIAS
+    // the client would send a QoS1 publish again on the next connection, where its alias means nothing
+    failures += expect(qos1_aliased == 0 && qos0_aliased > 0, "topic aliases on QoS0 publishes only");
+#endif
+    failures += expect(range_error, "QoS out of range rejected");
+    failures += expect(unknown_error, "unknown key rejected");
+    failures += expect(malformed_error, "malformed JSON rejected");
+    failures += expect(size_error, "oversized message rejected");
+    failures += expect(rejected_period == 0, "rejected messages changed nothing");
+    failures += expect(states == STEP_COUNT + 1 && applied == 3, "every message answered on the state topic");
+    failures += expect(last_state != NULL && last_state->retain &&
+                       payload_contains(last_state, "\"dht_period_ms\":20000"), "state carries the settings in effect");
+    failures += expect(within(requests_end - requests_240, (RUN_S - 240) * 1000 / FINAL_DHT_PERIOD_MS),
+                       "new sampling period applied live (20 s)");
+    failures += expect(mqtt_fake_stats()->protocol_errors == 0, "no protocol errors");
+
+    return failures;
+}
+
+static int reboot(void)
+{
+    uint32_t now_s = 0;
+    int failures = 0;
+
+    app_main();
+
+    failures += expect(remote_config_get()->dht_period_ms == FINAL_DHT_PERIOD_MS &&
+                       remote_config_get()->qos == QOS_AFTER && remote_config_get()->battery_period_ms == 60000,
+                       "settings loaded from NVS");
+
+    uint32_t requests_100 = run_until(&now_s, 100);
+    uint32_t requests_end = run_until(&now_s, REBOOT_RUN_S);
+
+    size_t count;
+    const mqtt_capture_t *captures = mqtt_fake_captured(&count);
+    uint32_t stored_qos = 0, other_qos = 0, states = 0;
+
+    for (size_t i = 0; i < count; i++) {
+        if (strcmp(captures[i].topic, LIVE_TOPIC) == 0) {
+            captures[i].qos == QOS_AFTER ? stored_qos++ : other_qos++;
+        } else if (strcmp(captures[i].topic, ESP_MQTT_TOPIC_CONFIG_STATE) == 0) {
+            states++;
+        }
+    }
+
+    printf("DHT22 start signals: %" PRIu32 " in 100..%u s\n", requests_end - requests_100, REBOOT_RUN_S);
+    printf("%s: %" PRIu32 " QoS%d, %" PRIu32 " QoS%d\n", LIVE_TOPIC, stored_qos, QOS_AFTER, other_qos, QOS_BEFORE);
+
+    failures += expect(within(requests_end - requests_100, (REBOOT_RUN_S - 100) * 1000 / FINAL_DHT_PERIOD_MS),
+                       "stored sampling period in effect after the reboot");
+    failures += expect(stored_qos > 0 && other_qos == 0, "stored QoS in effect after the reboot");
+    failures += expect(states == 0, "no configuration message, no state");
+
+    return failures;
+}
+#endif
+
+int main(int argc, char **argv)
+{
+    const char *nvs_path = NULL;
+    bool after_reboot = false;
+    int opt;
+
+    sim_init();
+
+    while ((opt = getopt(argc, argv, "n:rv")) != -1) {
+        switch (opt) {
+            case 'n':
+                nvs_path = optarg;
+                break;
+            case 'r':
+                after_reboot = true;
+                break;
+            case 'v':
+                sim_log_set_max_level(ESP_LOG_INFO);
+                break;
+            default:
+                nvs_path = NULL;
+                break;
+        }
+    }
+
+    if (nvs_path == NULL) {
+        fprintf(stderr, "usage: %s -n nvs.bin [-r] [-v]\n", argv[0]);
+        return 2;
+    }
+
+#if CONFIG_ESP_REMOTE_CONFIG
+    // a first boot starts from erased flash
+    if (!after_reboot) {
+        remove(nvs_path);
+    }
+    sim_nvs_set_file(nvs_path);
+    dht_line_set_source(dht_script, NULL);
+    max17048_model_set(4100 * 64 / 5, 90 * 256);
+
+    int failures = after_reboot ? reboot() : first_boot();
+    return failures ? 1 : 0;
+#else
+    (void)after_reboot;
+    printf("remote configuration is off (CONFIG_ESP_REMOTE_CONFIG), nothing to check\n");
+    return 0;
+#endif
+}
@@ -0,0 +1,265 @@
+/*
+ * Runs the reconnect policy of main/conn_policy.c against a fake clock, the way the connectivity task drives it:
+ * sleep for conn_policy_next_ms(), poll, perform the action, feed the outcome back as an event. Checks that the
+ * backoff doubles from its initial value up to the cap, that the jitter only ever shortens a delay and by no more
+ * than its share, that losing WiFi resets the MQTT backoff, that an attempt without an answer times out, and the
+ * outage accounting of both links, also across the wrap of the 32-bit millisecond clock. Prints the attempt times.
+ *
+ *   conn_policy_test
+ *
+ * Exits with 1 if a check fails.
+ */
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+#include "conn_policy.h"
+#include "test.h"
+
+#define MAX_ATTEMPTS        16
+
+static const conn_policy_config_t no_jitter = {
+        .initial_ms = 1000,
+        .max_ms = 60000,
+        .jitter_pct = 0,
+        .attempt_timeout_ms = 15000,
+};
+
+static uint32_t random_state = 12345;
+
+/* Numerical Recipes LCG, the sequence only has to be the same on every run */
+static uint32_t next_random(void)
+{
+    random_state = random_state * 1664525u + 1013904223u;
+    return random_state;
+}
+
+/* Sleeps until the policy has something to do and polls, as the connectivity task does; NONE after limit_ms */
+static conn_action_t wait_action(conn_policy_t *policy, uint32_t *now_ms, uint32_t limit_ms)
+{
+    uint32_t start_ms = *now_ms;
+
+    while (*now_ms - start_ms <= limit_ms) {
+        conn_action_t action = conn_policy_poll(policy, *now_ms, next_random());
+        if (action != CONN_ACTION_NONE) {
+            return action;
+        }
+
+        uint32_t next_ms = conn_policy_next_ms(policy, *now_ms);
+        if (next_ms == UINT32_MAX) {
+            return CONN_ACTION_NONE;
+        }
+        *now_ms += next_ms > 0 ? next_ms : 1;
+    }
+
+    return CONN_ACTION_NONE;
+}
+
+/* Every WiFi attempt fails right away: the gaps between the attempts are the backoff steps */
+static int check_backoff(uint32_t start_ms, const char *clock)
+{
+    conn_policy_t policy;
+    uint32_t now_ms = start_ms;
+    uint32_t attempts[MAX_ATTEMPTS] = { 0 };
+    bool doubled = true;
+    char what[96];
+    int failures = 0;
+
+    conn_policy_init(&policy, &no_jitter, now_ms);
+    for (size_t i = 0; i < MAX_ATTEMPTS; i++) {
+        if (wait_action(&policy, &now_ms, 10 * no_jitter.max_ms) != CONN_ACTION_CONNECT_WIFI) {
+            doubled = false;
+            break;
+        }
+        attempts[i] = now_ms - start_ms;
+        conn_policy_event(&policy, CONN_EVENT_WIFI_DOWN, now_ms, next_random());
+    }
+
+    printf("-- WiFi attempts that fail (%s), ms after the start:", clock);
+    for (size_t i = 0; i < MAX_ATTEMPTS; i++) {
+        printf(" %" PRIu32, attempts[i]);
+    }
+    printf("\n");
+
+    uint32_t expected_gap = no_jitter.initial_ms;
+    for (size_t i = 1; i < MAX_ATTEMPTS && doubled; i++) {
+        doubled = attempts[i] - attempts[i - 1] == expected_gap;
+        expected_gap = expected_gap * 2 > no_jitter.max_ms ? no_jitter.max_ms : expected_gap * 2;
+    }
+
+    snprintf(what, sizeof(what), "%s: first attempt at once, then %" PRIu32 " ms doubling up to %" PRIu32 " ms",
+             clock, no_jitter.initial_ms, no_jitter.max_ms);
+    failures += expect(attempts[0] == 0 && doubled, what);
+    snprintf(what, sizeof(what), "%s: no MQTT attempt without WiFi", clock);
+    failures += expect(policy.mqtt.attempts == 0, what);
+    return failures;
+}
+
+/* The failure that sets the backoff to delay_ms, the retry it schedules delay_ms minus the jitter from now */
+static uint32_t jittered_delay(const conn_policy_config_t *config, uint32_t delay_ms, uint32_t random)
+{
+    conn_policy_t policy;
+    uint32_t now_ms = 0;
+
+    conn_policy_init(&policy, config, now_ms);
+    conn_policy_poll(&policy, now_ms, 0);
+    while (true) {
+        conn_policy_event(&policy, CONN_EVENT_WIFI_DOWN, now_ms, random);
+        if (policy.wifi.backoff_ms >= delay_ms) {
+            return policy.wifi.retry_at_ms - now_ms;
+        }
+        now_ms = policy.wifi.retry_at_ms;
+        conn_policy_poll(&policy, now_ms, random);
+    }
+}
+
+static int check_jitter(void)
+{
+    conn_policy_config_t config = no_jitter;
+    uint32_t backoff_ms = 8000;
+    uint32_t min_ms = UINT32_MAX, max_ms = 0;
+    int failures = 0;
+
+    config.jitter_pct = 25;
+    for (int i = 0; i < 2000; i++) {
+        uint32_t delay_ms = jittered_delay(&config, backoff_ms, next_random());
+
+        min_ms = delay_ms < min_ms ? delay_ms : min_ms;
+        max_ms = delay_ms > max_ms ? delay_ms : max_ms;
+    }
+
+    printf("-- %u %% jitter on a %" PRIu32 " ms backoff: %" PRIu32 "..%" PRIu32 " ms over 2000 retries\n",
+           config.jitter_pct, backoff_ms, min_ms, max_ms);
+    failures += expect(min_ms >= backoff_ms - backoff_ms * config.jitter_pct / 100 && max_ms <= backoff_ms,
+                       "jitter: only shortens the delay, by at most its share");
+    failures += expect(min_ms < backoff_ms - backoff_ms * config.jitter_pct / 200 &&
+                       max_ms > backoff_ms - backoff_ms * config.jitter_pct / 200,
+                       "jitter: delays spread over the whole range");
+    failures += expect(jittered_delay(&config, backoff_ms, 0) == backoff_ms &&
+                       jittered_delay(&config, backoff_ms, backoff_ms / 4) == backoff_ms - backoff_ms / 4,
+                       "jitter: the ends of the range reached");
+    return failures;
+}
+
+static int check_wifi_loss_resets_mqtt(void)
+{
+    conn_policy_t policy;
+    uint32_t now_ms = 0;
+    int failures = 0;
+
+    conn_policy_init(&policy, &no_jitter, now_ms);
+    wait_action(&policy, &now_ms, 0);
+    conn_policy_event(&policy, CONN_EVENT_WIFI_UP, now_ms, 0);
+
+    // the broker refuses a few times, the MQTT backoff grows
+    for (int i = 0; i < 5; i++) {
+        wait_action(&policy, &now_ms, no_jitter.max_ms);
+        conn_policy_event(&policy, CONN_EVENT_MQTT_DOWN, now_ms, 0);
+    }
+    uint32_t grown_ms = policy.mqtt.backoff_ms;
+
+    // the AP goes, and comes back on the first WiFi retry
+    conn_policy_event(&policy, CONN_EVENT_WIFI_DOWN, now_ms, 0);
+    conn_action_t wifi = wait_action(&policy, &now_ms, no_jitter.max_ms);
+    conn_policy_event(&policy, CONN_EVENT_WIFI_UP, now_ms, 0);
+    uint32_t wifi_up_ms = now_ms;
+    conn_action_t mqtt = wait_action(&policy, &now_ms, no_jitter.max_ms);
+
+    printf("-- MQTT backoff %" PRIu32 " ms when WiFi went, MQTT attempt %" PRIu32 " ms after WiFi came back\n",
+           grown_ms, now_ms - wifi_up_ms);
+    failures += expect(grown_ms == 16000, "WiFi loss: the MQTT backoff had grown");
+    failures += expect(wifi == CONN_ACTION_CONNECT_WIFI && mqtt == CONN_ACTION_CONNECT_MQTT && now_ms == wifi_up_ms,
+                       "WiFi loss: broker tried as soon as WiFi is back, backoff reset");
+    return failures;
+}
+
+static int check_attempt_timeout(void)
+{
+    conn_policy_t policy;
+    uint32_t now_ms = 0;
+    int failures = 0;
+
+    conn_policy_init(&policy, &no_jitter, now_ms);
+    wait_action(&policy, &now_ms, 0);
+
+    // no answer to the WiFi attempt: the next poll is due when it times out
+    failures += expect(conn_policy_next_ms(&policy, now_ms + 1) == no_jitter.attempt_timeout_ms - 1 &&
+                       conn_policy_poll(&policy, now_ms + no_jitter.attempt_timeout_ms - 1, 0) == CONN_ACTION_NONE,
+                       "attempt timeout: nothing to do while the attempt runs");
+    conn_action_t retry = wait_action(&policy, &now_ms, 10 * no_jitter.attempt_timeout_ms);
+    failures += expect(retry == CONN_ACTION_CONNECT_WIFI &&
+                       now_ms == no_jitter.attempt_timeout_ms + no_jitter.initial_ms && policy.wifi.attempts == 2,
+                       "attempt timeout: counted as a failure, retried after the backoff");
+
+    // the same for the broker once WiFi is up
+    conn_policy_event(&policy, CONN_EVENT_WIFI_UP, now_ms, 0);
+    uint32_t attempt_ms = now_ms;
+    wait_action(&policy, &now_ms, 0);
+    retry = wait_action(&policy, &now_ms, 10 * no_jitter.attempt_timeout_ms);
+    failures += expect(retry == CONN_ACTION_CONNECT_MQTT &&
+                       now_ms - attempt_ms == no_jitter.attempt_timeout_ms + no_jitter.initial_ms,
+                       "attempt timeout: the same for MQTT");
+    return failures;
+}
+
+/* Scripted outages, the downtime of each link against the script */
+static int check_outages(uint32_t start_ms, const char *clock)
+{
+    conn_policy_t policy;
+    uint32_t t = start_ms;
+    char what[96];
+    int failures = 0;
+
+    conn_policy_init(&policy, &no_jitter, t);
+    conn_policy_poll(&policy, t, 0);
+    // time before the links first came up is no outage
+    conn_policy_event(&policy, CONN_EVENT_WIFI_UP, t + 3000, 0);
+    conn_policy_poll(&policy, t + 3000, 0);
+    conn_policy_event(&policy, CONN_EVENT_MQTT_UP, t + 3100, 0);
+
+    // the broker goes for 5 s
+    conn_policy_event(&policy, CONN_EVENT_MQTT_DOWN, t + 10000, 0);
+    conn_policy_poll(&policy, t + 11000, 0);
+    conn_policy_event(&policy, CONN_EVENT_MQTT_UP, t + 15000, 0);
+
+    // the AP goes for 3 s, the broker is back 100 ms after it
+    conn_policy_event(&policy, CONN_EVENT_WIFI_DOWN, t + 20000, 0);
+    conn_policy_poll(&policy, t + 21000, 0);
+    conn_policy_event(&policy, CONN_EVENT_WIFI_UP, t + 23000, 0);
+    conn_policy_poll(&policy, t + 23000, 0);
+    conn_policy_event(&policy, CONN_EVENT_MQTT_UP, t + 23100, 0);
+
+    // and the broker again, still down at the end
+    conn_policy_event(&policy, CONN_EVENT_MQTT_DOWN, t + 30000, 0);
+    uint32_t end_ms = t + 32000;
+
+    printf("-- outages (%s): WiFi %" PRIu32 ", %" PRIu32 " ms down; MQTT %" PRIu32 ", %" PRIu32
+           " ms down, longest %" PRIu32 " ms\n", clock, policy.wifi.outages,
+           conn_link_downtime_ms(&policy.wifi, end_ms), policy.mqtt.outages,
+           conn_link_downtime_ms(&policy.mqtt, end_ms), policy.mqtt.longest_outage_ms);
+
+    snprintf(what, sizeof(what), "%s: WiFi outage accounted", clock);
+    failures += expect(policy.wifi.outages == 1 && conn_link_downtime_ms(&policy.wifi, end_ms) == 3000 &&
+                       policy.wifi.longest_outage_ms == 3000, what);
+    snprintf(what, sizeof(what), "%s: MQTT outages accounted, the one in progress included", clock);
+    failures += expect(policy.mqtt.outages == 3 && conn_link_downtime_ms(&policy.mqtt, end_ms) == 5000 + 3100 + 2000 &&
+                       policy.mqtt.longest_outage_ms == 5000, what);
+    return failures;
+}
+
+int main(void)
+{
+    int failures = 0;
+
+    failures += check_backoff(0, "after boot");
+    failures += check_backoff(UINT32_MAX - 100000, "clock wraps");
+    failures += check_jitter();
+    failures += check_wifi_loss_resets_mqtt();
+    failures += check_attempt_timeout();
+    failures += check_outages(0, "after boot");
+    failures += check_outages(UINT32_MAX - 15000, "clock wraps");
+
+    printf("%d check(s) failed\n", failures);
+    return failures > 0 ? 1 : 0;
+}
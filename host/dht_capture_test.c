@@ -0,0 +1,251 @@
+/*
+ * Feeds synthetic multi-line DHT22 captures through the decode path of the GPIO backend (main/dht22_decode.c):
+ * the edge list of one parallel capture is split per line with dht_edges_to_pulses() and every line is decoded on
+ * its own. The sensors answer the start signal 20-40 us apart, every pulse is a few us off its nominal width and
+ * the capture loop only sees a level change at its polling period. Checks that every line decodes to its own
+ * reading, that a silent line times out and that a corrupted checksum is reported on its line only.
+ *
+ *   dht_capture_test
+ *
+ * Exits with 1 if a check fails.
+ */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dht22_decode.h"
+#include "test.h"
+
+#define POLL_US             2           /* a level change shows at the next poll of the capture loop */
+#define JITTER_US           4           /* +- on every pulse width */
+#define LINE_PULSES         (DHT_DATA_BITS * 2 + 8)     /* as dht22.c sizes its per-line buffer */
+#define MAX_EDGES           (1 + LINE_PULSES * DHT_MAX_CHANNELS)
+#define MAX_TRANSITIONS     (DHT_DATA_BITS * 2 + 4)
+
+typedef enum {
+    LINE_OK = 0,
+    LINE_SILENT,                /* no sensor on the line, it stays high */
+    LINE_BAD_CRC,
+} line_kind_t;
+
+typedef struct {
+    line_kind_t kind;
+    uint16_t delay_us;          /* from the release of the line to the start of the response */
+    int16_t temperature;        /* 0.1 °C */
+    uint16_t humidity;          /* 0.1 % */
+} line_t;
+
+/* level changes of one line, absolute times */
+typedef struct {
+    uint32_t time_us[MAX_TRANSITIONS];
+    uint8_t level[MAX_TRANSITIONS];
+    size_t count;
+} transitions_t;
+
+static uint32_t random_state = 1;
+
+static int jitter(void)
+{
+    return (int)(test_random(&random_state) % (2 * JITTER_US + 1)) - JITTER_US;
+}
+
+static void frame(const line_t *line, uint8_t data[DHT_DATA_BYTES])
+{
+    // the sensor sends sign and magnitude, not two's complement
+    uint16_t raw_temperature = line->temperature < 0 ? (uint16_t)(0x8000 | -line->temperature) :
+                               (uint16_t)line->temperature;
+
+    data[0] = line->humidity >> 8;
+    data[1] = line->humidity & 0xFF;
+    data[2] = raw_temperature >> 8;
+    data[3] = raw_temperature & 0xFF;
+    data[4] = (uint8_t)(data[0] + data[1] + data[2] + data[3]);
+    if (line->kind == LINE_BAD_CRC) {
+        data[4] ^= 0x10;
+    }
+}
+
+static void add_transition(transitions_t *transitions, uint32_t *time_us, int width_us, uint8_t level)
+{
+    *time_us += (uint32_t)(width_us + jitter());
+    transitions->time_us[transitions->count] = *time_us;
+    transitions->level[transitions->count] = level;
+    transitions->count++;
+}
+
+/*
+ * The line after the host released it: high for delay_us, the 80 us low / 80 us high response, 40 bits of a 50 us
+ * low and a 26 or 70 us high, a last 50 us low, then idle high
+ */
+static void line_transitions(const line_t *line, transitions_t *transitions)
+{
+    uint8_t data[DHT_DATA_BYTES];
+    uint32_t time_us = 0;
+
+    transitions->count = 0;
+    if (line->kind == LINE_SILENT) {
+        return;
+    }
+
+    frame(line, data);
+    add_transition(transitions, &time_us, line->delay_us, 0);      // response low starts
+    add_transition(transitions, &time_us, 80, 1);                  // response high starts
+    add_transition(transitions, &time_us, 80, 0);                  // first bit low starts
+    for (int k = 0; k < DHT_DATA_BITS; k++) {
+        bool one = data[k / 8] & (1 << (7 - (k % 8)));
+        add_transition(transitions, &time_us, 50, 1);
+        add_transition(transitions, &time_us, one ? 70 : 26, 0);
+    }
+    add_transition(transitions, &time_us, 50, 1);                  // released, idle high
+}
+
+/* Merges the lines into the edge list the capture loop records, changes between two polls show together */
+static size_t capture(const line_t *lines, size_t line_count, dht_edge_t *edges)
+{
+    static transitions_t transitions[DHT_MAX_CHANNELS];
+    size_t next[DHT_MAX_CHANNELS] = { 0 };
+    uint8_t levels = (uint8_t)((1 << line_count) - 1);
+    size_t count = 0;
+
+    for (size_t i = 0; i < line_count; i++) {
+        line_transitions(&lines[i], &transitions[i]);
+    }
+
+    edges[count++] = (dht_edge_t) { .time_us = 0, .levels = levels };
+
+    for (uint32_t poll_us = POLL_US; count < MAX_EDGES; poll_us += POLL_US) {
+        uint8_t now = levels;
+        bool pending = false;
+
+        for (size_t i = 0; i < line_count; i++) {
+            while (next[i] < transitions[i].count && transitions[i].time_us[next[i]] <= poll_us) {
+                now = (uint8_t)((now & ~(1 << i)) | (transitions[i].level[next[i]] << i));
+                next[i]++;
+            }
+            pending |= next[i] < transitions[i].count;
+        }
+
+        if (now != levels) {
+            edges[count++] = (dht_edge_t) { .time_us = (uint16_t)poll_us, .levels = now };
+            levels = now;
+        }
+
+        if (!pending) {
+            break;
+        }
+    }
+
+    return count;
+}
+
+static int check_capture(const char *name, const line_t *lines, size_t line_count)
+{
+    static dht_edge_t edges[MAX_EDGES];
+    dht_pulse_t pulses[LINE_PULSES];
+    size_t count = capture(lines, line_count, edges);
+    int failures = 0;
+    char what[128];
+
+    snprintf(what, sizeof(what), "%s: %zu edges fit the capture buffer", name, count);
+    failures += expect(count <= 1 + LINE_PULSES * line_count, what);
+
+    for (size_t i = 0; i < line_count; i++) {
+        const line_t *line = &lines[i];
+        uint8_t data[DHT_DATA_BYTES];
+        size_t pulse_count = dht_edges_to_pulses(edges, count, (uint8_t)i, pulses, LINE_PULSES);
+        dht_decode_result_t result = dht_decode_pulses(pulses, pulse_count, data);
+
+        switch (line->kind) {
+            case LINE_OK: {
+                int16_t temperature = 0;
+                uint16_t humidity = 0;
+
+                if (result == DHT_DECODE_OK) {
+                    dht_decode_values(data, &temperature, &humidity);
+                }
+                snprintf(what, sizeof(what), "%s: line %zu (+%u us) reads %d / %u", name, i, line->delay_us,
+                         line->temperature, line->humidity);
+                failures += expect(result == DHT_DECODE_OK && temperature == line->temperature &&
+                                   humidity == line->humidity, what);
+                break;
+            }
+            case LINE_SILENT:
+                snprintf(what, sizeof(what), "%s: silent line %zu times out", name, i);
+                failures += expect(result == DHT_DECODE_TIMEOUT, what);
+                break;
+            case LINE_BAD_CRC:
+                snprintf(what, sizeof(what), "%s: line %zu reports its checksum error", name, i);
+                failures += expect(result == DHT_DECODE_BAD_CRC, what);
+                break;
+        }
+    }
+
+    return failures;
+}
+
+/* A hand-made capture: two lines, one edge changes both */
+static int check_split(void)
+{
+    static const dht_edge_t edges[] = {
+            { 0, 0x3 },
+            { 10, 0x2 },        // line 0 low
+            { 30, 0x0 },        // line 1 low
+            { 50, 0x3 },        // both high
+            { 60, 0x1 },        // line 1 low
+    };
+    dht_pulse_t pulses[8];
+    int failures = 0;
+
+    size_t count = dht_edges_to_pulses(edges, 5, 0, pulses, 8);
+    failures += expect(count == 2 && pulses[0].level == 1 && pulses[0].duration_us == 10 &&
+                       pulses[1].level == 0 && pulses[1].duration_us == 40, "line 0 split from the shared edges");
+
+    count = dht_edges_to_pulses(edges, 5, 1, pulses, 8);
+    failures += expect(count == 3 && pulses[0].level == 1 && pulses[0].duration_us == 30 &&
+                       pulses[1].level == 0 && pulses[1].duration_us == 20 &&
+                       pulses[2].level == 1 && pulses[2].duration_us == 10, "line 1 split from the shared edges");
+
+    count = dht_edges_to_pulses(edges, 5, 1, pulses, 2);
+    failures += expect(count == 2, "pulses beyond the output buffer are dropped");
+
+    count = dht_edges_to_pulses(edges, 5, 2, pulses, 8);
+    failures += expect(count == 0, "a line without edges has no pulses");
+
+    return failures;
+}
+
+int main(void)
+{
+    static const line_t mixed[] = {
+            { LINE_OK, 20, 213, 452 },
+            { LINE_OK, 40, -57, 998 },
+            { LINE_SILENT, 0, 0, 0 },
+            { LINE_BAD_CRC, 30, 250, 500 },
+    };
+    line_t full[DHT_MAX_CHANNELS];
+    int failures = 0;
+
+    failures += check_split();
+    failures += check_capture("four sensors", mixed, sizeof(mixed) / sizeof(mixed[0]));
+
+    for (size_t i = 0; i < DHT_MAX_CHANNELS; i++) {
+        full[i] = (line_t) {
+                .kind = LINE_OK,
+                .delay_us = (uint16_t)(20 + (i * 7) % 21),
+                .temperature = (int16_t)(-400 + (int)i * 150),
+                .humidity = (uint16_t)(i * 125),
+        };
+    }
+    failures += check_capture("all channels", full, DHT_MAX_CHANNELS);
+
+    // every sensor answers after the same delay, the edges of the lines fall into the same polls
+    for (size_t i = 0; i < DHT_MAX_CHANNELS; i++) {
+        full[i].delay_us = 25;
+    }
+    failures += check_capture("simultaneous", full, DHT_MAX_CHANNELS);
+
+    printf("%d check(s) failed\n", failures);
+    return failures > 0 ? 1 : 0;
+}
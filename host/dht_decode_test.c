@@ -0,0 +1,286 @@
+/*
+ * Feeds single-line DHT22 pulse traces through the decoder of main/dht22_decode.c, as the RMT backend hands them
+ * over: the traces of host/traces/dht_pulses.csv, with frames at the limits of the response, bit low and bit high
+ * widths, then every width from 0 to past the limits for one pulse of a nominal frame. Ends with a report of the
+ * decode results under growing pulse width jitter and of the decode time per frame on this machine.
+ *
+ *   dht_decode_test [trace.csv]...
+ *
+ * Trace format, '#' starts a comment:
+ *   name,ok|timeout|bad_crc,data bytes in hex,pulses as H<us> or L<us> separated by spaces
+ *
+ * Exits with 1 if a check fails.
+ */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "dht22_decode.h"
+#include "test.h"
+
+#define MAX_PULSES          (DHT_DATA_BITS * 2 + 8)
+#define ERROR_RATE_FRAMES   10000
+#define MAX_CLEAN_JITTER_US 10          /* spread a frame must decode under without a single error */
+#define TIMING_ROUNDS       7
+#define TIMING_DECODES      100000
+
+#ifndef TRACE_DIR
+#define TRACE_DIR           "traces"
+#endif
+
+static const char *result_names[] = {
+        [DHT_DECODE_OK] = "ok",
+        [DHT_DECODE_TIMEOUT] = "timeout",
+        [DHT_DECODE_BAD_CRC] = "bad_crc",
+};
+
+static uint32_t random_state = 1;
+
+static bool parse_result(const char *name, dht_decode_result_t *result)
+{
+    for (size_t i = 0; i < sizeof(result_names) / sizeof(result_names[0]); i++) {
+        if (strcmp(name, result_names[i]) == 0) {
+            *result = (dht_decode_result_t)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool parse_data(const char *hex, uint8_t *data)
+{
+    for (int i = 0; i < DHT_DATA_BYTES; i++) {
+        unsigned int byte;
+
+        if (sscanf(hex + 2 * i, "%2x", &byte) != 1) {
+            return false;
+        }
+        data[i] = (uint8_t)byte;
+    }
+    return strlen(hex) == 2 * DHT_DATA_BYTES;
+}
+
+static size_t parse_pulses(char *text, dht_pulse_t *pulses)
+{
+    size_t count = 0;
+
+    for (char *token = strtok(text, " \n"); token != NULL && count < MAX_PULSES; token = strtok(NULL, " \n")) {
+        if ((token[0] != 'H' && token[0] != 'L') || atoi(token + 1) <= 0) {
+            return 0;
+        }
+        pulses[count++] = (dht_pulse_t) { .level = token[0] == 'H', .duration_us = (uint16_t)atoi(token + 1) };
+    }
+    return count;
+}
+
+static int replay(const char *path)
+{
+    FILE *file = fopen(path, "r");
+    char line[2048];
+    int failures = 0;
+    int traces = 0;
+
+    if (file == NULL) {
+        perror(path);
+        return 1;
+    }
+
+    while (fgets(line, sizeof(line), file) != NULL) {
+        char *fields[4];
+        char *next = line;
+        dht_pulse_t pulses[MAX_PULSES];
+        dht_decode_result_t expected;
+        uint8_t data[DHT_DATA_BYTES];
+        uint8_t decoded[DHT_DATA_BYTES];
+        char what[160];
+
+        if (line[0] == '#' || line[0] == '\n') {
+            continue;
+        }
+        for (int i = 0; i < 4; i++) {
+            fields[i] = next;
+            next = i < 3 && next != NULL ? strchr(next, ',') : NULL;
+            if (i < 3 && next == NULL) {
+                break;
+            }
+            if (next != NULL) {
+                *next++ = '\0';
+            }
+        }
+
+        size_t count = next == NULL ? parse_pulses(fields[3], pulses) : 0;
+        if (count == 0 || !parse_result(fields[1], &expected) || !parse_data(fields[2], data)) {
+            snprintf(what, sizeof(what), "%s: trace line %.40s malformed", path, fields[0]);
+            failures += expect(false, what);
+            continue;
+        }
+
+        dht_decode_result_t result = dht_decode_pulses(pulses, count, decoded);
+        bool ok = result == expected && (result != DHT_DECODE_OK || memcmp(decoded, data, DHT_DATA_BYTES) == 0);
+
+        snprintf(what, sizeof(what), "%s: %s", fields[0], result_names[result]);
+        failures += expect(ok, what);
+        traces++;
+    }
+
+    fclose(file);
+    return traces > 0 ? failures : failures + expect(false, "trace file holds no frames");
+}
+
+/* Pulses of a frame with the datasheet widths plus up to +-jitter_us on every pulse, response first */
+static size_t make_frame(const uint8_t *data, int jitter_us, dht_pulse_t *pulses)
+{
+    size_t count = 0;
+
+#define PULSE(lvl, us) pulses[count++] = (dht_pulse_t) { .level = (lvl), \
+        .duration_us = (uint16_t)((us) + (jitter_us > 0 ? \
+                                          (int)(test_random(&random_state) % (2 * jitter_us + 1)) - jitter_us : 0)) }
+
+    PULSE(0, 80);
+    PULSE(1, 80);
+    for (int k = 0; k < DHT_DATA_BITS; k++) {
+        PULSE(0, 50);
+        PULSE(1, data[k / 8] & (1 << (7 - k % 8)) ? 70 : 27);
+    }
+    PULSE(0, 50);
+
+#undef PULSE
+    return count;
+}
+
+static void make_data(uint8_t *data)
+{
+    for (int i = 0; i < DHT_DATA_BYTES - 1; i++) {
+        data[i] = (uint8_t)test_random(&random_state);
+    }
+    data[4] = (uint8_t)(data[0] + data[1] + data[2] + data[3]);
+}
+
+/* One pulse of a frame swept over every width from 0 to past its limit: the result has to flip exactly there */
+static int sweep(void)
+{
+    const uint8_t data[DHT_DATA_BYTES] = { 0x02, 0x8C, 0x01, 0x5F, 0xEE };     // bit 6 is 1, bit 7 is 0
+    dht_pulse_t pulses[MAX_PULSES];
+    uint8_t decoded[DHT_DATA_BYTES];
+    size_t count = make_frame(data, 0, pulses);
+    bool low_ok = true;
+    bool high_ok = true;
+    bool response_ok = true;
+
+    for (uint16_t width = 1; width <= 2 * DHT_BIT_HIGH_MAX_US; width++) {
+        dht_pulse_t swept[MAX_PULSES];
+        bool in_low = width >= DHT_BIT_LOW_MIN_US && width <= DHT_BIT_LOW_MAX_US;
+        bool in_response = width >= DHT_RESPONSE_MIN_US && width <= DHT_RESPONSE_MAX_US;
+
+        // the low of bit 6
+        memcpy(swept, pulses, sizeof(swept));
+        swept[2 + 2 * 6].duration_us = width;
+        low_ok &= dht_decode_pulses(swept, count, decoded) == (in_low ? DHT_DECODE_OK : DHT_DECODE_TIMEOUT);
+
+        // the high of bit 7, a "0": read as "1" above DHT_BIT_ONE_MIN_US, which the checksum then catches
+        memcpy(swept, pulses, sizeof(swept));
+        swept[3 + 2 * 7].duration_us = width;
+        dht_decode_result_t expected = width > DHT_BIT_HIGH_MAX_US ? DHT_DECODE_TIMEOUT :
+                                       width > DHT_BIT_ONE_MIN_US ? DHT_DECODE_BAD_CRC : DHT_DECODE_OK;
+        high_ok &= dht_decode_pulses(swept, count, decoded) == expected;
+
+        // the high of the response
+        memcpy(swept, pulses, sizeof(swept));
+        swept[1].duration_us = width;
+        response_ok &= dht_decode_pulses(swept, count, decoded) == (in_response ? DHT_DECODE_OK : DHT_DECODE_TIMEOUT);
+    }
+
+    return expect(low_ok, "sweep: bit low decodes from DHT_BIT_LOW_MIN_US to DHT_BIT_LOW_MAX_US only") +
+           expect(high_ok, "sweep: bit high is a 1 above DHT_BIT_ONE_MIN_US, a timeout above DHT_BIT_HIGH_MAX_US") +
+           expect(response_ok, "sweep: response decodes from DHT_RESPONSE_MIN_US to DHT_RESPONSE_MAX_US only");
+}
+
+/* Random frames under uniform pulse width jitter: how many decode, time out, fail the checksum or decode wrong */
+static int report_error_rate(void)
+{
+    int failures = 0;
+
+    printf("-- decode results of %d random frames per jitter, +- us on every pulse\n", ERROR_RATE_FRAMES);
+    printf("jitter      ok  timeout  bad_crc  wrong\n");
+    for (int jitter_us = 0; jitter_us <= 30; jitter_us += 2) {
+        unsigned int results[3] = { 0 };
+        unsigned int wrong = 0;
+
+        for (int i = 0; i < ERROR_RATE_FRAMES; i++) {
+            dht_pulse_t pulses[MAX_PULSES];
+            uint8_t data[DHT_DATA_BYTES];
+            uint8_t decoded[DHT_DATA_BYTES];
+
+            make_data(data);
+            size_t count = make_frame(data, jitter_us, pulses);
+            dht_decode_result_t result = dht_decode_pulses(pulses, count, decoded);
+
+            results[result]++;
+            wrong += result == DHT_DECODE_OK && memcmp(decoded, data, DHT_DATA_BYTES) != 0;
+        }
+
+        printf("%4d us  %6u  %7u  %7u  %5u\n", jitter_us, results[DHT_DECODE_OK], results[DHT_DECODE_TIMEOUT],
+               results[DHT_DECODE_BAD_CRC], wrong);
+        if (jitter_us <= MAX_CLEAN_JITTER_US && results[DHT_DECODE_OK] != ERROR_RATE_FRAMES) {
+            failures++;
+        }
+    }
+
+    return expect(failures == 0, "every frame decodes with up to +-10 us on every pulse");
+}
+
+static int compare_ns(const void *a, const void *b)
+{
+    int64_t left = *(const int64_t *)a;
+    int64_t right = *(const int64_t *)b;
+
+    return (left > right) - (left < right);
+}
+
+/* Decode time of a nominal frame, fastest and median of the rounds; a host figure, not the one of the ESP32 */
+static void report_timing(void)
+{
+    const uint8_t data[DHT_DATA_BYTES] = { 0x02, 0x8C, 0x01, 0x5F, 0xEE };
+    dht_pulse_t pulses[MAX_PULSES];
+    uint8_t decoded[DHT_DATA_BYTES];
+    size_t count = make_frame(data, 0, pulses);
+    int64_t round_ns[TIMING_ROUNDS];
+    volatile unsigned int sink = 0;
+
+    for (int round = 0; round < TIMING_ROUNDS; round++) {
+        struct timespec start, end;
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (int i = 0; i < TIMING_DECODES; i++) {
+            sink += dht_decode_pulses(pulses, count, decoded);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        round_ns[round] = (end.tv_sec - start.tv_sec) * 1000000000LL + (end.tv_nsec - start.tv_nsec);
+    }
+    qsort(round_ns, TIMING_ROUNDS, sizeof(round_ns[0]), compare_ns);
+
+    printf("-- decode time of one frame on this host: fastest %.1f ns, median %.1f ns\n",
+           (double)round_ns[0] / TIMING_DECODES, (double)round_ns[TIMING_ROUNDS / 2] / TIMING_DECODES);
+}
+
+int main(int argc, char **argv)
+{
+    int failures = 0;
+
+    if (argc > 1) {
+        for (int i = 1; i < argc; i++) {
+            failures += replay(argv[i]);
+        }
+    } else {
+        failures += replay(TRACE_DIR "/dht_pulses.csv");
+    }
+    failures += sweep();
+    failures += report_error_rate();
+    report_timing();
+
+    printf("%d check(s) failed\n", failures);
+    return failures > 0 ? 1 : 0;
+}
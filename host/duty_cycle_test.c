@@ -0,0 +1,198 @@
+/*
+ * Runs the duty-cycle state machine of main/duty_cycle.c against a simulated clock with the Kconfig timeouts of the
+ * firmware (host/sdkconfig.h): a wake whose steps complete, one whose broker never answers, one whose PUBACKs never
+ * arrive and ones that hit the awake budget, each with the state it ends in, the time it ends at and the sleep that
+ * follows. The same wakes again across the wrap of the 32-bit millisecond clock. Then the battery life projection
+ * against values worked out by hand, and a report of the projected life for a range of awake times.
+ *
+ *   duty_cycle_test
+ *
+ * Exits with 1 if a check fails.
+ */
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+#include "duty_cycle.h"
+#include "test.h"
+
+#define STEP_MS             10          /*!< the poll interval of duty_cycle_run() */
+#define NEVER               UINT32_MAX
+
+/* When each step of a wake completes, ms after the wake-up, NEVER for a step that does not */
+typedef struct {
+    const char *name;
+    uint32_t sampled_ms;
+    uint32_t connected_ms;
+    uint32_t published_ms;
+    uint32_t acked_ms;
+} wake_script_t;
+
+typedef struct {
+    duty_cycle_result_t result;
+    uint32_t awake_ms;
+    uint32_t sleep_ms;
+} wake_outcome_t;
+
+static const duty_cycle_config_t config = {
+        .period_ms = CONFIG_ESP_DUTY_CYCLE_PERIOD_SEC * 1000,
+        .min_sleep_ms = 1000,
+        .connect_timeout_ms = CONFIG_ESP_DUTY_CYCLE_CONNECT_TIMEOUT_MS,
+        .ack_timeout_ms = CONFIG_ESP_DUTY_CYCLE_ACK_TIMEOUT_MS,
+        .max_awake_ms = CONFIG_ESP_DUTY_CYCLE_MAX_AWAKE_MS,
+};
+
+static const char *result_names[] = { "none", "ok", "connect timeout", "ack timeout", "awake timeout" };
+
+static bool done(uint32_t at_ms, uint32_t elapsed_ms)
+{
+    return at_ms != NEVER && elapsed_ms >= at_ms;
+}
+
+/* Polls the state machine every STEP_MS from wake_ms on, as duty_cycle_run() does, and reports inputs per script */
+static wake_outcome_t run_wake(const duty_cycle_config_t *cfg, const wake_script_t *script, uint32_t wake_ms)
+{
+    duty_cycle_t cycle;
+    duty_cycle_inputs_t inputs = { 0 };
+    uint32_t now_ms = wake_ms;
+
+    duty_cycle_start(&cycle, cfg, now_ms);
+    while (duty_cycle_update(&cycle, &inputs, now_ms) != DUTY_CYCLE_SLEEP) {
+        now_ms += STEP_MS;
+
+        uint32_t elapsed_ms = now_ms - wake_ms;
+        inputs.sampled = done(script->sampled_ms, elapsed_ms);
+        inputs.connected = done(script->connected_ms, elapsed_ms);
+        // publishing needs the connection, the state machine only asks for it after CONNECT
+        inputs.published = inputs.connected && done(script->published_ms, elapsed_ms);
+        inputs.pending_acks = inputs.published && done(script->acked_ms, elapsed_ms) ? 0 : 3;
+    }
+
+    wake_outcome_t outcome = {
+            .result = cycle.result,
+            .awake_ms = cycle.awake_ms,
+            .sleep_ms = duty_cycle_sleep_ms(&cycle),
+    };
+    printf("%-40s %-16s awake %6" PRIu32 " ms, sleep %7" PRIu32 " ms\n", script->name, result_names[outcome.result],
+           outcome.awake_ms, outcome.sleep_ms);
+    return outcome;
+}
+
+/* Ends within one poll of the expected time, with the given result and the sleep that keeps the period */
+static bool ended(const wake_outcome_t *outcome, duty_cycle_result_t result, uint32_t at_ms)
+{
+    uint32_t sleep_ms = at_ms + config.min_sleep_ms >= config.period_ms ? config.min_sleep_ms : config.period_ms - at_ms;
+
+    return outcome->result == result && outcome->awake_ms >= at_ms && outcome->awake_ms <= at_ms + STEP_MS &&
+           outcome->sleep_ms + STEP_MS >= sleep_ms && outcome->sleep_ms <= sleep_ms;
+}
+
+static int check_wakes(uint32_t wake_ms, const char *clock)
+{
+    const wake_script_t complete = { "complete", 40, 1500, 1520, 1600 };
+    const wake_script_t no_broker = { "broker never answers", 40, NEVER, NEVER, NEVER };
+    const wake_script_t no_acks = { "PUBACKs never arrive", 40, 1500, 1520, NEVER };
+    const wake_script_t slow_sample = { "sensors never done", NEVER, NEVER, NEVER, NEVER };
+    const wake_script_t slow_publish = { "publish never done", 40, 1500, NEVER, NEVER };
+    char what[96];
+    int failures = 0;
+
+    printf("-- wake-up at %" PRIu32 " ms (%s)\n", wake_ms, clock);
+
+    wake_outcome_t outcome = run_wake(&config, &complete, wake_ms);
+    snprintf(what, sizeof(what), "%s: asleep after the last PUBACK, up to the period", clock);
+    failures += expect(ended(&outcome, DUTY_CYCLE_RESULT_OK, 1600), what);
+
+    outcome = run_wake(&config, &no_broker, wake_ms);
+    snprintf(what, sizeof(what), "%s: connect timeout counted from the wake-up", clock);
+    failures += expect(ended(&outcome, DUTY_CYCLE_RESULT_CONNECT_TIMEOUT, config.connect_timeout_ms), what);
+
+    outcome = run_wake(&config, &no_acks, wake_ms);
+    snprintf(what, sizeof(what), "%s: ack timeout counted from the end of the publish", clock);
+    failures += expect(ended(&outcome, DUTY_CYCLE_RESULT_ACK_TIMEOUT, 1520 + config.ack_timeout_ms), what);
+
+    outcome = run_wake(&config, &slow_sample, wake_ms);
+    snprintf(what, sizeof(what), "%s: a sample that never ends stops at the awake budget", clock);
+    failures += expect(ended(&outcome, DUTY_CYCLE_RESULT_AWAKE_TIMEOUT, config.max_awake_ms), what);
+
+    outcome = run_wake(&config, &slow_publish, wake_ms);
+    snprintf(what, sizeof(what), "%s: a publish that never ends stops at the awake budget", clock);
+    failures += expect(ended(&outcome, DUTY_CYCLE_RESULT_AWAKE_TIMEOUT, config.max_awake_ms), what);
+
+    // the awake budget cuts the PUBACK wait short when it is the tighter of the two
+    duty_cycle_config_t tight = config;
+    tight.max_awake_ms = 1520 + config.ack_timeout_ms / 2;
+    outcome = run_wake(&tight, &no_acks, wake_ms);
+    snprintf(what, sizeof(what), "%s: the awake budget wins over a longer ack timeout", clock);
+    failures += expect(outcome.result == DUTY_CYCLE_RESULT_AWAKE_TIMEOUT && outcome.awake_ms >= tight.max_awake_ms &&
+                       outcome.awake_ms <= tight.max_awake_ms + STEP_MS, what);
+
+    // a wake that overran the period still sleeps the minimum
+    duty_cycle_config_t short_period = config;
+    short_period.period_ms = 1000;
+    outcome = run_wake(&short_period, &complete, wake_ms);
+    snprintf(what, sizeof(what), "%s: overrun of the period sleeps the minimum", clock);
+    failures += expect(outcome.result == DUTY_CYCLE_RESULT_OK && outcome.sleep_ms == config.min_sleep_ms, what);
+
+    return failures;
+}
+
+static int check_projection(void)
+{
+    const duty_cycle_power_t power = { .active_current_ua = 80000, .sleep_current_ua = 150, .capacity_mah = 2000 };
+    const duty_cycle_power_t no_draw = { .active_current_ua = 0, .sleep_current_ua = 0, .capacity_mah = 2000 };
+    int failures = 0;
+
+    // 80 mA for 2 s and 150 uA for 298 s: 682333 nA on average, 2000 mAh last 2931 h
+    failures += expect(duty_cycle_projected_hours(&power, 2000, 300000) == 2931, "projection: 2 s of 300 s");
+    // always awake: 2000 mAh at 80 mA
+    failures += expect(duty_cycle_projected_hours(&power, 300000, 300000) == 25, "projection: always awake");
+    failures += expect(duty_cycle_projected_hours(&power, 400000, 300000) == 25,
+                       "projection: awake longer than the period counts as the period");
+    // never awake: 2000 mAh at 150 uA
+    failures += expect(duty_cycle_projected_hours(&power, 0, 300000) == 13333, "projection: never awake");
+    failures += expect(duty_cycle_projected_hours(&power, 2000, 0) == 0, "projection: no period, no projection");
+    failures += expect(duty_cycle_projected_hours(&no_draw, 2000, 300000) == UINT32_MAX,
+                       "projection: no draw lasts forever");
+
+    // a day of awake time at 1 A over a day: no overflow in the ms * uA products
+    const duty_cycle_power_t heavy = { .active_current_ua = 1000000, .sleep_current_ua = 1000000, .capacity_mah = 1000 };
+    failures += expect(duty_cycle_projected_hours(&heavy, 86400000, 86400000) == 1, "projection: no overflow");
+
+    return failures;
+}
+
+/* What the Kconfig power figures give for typical awake times at the configured period */
+static void report_projection(void)
+{
+    const duty_cycle_power_t power = {
+            .active_current_ua = CONFIG_ESP_DUTY_CYCLE_ACTIVE_CURRENT_UA,
+            .sleep_current_ua = CONFIG_ESP_DUTY_CYCLE_SLEEP_CURRENT_UA,
+            .capacity_mah = CONFIG_ESP_DUTY_CYCLE_BATTERY_CAPACITY_MAH,
+    };
+    const uint32_t awake_times_ms[] = {
+            1000, 2000, 3000, 5000, config.connect_timeout_ms, config.max_awake_ms,
+    };
+
+    printf("-- projected battery life, %" PRIu32 " mAh, %" PRIu32 " uA awake, %" PRIu32 " uA asleep, period %u s\n",
+           power.capacity_mah, power.active_current_ua, power.sleep_current_ua, CONFIG_ESP_DUTY_CYCLE_PERIOD_SEC);
+    for (size_t i = 0; i < sizeof(awake_times_ms) / sizeof(awake_times_ms[0]); i++) {
+        uint32_t hours = duty_cycle_projected_hours(&power, awake_times_ms[i], config.period_ms);
+
+        printf("awake %6" PRIu32 " ms: %7" PRIu32 " h (%" PRIu32 " days)\n", awake_times_ms[i], hours, hours / 24);
+    }
+}
+
+int main(void)
+{
+    int failures = 0;
+
+    failures += check_wakes(5000, "after boot");
+    failures += check_wakes(UINT32_MAX - 700, "clock wraps during the wake");
+    failures += check_projection();
+    report_projection();
+
+    printf("%d check(s) failed\n", failures);
+    return failures > 0 ? 1 : 0;
+}
@@ -0,0 +1,344 @@
+/*
+ * Runs DHT22 traces through the sample filter of main/filter.c with the Kconfig defaults of the firmware and checks
+ * it against a plain double precision reference: glitches are dropped, a real step is followed within a few
+ * readings, the smoothed values stay close to the trace and the windowed statistics match the reference. A few
+ * short sequences pin down the median, Kalman, range and jump behaviour.
+ *
+ *   filter_test [trace.csv]...
+ *
+ * Trace format as for tools/deadband_replay.c, '#' starts a comment, a trailing "# glitch temperature" or
+ * "# glitch humidity" marks a value the filter must drop:
+ *   time_ms,temperature,humidity,voltage,soc
+ *
+ * Exits with 1 if a check fails.
+ */
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "filter.h"
+#include "fixed.h"
+#include "test.h"
+
+#define MAX_READINGS        4096
+#define WINDOW_MS           60000
+#define MAX_STEP_READINGS   6           /* readings until a real step shows in the output */
+#define MAX_TRACKING_ERROR  3           /* 0.1 units between the smoothed values and the trace outside a step */
+
+#ifndef TRACE_DIR
+#define TRACE_DIR           "traces"
+#endif
+
+typedef struct {
+    uint32_t time_ms;
+    int32_t value;
+    bool glitch;
+} reading_t;
+
+typedef struct {
+    const char *name;
+    filter_config_t config;
+} metric_t;
+
+/* The firmware defaults, see dht22.c and the DHT Configuration menu */
+static const metric_t metrics[2] = {
+        {
+                "temperature",
+                { .min = -400, .max = 800, .max_step = 5, .max_rate = 20, .max_rejects = 3,
+                  .smooth = FILTER_SMOOTH_MEDIAN, .median_size = 5, .kalman_q = 16, .kalman_r = 256,
+                  .window_ms = WINDOW_MS },
+        },
+        {
+                "humidity",
+                { .min = 0, .max = 1000, .max_step = 20, .max_rate = 100, .max_rejects = 3,
+                  .smooth = FILTER_SMOOTH_MEDIAN, .median_size = 5, .kalman_q = 64, .kalman_r = 1024,
+                  .window_ms = WINDOW_MS },
+        },
+};
+
+static const char *smooth_names[] = {
+        [FILTER_SMOOTH_NONE] = "none",
+        [FILTER_SMOOTH_MEDIAN] = "median",
+        [FILTER_SMOOTH_KALMAN] = "kalman",
+};
+
+static reading_t readings[2][MAX_READINGS];
+static size_t reading_count;
+
+static bool load_trace(const char *path)
+{
+    FILE *file = fopen(path, "r");
+    char line[256];
+
+    if (file == NULL) {
+        perror(path);
+        return false;
+    }
+
+    reading_count = 0;
+    while (fgets(line, sizeof(line), file) != NULL && reading_count < MAX_READINGS) {
+        char *comment = strchr(line, '#');
+        bool temperature_glitch = comment != NULL && strstr(comment, "glitch temperature") != NULL;
+        bool humidity_glitch = comment != NULL && strstr(comment, "glitch humidity") != NULL;
+        unsigned long time_ms;
+        double temperature;
+        double humidity;
+
+        if (comment != NULL) {
+            *comment = '\0';
+        }
+        if (sscanf(line, "%lu,%lf,%lf", &time_ms, &temperature, &humidity) != 3) {
+            continue;
+        }
+
+        readings[0][reading_count] = (reading_t) {
+                (uint32_t)time_ms, (int32_t)lround(temperature * FIXED_DHT_DEN), temperature_glitch };
+        readings[1][reading_count] = (reading_t) {
+                (uint32_t)time_ms, (int32_t)lround(humidity * FIXED_DHT_DEN), humidity_glitch };
+        reading_count++;
+    }
+
+    fclose(file);
+    return reading_count > 0;
+}
+
+/* Reference statistics of the smoothed values of one window, in double precision */
+static bool stats_match(const filter_stats_t *stats, const int32_t *values, size_t count)
+{
+    double sum = 0;
+    double sum_sq = 0;
+    int32_t min = values[0];
+    int32_t max = values[0];
+
+    for (size_t i = 0; i < count; i++) {
+        sum += values[i];
+        min = values[i] < min ? values[i] : min;
+        max = values[i] > max ? values[i] : max;
+    }
+
+    double mean = sum / count;
+    for (size_t i = 0; i < count; i++) {
+        sum_sq += (values[i] - mean) * (values[i] - mean);
+    }
+    double stddev = sqrt(sum_sq / count);
+
+    // one step of FILTER_STATS_SCALE for the rounding of each side
+    return stats->count == count && stats->min == min && stats->max == max &&
+           fabs(stats->mean - mean * FILTER_STATS_SCALE) <= 1 && fabs(stats->stddev - stddev * FILTER_STATS_SCALE) <= 1;
+}
+
+static int replay(const metric_t *metric, const reading_t *trace, filter_smooth_t smooth)
+{
+    static int32_t window_values[MAX_READINGS];
+    filter_config_t config = metric->config;
+    filter_t filter;
+    size_t window_count = 0;
+    unsigned int windows = 0;
+    unsigned int windows_matched = 0;
+    unsigned int glitches = 0;
+    unsigned int glitches_rejected = 0;
+    unsigned int good_rejected = 0;
+    int32_t worst_error = 0;
+    size_t last_jump = 0;
+    int32_t previous = trace[0].value;
+    int failures = 0;
+    char what[128];
+
+    config.smooth = smooth;
+    filter_init(&filter, &config, trace[0].time_ms);
+
+    for (size_t i = 0; i < reading_count; i++) {
+        filter_stats_t stats;
+        int32_t value;
+        filter_result_t result = filter_push(&filter, trace[i].value, trace[i].time_ms, &value);
+
+        if (trace[i].glitch) {
+            glitches++;
+            glitches_rejected += result != FILTER_ACCEPTED;
+            continue;
+        }
+
+        // the first readings of a step are rejected until max_rejects of them agree, then the smoothing follows
+        if (i > 0 && abs(trace[i].value - previous) > 4 * config.max_step) {
+            last_jump = i;
+        }
+        previous = trace[i].value;
+        if (result != FILTER_ACCEPTED) {
+            good_rejected += i - last_jump >= config.max_rejects;
+            continue;
+        }
+
+        window_values[window_count++] = value;
+        if (i - last_jump >= MAX_STEP_READINGS && abs(value - trace[i].value) > worst_error) {
+            worst_error = abs(value - trace[i].value);
+        }
+
+        if (filter_window_take(&filter, trace[i].time_ms, &stats)) {
+            windows++;
+            windows_matched += stats_match(&stats, window_values, window_count);
+            window_count = 0;
+        }
+    }
+
+    snprintf(what, sizeof(what), "%s, %s: %u of %u glitches rejected", metric->name, smooth_names[smooth],
+             glitches_rejected, glitches);
+    failures += expect(glitches_rejected == glitches, what);
+
+    snprintf(what, sizeof(what), "%s, %s: %u genuine readings rejected after a step settled", metric->name,
+             smooth_names[smooth], good_rejected);
+    failures += expect(good_rejected == 0, what);
+
+    snprintf(what, sizeof(what), "%s, %s: largest deviation from the trace %.1f", metric->name,
+             smooth_names[smooth], worst_error / (double)FIXED_DHT_DEN);
+    failures += expect(worst_error <= MAX_TRACKING_ERROR, what);
+
+    snprintf(what, sizeof(what), "%s, %s: %u of %u windows match the reference statistics", metric->name,
+             smooth_names[smooth], windows_matched, windows);
+    failures += expect(windows > 0 && windows_matched == windows, what);
+
+    return failures;
+}
+
+static int check_median(void)
+{
+    static const int32_t raw[] = { 200, 201, 230, 202, 201, 203, 202 };
+    static const int32_t smoothed[] = { 200, 200, 201, 201, 201, 202, 202 };
+    filter_config_t config = { .min = -400, .max = 800, .smooth = FILTER_SMOOTH_MEDIAN, .median_size = 5 };
+    filter_t filter;
+    bool match = true;
+
+    filter_init(&filter, &config, 0);
+    for (size_t i = 0; i < sizeof(raw) / sizeof(raw[0]); i++) {
+        int32_t value;
+        filter_push(&filter, raw[i], i * 5000, &value);
+        match &= value == smoothed[i];
+    }
+
+    return expect(match, "median: a single outlier never reaches the output");
+}
+
+static int check_kalman(void)
+{
+    filter_config_t config = { .min = -400, .max = 800, .smooth = FILTER_SMOOTH_KALMAN, .kalman_q = 16,
+                               .kalman_r = 256 };
+    filter_t filter;
+    int32_t value = 0;
+    int failures = 0;
+    double noisy = 0;
+    double smoothed = 0;
+
+    // alternating +-1 around 21.0 °C: the output settles on the middle
+    filter_init(&filter, &config, 0);
+    for (uint32_t i = 0; i < 200; i++) {
+        int32_t raw = 210 + (i % 2 ? 1 : -1);
+
+        filter_push(&filter, raw, i * 5000, &value);
+        if (i >= 100) {
+            noisy += (raw - 210) * (raw - 210);
+            smoothed += (value - 210) * (value - 210);
+        }
+    }
+    failures += expect(smoothed < noisy / 4, "kalman: noise reduced to less than a quarter of its power");
+
+    // a step without jump rejection: the estimate follows within a few time constants
+    for (uint32_t i = 200; i < 240; i++) {
+        filter_push(&filter, 230, i * 5000, &value);
+    }
+    failures += expect(value == 230, "kalman: follows a step");
+
+    return failures;
+}
+
+static int check_rejection(void)
+{
+    filter_config_t config = { .min = 0, .max = 1000, .max_step = 20, .max_rate = 100, .max_rejects = 3,
+                               .smooth = FILTER_SMOOTH_NONE };
+    filter_t filter;
+    int32_t value;
+    int failures = 0;
+
+    filter_init(&filter, &config, 0);
+    filter_push(&filter, 500, 0, &value);
+    failures += expect(filter_push(&filter, 1001, 5000, &value) == FILTER_REJECTED_RANGE && value == 500,
+                       "range: a value above max is dropped, the output keeps the last value");
+    failures += expect(filter_push(&filter, 999, 5000, &value) == FILTER_REJECTED_JUMP,
+                       "jump: 49.9 % in 5 s is dropped");
+    failures += expect(filter_push(&filter, 0, 10000, &value) == FILTER_REJECTED_JUMP &&
+                       filter_push(&filter, 999, 15000, &value) == FILTER_REJECTED_JUMP &&
+                       filter_push(&filter, 0, 20000, &value) == FILTER_REJECTED_JUMP,
+                       "jump: jumps that scatter are never accepted");
+    failures += expect(filter_push(&filter, 540, 60000, &value) == FILTER_ACCEPTED,
+                       "jump: the allowance grows with the time since the last accepted value");
+    failures += expect(filter_push(&filter, 300, 65000, &value) == FILTER_REJECTED_JUMP &&
+                       filter_push(&filter, 305, 70000, &value) == FILTER_REJECTED_JUMP &&
+                       filter_push(&filter, 310, 75000, &value) == FILTER_ACCEPTED && value == 310,
+                       "jump: three jumps that agree are a new level");
+
+    config.max_rejects = 0;
+    filter_init(&filter, &config, 0);
+    filter_push(&filter, 500, 0, &value);
+    failures += expect(filter_push(&filter, 0, 5000, &value) == FILTER_ACCEPTED,
+                       "jump: max_rejects 0 never rejects a jump");
+
+    return failures;
+}
+
+static int check_window(void)
+{
+    filter_config_t config = { .min = -400, .max = 800, .smooth = FILTER_SMOOTH_NONE, .window_ms = 10000 };
+    filter_t filter;
+    filter_stats_t stats;
+    int32_t value;
+    int failures = 0;
+
+    filter_init(&filter, &config, 0);
+    filter_push(&filter, -12, 0, &value);
+    filter_push(&filter, -10, 4000, &value);
+    failures += expect(!filter_window_take(&filter, 9999, &stats), "window: still open before window_ms");
+    filter_push(&filter, -5, 9999, &value);
+    failures += expect(filter_window_take(&filter, 10000, &stats) && stats.count == 3 && stats.min == -12 &&
+                       stats.max == -5 && stats.mean == -90 && stats.stddev == 29,
+                       "window: -1.2, -1.0, -0.5 give mean -0.90 and stddev 0.29");
+    failures += expect(filter.window_start_ms == 10000, "window: the next one starts where the last one ended");
+
+    filter_push(&filter, 800, 15000, &value);
+    filter_push(&filter, 1000, 16000, &value);
+    failures += expect(filter_window_take(&filter, 45000, &stats) && stats.count == 1 && stats.stddev == 0,
+                       "window: only accepted values count");
+    failures += expect(filter.window_start_ms == 45000, "window: after a gap the next one starts now");
+    failures += expect(!filter_window_take(&filter, 56000, &stats), "window: an empty window has no statistics");
+
+    return failures;
+}
+
+int main(int argc, char **argv)
+{
+    static const char *default_traces[] = { TRACE_DIR "/dht_glitches.csv" };
+    const char **traces = argc > 1 ? (const char **)&argv[1] : default_traces;
+    int trace_count = argc > 1 ? argc - 1 : 1;
+    int failures = 0;
+
+    failures += check_median();
+    failures += check_kalman();
+    failures += check_rejection();
+    failures += check_window();
+
+    for (int t = 0; t < trace_count; t++) {
+        if (!load_trace(traces[t])) {
+            fprintf(stderr, "%s: no readings\n", traces[t]);
+            return 1;
+        }
+        printf("%s: %zu readings\n", traces[t], reading_count);
+
+        for (size_t m = 0; m < 2; m++) {
+            failures += replay(&metrics[m], readings[m], FILTER_SMOOTH_MEDIAN);
+            failures += replay(&metrics[m], readings[m], FILTER_SMOOTH_KALMAN);
+        }
+    }
+
+    printf("%d check(s) failed\n", failures);
+    return failures > 0 ? 1 : 0;
+}
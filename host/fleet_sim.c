@@ -0,0 +1,1236 @@
+/*
+ * Load generator for the broker: N virtual sensor nodes publish like the firmware does, over real MQTT5
+ * connections, e.g. against the mosquitto of docker/docker-compose.yml. Reports publish throughput and PUBACK and
+ * CONNACK latency percentiles every second and for the whole run, to find where the broker saturates.
+ *
+ * A virtual node is the firmware's publish path without the hardware:
+ * - CONNECT with the session of mqtt_session.h: session expiry, will with its properties and the user properties;
+ * - per-value topics formatted with fixed_format(), or a frame encoded with payload_encode() (-f), QoS 1 retained;
+ * - topic aliases from topic_alias.c, up to the broker's Topic Alias Maximum, on the QoS 1 publishes too: a virtual
+ *   node never sends a publish again on a new connection, unlike esp-mqtt, so it can (-A turns them off);
+ * - reconnects scheduled by conn_policy.c with the Kconfig backoff and jitter.
+ * The topics are the configured ones (host/sdkconfig.h) with the node level, esp32dhtA by default, replaced by
+ * <prefix>-<node number>.
+ *
+ * Nodes connect at -c per second, then sample every -i ms with -j % jitter. A sample falls on the floor while its
+ * node is offline or has Receive Maximum publishes in flight; both are counted. A reconnect storm (-s) drops the
+ * connections of -S % of the nodes at once without a DISCONNECT, as a broker restart or an AP outage would. The
+ * broker publishes their wills, and the nodes come back through their backoff.
+ *
+ *   fleet_sim [-h host] [-p port] [-u user] [-P password] [-n nodes] [-w workers] [-c connects/s] [-i interval_ms]
+ *             [-j jitter_pct] [-d seconds] [-s storm_every_s] [-S storm_pct] [-f json|cbor|binary] [-A] [-t prefix]
+ *
+ * Not part of ctest, it needs a broker. Exits with 1 if no publish was acknowledged.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <netdb.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+
+#include "conn_policy.h"
+#include "connectivity.h"
+#include "fixed.h"
+#include "mqtt_session.h"
+#include "payload.h"
+#include "topic_alias.h"
+
+#define NODE_TOPICS             5           /* the four per-value topics and the frame topic */
+#define NODE_TOPIC_SIZE         96
+#define NODE_INFLIGHT_SLOTS     64          /* QoS 1 publishes in flight per node, capped further by the broker */
+#define NODE_RX_SIZE            512
+#define NODE_TX_SIZE            2048
+#define NODE_NAME_SIZE          32
+
+/* log-linear histogram in microseconds: 32 buckets per power of two, 3 % resolution */
+#define HIST_SUB_BITS           5
+#define HIST_BUCKETS            ((32 - HIST_SUB_BITS + 1) << HIST_SUB_BITS)
+
+#define MQTT_CONNECT            0x10
+#define MQTT_CONNACK            0x20
+#define MQTT_PUBLISH_QOS1       0x32
+#define MQTT_PUBACK             0x40
+#define MQTT_PINGREQ            0xc0
+#define MQTT_PINGRESP           0xd0
+#define MQTT_DISCONNECT         0xe0
+
+enum {
+    TOPIC_TEMPERATURE = 0,
+    TOPIC_HUMIDITY,
+    TOPIC_VOLTAGE,
+    TOPIC_SOC,
+    TOPIC_FRAME,
+};
+
+typedef enum {
+    NODE_OFFLINE = 0,           /*!< not started yet or waiting for conn_policy */
+    NODE_TCP_CONNECTING,
+    NODE_WAIT_CONNACK,
+    NODE_ONLINE,
+} node_state_t;
+
+typedef struct {
+    uint16_t packet_id;         /*!< 0 = free */
+    int64_t sent_us;
+} inflight_t;
+
+typedef struct {
+    uint32_t number;
+    char client_id[NODE_NAME_SIZE];
+    char topics[NODE_TOPICS][NODE_TOPIC_SIZE];
+
+    node_state_t state;
+    int fd;
+    conn_policy_t policy;
+    int64_t start_us;           /*!< connect ramp: the node powers up at this time */
+    int64_t connect_us;         /*!< start of the attempt in progress */
+    int64_t last_tx_us;
+
+    topic_alias_t aliases;
+    uint16_t receive_maximum;   /*!< publishes the broker accepts in flight */
+    uint16_t next_packet_id;
+    uint16_t inflight_count;
+    inflight_t inflight[NODE_INFLIGHT_SLOTS];
+
+    int64_t next_sample_us;
+    uint32_t seq;
+    sensor_frame_t frame;       /*!< current values, a random walk */
+
+    uint8_t rx[NODE_RX_SIZE];
+    size_t rx_len;
+    uint8_t tx[NODE_TX_SIZE];
+    size_t tx_len;
+    bool want_write;
+} node_t;
+
+typedef struct {
+    atomic_uint_fast64_t buckets[HIST_BUCKETS];
+    atomic_uint_fast64_t max_us;
+} histogram_t;
+
+typedef struct {
+    atomic_uint_fast64_t samples;           /*!< samples the nodes took */
+    atomic_uint_fast64_t publishes;
+    atomic_uint_fast64_t pubacks;
+    atomic_uint_fast64_t publish_errors;    /*!< PUBACK with a reason code >= 0x80 */
+    atomic_uint_fast64_t wire_bytes;        /*!< PUBLISH packets sent */
+    atomic_uint_fast64_t offline_samples;   /*!< taken while the node was not connected */
+    atomic_uint_fast64_t inflight_full;     /*!< taken while Receive Maximum publishes were in flight */
+    atomic_uint_fast64_t connects;          /*!< CONNACK with success */
+    atomic_uint_fast64_t refused;           /*!< CONNACK with an error reason code */
+    atomic_uint_fast64_t connect_failures;  /*!< TCP errors and attempts that timed out */
+    atomic_uint_fast64_t drops;             /*!< established connections lost, storms included */
+    atomic_int_fast32_t online;
+    histogram_t puback;
+    histogram_t connack;
+} stats_t;
+
+typedef struct {
+    const char *host;
+    const char *port;
+    const char *username;
+    const char *password;
+    const char *prefix;
+    uint32_t nodes;
+    uint32_t workers;
+    uint32_t connects_per_s;
+    uint32_t interval_ms;
+    uint32_t jitter_pct;
+    uint32_t duration_s;
+    uint32_t storm_every_s;
+    uint32_t storm_pct;
+    bool frame;
+    payload_format_t format;
+    bool aliases;
+} options_t;
+
+typedef struct {
+    pthread_t thread;
+    node_t *nodes;
+    size_t count;
+    int epoll;
+    uint64_t random;
+    int64_t next_storm_us;
+    int64_t next_poll_us;       /*!< earliest timer of any node, a lost connection brings it forward */
+} worker_t;
+
+static options_t options = {
+        .host = "localhost",
+        .port = "1883",
+        .username = CONFIG_ESP_MQTT_USERNAME,
+        .password = CONFIG_ESP_MQTT_PASSWORD,
+        .prefix = "fleet",
+        .nodes = 100,
+        .workers = 4,
+        .connects_per_s = 100,
+        .interval_ms = 1000,
+        .jitter_pct = 10,
+        .duration_s = 60,
+        .storm_pct = 100,
+        .aliases = true,
+};
+
+static const conn_policy_config_t conn_config = {
+        .initial_ms = CONN_BACKOFF_INITIAL_MS,
+        .max_ms = CONN_BACKOFF_MAX_MS,
+        .jitter_pct = CONN_BACKOFF_JITTER_PCT,
+        .attempt_timeout_ms = CONN_ATTEMPT_TIMEOUT_MS,
+};
+
+static const struct {
+    const char *key;
+    const char *value;
+} user_properties[] = {
+        MQTT_SESSION_USER_PROPERTIES
+};
+
+static const char *const configured_topics[NODE_TOPICS] = {
+        [TOPIC_TEMPERATURE] = CONFIG_ESP_MQTT_TOPIC_TEMPERATURE,
+        [TOPIC_HUMIDITY] = CONFIG_ESP_MQTT_TOPIC_HUMIDITY,
+        [TOPIC_VOLTAGE] = CONFIG_ESP_MQTT_TOPIC_BATTERY_VOLTAGE,
+        [TOPIC_SOC] = CONFIG_ESP_MQTT_TOPIC_BATTERY_SOC,
+        [TOPIC_FRAME] = CONFIG_ESP_MQTT_TOPIC_FRAME,
+};
+
+static struct addrinfo *broker;
+static stats_t stats;
+static int64_t epoch_us;
+static atomic_bool stopping;
+
+static int64_t now_us(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000 - epoch_us;
+}
+
+/* conn_policy runs on a millisecond clock */
+static uint32_t policy_ms(int64_t time_us)
+{
+    return (uint32_t)(time_us / 1000);
+}
+
+static uint32_t next_random(worker_t *worker)
+{
+    // xorshift64
+    worker->random ^= worker->random << 13;
+    worker->random ^= worker->random >> 7;
+    worker->random ^= worker->random << 17;
+    return (uint32_t)(worker->random >> 32);
+}
+
+/* == Histograms ========================================================== */
+
+static size_t hist_index(uint64_t value)
+{
+    if (value >= UINT32_MAX) {
+        value = UINT32_MAX;
+    }
+    if (value < (2u << HIST_SUB_BITS)) {
+        return (size_t)value;
+    }
+
+    int shift = 63 - __builtin_clzll(value) - HIST_SUB_BITS;
+    return ((size_t)shift << HIST_SUB_BITS) + (size_t)(value >> shift);
+}
+
+/* Upper end of a bucket */
+static uint64_t hist_value(size_t index)
+{
+    if (index < (2u << HIST_SUB_BITS)) {
+        return index;
+    }
+
+    int shift = (int)(index >> HIST_SUB_BITS) - 1;
+    uint64_t mantissa = index - ((uint64_t)shift << HIST_SUB_BITS);
+    return ((mantissa + 1) << shift) - 1;
+}
+
+static void hist_record(histogram_t *histogram, int64_t value_us)
+{
+    uint64_t value = value_us > 0 ? (uint64_t)value_us : 0;
+    uint64_t max = atomic_load_explicit(&histogram->max_us, memory_order_relaxed);
+
+    atomic_fetch_add_explicit(&histogram->buckets[hist_index(value)], 1, memory_order_relaxed);
+    while (value > max &&
+           !atomic_compare_exchange_weak_explicit(&histogram->max_us, &max, value, memory_order_relaxed,
+                                                  memory_order_relaxed)) {
+    }
+}
+
+/* A copy of the counts, or the counts since an earlier copy when previous is given */
+static uint64_t hist_snapshot(const histogram_t *histogram, uint64_t *counts, const uint64_t *previous)
+{
+    uint64_t total = 0;
+
+    for (size_t i = 0; i < HIST_BUCKETS; i++) {
+        uint64_t count = atomic_load_explicit(&histogram->buckets[i], memory_order_relaxed);
+        counts[i] = previous != NULL ? count - previous[i] : count;
+        total += counts[i];
+    }
+
+    return total;
+}
+
+static double hist_percentile_ms(const uint64_t *counts, uint64_t total, double percentile)
+{
+    uint64_t rank = (uint64_t)(total * percentile / 100);
+    uint64_t seen = 0;
+
+    if (total == 0) {
+        return 0;
+    }
+    for (size_t i = 0; i < HIST_BUCKETS; i++) {
+        seen += counts[i];
+        if (seen > rank) {
+            return hist_value(i) / 1000.0;
+        }
+    }
+    return hist_value(HIST_BUCKETS - 1) / 1000.0;
+}
+
+/* == MQTT5 packets ======================================================= */
+
+typedef struct {
+    uint8_t *data;
+    size_t len;
+    size_t size;
+    bool overflow;
+} packet_t;
+
+static void put_byte(packet_t *packet, uint8_t value)
+{
+    if (packet->len < packet->size) {
+        packet->data[packet->len++] = value;
+    } else {
+        packet->overflow = true;
+    }
+}
+
+static void put_u16(packet_t *packet, uint16_t value)
+{
+    put_byte(packet, value >> 8);
+    put_byte(packet, value & 0xff);
+}
+
+static void put_u32(packet_t *packet, uint32_t value)
+{
+    put_u16(packet, value >> 16);
+    put_u16(packet, value & 0xffff);
+}
+
+static void put_bytes(packet_t *packet, const void *data, size_t len)
+{
+    for (size_t i = 0; i < len; i++) {
+        put_byte(packet, ((const uint8_t *)data)[i]);
+    }
+}
+
+static void put_string(packet_t *packet, const char *string)
+{
+    size_t len = strlen(string);
+
+    put_u16(packet, (uint16_t)len);
+    put_bytes(packet, string, len);
+}
+
+static void put_varint(packet_t *packet, size_t value)
+{
+    do {
+        uint8_t byte = value % 128;
+        value /= 128;
+        put_byte(packet, value > 0 ? byte | 0x80 : byte);
+    } while (value > 0);
+}
+
+static size_t varint_size(size_t value)
+{
+    size_t size = 1;
+
+    while (value >= 128) {
+        value /= 128;
+        size++;
+    }
+
+    return size;
+}
+
+static void put_user_properties(packet_t *packet)
+{
+    for (size_t i = 0; i < sizeof(user_properties) / sizeof(user_properties[0]); i++) {
+        put_byte(packet, 0x26);
+        put_string(packet, user_properties[i].key);
+        put_string(packet, user_properties[i].value);
+    }
+}
+
+/* Prefix a packet body with its fixed header, the body starts at offset 5 (room for the largest header) */
+static size_t finish_packet(uint8_t *buffer, size_t body_len, uint8_t type)
+{
+    size_t header = 1 + varint_size(body_len);
+    packet_t packet = { buffer + 5 - header, 0, header };
+
+    put_byte(&packet, type);
+    put_varint(&packet, body_len);
+    memmove(buffer, buffer + 5 - header, header + body_len);
+    return header + body_len;
+}
+
+/* CONNECT with the session of mqtt5_init(), returns the packet length or 0 if it does not fit */
+static size_t encode_connect(const node_t *node, uint8_t *buffer, size_t size)
+{
+    uint8_t properties[256];
+    uint8_t will_properties[256];
+    packet_t props = { properties, 0, sizeof(properties) };
+    packet_t will = { will_properties, 0, sizeof(will_properties) };
+    packet_t body = { buffer + 5, 0, size - 5 };
+    uint8_t flags = 0x04 | (MQTT_SESSION_WILL_QOS << 3) | (MQTT_SESSION_WILL_RETAIN ? 0x20 : 0);
+
+    put_byte(&props, 0x11);
+    put_u32(&props, MQTT_SESSION_EXPIRY_INTERVAL_SEC);
+    put_byte(&props, 0x21);
+    put_u16(&props, MQTT_SESSION_RECEIVE_MAXIMUM);
+    put_byte(&props, 0x27);
+    put_u32(&props, MQTT_SESSION_MAXIMUM_PACKET_SIZE);
+    put_byte(&props, 0x22);
+    put_u16(&props, MQTT_SESSION_TOPIC_ALIAS_MAXIMUM);
+    put_byte(&props, 0x19);
+    put_byte(&props, MQTT_SESSION_REQUEST_RESP_INFO);
+    put_byte(&props, 0x17);
+    put_byte(&props, MQTT_SESSION_REQUEST_PROBLEM_INFO);
+    put_user_properties(&props);
+
+    put_byte(&will, 0x18);
+    put_u32(&will, MQTT_SESSION_WILL_DELAY_SEC);
+    put_byte(&will, 0x01);
+    put_byte(&will, MQTT_SESSION_WILL_PAYLOAD_FORMAT);
+    put_byte(&will, 0x02);
+    put_u32(&will, MQTT_SESSION_WILL_MESSAGE_EXPIRY_SEC);
+    put_user_properties(&will);
+
+    if (options.username[0] != '\0') {
+        flags |= 0x80;
+    }
+    if (options.password[0] != '\0') {
+        flags |= 0x40;
+    }
+
+    put_string(&body, "MQTT");
+    put_byte(&body, 5);
+    put_byte(&body, flags);
+    put_u16(&body, MQTT_SESSION_KEEPALIVE_SEC);
+    put_varint(&body, props.len);
+    put_bytes(&body, properties, props.len);
+    put_string(&body, node->client_id);
+    put_varint(&body, will.len);
+    put_bytes(&body, will_properties, will.len);
+    put_string(&body, MQTT_SESSION_WILL_TOPIC);
+    put_u16(&body, sizeof(MQTT_SESSION_WILL_MESSAGE) - 1);
+    put_bytes(&body, MQTT_SESSION_WILL_MESSAGE, sizeof(MQTT_SESSION_WILL_MESSAGE) - 1);
+    if (options.username[0] != '\0') {
+        put_string(&body, options.username);
+    }
+    if (options.password[0] != '\0') {
+        put_string(&body, options.password);
+    }
+
+    if (props.overflow || will.overflow || body.overflow) {
+        return 0;
+    }
+    return finish_packet(buffer, body.len, MQTT_CONNECT);
+}
+
+/* QoS 1 retained PUBLISH, an empty topic once the alias is established */
+static size_t encode_publish(const char *topic, uint16_t alias, uint16_t packet_id, const void *payload, size_t len,
+                             uint8_t *buffer, size_t size)
+{
+    packet_t body = { buffer + 5, 0, size - 5 };
+
+    put_string(&body, topic);
+    put_u16(&body, packet_id);
+    if (alias > 0) {
+        put_varint(&body, 3);
+        put_byte(&body, 0x23);
+        put_u16(&body, alias);
+    } else {
+        put_varint(&body, 0);
+    }
+    put_bytes(&body, payload, len);
+
+    if (body.overflow) {
+        return 0;
+    }
+    return finish_packet(buffer, body.len, MQTT_PUBLISH_QOS1 | 0x01);
+}
+
+static int get_varint(const uint8_t *data, size_t len, size_t *value)
+{
+    size_t multiplier = 1;
+
+    *value = 0;
+    for (size_t i = 0; i < len && i < 4; i++) {
+        *value += (data[i] & 0x7f) * multiplier;
+        if ((data[i] & 0x80) == 0) {
+            return (int)i + 1;
+        }
+        multiplier *= 128;
+    }
+    return len < 4 ? 0 : -1;
+}
+
+/* Size of a property value by its identifier, -1 for variable length (string, binary), -2 if unknown */
+static int property_size(uint8_t id)
+{
+    switch (id) {
+        case 0x01: case 0x17: case 0x19: case 0x24: case 0x25: case 0x28: case 0x29: case 0x2a:
+            return 1;
+        case 0x13: case 0x21: case 0x22: case 0x23:
+            return 2;
+        case 0x02: case 0x11: case 0x18: case 0x27:
+            return 4;
+        case 0x03: case 0x08: case 0x09: case 0x12: case 0x15: case 0x16: case 0x1a: case 0x1c: case 0x1f:
+            return -1;
+        default:
+            return -2;
+    }
+}
+
+/* The CONNACK properties the node cares about: Receive Maximum and Topic Alias Maximum */
+static void parse_connack_properties(node_t *node, const uint8_t *data, size_t len, uint16_t *alias_max)
+{
+    size_t pos = 0;
+
+    while (pos < len) {
+        uint8_t id = data[pos++];
+        int size = property_size(id);
+
+        if (id == 0x26) {
+            // user property: two strings
+            for (int i = 0; i < 2 && pos + 2 <= len; i++) {
+                pos += 2 + ((data[pos] << 8) | data[pos + 1]);
+            }
+            continue;
+        }
+        if (size == -1) {
+            if (pos + 2 > len) {
+                return;
+            }
+            pos += 2 + ((data[pos] << 8) | data[pos + 1]);
+            continue;
+        }
+        if (size < 0 || pos + size > len) {
+            return;
+        }
+        if (id == 0x21) {
+            node->receive_maximum = (data[pos] << 8) | data[pos + 1];
+        } else if (id == 0x22) {
+            *alias_max = (data[pos] << 8) | data[pos + 1];
+        }
+        pos += size;
+    }
+}
+
+/* == Nodes =============================================================== */
+
+static void node_init(node_t *node, uint32_t number, worker_t *worker)
+{
+    char name[NODE_NAME_SIZE];
+
+    memset(node, 0, sizeof(*node));
+    node->number = number;
+    node->fd = -1;
+    snprintf(node->client_id, sizeof(node->client_id), "%s-%05u", options.prefix, number);
+    snprintf(name, sizeof(name), "%s-%05u", options.prefix, number);
+
+    // dt/hub/barn/esp32dhtA/temperature -> dt/hub/barn/fleet-00042/temperature
+    for (int i = 0; i < NODE_TOPICS; i++) {
+        const char *topic = configured_topics[i];
+        const char *leaf = strrchr(topic, '/');
+        const char *node_level = leaf;
+
+        while (node_level != NULL && node_level > topic && node_level[-1] != '/') {
+            node_level--;
+        }
+        if (leaf == NULL || node_level == topic) {
+            snprintf(node->topics[i], NODE_TOPIC_SIZE, "%s/%s", name, topic);
+        } else {
+            snprintf(node->topics[i], NODE_TOPIC_SIZE, "%.*s%s%s", (int)(node_level - topic), topic, name, leaf);
+        }
+    }
+
+    node->start_us = (int64_t)number * 1000000 / options.connects_per_s;
+    node->next_sample_us = node->start_us + (int64_t)(next_random(worker) % options.interval_ms) * 1000;
+    node->frame = (sensor_frame_t) {
+            .flags = PAYLOAD_HAS_DHT | PAYLOAD_HAS_BATTERY,
+            .temperature = 180 + next_random(worker) % 80,
+            .humidity = 400 + next_random(worker) % 200,
+            .voltage = 3700 * 64 / 5 + next_random(worker) % 4000,
+            .soc = (60 + next_random(worker) % 40) * 256,
+    };
+}
+
+static void node_watch(worker_t *worker, node_t *node, bool write)
+{
+    struct epoll_event event = {
+            .events = EPOLLIN | (write ? EPOLLOUT : 0),
+            .data.ptr = node,
+    };
+
+    node->want_write = write;
+    epoll_ctl(worker->epoll, EPOLL_CTL_MOD, node->fd, &event);
+}
+
+static void node_close(worker_t *worker, node_t *node)
+{
+    if (node->fd >= 0) {
+        epoll_ctl(worker->epoll, EPOLL_CTL_DEL, node->fd, NULL);
+        close(node->fd);
+        node->fd = -1;
+    }
+    if (node->state == NODE_ONLINE) {
+        atomic_fetch_sub(&stats.online, 1);
+    }
+
+    // QoS 1 publishes in flight are lost with the connection, as without store and forward
+    memset(node->inflight, 0, sizeof(node->inflight));
+    node->inflight_count = 0;
+    node->rx_len = 0;
+    node->tx_len = 0;
+    node->state = NODE_OFFLINE;
+}
+
+/* The connection failed or dropped: close it and let conn_policy schedule the next attempt */
+static void node_down(worker_t *worker, node_t *node, int64_t now)
+{
+    if (node->state == NODE_ONLINE) {
+        atomic_fetch_add(&stats.drops, 1);
+    } else {
+        atomic_fetch_add(&stats.connect_failures, 1);
+    }
+    node_close(worker, node);
+    conn_policy_event(&node->policy, CONN_EVENT_MQTT_DOWN, policy_ms(now), next_random(worker));
+    worker->next_poll_us = now;
+}
+
+static bool node_flush(worker_t *worker, node_t *node)
+{
+    while (node->tx_len > 0) {
+        ssize_t sent = send(node->fd, node->tx, node->tx_len, MSG_NOSIGNAL);
+
+        if (sent < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                if (!node->want_write) {
+                    node_watch(worker, node, true);
+                }
+                return true;
+            }
+            return false;
+        }
+        memmove(node->tx, node->tx + sent, node->tx_len - sent);
+        node->tx_len -= sent;
+    }
+
+    if (node->want_write) {
+        node_watch(worker, node, false);
+    }
+    return true;
+}
+
+/* Queue a packet for sending, false if the node's send buffer is full */
+static bool node_queue(node_t *node, const uint8_t *packet, size_t len, int64_t now)
+{
+    if (node->tx_len + len > NODE_TX_SIZE) {
+        return false;
+    }
+    memcpy(node->tx + node->tx_len, packet, len);
+    node->tx_len += len;
+    node->last_tx_us = now;
+    return true;
+}
+
+static void node_connect(worker_t *worker, node_t *node, int64_t now)
+{
+    struct epoll_event event = { .events = EPOLLOUT, .data.ptr = node };
+    int one = 1;
+
+    node->fd = socket(broker->ai_family, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    if (node->fd < 0) {
+        node_down(worker, node, now);
+        return;
+    }
+    setsockopt(node->fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    node->connect_us = now;
+    node->state = NODE_TCP_CONNECTING;
+    node->want_write = true;
+    epoll_ctl(worker->epoll, EPOLL_CTL_ADD, node->fd, &event);
+
+    if (connect(node->fd, broker->ai_addr, broker->ai_addrlen) < 0 && errno != EINPROGRESS) {
+        node_down(worker, node, now);
+    }
+}
+
+/* TCP is up: send the CONNECT */
+static void node_tcp_connected(worker_t *worker, node_t *node, int64_t now)
+{
+    uint8_t packet[NODE_TX_SIZE];
+    int error = 0;
+    socklen_t len = sizeof(error);
+
+    if (getsockopt(node->fd, SOL_SOCKET, SO_ERROR, &error, &len) < 0 || error != 0) {
+        node_down(worker, node, now);
+        return;
+    }
+
+    size_t size = encode_connect(node, packet, sizeof(packet));
+    node->state = NODE_WAIT_CONNACK;
+    if (size == 0 || !node_queue(node, packet, size, now) || !node_flush(worker, node)) {
+        node_down(worker, node, now);
+    }
+}
+
+static void node_connack(worker_t *worker, node_t *node, const uint8_t *body, size_t len, int64_t now)
+{
+    uint16_t alias_max = 0;
+    size_t properties_len;
+    int header;
+
+    if (len < 2 || body[1] >= 0x80) {
+        atomic_fetch_add(&stats.refused, 1);
+        node_down(worker, node, now);
+        return;
+    }
+
+    node->receive_maximum = 65535;
+    header = len > 2 ? get_varint(body + 2, len - 2, &properties_len) : 0;
+    if (header > 0 && 2 + header + properties_len <= len) {
+        parse_connack_properties(node, body + 2 + header, properties_len, &alias_max);
+    }
+
+    // topic aliases are per connection, as in client_publish()
+    if (alias_max > TOPIC_ALIAS_MAX) {
+        alias_max = TOPIC_ALIAS_MAX;
+    }
+    topic_alias_reset(&node->aliases, options.aliases ? alias_max : 0);
+
+    node->state = NODE_ONLINE;
+    atomic_fetch_add(&stats.online, 1);
+    atomic_fetch_add(&stats.connects, 1);
+    hist_record(&stats.connack, now - node->connect_us);
+    conn_policy_event(&node->policy, CONN_EVENT_MQTT_UP, policy_ms(now), next_random(worker));
+}
+
+static void node_puback(node_t *node, const uint8_t *body, size_t len, int64_t now)
+{
+    if (len < 2) {
+        return;
+    }
+
+    uint16_t packet_id = (body[0] << 8) | body[1];
+    inflight_t *slot = &node->inflight[packet_id % NODE_INFLIGHT_SLOTS];
+
+    if (slot->packet_id != packet_id) {
+        return;
+    }
+    if (len >= 3 && body[2] >= 0x80) {
+        atomic_fetch_add(&stats.publish_errors, 1);
+    }
+    atomic_fetch_add(&stats.pubacks, 1);
+    hist_record(&stats.puback, now - slot->sent_us);
+    slot->packet_id = 0;
+    node->inflight_count--;
+}
+
+static void node_receive(worker_t *worker, node_t *node, int64_t now)
+{
+    for (;;) {
+        ssize_t received = recv(node->fd, node->rx + node->rx_len, NODE_RX_SIZE - node->rx_len, 0);
+
+        if (received == 0 || (received < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) {
+            node_down(worker, node, now);
+            return;
+        }
+        if (received < 0) {
+            break;
+        }
+        node->rx_len += received;
+
+        // every complete packet in the buffer
+        size_t pos = 0;
+        while (node->rx_len - pos >= 2) {
+            size_t body_len;
+            int header = get_varint(node->rx + pos + 1, node->rx_len - pos - 1, &body_len);
+
+            if (header < 0 || 1 + header + body_len > NODE_RX_SIZE) {
+                node_down(worker, node, now);
+                return;
+            }
+            if (header == 0 || node->rx_len - pos < 1 + header + body_len) {
+                break;
+            }
+
+            uint8_t type = node->rx[pos] & 0xf0;
+            const uint8_t *body = node->rx + pos + 1 + header;
+
+            pos += 1 + header + body_len;
+            if (type == MQTT_CONNACK && node->state == NODE_WAIT_CONNACK) {
+                node_connack(worker, node, body, body_len, now);
+            } else if (type == MQTT_PUBACK && node->state == NODE_ONLINE) {
+                node_puback(node, body, body_len, now);
+            } else if (type == MQTT_DISCONNECT) {
+                node_down(worker, node, now);
+                return;
+            }
+            if (node->state == NODE_OFFLINE) {
+                return;
+            }
+        }
+        memmove(node->rx, node->rx + pos, node->rx_len - pos);
+        node->rx_len -= pos;
+    }
+}
+
+/* Next free packet id whose slot is free, 0 if Receive Maximum publishes are in flight */
+static uint16_t node_packet_id(node_t *node)
+{
+    uint16_t limit = node->receive_maximum < NODE_INFLIGHT_SLOTS ? node->receive_maximum : NODE_INFLIGHT_SLOTS;
+
+    if (node->inflight_count >= limit) {
+        return 0;
+    }
+    for (int tries = 0; tries < NODE_INFLIGHT_SLOTS; tries++) {
+        uint16_t packet_id = ++node->next_packet_id;
+
+        if (packet_id == 0) {
+            packet_id = node->next_packet_id = 1;
+        }
+        if (node->inflight[packet_id % NODE_INFLIGHT_SLOTS].packet_id == 0) {
+            return packet_id;
+        }
+    }
+    return 0;
+}
+
+static bool node_publish(node_t *node, int topic_index, const void *payload, size_t len, int64_t now)
+{
+    uint8_t packet[NODE_TX_SIZE];
+    const char *topic = node->topics[topic_index];
+    uint16_t packet_id = node_packet_id(node);
+    bool established = false;
+
+    if (packet_id == 0) {
+        atomic_fetch_add(&stats.inflight_full, 1);
+        return true;
+    }
+
+    uint16_t alias = topic_alias_get(&node->aliases, topic, &established);
+    size_t size = encode_publish(established ? "" : topic, alias, packet_id, payload, len, packet, sizeof(packet));
+    if (size == 0 || !node_queue(node, packet, size, now)) {
+        atomic_fetch_add(&stats.inflight_full, 1);
+        return true;
+    }
+    if (alias > 0 && !established) {
+        topic_alias_confirm(&node->aliases, alias);
+    }
+
+    node->inflight[packet_id % NODE_INFLIGHT_SLOTS] = (inflight_t) { .packet_id = packet_id, .sent_us = now };
+    node->inflight_count++;
+    atomic_fetch_add(&stats.publishes, 1);
+    atomic_fetch_add(&stats.wire_bytes, size);
+    return true;
+}
+
+/* One sample: the values drift, then go out as a frame or as the four per-value topics */
+static void node_sample(worker_t *worker, node_t *node, int64_t now)
+{
+    sensor_frame_t *frame = &node->frame;
+
+    frame->seq = ++node->seq;
+    frame->timestamp = (uint32_t)time(NULL);
+    frame->temperature += (int16_t)(next_random(worker) % 3) - 1;
+    frame->humidity += (int16_t)(next_random(worker) % 5) - 2;
+    atomic_fetch_add(&stats.samples, 1);
+
+    if (node->state != NODE_ONLINE) {
+        atomic_fetch_add(&stats.offline_samples, 1);
+        return;
+    }
+
+    if (options.frame) {
+        uint8_t payload[PAYLOAD_MAX_SIZE];
+        int len = payload_encode(options.format, frame, payload, sizeof(payload));
+
+        if (len > 0) {
+            node_publish(node, TOPIC_FRAME, payload, len, now);
+        }
+    } else {
+        static const struct {
+            int topic;
+            size_t offset;
+            bool is_signed;
+            uint32_t den;
+        } values[] = {
+                { TOPIC_HUMIDITY, offsetof(sensor_frame_t, humidity), false, FIXED_DHT_DEN },
+                { TOPIC_TEMPERATURE, offsetof(sensor_frame_t, temperature), true, FIXED_DHT_DEN },
+                { TOPIC_VOLTAGE, offsetof(sensor_frame_t, voltage), false, FIXED_VCELL_DEN },
+                { TOPIC_SOC, offsetof(sensor_frame_t, soc), false, FIXED_SOC_DEN },
+        };
+
+        for (size_t i = 0; i < sizeof(values) / sizeof(values[0]); i++) {
+            const uint8_t *field = (const uint8_t *)frame + values[i].offset;
+            int32_t raw = values[i].is_signed ? *(const int16_t *)field : *(const uint16_t *)field;
+            char string[FIXED_STRING_SIZE];
+            int len = fixed_format(raw, values[i].den, string, sizeof(string));
+
+            node_publish(node, values[i].topic, string, len, now);
+        }
+    }
+
+    if (!node_flush(worker, node)) {
+        node_down(worker, node, now);
+    }
+}
+
+/* Timers of one node: connect ramp, conn_policy, keepalive and sampling. Returns the next deadline. */
+static int64_t node_poll(worker_t *worker, node_t *node, int64_t now)
+{
+    int64_t interval_us = (int64_t)options.interval_ms * 1000;
+
+    if (now < node->start_us) {
+        return node->start_us;
+    }
+    if (node->policy.wifi.state != CONN_LINK_UP) {
+        // power-up: the station got its IP, the broker may be tried
+        conn_policy_init(&node->policy, &conn_config, policy_ms(now));
+        conn_policy_event(&node->policy, CONN_EVENT_WIFI_UP, policy_ms(now), next_random(worker));
+    }
+
+    conn_action_t action = conn_policy_poll(&node->policy, policy_ms(now), next_random(worker));
+    if (node->state != NODE_OFFLINE && node->state != NODE_ONLINE &&
+        node->policy.mqtt.state != CONN_LINK_CONNECTING) {
+        // conn_policy gave up on the attempt in progress
+        atomic_fetch_add(&stats.connect_failures, 1);
+        node_close(worker, node);
+    }
+    if (action == CONN_ACTION_CONNECT_MQTT && node->state == NODE_OFFLINE) {
+        node_connect(worker, node, now);
+    }
+
+    if (node->state == NODE_ONLINE && now - node->last_tx_us >= MQTT_SESSION_KEEPALIVE_SEC * 1000000LL / 2) {
+        const uint8_t ping[] = { MQTT_PINGREQ, 0 };
+
+        if (!node_queue(node, ping, sizeof(ping), now) || !node_flush(worker, node)) {
+            node_down(worker, node, now);
+        }
+    }
+
+    if (now >= node->next_sample_us) {
+        int64_t jitter = interval_us * options.jitter_pct / 100;
+
+        node_sample(worker, node, now);
+        node->next_sample_us += interval_us;
+        if (jitter > 0) {
+            node->next_sample_us += (int64_t)(next_random(worker) % (2 * jitter + 1)) - jitter;
+        }
+        if (node->next_sample_us <= now) {
+            node->next_sample_us = now + interval_us;
+        }
+    }
+
+    int64_t next = node->next_sample_us;
+    if (node->state == NODE_ONLINE && node->last_tx_us + MQTT_SESSION_KEEPALIVE_SEC * 1000000LL / 2 < next) {
+        next = node->last_tx_us + MQTT_SESSION_KEEPALIVE_SEC * 1000000LL / 2;
+    }
+    uint32_t policy_next = conn_policy_next_ms(&node->policy, policy_ms(now));
+    if (policy_next != UINT32_MAX && now + (int64_t)policy_next * 1000 < next) {
+        next = now + (int64_t)policy_next * 1000;
+    }
+    return next;
+}
+
+/* == Workers ============================================================= */
+
+static void storm(worker_t *worker, int64_t now)
+{
+    for (size_t i = 0; i < worker->count; i++) {
+        node_t *node = &worker->nodes[i];
+
+        if (node->state == NODE_ONLINE && next_random(worker) % 100 < options.storm_pct) {
+            node_down(worker, node, now);
+        }
+    }
+}
+
+static void *worker_run(void *arg)
+{
+    worker_t *worker = arg;
+    struct epoll_event events[256];
+
+    while (!atomic_load(&stopping)) {
+        int64_t now = now_us();
+
+        if (worker->next_storm_us > 0 && now >= worker->next_storm_us) {
+            storm(worker, now);
+            worker->next_storm_us += (int64_t)options.storm_every_s * 1000000;
+        }
+
+        // the timers of all nodes are only walked when one is due, not on every PUBACK
+        if (now >= worker->next_poll_us) {
+            worker->next_poll_us = now + 100000;
+            for (size_t i = 0; i < worker->count; i++) {
+                int64_t deadline = node_poll(worker, &worker->nodes[i], now);
+                if (deadline < worker->next_poll_us) {
+                    worker->next_poll_us = deadline;
+                }
+            }
+        }
+
+        int64_t next = worker->next_poll_us;
+        if (worker->next_storm_us > 0 && worker->next_storm_us < next) {
+            next = worker->next_storm_us;
+        }
+        int timeout_ms = next > now ? (int)((next - now + 999) / 1000) : 0;
+        int count = epoll_wait(worker->epoll, events, sizeof(events) / sizeof(events[0]), timeout_ms);
+
+        now = now_us();
+        for (int i = 0; i < count; i++) {
+            node_t *node = events[i].data.ptr;
+
+            if (node->fd < 0) {
+                continue;
+            }
+            if (node->state == NODE_TCP_CONNECTING) {
+                node_tcp_connected(worker, node, now);
+                continue;
+            }
+            if ((events[i].events & EPOLLOUT) && !node_flush(worker, node)) {
+                node_down(worker, node, now);
+                continue;
+            }
+            if (events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP)) {
+                node_receive(worker, node, now);
+            }
+        }
+    }
+
+    for (size_t i = 0; i < worker->count; i++) {
+        node_t *node = &worker->nodes[i];
+
+        if (node->state == NODE_ONLINE) {
+            // a clean DISCONNECT, no will
+            const uint8_t disconnect[] = { MQTT_DISCONNECT, 0 };
+            send(node->fd, disconnect, sizeof(disconnect), MSG_NOSIGNAL);
+        }
+        node_close(worker, node);
+    }
+    return NULL;
+}
+
+/* == Reports ============================================================= */
+
+typedef struct {
+    uint64_t publishes;
+    uint64_t pubacks;
+    uint64_t connects;
+    uint64_t drops;
+    uint64_t puback[HIST_BUCKETS];
+} report_t;
+
+static void report_interval(report_t *last, int64_t elapsed_us)
+{
+    static uint64_t counts[HIST_BUCKETS];
+    uint64_t publishes = atomic_load(&stats.publishes);
+    uint64_t pubacks = atomic_load(&stats.pubacks);
+    uint64_t connects = atomic_load(&stats.connects);
+    uint64_t drops = atomic_load(&stats.drops);
+    uint64_t total = hist_snapshot(&stats.puback, counts, last->puback);
+
+    printf("%6.1f s  online %6d  connects %+5" PRId64 "  drops %+5" PRId64 "  publish %8" PRIu64 "/s  puback %8"
+           PRIu64 "/s  unacked %6" PRId64 "  p50 %7.2f ms  p99 %7.2f ms\n",
+           elapsed_us / 1e6, (int)atomic_load(&stats.online), (int64_t)(connects - last->connects),
+           (int64_t)(drops - last->drops),
+           publishes - last->publishes, pubacks - last->pubacks, (int64_t)(publishes - pubacks),
+           hist_percentile_ms(counts, total, 50), hist_percentile_ms(counts, total, 99));
+    fflush(stdout);
+
+    last->publishes = publishes;
+    last->pubacks = pubacks;
+    last->connects = connects;
+    last->drops = drops;
+    hist_snapshot(&stats.puback, last->puback, NULL);
+}
+
+static void report_histogram(const char *name, const histogram_t *histogram)
+{
+    static uint64_t counts[HIST_BUCKETS];
+    uint64_t total = hist_snapshot(histogram, counts, NULL);
+
+    printf("%-8s latency: %" PRIu64 " samples, p50 %.2f ms, p90 %.2f ms, p99 %.2f ms, p99.9 %.2f ms, max %.2f ms\n",
+           name, total, hist_percentile_ms(counts, total, 50), hist_percentile_ms(counts, total, 90),
+           hist_percentile_ms(counts, total, 99), hist_percentile_ms(counts, total, 99.9),
+           atomic_load(&histogram->max_us) / 1000.0);
+}
+
+static void report_summary(int64_t elapsed_us)
+{
+    double seconds = elapsed_us / 1e6;
+    uint64_t publishes = atomic_load(&stats.publishes);
+    uint64_t pubacks = atomic_load(&stats.pubacks);
+
+    printf("\n%u nodes, %.1f s, %s\n", options.nodes, seconds,
+           options.frame ? "frames" : "per-value topics");
+    printf("samples  %" PRIu64 ", %" PRIu64 " while offline, %" PRIu64 " with Receive Maximum publishes in flight\n",
+           (uint64_t)atomic_load(&stats.samples), (uint64_t)atomic_load(&stats.offline_samples),
+           (uint64_t)atomic_load(&stats.inflight_full));
+    printf("publish  %" PRIu64 " (%.0f/s, %.0f bytes/s), puback %" PRIu64 " (%.0f/s), %" PRIu64 " with an error\n",
+           publishes, publishes / seconds, atomic_load(&stats.wire_bytes) / seconds, pubacks, pubacks / seconds,
+           (uint64_t)atomic_load(&stats.publish_errors));
+    printf("connect  %" PRIu64 " accepted, %" PRIu64 " refused, %" PRIu64 " failed, %" PRIu64 " dropped\n",
+           (uint64_t)atomic_load(&stats.connects), (uint64_t)atomic_load(&stats.refused),
+           (uint64_t)atomic_load(&stats.connect_failures), (uint64_t)atomic_load(&stats.drops));
+    report_histogram("PUBACK", &stats.puback);
+    report_histogram("CONNACK", &stats.connack);
+}
+
+static void on_signal(int signal)
+{
+    atomic_store(&stopping, true);
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr, "usage: %s [-h host] [-p port] [-u user] [-P password] [-n nodes] [-w workers] "
+                    "[-c connects/s] [-i interval_ms] [-j jitter_pct] [-d seconds] [-s storm_every_s] "
+                    "[-S storm_pct] [-f json|cbor|binary] [-A] [-t prefix]\n", name);
+}
+
+int main(int argc, char **argv)
+{
+    struct addrinfo hints = { .ai_family = AF_UNSPEC, .ai_socktype = SOCK_STREAM };
+    struct timespec start;
+    report_t last = { 0 };
+    int opt;
+
+    while ((opt = getopt(argc, argv, "h:p:u:P:n:w:c:i:j:d:s:S:f:At:")) != -1) {
+        switch (opt) {
+            case 'h': options.host = optarg; break;
+            case 'p': options.port = optarg; break;
+            case 'u': options.username = optarg; break;
+            case 'P': options.password = optarg; break;
+            case 'n': options.nodes = (uint32_t)atoi(optarg); break;
+            case 'w': options.workers = (uint32_t)atoi(optarg); break;
+            case 'c': options.connects_per_s = (uint32_t)atoi(optarg); break;
+            case 'i': options.interval_ms = (uint32_t)atoi(optarg); break;
+            case 'j': options.jitter_pct = (uint32_t)atoi(optarg); break;
+            case 'd': options.duration_s = (uint32_t)atoi(optarg); break;
+            case 's': options.storm_every_s = (uint32_t)atoi(optarg); break;
+            case 'S': options.storm_pct = (uint32_t)atoi(optarg); break;
+            case 'A': options.aliases = false; break;
+            case 't': options.prefix = optarg; break;
+            case 'f':
+                options.frame = true;
+                if (strcmp(optarg, "json") == 0) {
+                    options.format = PAYLOAD_FORMAT_JSON;
+                } else if (strcmp(optarg, "cbor") == 0) {
+                    options.format = PAYLOAD_FORMAT_CBOR;
+                } else if (strcmp(optarg, "binary") == 0) {
+                    options.format = PAYLOAD_FORMAT_BINARY;
+                } else {
+                    usage(argv[0]);
+                    return 2;
+                }
+                break;
+            default:
+                usage(argv[0]);
+                return 2;
+        }
+    }
+    if (options.nodes == 0 || options.workers == 0 || options.connects_per_s == 0 || options.interval_ms == 0 ||
+        options.jitter_pct > 100 || options.storm_pct > 100) {
+        usage(argv[0]);
+        return 2;
+    }
+    if (options.workers > options.nodes) {
+        options.workers = options.nodes;
+    }
+
+    int error = getaddrinfo(options.host, options.port, &hints, &broker);
+    if (error != 0) {
+        fprintf(stderr, "%s:%s: %s\n", options.host, options.port, gai_strerror(error));
+        return 2;
+    }
+
+    signal(SIGINT, on_signal);
+    signal(SIGTERM, on_signal);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    epoch_us = (int64_t)start.tv_sec * 1000000 + start.tv_nsec / 1000;
+
+    node_t *nodes = calloc(options.nodes, sizeof(node_t));
+    worker_t *workers = calloc(options.workers, sizeof(worker_t));
+    if (nodes == NULL || workers == NULL) {
+        fprintf(stderr, "Out of memory for %u nodes\n", options.nodes);
+        return 2;
+    }
+
+    printf("%u nodes on %u workers against %s:%s, a sample every %u ms +-%u %%, %s\n", options.nodes,
+           options.workers, options.host, options.port, options.interval_ms, options.jitter_pct,
+           options.frame ? "frames" : "per-value topics");
+
+    // nodes are interleaved over the workers so the connect ramp spreads over all of them
+    for (uint32_t w = 0, first = 0; w < options.workers; w++) {
+        worker_t *worker = &workers[w];
+        uint32_t count = options.nodes / options.workers + (w < options.nodes % options.workers ? 1 : 0);
+
+        worker->nodes = &nodes[first];
+        worker->count = count;
+        worker->random = 0x9e3779b97f4a7c15ull * (w + 1);
+        worker->epoll = epoll_create1(0);
+        worker->next_storm_us = options.storm_every_s > 0 ? (int64_t)options.storm_every_s * 1000000 : 0;
+        for (uint32_t i = 0; i < count; i++) {
+            node_init(&worker->nodes[i], first + i, worker);
+        }
+        first += count;
+    }
+    for (uint32_t w = 0; w < options.workers; w++) {
+        pthread_create(&workers[w].thread, NULL, worker_run, &workers[w]);
+    }
+
+    int64_t end_us = (int64_t)options.duration_s * 1000000;
+    int64_t next_report = 1000000;
+    while (!atomic_load(&stopping) && now_us() < end_us) {
+        int64_t now = now_us();
+
+        if (now >= next_report) {
+            report_interval(&last, now);
+            next_report += 1000000;
+        }
+        usleep(10000);
+    }
+    int64_t elapsed = now_us();
+    atomic_store(&stopping, true);
+
+    for (uint32_t w = 0; w < options.workers; w++) {
+        pthread_join(workers[w].thread, NULL);
+        close(workers[w].epoll);
+    }
+    report_summary(elapsed);
+
+    freeaddrinfo(broker);
+    free(workers);
+    free(nodes);
+    return atomic_load(&stats.pubacks) > 0 ? 0 : 1;
+}
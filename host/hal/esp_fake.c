@@ -0,0 +1,751 @@
+#include <malloc.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp_app_desc.h"
+#include "esp_err.h"
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "esp_ota_ops.h"
+#include "esp_partition.h"
+#include "esp_random.h"
+#include "esp_sleep.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "nvs.h"
+#include "nvs_flash.h"
+#include "sim.h"
+
+/* Heap the firmware would see on the device, malloc use of the process is taken off it */
+#define SIM_HEAP_SIZE       (300 * 1024)
+#define SIM_FLASH_SECTOR    4096
+#define SIM_FLASH_PAGE      256
+#define SIM_ERASE_US        45000   /*!< one sector, typical of the flash of an ESP32 module */
+#define SIM_PAGE_US         400     /*!< programming one page */
+
+const char *esp_err_to_name(esp_err_t code)
+{
+    switch (code) {
+        case ESP_OK:
+            return "ESP_OK";
+        case ESP_FAIL:
+            return "ESP_FAIL";
+        case ESP_ERR_NO_MEM:
+            return "ESP_ERR_NO_MEM";
+        case ESP_ERR_INVALID_ARG:
+            return "ESP_ERR_INVALID_ARG";
+        case ESP_ERR_INVALID_STATE:
+            return "ESP_ERR_INVALID_STATE";
+        case ESP_ERR_INVALID_SIZE:
+            return "ESP_ERR_INVALID_SIZE";
+        case ESP_ERR_NOT_FOUND:
+            return "ESP_ERR_NOT_FOUND";
+        case ESP_ERR_NOT_SUPPORTED:
+            return "ESP_ERR_NOT_SUPPORTED";
+        case ESP_ERR_TIMEOUT:
+            return "ESP_ERR_TIMEOUT";
+        case ESP_ERR_INVALID_RESPONSE:
+            return "ESP_ERR_INVALID_RESPONSE";
+        case ESP_ERR_INVALID_CRC:
+            return "ESP_ERR_INVALID_CRC";
+        case ESP_ERR_NOT_FINISHED:
+            return "ESP_ERR_NOT_FINISHED";
+        case ESP_ERR_NVS_NOT_FOUND:
+            return "ESP_ERR_NVS_NOT_FOUND";
+        case ESP_ERR_OTA_PARTITION_CONFLICT:
+            return "ESP_ERR_OTA_PARTITION_CONFLICT";
+        case ESP_ERR_OTA_SELECT_INFO_INVALID:
+            return "ESP_ERR_OTA_SELECT_INFO_INVALID";
+        case ESP_ERR_OTA_VALIDATE_FAILED:
+            return "ESP_ERR_OTA_VALIDATE_FAILED";
+        case ESP_ERR_OTA_ROLLBACK_INVALID_STATE:
+            return "ESP_ERR_OTA_ROLLBACK_INVALID_STATE";
+        default:
+            return "UNKNOWN ERROR";
+    }
+}
+
+/* == Logging ============================================================= */
+
+static esp_log_level_t app_level = ESP_LOG_INFO;
+static esp_log_level_t max_level = ESP_LOG_WARN;
+static vprintf_like_t log_vprintf = vprintf;
+
+void sim_log_set_max_level(int level)
+{
+    max_level = level;
+}
+
+void esp_log_level_set(const char *tag, esp_log_level_t level)
+{
+    // only the default level is kept, per-tag levels are not needed on the host
+    if (strcmp(tag, "*") == 0) {
+        app_level = level;
+    }
+}
+
+vprintf_like_t esp_log_set_vprintf(vprintf_like_t func)
+{
+    vprintf_like_t previous = log_vprintf;
+
+    log_vprintf = func;
+    return previous;
+}
+
+void esp_log_write(esp_log_level_t level, const char *tag, const char *format, ...)
+{
+    if (level > app_level || level > max_level) {
+        return;
+    }
+
+    va_list args;
+    va_start(args, format);
+    log_vprintf(format, args);
+    va_end(args);
+}
+
+uint32_t esp_log_timestamp(void)
+{
+    return (uint32_t)(sim_now_us() / 1000);
+}
+
+/* == System ============================================================== */
+
+int64_t esp_timer_get_time(void)
+{
+    return sim_now_us();
+}
+
+void esp_rom_delay_us(uint32_t us)
+{
+    sim_advance_us(us);
+}
+
+uint32_t esp_get_free_heap_size(void)
+{
+    struct mallinfo2 info = mallinfo2();
+    return info.uordblks < SIM_HEAP_SIZE ? SIM_HEAP_SIZE - (uint32_t)info.uordblks : 0;
+}
+
+uint32_t esp_get_minimum_free_heap_size(void)
+{
+    static uint32_t minimum = SIM_HEAP_SIZE;
+    uint32_t free_heap = esp_get_free_heap_size();
+
+    if (free_heap < minimum) {
+        minimum = free_heap;
+    }
+
+    return minimum;
+}
+
+size_t heap_caps_get_largest_free_block(uint32_t caps)
+{
+    return esp_get_free_heap_size();
+}
+
+const char *esp_get_idf_version(void)
+{
+    return "host";
+}
+
+const esp_app_desc_t *esp_app_get_description(void)
+{
+    static const esp_app_desc_t description = {
+            .version = HOST_APP_VERSION,
+            .project_name = "esp32-temp",
+            .time = __TIME__,
+            .date = __DATE__,
+            .idf_ver = "host",
+    };
+
+    return &description;
+}
+
+void esp_restart(void)
+{
+    printf("esp_restart() at %" PRId64 " us\n", sim_now_us());
+    exit(3);
+}
+
+uint32_t esp_random(void)
+{
+    // xorshift32, fixed seed so every run takes the same jitter
+    static uint32_t state = 0x2545F491;
+
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
+esp_err_t esp_sleep_enable_timer_wakeup(uint64_t time_in_us)
+{
+    return ESP_OK;
+}
+
+void esp_deep_sleep_start(void)
+{
+    printf("esp_deep_sleep_start() at %" PRId64 " us\n", sim_now_us());
+    exit(0);
+}
+
+/* == NVS ================================================================= */
+
+#define NVS_MAX_ENTRIES     16
+#define NVS_MAX_HANDLES     8
+#define NVS_NAME_SIZE       16      /*!< namespaces and keys, 15 characters as on the device */
+
+typedef struct {
+    char name[NVS_NAME_SIZE];       /*!< namespace */
+    char key[NVS_NAME_SIZE];
+    uint32_t size;
+    uint8_t *data;
+} nvs_entry_t;
+
+typedef struct {
+    bool open;
+    bool writable;
+    char name[NVS_NAME_SIZE];
+} nvs_open_handle_t;
+
+static nvs_entry_t nvs_entries[NVS_MAX_ENTRIES];
+static size_t nvs_entry_count = 0;
+static nvs_open_handle_t nvs_handles[NVS_MAX_HANDLES];
+static const char *nvs_file = NULL;
+
+static void nvs_clear(void)
+{
+    for (size_t i = 0; i < nvs_entry_count; i++) {
+        free(nvs_entries[i].data);
+    }
+    nvs_entry_count = 0;
+}
+
+/* The file holds the entries one after the other: namespace, key, size (host byte order), data */
+static void nvs_save(void)
+{
+    if (nvs_file == NULL) {
+        return;
+    }
+
+    FILE *file = fopen(nvs_file, "wb");
+    if (file == NULL) {
+        perror(nvs_file);
+        return;
+    }
+
+    for (size_t i = 0; i < nvs_entry_count; i++) {
+        const nvs_entry_t *entry = &nvs_entries[i];
+
+        fwrite(entry->name, sizeof(entry->name), 1, file);
+        fwrite(entry->key, sizeof(entry->key), 1, file);
+        fwrite(&entry->size, sizeof(entry->size), 1, file);
+        fwrite(entry->data, entry->size, 1, file);
+    }
+
+    fclose(file);
+}
+
+void sim_nvs_set_file(const char *path)
+{
+    nvs_clear();
+    nvs_file = path;
+
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) {
+        return;
+    }
+
+    nvs_entry_t entry;
+    while (nvs_entry_count < NVS_MAX_ENTRIES && fread(entry.name, sizeof(entry.name), 1, file) == 1 &&
+           fread(entry.key, sizeof(entry.key), 1, file) == 1 && fread(&entry.size, sizeof(entry.size), 1, file) == 1) {
+        entry.data = malloc(entry.size > 0 ? entry.size : 1);
+        if (entry.data == NULL || fread(entry.data, 1, entry.size, file) != entry.size) {
+            free(entry.data);
+            break;
+        }
+        entry.name[NVS_NAME_SIZE - 1] = '\0';
+        entry.key[NVS_NAME_SIZE - 1] = '\0';
+        nvs_entries[nvs_entry_count++] = entry;
+    }
+
+    fclose(file);
+}
+
+static nvs_entry_t *nvs_find(const char *name, const char *key)
+{
+    for (size_t i = 0; i < nvs_entry_count; i++) {
+        if (strcmp(nvs_entries[i].name, name) == 0 && (key == NULL || strcmp(nvs_entries[i].key, key) == 0)) {
+            return &nvs_entries[i];
+        }
+    }
+
+    return NULL;
+}
+
+static nvs_open_handle_t *nvs_handle_get(nvs_handle_t handle)
+{
+    if (handle == 0 || handle > NVS_MAX_HANDLES || !nvs_handles[handle - 1].open) {
+        return NULL;
+    }
+
+    return &nvs_handles[handle - 1];
+}
+
+esp_err_t nvs_flash_init(void)
+{
+    return ESP_OK;
+}
+
+esp_err_t nvs_flash_erase(void)
+{
+    nvs_clear();
+    nvs_save();
+    return ESP_OK;
+}
+
+esp_err_t nvs_open(const char *name, nvs_open_mode_t open_mode, nvs_handle_t *out_handle)
+{
+    if (strlen(name) >= NVS_NAME_SIZE) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    // as on the device, a namespace only exists once something was written to it
+    if (open_mode == NVS_READONLY && nvs_find(name, NULL) == NULL) {
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+
+    for (size_t i = 0; i < NVS_MAX_HANDLES; i++) {
+        if (!nvs_handles[i].open) {
+            nvs_handles[i] = (nvs_open_handle_t) { .open = true, .writable = open_mode == NVS_READWRITE };
+            strcpy(nvs_handles[i].name, name);
+            *out_handle = (nvs_handle_t)(i + 1);
+            return ESP_OK;
+        }
+    }
+
+    return ESP_ERR_NO_MEM;
+}
+
+esp_err_t nvs_get_blob(nvs_handle_t handle, const char *key, void *out_value, size_t *length)
+{
+    nvs_open_handle_t *open = nvs_handle_get(handle);
+    if (open == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    nvs_entry_t *entry = nvs_find(open->name, key);
+    if (entry == NULL) {
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+
+    if (out_value == NULL) {
+        *length = entry->size;
+        return ESP_OK;
+    }
+    if (*length < entry->size) {
+        return ESP_ERR_NVS_INVALID_LENGTH;
+    }
+
+    memcpy(out_value, entry->data, entry->size);
+    *length = entry->size;
+    return ESP_OK;
+}
+
+esp_err_t nvs_set_blob(nvs_handle_t handle, const char *key, const void *value, size_t length)
+{
+    nvs_open_handle_t *open = nvs_handle_get(handle);
+    if (open == NULL || !open->writable || strlen(key) >= NVS_NAME_SIZE) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    uint8_t *data = malloc(length > 0 ? length : 1);
+    if (data == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    memcpy(data, value, length);
+
+    nvs_entry_t *entry = nvs_find(open->name, key);
+    if (entry == NULL) {
+        if (nvs_entry_count == NVS_MAX_ENTRIES) {
+            free(data);
+            return ESP_ERR_NVS_NOT_ENOUGH_SPACE;
+        }
+        entry = &nvs_entries[nvs_entry_count++];
+        strcpy(entry->name, open->name);
+        strcpy(entry->key, key);
+    } else {
+        free(entry->data);
+    }
+
+    entry->data = data;
+    entry->size = (uint32_t)length;
+    return ESP_OK;
+}
+
+esp_err_t nvs_commit(nvs_handle_t handle)
+{
+    if (nvs_handle_get(handle) == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    nvs_save();
+    return ESP_OK;
+}
+
+void nvs_close(nvs_handle_t handle)
+{
+    nvs_open_handle_t *open = nvs_handle_get(handle);
+
+    if (open != NULL) {
+        open->open = false;
+    }
+}
+
+/* == Flash partitions ==================================================== */
+
+typedef struct {
+    esp_partition_t partition;
+    uint8_t *data;
+} sim_partition_t;
+
+/* The partitions of partitions.csv the firmware looks up, the OTA slots first */
+static sim_partition_t partitions[] = {
+        { { ESP_PARTITION_TYPE_APP, ESP_PARTITION_SUBTYPE_APP_OTA_0, 0x20000, 1024 * 1024, SIM_FLASH_SECTOR, "ota_0" },
+          NULL },
+        { { ESP_PARTITION_TYPE_APP, ESP_PARTITION_SUBTYPE_APP_OTA_1, 0x120000, 1024 * 1024, SIM_FLASH_SECTOR, "ota_1" },
+          NULL },
+        { { ESP_PARTITION_TYPE_DATA, 0x40, 0x220000, 64 * 1024, SIM_FLASH_SECTOR, "samples" }, NULL },
+};
+
+#define PARTITION_COUNT (sizeof(partitions) / sizeof(partitions[0]))
+#define OTA_SLOTS       2
+
+static sim_partition_t *find_partition(const esp_partition_t *partition)
+{
+    for (size_t i = 0; i < PARTITION_COUNT; i++) {
+        if (&partitions[i].partition == partition) {
+            return &partitions[i];
+        }
+    }
+
+    return NULL;
+}
+
+static bool partition_mapped(sim_partition_t *entry)
+{
+    if (entry->data == NULL) {
+        // erased flash reads as all ones
+        entry->data = malloc(entry->partition.size);
+        if (entry->data == NULL) {
+            return false;
+        }
+        memset(entry->data, 0xFF, entry->partition.size);
+    }
+
+    return true;
+}
+
+const esp_partition_t *esp_partition_find_first(esp_partition_type_t type, esp_partition_subtype_t subtype,
+                                                const char *label)
+{
+    for (size_t i = 0; i < PARTITION_COUNT; i++) {
+        sim_partition_t *entry = &partitions[i];
+
+        if (entry->partition.type != type ||
+            (subtype != ESP_PARTITION_SUBTYPE_ANY && entry->partition.subtype != subtype) ||
+            (label != NULL && strcmp(entry->partition.label, label) != 0)) {
+            continue;
+        }
+
+        return partition_mapped(entry) ? &entry->partition : NULL;
+    }
+
+    return NULL;
+}
+
+esp_err_t esp_partition_read(const esp_partition_t *partition, size_t offset, void *dst, size_t size)
+{
+    sim_partition_t *entry = find_partition(partition);
+
+    if (entry == NULL || offset + size > partition->size) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    memcpy(dst, entry->data + offset, size);
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_write(const esp_partition_t *partition, size_t offset, const void *src, size_t size)
+{
+    sim_partition_t *entry = find_partition(partition);
+    const uint8_t *bytes = src;
+
+    if (entry == NULL || offset + size > partition->size) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    // NOR flash: a write can only clear bits, setting them again takes an erase
+    for (size_t i = 0; i < size; i++) {
+        entry->data[offset + i] &= bytes[i];
+    }
+
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_erase_range(const esp_partition_t *partition, size_t offset, size_t size)
+{
+    sim_partition_t *entry = find_partition(partition);
+
+    if (entry == NULL || offset + size > partition->size || offset % partition->erase_size != 0 ||
+        size % partition->erase_size != 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    memset(entry->data + offset, 0xFF, size);
+    return ESP_OK;
+}
+
+/* == OTA ================================================================= */
+
+#define ESP_IMAGE_HEADER_MAGIC  0xE9
+
+/* otadata, as the bootloader would leave it. Without sim_ota_set_running() the node runs from ota_0. */
+static struct {
+    int running;
+    int boot;
+    int last_invalid;                       /*!< slot rolled back from, -1 if none */
+    esp_ota_img_states_t state[OTA_SLOTS];
+    esp_ota_handle_t handle;                /*!< the open update, 0 if none */
+    esp_ota_handle_t next_handle;
+    int slot;                               /*!< of the open update */
+    size_t written;
+    size_t erased;
+    bool sequential;
+} ota = {
+        .last_invalid = -1,
+        .state = { ESP_OTA_IMG_UNDEFINED, ESP_OTA_IMG_UNDEFINED },
+        .next_handle = 1,
+};
+
+static int ota_slot(const esp_partition_t *partition)
+{
+    for (int slot = 0; slot < OTA_SLOTS; slot++) {
+        if (partition == &partitions[slot].partition) {
+            return slot;
+        }
+    }
+
+    return -1;
+}
+
+static const esp_partition_t *ota_partition(int slot)
+{
+    return partition_mapped(&partitions[slot]) ? &partitions[slot].partition : NULL;
+}
+
+static esp_err_t ota_erase(size_t offset, size_t size)
+{
+    for (size_t end = offset + size; offset < end; offset += SIM_FLASH_SECTOR) {
+        esp_err_t err = esp_partition_erase_range(&partitions[ota.slot].partition, offset, SIM_FLASH_SECTOR);
+        if (err != ESP_OK) {
+            return err;
+        }
+        sim_advance_us(SIM_ERASE_US);
+    }
+
+    return ESP_OK;
+}
+
+void sim_ota_set_running(uint8_t slot, const void *image, size_t len, bool pending_verify)
+{
+    sim_partition_t *entry = &partitions[slot % OTA_SLOTS];
+
+    if (!partition_mapped(entry) || len > entry->partition.size) {
+        abort();
+    }
+    memset(entry->data, 0xFF, entry->partition.size);
+    memcpy(entry->data, image, len);
+
+    ota.running = slot % OTA_SLOTS;
+    ota.boot = ota.running;
+    ota.state[ota.running] = pending_verify ? ESP_OTA_IMG_PENDING_VERIFY : ESP_OTA_IMG_VALID;
+}
+
+esp_err_t esp_ota_begin(const esp_partition_t *partition, size_t image_size, esp_ota_handle_t *out_handle)
+{
+    int slot = ota_slot(partition);
+
+    if (slot < 0 || !partition_mapped(&partitions[slot])) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (slot == ota.running) {
+        return ESP_ERR_OTA_PARTITION_CONFLICT;
+    }
+    if (ota.handle != 0) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    ota.handle = ota.next_handle++;
+    ota.slot = slot;
+    ota.written = 0;
+    ota.erased = 0;
+    ota.sequential = image_size == OTA_WITH_SEQUENTIAL_WRITES;
+
+    if (!ota.sequential) {
+        size_t size = image_size == OTA_SIZE_UNKNOWN ? partition->size :
+                      (image_size + SIM_FLASH_SECTOR - 1) / SIM_FLASH_SECTOR * SIM_FLASH_SECTOR;
+        esp_err_t err = size <= partition->size ? ota_erase(0, size) : ESP_ERR_INVALID_SIZE;
+
+        if (err != ESP_OK) {
+            ota.handle = 0;
+            return err;
+        }
+        ota.erased = size;
+    }
+
+    *out_handle = ota.handle;
+    return ESP_OK;
+}
+
+esp_err_t esp_ota_write(esp_ota_handle_t handle, const void *data, size_t size)
+{
+    const esp_partition_t *partition = &partitions[ota.slot].partition;
+
+    if (handle == 0 || handle != ota.handle) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (ota.written + size > partition->size) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    if (ota.written == 0 && size > 0 && ((const uint8_t *)data)[0] != ESP_IMAGE_HEADER_MAGIC) {
+        return ESP_ERR_OTA_VALIDATE_FAILED;
+    }
+
+    // sequential writes erase each sector as the image reaches it
+    if (ota.sequential && ota.written + size > ota.erased) {
+        size_t end = (ota.written + size + SIM_FLASH_SECTOR - 1) / SIM_FLASH_SECTOR * SIM_FLASH_SECTOR;
+        esp_err_t err = ota_erase(ota.erased, end - ota.erased);
+
+        if (err != ESP_OK) {
+            return err;
+        }
+        ota.erased = end;
+    }
+
+    esp_err_t err = esp_partition_write(partition, ota.written, data, size);
+    if (err == ESP_OK) {
+        sim_advance_us((uint32_t)((size + SIM_FLASH_PAGE - 1) / SIM_FLASH_PAGE * SIM_PAGE_US));
+        ota.written += size;
+    }
+
+    return err;
+}
+
+esp_err_t esp_ota_end(esp_ota_handle_t handle)
+{
+    if (handle == 0 || handle != ota.handle) {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    // the handle is released even if the image is not valid
+    ota.handle = 0;
+    if (ota.written == 0 || partitions[ota.slot].data[0] != ESP_IMAGE_HEADER_MAGIC) {
+        return ESP_ERR_OTA_VALIDATE_FAILED;
+    }
+
+    return ESP_OK;
+}
+
+esp_err_t esp_ota_abort(esp_ota_handle_t handle)
+{
+    if (handle == 0 || handle != ota.handle) {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    ota.handle = 0;
+    return ESP_OK;
+}
+
+esp_err_t esp_ota_set_boot_partition(const esp_partition_t *partition)
+{
+    int slot = ota_slot(partition);
+
+    if (slot < 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (partitions[slot].data == NULL || partitions[slot].data[0] != ESP_IMAGE_HEADER_MAGIC) {
+        return ESP_ERR_OTA_VALIDATE_FAILED;
+    }
+
+    // with CONFIG_BOOTLOADER_APP_ROLLBACK_ENABLE the new image boots pending verification
+    ota.boot = slot;
+    if (slot != ota.running) {
+        ota.state[slot] = ESP_OTA_IMG_NEW;
+    }
+    return ESP_OK;
+}
+
+const esp_partition_t *esp_ota_get_boot_partition(void)
+{
+    return ota_partition(ota.boot);
+}
+
+const esp_partition_t *esp_ota_get_running_partition(void)
+{
+    return ota_partition(ota.running);
+}
+
+const esp_partition_t *esp_ota_get_next_update_partition(const esp_partition_t *start_from)
+{
+    int slot = start_from != NULL ? ota_slot(start_from) : ota.running;
+
+    return slot < 0 ? NULL : ota_partition((slot + 1) % OTA_SLOTS);
+}
+
+esp_err_t esp_ota_get_state_partition(const esp_partition_t *partition, esp_ota_img_states_t *ota_state)
+{
+    int slot = ota_slot(partition);
+
+    if (slot < 0 || ota_state == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (ota.state[slot] == ESP_OTA_IMG_UNDEFINED) {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    *ota_state = ota.state[slot];
+    return ESP_OK;
+}
+
+esp_err_t esp_ota_mark_app_valid_cancel_rollback(void)
+{
+    if (ota.state[ota.running] == ESP_OTA_IMG_PENDING_VERIFY) {
+        ota.state[ota.running] = ESP_OTA_IMG_VALID;
+    }
+
+    return ESP_OK;
+}
+
+esp_err_t esp_ota_mark_app_invalid_rollback_and_reboot(void)
+{
+    int previous = (ota.running + 1) % OTA_SLOTS;
+
+    if (partitions[previous].data == NULL || partitions[previous].data[0] != ESP_IMAGE_HEADER_MAGIC ||
+        ota.state[previous] == ESP_OTA_IMG_INVALID || ota.state[previous] == ESP_OTA_IMG_ABORTED) {
+        return ESP_ERR_OTA_ROLLBACK_INVALID_STATE;
+    }
+
+    ota.state[ota.running] = ESP_OTA_IMG_INVALID;
+    ota.last_invalid = ota.running;
+    ota.boot = previous;
+    esp_restart();
+}
+
+const esp_partition_t *esp_ota_get_last_invalid_partition(void)
+{
+    return ota.last_invalid >= 0 ? ota_partition(ota.last_invalid) : NULL;
+}
@@ -0,0 +1,834 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "sim.h"
+
+/*
+ * Every task is a thread, but a task only runs while it holds the baton (sim_lock with current == itself). A task
+ * gives the baton away when it blocks or yields, the highest priority ready task gets it, round robin among equal
+ * priorities. When no task is ready the clock jumps to the earliest deadline. Any change to a queue, event group or
+ * notification makes every blocked task re-check its condition, which is plenty for a handful of tasks.
+ */
+
+#define TICK_US     (1000000 / configTICK_RATE_HZ)
+#define NO_DEADLINE INT64_MAX
+#define RADIO_CORE  0
+
+typedef enum {
+    TASK_READY = 0,
+    TASK_BLOCKED,
+    TASK_DONE,
+} task_state_t;
+
+struct sim_task {
+    pthread_t thread;
+    pthread_cond_t baton;
+    TaskFunction_t function;
+    void *params;
+    char name[16];
+    UBaseType_t priority;
+    uint32_t stack_depth;
+    uint8_t *stack;                 /*!< heap block a dynamic task's stack takes on the device, never touched */
+    BaseType_t core;
+    task_state_t state;
+    bool suspended;
+    int64_t deadline_us;
+    uint32_t notify;
+    struct sim_task *next;
+};
+
+struct sim_queue {
+    uint8_t *storage;
+    UBaseType_t length;
+    UBaseType_t item_size;
+    UBaseType_t count;
+    UBaseType_t head;
+    struct sim_queue *set;
+};
+
+struct sim_event_group {
+    EventBits_t bits;
+};
+
+struct sim_timer {
+    char name[16];
+    TickType_t period;
+    bool auto_reload;
+    bool active;
+    int64_t expiry_us;
+    void *id;
+    TimerCallbackFunction_t callback;
+    struct sim_timer *next;
+};
+
+static pthread_mutex_t sim_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct sim_task *tasks = NULL;
+static struct sim_task *current = NULL;
+static int64_t now_us = 0;
+
+static struct sim_timer *timers = NULL;
+static TaskHandle_t timer_task = NULL;
+
+static int scheduler_suspended = 0;
+
+static uint32_t radio_period_us = 0;
+static uint32_t radio_busy_us = 0;
+static int64_t radio_next_us = 0;
+static int64_t radio_deferred_us = 0;
+static uint32_t radio_random = 1;
+
+/* == Scheduler =========================================================== */
+
+static void wake_expired(void)
+{
+    for (struct sim_task *task = tasks; task != NULL; task = task->next) {
+        if (task->state == TASK_BLOCKED && task->deadline_us <= now_us) {
+            task->state = TASK_READY;
+        }
+    }
+}
+
+/* Highest priority ready task, the ones after current first among equals */
+static struct sim_task *pick_next(void)
+{
+    struct sim_task *best = NULL;
+    struct sim_task *start = current != NULL && current->next != NULL ? current->next : tasks;
+    struct sim_task *task = start;
+
+    do {
+        if (task->state == TASK_READY && !task->suspended && (best == NULL || task->priority > best->priority)) {
+            best = task;
+        }
+        task = task->next != NULL ? task->next : tasks;
+    } while (task != start);
+
+    return best;
+}
+
+static int64_t earliest_deadline(void)
+{
+    int64_t earliest = NO_DEADLINE;
+
+    for (struct sim_task *task = tasks; task != NULL; task = task->next) {
+        if (task->state == TASK_BLOCKED && task->deadline_us < earliest) {
+            earliest = task->deadline_us;
+        }
+    }
+
+    return earliest;
+}
+
+/* Hands the baton to the next task and waits until it comes back, called with sim_lock held */
+static void schedule(void)
+{
+    struct sim_task *self = current;
+    struct sim_task *next;
+
+    wake_expired();
+    while ((next = pick_next()) == NULL) {
+        int64_t earliest = earliest_deadline();
+
+        if (earliest == NO_DEADLINE) {
+            fprintf(stderr, "sim: every task is blocked forever\n");
+            exit(2);
+        }
+
+        now_us = earliest;
+        wake_expired();
+    }
+
+    if (next == self) {
+        return;
+    }
+
+    current = next;
+    pthread_cond_signal(&next->baton);
+
+    if (self->state == TASK_DONE) {
+        return;
+    }
+
+    while (current != self) {
+        pthread_cond_wait(&self->baton, &sim_lock);
+    }
+}
+
+/* Blocks the current task until it is woken or the deadline passes */
+static void block_until(int64_t deadline_us)
+{
+    current->state = TASK_BLOCKED;
+    current->deadline_us = deadline_us;
+    schedule();
+}
+
+static int64_t deadline_after(TickType_t ticks)
+{
+    if (ticks == portMAX_DELAY) {
+        return NO_DEADLINE;
+    }
+
+    return (now_us / TICK_US + ticks) * TICK_US;
+}
+
+static bool higher_priority_ready(void)
+{
+    for (struct sim_task *task = tasks; task != NULL; task = task->next) {
+        if (task->state == TASK_READY && !task->suspended && task->priority > current->priority) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/* Something changed that a blocked task may wait for, let all of them re-check */
+static bool wake_waiters(void)
+{
+    for (struct sim_task *task = tasks; task != NULL; task = task->next) {
+        if (task->state == TASK_BLOCKED) {
+            task->state = TASK_READY;
+        }
+    }
+
+    return higher_priority_ready();
+}
+
+static void preempt(void)
+{
+    if (scheduler_suspended == 0 && higher_priority_ready()) {
+        schedule();
+    }
+}
+
+/* Traffic does not keep step with the sensor period: the gaps vary from half to one and a half periods */
+static uint32_t radio_gap(void)
+{
+    // xorshift32, the same sequence on every run
+    radio_random ^= radio_random << 13;
+    radio_random ^= radio_random >> 17;
+    radio_random ^= radio_random << 5;
+    return radio_period_us / 2 + radio_random % radio_period_us;
+}
+
+/*
+ * The WiFi and LwIP tasks outrank every application task on the protocol core. A busy-wait that can run there loses
+ * the CPU for every burst of radio work that falls into it, unless it holds the scheduler, which defers the burst.
+ */
+static void radio_run(int64_t start_us)
+{
+    if (radio_period_us == 0) {
+        return;
+    }
+
+    // the bursts while every task was blocked did not take anything from anyone
+    if (radio_next_us < start_us) {
+        radio_next_us = start_us + radio_gap() - radio_period_us / 2;
+    }
+
+    while (radio_next_us <= now_us) {
+        if (current->core == RADIO_CORE || current->core == tskNO_AFFINITY) {
+            if (scheduler_suspended > 0) {
+                radio_deferred_us += radio_busy_us;
+            } else {
+                now_us += radio_busy_us;
+            }
+        }
+
+        radio_next_us += radio_gap();
+    }
+}
+
+void sim_yield(void)
+{
+    schedule();
+}
+
+void sim_init(void)
+{
+    struct sim_task *task = calloc(1, sizeof(*task));
+
+    pthread_cond_init(&task->baton, NULL);
+    strcpy(task->name, "main");
+    task->priority = 1;
+    task->thread = pthread_self();
+    task->state = TASK_READY;
+
+    pthread_mutex_lock(&sim_lock);
+    tasks = task;
+    current = task;
+}
+
+int64_t sim_now_us(void)
+{
+    return now_us;
+}
+
+void sim_advance_us(uint32_t us)
+{
+    int64_t start_us = now_us;
+
+    now_us += us;
+    radio_run(start_us);
+
+    // a tick that makes a higher priority task ready preempts the busy-wait, as on the device
+    wake_expired();
+    preempt();
+}
+
+/* == Tasks =============================================================== */
+
+static void *task_entry(void *arg)
+{
+    struct sim_task *self = arg;
+
+    pthread_mutex_lock(&sim_lock);
+    while (current != self) {
+        pthread_cond_wait(&self->baton, &sim_lock);
+    }
+
+    self->function(self->params);
+    vTaskDelete(NULL);
+    return NULL;
+}
+
+static TaskHandle_t create_task(TaskFunction_t function, const char *name, uint32_t stack_depth, void *params,
+                                UBaseType_t priority, BaseType_t core, bool heap_stack)
+{
+    struct sim_task *task = calloc(1, sizeof(*task));
+
+    if (task == NULL) {
+        return NULL;
+    }
+
+    // the thread runs on a stack of its own, but the heap is charged as on the device so that the free heap of
+    // the static and the dynamic build differ by the stacks
+    if (heap_stack && (task->stack = malloc(stack_depth)) == NULL) {
+        free(task);
+        return NULL;
+    }
+
+    pthread_cond_init(&task->baton, NULL);
+    snprintf(task->name, sizeof(task->name), "%s", name);
+    task->function = function;
+    task->params = params;
+    task->priority = priority;
+    task->stack_depth = stack_depth;
+    task->core = core;
+    task->state = TASK_READY;
+
+    struct sim_task **tail = &tasks;
+    while (*tail != NULL) {
+        tail = &(*tail)->next;
+    }
+    *tail = task;
+
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    if (pthread_create(&task->thread, &attr, task_entry, task) != 0) {
+        task->state = TASK_DONE;
+        return NULL;
+    }
+    pthread_attr_destroy(&attr);
+
+    preempt();
+    return task;
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t function, const char *name, uint32_t stack_depth, void *params,
+                                   UBaseType_t priority, TaskHandle_t *task, BaseType_t core)
+{
+    TaskHandle_t handle = create_task(function, name, stack_depth, params, priority, core, true);
+
+    if (task != NULL) {
+        *task = handle;
+    }
+
+    return handle != NULL ? pdPASS : pdFAIL;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t function, const char *name, uint32_t stack_depth, void *params,
+                       UBaseType_t priority, TaskHandle_t *task)
+{
+    return xTaskCreatePinnedToCore(function, name, stack_depth, params, priority, task, tskNO_AFFINITY);
+}
+
+TaskHandle_t xTaskCreateStaticPinnedToCore(TaskFunction_t function, const char *name, uint32_t stack_depth,
+                                           void *params, UBaseType_t priority, StackType_t *stack, StaticTask_t *tcb,
+                                           BaseType_t core)
+{
+    return create_task(function, name, stack_depth, params, priority, core, false);
+}
+
+TaskHandle_t xTaskCreateStatic(TaskFunction_t function, const char *name, uint32_t stack_depth, void *params,
+                               UBaseType_t priority, StackType_t *stack, StaticTask_t *tcb)
+{
+    return create_task(function, name, stack_depth, params, priority, tskNO_AFFINITY, false);
+}
+
+void sim_radio_load(uint32_t period_us, uint32_t busy_us)
+{
+    radio_period_us = period_us;
+    radio_busy_us = busy_us;
+    radio_next_us = now_us + period_us;
+}
+
+int64_t sim_radio_deferred_us(void)
+{
+    return radio_deferred_us;
+}
+
+void vTaskSuspendAll(void)
+{
+    scheduler_suspended++;
+}
+
+BaseType_t xTaskResumeAll(void)
+{
+    if (scheduler_suspended > 0 && --scheduler_suspended == 0 && higher_priority_ready()) {
+        schedule();
+        return pdTRUE;
+    }
+
+    return pdFALSE;
+}
+
+void vTaskDelete(TaskHandle_t task)
+{
+    if (task == NULL || task == current) {
+        current->state = TASK_DONE;
+        schedule();
+        pthread_mutex_unlock(&sim_lock);
+        pthread_exit(NULL);
+    }
+
+    // the thread stays parked on its baton, it is never picked again
+    task->state = TASK_DONE;
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+    int64_t deadline = deadline_after(ticks);
+
+    while (now_us < deadline) {
+        block_until(deadline);
+    }
+}
+
+void vTaskSuspend(TaskHandle_t task)
+{
+    task = task != NULL ? task : current;
+    task->suspended = true;
+
+    if (task == current) {
+        schedule();
+    }
+}
+
+void vTaskResume(TaskHandle_t task)
+{
+    if (task->suspended) {
+        task->suspended = false;
+        // a task suspended while blocked comes back as if its wait ended
+        if (task->state == TASK_BLOCKED) {
+            task->state = TASK_READY;
+        }
+        preempt();
+    }
+}
+
+TickType_t xTaskGetTickCount(void)
+{
+    return (TickType_t)(now_us / TICK_US);
+}
+
+TickType_t xTaskGetTickCountFromISR(void)
+{
+    return xTaskGetTickCount();
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void)
+{
+    return current;
+}
+
+const char *pcTaskGetName(TaskHandle_t task)
+{
+    return (task != NULL ? task : current)->name;
+}
+
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task)
+{
+    // stack use is not measured on the host, report it untouched
+    return (task != NULL ? task : current)->stack_depth;
+}
+
+UBaseType_t uxTaskPriorityGet(TaskHandle_t task)
+{
+    return (task != NULL ? task : current)->priority;
+}
+
+BaseType_t xTaskGetCoreID(TaskHandle_t task)
+{
+    return (task != NULL ? task : current)->core;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear_on_exit, TickType_t ticks)
+{
+    int64_t deadline = deadline_after(ticks);
+
+    while (current->notify == 0 && now_us < deadline) {
+        block_until(deadline);
+    }
+
+    uint32_t value = current->notify;
+    if (value > 0) {
+        current->notify = clear_on_exit ? 0 : value - 1;
+    }
+
+    return value;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task)
+{
+    task->notify++;
+    if (wake_waiters()) {
+        schedule();
+    }
+
+    return pdPASS;
+}
+
+void vTaskNotifyGiveFromISR(TaskHandle_t task, BaseType_t *higher_priority_task_woken)
+{
+    task->notify++;
+    if (wake_waiters() && higher_priority_task_woken != NULL) {
+        *higher_priority_task_woken = pdTRUE;
+    }
+}
+
+/* == Queues ============================================================== */
+
+QueueHandle_t xQueueGenericCreateStatic(UBaseType_t length, UBaseType_t item_size, uint8_t *storage,
+                                        StaticQueue_t *buffer, uint8_t type)
+{
+    struct sim_queue *queue = calloc(1, sizeof(*queue));
+
+    if (queue == NULL) {
+        return NULL;
+    }
+
+    queue->length = length;
+    queue->item_size = item_size;
+    queue->storage = storage != NULL ? storage : calloc(length, item_size);
+    if (queue->storage == NULL) {
+        free(queue);
+        return NULL;
+    }
+
+    return queue;
+}
+
+QueueHandle_t xQueueGenericCreate(UBaseType_t length, UBaseType_t item_size, uint8_t type)
+{
+    return xQueueGenericCreateStatic(length, item_size, NULL, NULL, type);
+}
+
+QueueSetHandle_t xQueueCreateSet(UBaseType_t length)
+{
+    return xQueueGenericCreate(length, sizeof(QueueSetMemberHandle_t), queueQUEUE_TYPE_SET);
+}
+
+void vQueueDelete(QueueHandle_t queue)
+{
+    free(queue);
+}
+
+static void queue_put(struct sim_queue *queue, const void *item, BaseType_t position)
+{
+    UBaseType_t slot;
+
+    if (position == queueSEND_TO_FRONT) {
+        queue->head = (queue->head + queue->length - 1) % queue->length;
+        slot = queue->head;
+    } else {
+        slot = (queue->head + queue->count) % queue->length;
+    }
+
+    memcpy(queue->storage + slot * queue->item_size, item, queue->item_size);
+    queue->count++;
+}
+
+/* Returns true if a task waiting on the queue has a higher priority than the sender */
+static bool queue_send(struct sim_queue *queue, const void *item, BaseType_t position)
+{
+    if (position == queueOVERWRITE && queue->count == queue->length) {
+        // like FreeRTOS, an overwrite that does not add an item does not notify the set
+        memcpy(queue->storage + queue->head * queue->item_size, item, queue->item_size);
+        return wake_waiters();
+    }
+
+    queue_put(queue, item, position);
+
+    if (queue->set != NULL && queue->set->count < queue->set->length) {
+        queue_put(queue->set, &queue, queueSEND_TO_BACK);
+    }
+
+    return wake_waiters();
+}
+
+BaseType_t xQueueGenericSend(QueueHandle_t queue, const void *item, TickType_t ticks, BaseType_t position)
+{
+    int64_t deadline = deadline_after(ticks);
+
+    while (position != queueOVERWRITE && queue->count == queue->length) {
+        if (now_us >= deadline) {
+            return pdFAIL;
+        }
+        block_until(deadline);
+    }
+
+    if (queue_send(queue, item, position)) {
+        schedule();
+    }
+
+    return pdPASS;
+}
+
+BaseType_t xQueueGenericSendFromISR(QueueHandle_t queue, const void *item, BaseType_t *higher_priority_task_woken,
+                                    BaseType_t position)
+{
+    if (position != queueOVERWRITE && queue->count == queue->length) {
+        return pdFAIL;
+    }
+
+    if (queue_send(queue, item, position) && higher_priority_task_woken != NULL) {
+        *higher_priority_task_woken = pdTRUE;
+    }
+
+    return pdPASS;
+}
+
+static BaseType_t queue_take(QueueHandle_t queue, void *buffer, TickType_t ticks, bool remove)
+{
+    int64_t deadline = deadline_after(ticks);
+
+    while (queue->count == 0) {
+        if (now_us >= deadline) {
+            return pdFAIL;
+        }
+        block_until(deadline);
+    }
+
+    memcpy(buffer, queue->storage + queue->head * queue->item_size, queue->item_size);
+    if (remove) {
+        queue->head = (queue->head + 1) % queue->length;
+        queue->count--;
+        if (wake_waiters()) {
+            schedule();
+        }
+    }
+
+    return pdPASS;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void *buffer, TickType_t ticks)
+{
+    return queue_take(queue, buffer, ticks, true);
+}
+
+BaseType_t xQueuePeek(QueueHandle_t queue, void *buffer, TickType_t ticks)
+{
+    return queue_take(queue, buffer, ticks, false);
+}
+
+BaseType_t xQueueReset(QueueHandle_t queue)
+{
+    queue->count = 0;
+    queue->head = 0;
+    return pdPASS;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue)
+{
+    return queue->count;
+}
+
+BaseType_t xQueueAddToSet(QueueSetMemberHandle_t member, QueueSetHandle_t set)
+{
+    if (member->set != NULL || member->count != 0) {
+        return pdFAIL;
+    }
+
+    member->set = set;
+    return pdPASS;
+}
+
+QueueSetMemberHandle_t xQueueSelectFromSet(QueueSetHandle_t set, TickType_t ticks)
+{
+    QueueSetMemberHandle_t member = NULL;
+
+    if (xQueueReceive(set, &member, ticks) != pdPASS) {
+        return NULL;
+    }
+
+    return member;
+}
+
+/* == Event groups ======================================================== */
+
+EventGroupHandle_t xEventGroupCreate(void)
+{
+    return calloc(1, sizeof(struct sim_event_group));
+}
+
+EventGroupHandle_t xEventGroupCreateStatic(StaticEventGroup_t *buffer)
+{
+    return xEventGroupCreate();
+}
+
+EventBits_t xEventGroupSetBits(EventGroupHandle_t group, EventBits_t bits)
+{
+    group->bits |= bits;
+    EventBits_t value = group->bits;
+
+    if (wake_waiters()) {
+        schedule();
+    }
+
+    return value;
+}
+
+EventBits_t xEventGroupClearBits(EventGroupHandle_t group, EventBits_t bits)
+{
+    EventBits_t value = group->bits;
+    group->bits &= ~bits;
+    return value;
+}
+
+EventBits_t xEventGroupGetBits(EventGroupHandle_t group)
+{
+    return group->bits;
+}
+
+EventBits_t xEventGroupWaitBits(EventGroupHandle_t group, EventBits_t bits, BaseType_t clear_on_exit,
+                                BaseType_t wait_for_all, TickType_t ticks)
+{
+    int64_t deadline = deadline_after(ticks);
+
+    while (true) {
+        EventBits_t value = group->bits;
+        bool satisfied = wait_for_all ? (value & bits) == bits : (value & bits) != 0;
+
+        if (satisfied) {
+            if (clear_on_exit) {
+                group->bits &= ~bits;
+            }
+            return value;
+        }
+
+        if (now_us >= deadline) {
+            return value;
+        }
+
+        block_until(deadline);
+    }
+}
+
+/* == Software timers ===================================================== */
+
+static void timer_service_task(void *params)
+{
+    while (true) {
+        struct sim_timer *due = NULL;
+
+        for (struct sim_timer *timer = timers; timer != NULL; timer = timer->next) {
+            if (timer->active && (due == NULL || timer->expiry_us < due->expiry_us)) {
+                due = timer;
+            }
+        }
+
+        if (due == NULL) {
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+            continue;
+        }
+
+        if (due->expiry_us > now_us) {
+            // a started or stopped timer cuts the wait short
+            ulTaskNotifyTake(pdTRUE, (TickType_t)((due->expiry_us - now_us + TICK_US - 1) / TICK_US));
+            continue;
+        }
+
+        if (due->auto_reload) {
+            due->expiry_us += (int64_t)due->period * TICK_US;
+        } else {
+            due->active = false;
+        }
+
+        due->callback(due);
+    }
+}
+
+TimerHandle_t xTimerCreate(const char *name, TickType_t period, UBaseType_t auto_reload, void *id,
+                           TimerCallbackFunction_t callback)
+{
+    struct sim_timer *timer = calloc(1, sizeof(*timer));
+
+    if (timer == NULL) {
+        return NULL;
+    }
+
+    snprintf(timer->name, sizeof(timer->name), "%s", name);
+    timer->period = period;
+    timer->auto_reload = auto_reload;
+    timer->id = id;
+    timer->callback = callback;
+    timer->next = timers;
+    timers = timer;
+
+    return timer;
+}
+
+TimerHandle_t xTimerCreateStatic(const char *name, TickType_t period, UBaseType_t auto_reload, void *id,
+                                 TimerCallbackFunction_t callback, StaticTimer_t *buffer)
+{
+    return xTimerCreate(name, period, auto_reload, id, callback);
+}
+
+static void timers_changed(void)
+{
+    if (timer_task == NULL) {
+        xTaskCreate(timer_service_task, "Tmr Svc", 2048, NULL, 1, &timer_task);
+    } else {
+        xTaskNotifyGive(timer_task);
+    }
+}
+
+BaseType_t xTimerStart(TimerHandle_t timer, TickType_t ticks)
+{
+    timer->active = true;
+    timer->expiry_us = now_us + (int64_t)timer->period * TICK_US;
+    timers_changed();
+    return pdPASS;
+}
+
+BaseType_t xTimerStop(TimerHandle_t timer, TickType_t ticks)
+{
+    timer->active = false;
+    timers_changed();
+    return pdPASS;
+}
+
+BaseType_t xTimerChangePeriod(TimerHandle_t timer, TickType_t period, TickType_t ticks)
+{
+    timer->period = period;
+    return xTimerStart(timer, ticks);
+}
+
+void *pvTimerGetTimerID(TimerHandle_t timer)
+{
+    return timer->id;
+}
@@ -0,0 +1,289 @@
+#include <string.h>
+
+#include "driver/gpio.h"
+#include "dht22_decode.h"
+#include "sim.h"
+
+/*
+ * The DHT22 pins answer a start signal the way the sensor does: once the host releases a line (switches it to
+ * input) it plays back the 80 us low / 80 us high response and the 40 data bits of the frame the script returns,
+ * then idles high. Every DHT22 line has its own script. All other pins read their pull-up, or the level the
+ * harness drives.
+ */
+
+#define GPIO_PIN_COUNT          49
+
+#define DHT_RESPONSE_US         80
+#define DHT_BIT_LOW_US          50
+#define DHT_BIT_ZERO_US         26
+#define DHT_BIT_ONE_US          70
+#define DHT_TRACE_LENGTH        (2 + DHT_DATA_BITS * 2 + 1)
+#define DHT_LINES               CONFIG_ESP_DHT_SENSOR_COUNT
+
+typedef struct {
+    gpio_mode_t mode;
+    int output;
+    int input;
+    gpio_int_type_t intr_type;
+    gpio_isr_t isr;
+    void *isr_arg;
+} sim_pin_t;
+
+static sim_pin_t pins[GPIO_PIN_COUNT];
+static bool pins_ready = false;
+static bool isr_service = false;
+
+typedef struct {
+    gpio_num_t gpio_num;
+    dht_line_source_t source;
+    void *ctx;
+    uint32_t requests;
+    bool start_seen;
+    int64_t trace_start_us;
+    dht_pulse_t trace[DHT_TRACE_LENGTH];
+} dht_line_t;
+
+static dht_line_t dht_lines[DHT_LINES] = {
+        { .gpio_num = CONFIG_ESP_DHT_GPIO_PIN, .trace_start_us = -1 },
+#if DHT_LINES >= 2
+        { .gpio_num = CONFIG_ESP_DHT_GPIO_PIN_1, .trace_start_us = -1 },
+#endif
+#if DHT_LINES >= 3
+        { .gpio_num = CONFIG_ESP_DHT_GPIO_PIN_2, .trace_start_us = -1 },
+#endif
+#if DHT_LINES >= 4
+        { .gpio_num = CONFIG_ESP_DHT_GPIO_PIN_3, .trace_start_us = -1 },
+#endif
+};
+
+static sim_pin_t *pin(gpio_num_t gpio_num)
+{
+    if (!pins_ready) {
+        for (int i = 0; i < GPIO_PIN_COUNT; i++) {
+            pins[i] = (sim_pin_t) { .input = 1, .output = 1 };
+        }
+        pins_ready = true;
+    }
+
+    return gpio_num >= 0 && gpio_num < GPIO_PIN_COUNT ? &pins[gpio_num] : NULL;
+}
+
+/* == DHT22 =============================================================== */
+
+static dht_line_t *dht_line(gpio_num_t gpio_num)
+{
+    for (size_t i = 0; i < DHT_LINES; i++) {
+        if (dht_lines[i].gpio_num == gpio_num) {
+            return &dht_lines[i];
+        }
+    }
+
+    return NULL;
+}
+
+void dht_line_set_source_at(uint8_t sensor, dht_line_source_t source, void *ctx)
+{
+    if (sensor < DHT_LINES) {
+        dht_lines[sensor].source = source;
+        dht_lines[sensor].ctx = ctx;
+    }
+}
+
+void dht_line_set_source(dht_line_source_t source, void *ctx)
+{
+    dht_line_set_source_at(0, source, ctx);
+}
+
+void dht_line_frame(int16_t temperature, uint16_t humidity, uint8_t data[5])
+{
+    // the sensor sends sign and magnitude, not two's complement
+    uint16_t raw_temperature = temperature < 0 ? (uint16_t)(0x8000 | -temperature) : (uint16_t)temperature;
+
+    data[0] = humidity >> 8;
+    data[1] = humidity & 0xFF;
+    data[2] = raw_temperature >> 8;
+    data[3] = raw_temperature & 0xFF;
+    data[4] = (uint8_t)(data[0] + data[1] + data[2] + data[3]);
+}
+
+uint32_t dht_line_requests_at(uint8_t sensor)
+{
+    return sensor < DHT_LINES ? dht_lines[sensor].requests : 0;
+}
+
+uint32_t dht_line_requests(void)
+{
+    return dht_line_requests_at(0);
+}
+
+static void dht_respond(dht_line_t *line)
+{
+    uint8_t data[DHT_DATA_BYTES];
+    size_t count = 0;
+
+    line->requests++;
+    line->trace_start_us = -1;
+
+    if (line->source == NULL || !line->source(sim_now_us(), data, line->ctx)) {
+        return;
+    }
+
+    line->trace[count++] = (dht_pulse_t) { .level = 0, .duration_us = DHT_RESPONSE_US };
+    line->trace[count++] = (dht_pulse_t) { .level = 1, .duration_us = DHT_RESPONSE_US };
+    for (int k = 0; k < DHT_DATA_BITS; k++) {
+        bool one = data[k / 8] & (1 << (7 - (k % 8)));
+        line->trace[count++] = (dht_pulse_t) { .level = 0, .duration_us = DHT_BIT_LOW_US };
+        line->trace[count++] = (dht_pulse_t) { .level = 1, .duration_us = one ? DHT_BIT_ONE_US : DHT_BIT_ZERO_US };
+    }
+    line->trace[count++] = (dht_pulse_t) { .level = 0, .duration_us = DHT_BIT_LOW_US };
+
+    line->trace_start_us = sim_now_us();
+}
+
+static int dht_level(const dht_line_t *line)
+{
+    if (line->trace_start_us < 0) {
+        return 1;
+    }
+
+    int64_t offset = sim_now_us() - line->trace_start_us;
+    for (size_t i = 0; i < DHT_TRACE_LENGTH; i++) {
+        if (offset < line->trace[i].duration_us) {
+            return line->trace[i].level;
+        }
+        offset -= line->trace[i].duration_us;
+    }
+
+    return 1;
+}
+
+/* == GPIO driver ========================================================= */
+
+esp_err_t gpio_config(const gpio_config_t *config)
+{
+    for (gpio_num_t gpio_num = 0; gpio_num < GPIO_PIN_COUNT; gpio_num++) {
+        if (config->pin_bit_mask & (1ULL << gpio_num)) {
+            pin(gpio_num)->mode = config->mode;
+            pin(gpio_num)->intr_type = config->intr_type;
+        }
+    }
+
+    return ESP_OK;
+}
+
+esp_err_t gpio_set_direction(gpio_num_t gpio_num, gpio_mode_t mode)
+{
+    sim_pin_t *p = pin(gpio_num);
+
+    if (p == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    // the host pulled a DHT line low and now lets go of it: the sensor answers
+    dht_line_t *line = dht_line(gpio_num);
+    if (line != NULL && mode == GPIO_MODE_INPUT && line->start_seen) {
+        line->start_seen = false;
+        dht_respond(line);
+    }
+
+    p->mode = mode;
+    return ESP_OK;
+}
+
+esp_err_t gpio_set_pull_mode(gpio_num_t gpio_num, gpio_pull_mode_t pull)
+{
+    return pin(gpio_num) != NULL ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+esp_err_t gpio_set_level(gpio_num_t gpio_num, uint32_t level)
+{
+    sim_pin_t *p = pin(gpio_num);
+
+    if (p == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    dht_line_t *line = dht_line(gpio_num);
+    if (line != NULL && level == 0) {
+        line->start_seen = true;
+    }
+
+    p->output = level != 0;
+    return ESP_OK;
+}
+
+int gpio_get_level(gpio_num_t gpio_num)
+{
+    sim_pin_t *p = pin(gpio_num);
+
+    if (p == NULL) {
+        return 0;
+    }
+
+    dht_line_t *line = dht_line(gpio_num);
+    if (line != NULL) {
+        return dht_level(line);
+    }
+
+    return p->mode == GPIO_MODE_OUTPUT ? p->output : p->input;
+}
+
+esp_err_t gpio_install_isr_service(int intr_alloc_flags)
+{
+    if (isr_service) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    isr_service = true;
+    return ESP_OK;
+}
+
+esp_err_t gpio_isr_handler_add(gpio_num_t gpio_num, gpio_isr_t isr_handler, void *args)
+{
+    sim_pin_t *p = pin(gpio_num);
+
+    if (p == NULL || !isr_service) {
+        return p == NULL ? ESP_ERR_INVALID_ARG : ESP_ERR_INVALID_STATE;
+    }
+
+    p->isr = isr_handler;
+    p->isr_arg = args;
+    return ESP_OK;
+}
+
+void gpio_fake_set_input(int gpio_num, int level)
+{
+    sim_pin_t *p = pin(gpio_num);
+
+    if (p == NULL) {
+        return;
+    }
+
+    int previous = p->input;
+    p->input = level != 0;
+
+    bool fire = false;
+    switch (p->intr_type) {
+        case GPIO_INTR_POSEDGE:
+            fire = !previous && p->input;
+            break;
+        case GPIO_INTR_NEGEDGE:
+            fire = previous && !p->input;
+            break;
+        case GPIO_INTR_ANYEDGE:
+            fire = previous != p->input;
+            break;
+        case GPIO_INTR_LOW_LEVEL:
+            fire = !p->input;
+            break;
+        case GPIO_INTR_HIGH_LEVEL:
+            fire = p->input;
+            break;
+        default:
+            break;
+    }
+
+    if (fire && p->isr != NULL) {
+        p->isr(p->isr_arg);
+    }
+}
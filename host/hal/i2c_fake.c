@@ -0,0 +1,225 @@
+#include <stdlib.h>
+
+#include "driver/i2c_master.h"
+#include "sim.h"
+
+/*
+ * A MAX17048 fuel gauge at 0x36, register for register. The harness sets the cell voltage and state of charge; like
+ * the real chip the registers only take them over at the next conversion, every 250 ms while active and every 45 s
+ * while hibernating. With ALSC set a change of the integer SOC raises the SC alert and pulls ALERT low until the
+ * firmware clears CONFIG.ALRT.
+ */
+
+#define MAX17048_ADDRESS        0x36
+#define MAX17048_REG_COUNT      0x100
+
+#define REG_VCELL               0x02
+#define REG_SOC                 0x04
+#define REG_VERSION             0x08
+#define REG_HIBRT               0x0A
+#define REG_CONFIG              0x0C
+#define REG_STATUS              0x1A
+
+#define CONFIG_ALSC             (1 << 6)
+#define CONFIG_ALRT             (1 << 5)
+#define STATUS_SC               (1 << 13)
+
+#define ACTIVE_CONVERSION_US    250000
+#define HIBERNATE_CONVERSION_US 45000000
+#define I2C_BYTE_US             23      /*!< 9 clocks at 400 kHz */
+
+struct sim_i2c_bus {
+    int port;
+};
+
+struct sim_i2c_device {
+    uint16_t address;
+};
+
+static uint16_t regs[MAX17048_REG_COUNT];
+static bool regs_ready = false;
+static bool present = true;
+static uint32_t fail_count = 0;
+static uint32_t fail_from = 0;
+static uint32_t transactions = 0;
+static uint16_t model_vcell = 0xC800;   // 4.0 V
+static uint16_t model_soc = 0x5000;     // 80 %
+static int64_t last_conversion_us = 0;
+
+static void reset_regs(void)
+{
+    if (regs_ready) {
+        return;
+    }
+
+    regs[REG_VERSION] = 0x0012;
+    regs[REG_HIBRT] = 0x8030;
+    regs[REG_CONFIG] = 0x971C;
+    regs[REG_STATUS] = 0x0100;      // RI, reset indicator
+    regs[REG_VCELL] = model_vcell;
+    regs[REG_SOC] = model_soc;
+    regs_ready = true;
+}
+
+static bool hibernating(void)
+{
+    return regs[REG_HIBRT] == 0xFFFF;
+}
+
+static void set_alert(bool active)
+{
+    gpio_fake_set_input(CONFIG_ESP_BATTERY_ALERT_GPIO, active ? 0 : 1);
+}
+
+/* Takes over the model values if a conversion completed since the last one */
+static void convert(void)
+{
+    int64_t interval = hibernating() ? HIBERNATE_CONVERSION_US : ACTIVE_CONVERSION_US;
+    int64_t now = sim_now_us();
+
+    if (now - last_conversion_us < interval) {
+        return;
+    }
+
+    last_conversion_us = now;
+    regs[REG_VCELL] = model_vcell;
+
+    bool soc_step = (regs[REG_SOC] >> 8) != (model_soc >> 8);
+    regs[REG_SOC] = model_soc;
+
+    if (soc_step && (regs[REG_CONFIG] & CONFIG_ALSC)) {
+        regs[REG_STATUS] |= STATUS_SC;
+        regs[REG_CONFIG] |= CONFIG_ALRT;
+        set_alert(true);
+    }
+}
+
+void max17048_model_set(uint16_t vcell, uint16_t soc)
+{
+    // set before the first access, the values are there from power-up as after the quick-start of the chip
+    model_vcell = vcell;
+    model_soc = soc;
+    reset_regs();
+}
+
+void max17048_model_set_present(bool is_present)
+{
+    present = is_present;
+}
+
+void max17048_model_fail(uint32_t count)
+{
+    max17048_model_fail_at(transactions + 1, count);
+}
+
+void max17048_model_fail_at(uint32_t transaction, uint32_t count)
+{
+    fail_from = transaction;
+    fail_count = count;
+}
+
+uint16_t max17048_model_reg(uint8_t address)
+{
+    reset_regs();
+    return regs[address];
+}
+
+uint32_t max17048_model_transactions(void)
+{
+    return transactions;
+}
+
+/* Common part of every transaction, false if the device does not acknowledge */
+static bool transaction(uint16_t address, size_t bytes)
+{
+    reset_regs();
+    sim_advance_us((uint32_t)(bytes + 1) * I2C_BYTE_US);
+
+    if (address != MAX17048_ADDRESS || !present) {
+        return false;
+    }
+
+    transactions++;
+    if (fail_count > 0 && transactions >= fail_from) {
+        fail_count--;
+        return false;
+    }
+
+    convert();
+    return true;
+}
+
+esp_err_t i2c_new_master_bus(const i2c_master_bus_config_t *bus_config, i2c_master_bus_handle_t *ret_bus_handle)
+{
+    struct sim_i2c_bus *bus = calloc(1, sizeof(*bus));
+
+    if (bus == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    bus->port = bus_config->i2c_port;
+    *ret_bus_handle = bus;
+    return ESP_OK;
+}
+
+esp_err_t i2c_master_bus_add_device(i2c_master_bus_handle_t bus_handle, const i2c_device_config_t *dev_config,
+                                    i2c_master_dev_handle_t *ret_handle)
+{
+    struct sim_i2c_device *device = calloc(1, sizeof(*device));
+
+    if (device == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    device->address = dev_config->device_address;
+    *ret_handle = device;
+    return ESP_OK;
+}
+
+esp_err_t i2c_master_probe(i2c_master_bus_handle_t bus_handle, uint16_t address, int xfer_timeout_ms)
+{
+    return transaction(address, 0) ? ESP_OK : ESP_ERR_NOT_FOUND;
+}
+
+esp_err_t i2c_master_transmit(i2c_master_dev_handle_t i2c_dev, const uint8_t *write_buffer, size_t write_size,
+                              int xfer_timeout_ms)
+{
+    if (!transaction(i2c_dev->address, write_size)) {
+        return ESP_FAIL;
+    }
+
+    // register address, then 16 bit words MSB first into consecutive registers
+    uint8_t reg = write_buffer[0];
+    for (size_t i = 1; i + 1 < write_size; i += 2, reg += 2) {
+        uint16_t value = ((uint16_t)write_buffer[i] << 8) | write_buffer[i + 1];
+
+        if (reg == REG_VCELL || reg == REG_SOC || reg == REG_VERSION) {
+            continue;
+        }
+
+        regs[reg] = value;
+        if (reg == REG_CONFIG && !(value & CONFIG_ALRT)) {
+            set_alert(false);
+        }
+    }
+
+    return ESP_OK;
+}
+
+esp_err_t i2c_master_transmit_receive(i2c_master_dev_handle_t i2c_dev, const uint8_t *write_buffer,
+                                      size_t write_size, uint8_t *read_buffer, size_t read_size,
+                                      int xfer_timeout_ms)
+{
+    if (!transaction(i2c_dev->address, write_size + read_size)) {
+        return ESP_FAIL;
+    }
+
+    // reads run on through consecutive registers
+    uint8_t reg = write_buffer[0];
+    for (size_t i = 0; i < read_size; i++) {
+        uint16_t value = regs[(uint8_t)(reg + (i / 2) * 2)];
+        read_buffer[i] = i % 2 == 0 ? value >> 8 : value & 0xFF;
+    }
+
+    return ESP_OK;
+}
@@ -0,0 +1,678 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "mqtt_client.h"
+#include "wifi.h"
+#include "sim.h"
+
+/*
+ * esp-mqtt client plus the broker it talks to. Every publish the broker accepts lands in the capture sink with its
+ * topic resolved from the topic alias, the way a subscriber would see it. CONNECTED, DISCONNECTED and PUBLISHED
+ * events are delivered from the client's own task after the configured latencies, like esp-mqtt does from its
+ * network task. A connect attempt succeeds if the broker is online and the station has an IP.
+ *
+ * QoS1 publishes stay in the client's outbox until their PUBACK. The ones a disconnect left there are sent again as
+ * they were, topic alias included, right after the next CONNACK, as esp-mqtt resends its outbox.
+ *
+ * Messages the harness publishes with mqtt_fake_publish() reach the client as MQTT_EVENT_DATA if it subscribed to
+ * their topic on the current connection. Topic filters match exactly, there are no wildcards. A message larger than
+ * the client's buffer comes in several events, as from esp-mqtt: only the first carries the topic.
+ */
+
+#define MQTT_CLIENT_TASK_PRIORITY   5
+#define MQTT_CLIENT_STACK_SIZE      6144
+#define MQTT_MAX_PENDING            64
+#define MQTT_MAX_ALIASES            64
+#define MQTT_DEFAULT_ALIAS_MAX      10      /*!< mosquitto's max_topic_alias default */
+#define MQTT_MAX_SUBSCRIPTIONS      4
+#define MQTT_MAX_RETAINED           8
+#define MQTT_BUFFER_SIZE            1024    /*!< esp-mqtt's default buffer.size */
+
+typedef enum {
+    PENDING_CONNECT = 0,
+    PENDING_DISCONNECT,
+    PENDING_PUBACK,
+    PENDING_SUBACK,
+    PENDING_MESSAGE,
+} pending_kind_t;
+
+typedef struct {
+    pending_kind_t kind;
+    int64_t due_us;
+    int msg_id;
+    uint32_t connection;            /*!< PUBACKs of an earlier connection are never delivered */
+    char *topic;                    /*!< PENDING_MESSAGE only, owned by the event */
+    char *data;
+    size_t len;
+    bool retain;
+} pending_event_t;
+
+typedef struct {
+    char *topic;
+    char *data;
+    size_t len;
+} retained_t;
+
+typedef struct {
+    int msg_id;
+    char *topic;                    /*!< as passed to esp_mqtt_client_publish(), empty with an established alias */
+    char *data;
+    size_t len;
+    int qos;
+    int retain;
+    uint16_t alias;
+} outbox_entry_t;
+
+struct esp_mqtt_client {
+    esp_event_handler_t handler;
+    void *handler_arg;
+    TaskHandle_t task;
+    bool connected;
+    uint32_t connection;
+    int next_msg_id;
+    uint16_t publish_alias;         /*!< set by esp_mqtt5_client_set_publish_property() for the next publish */
+    char *aliases[MQTT_MAX_ALIASES + 1];
+    char *subscriptions[MQTT_MAX_SUBSCRIPTIONS];    /*!< of the current connection */
+    pending_event_t pending[MQTT_MAX_PENDING];
+    size_t pending_count;
+    outbox_entry_t outbox[MQTT_MAX_PENDING];        /*!< QoS1 publishes waiting for their PUBACK */
+    size_t outbox_count;
+};
+
+static const char *TAG = "mqtt_client";
+static const char *MQTT_EVENTS = "MQTT_EVENTS";
+
+static struct esp_mqtt_client *the_client = NULL;
+static bool online = true;
+static uint32_t connect_latency_ms = 50;
+static uint32_t puback_latency_ms = 20;
+static uint16_t alias_max = MQTT_DEFAULT_ALIAS_MAX;
+static retained_t retained[MQTT_MAX_RETAINED];
+
+static mqtt_capture_t *captures = NULL;
+static size_t capture_count = 0;
+static size_t capture_capacity = 0;
+static mqtt_fake_stats_t stats;
+
+/* == Broker side ========================================================= */
+
+static bool schedule_event(struct esp_mqtt_client *client, pending_event_t event, uint32_t delay_ms)
+{
+    if (client->pending_count == MQTT_MAX_PENDING) {
+        ESP_LOGE(TAG, "Too many pending events, event %d dropped", event.kind);
+        return false;
+    }
+
+    event.due_us = sim_now_us() + (int64_t)delay_ms * 1000;
+    event.connection = client->connection;
+    client->pending[client->pending_count++] = event;
+
+    if (client->task != NULL) {
+        xTaskNotifyGive(client->task);
+    }
+
+    return true;
+}
+
+static void schedule(struct esp_mqtt_client *client, pending_kind_t kind, uint32_t delay_ms, int msg_id)
+{
+    schedule_event(client, (pending_event_t) { .kind = kind, .msg_id = msg_id }, delay_ms);
+}
+
+static void schedule_message(struct esp_mqtt_client *client, const char *topic, const void *data, size_t len,
+                             bool retain)
+{
+    pending_event_t event = {
+            .kind = PENDING_MESSAGE,
+            .topic = strdup(topic),
+            .data = malloc(len > 0 ? len : 1),
+            .len = len,
+            .retain = retain,
+    };
+
+    if (event.topic == NULL || event.data == NULL) {
+        abort();
+    }
+    memcpy(event.data, data, len);
+
+    if (!schedule_event(client, event, puback_latency_ms)) {
+        free(event.topic);
+        free(event.data);
+    }
+}
+
+static void pending_free(pending_event_t *event)
+{
+    free(event->topic);
+    free(event->data);
+}
+
+static bool subscribed(const struct esp_mqtt_client *client, const char *topic)
+{
+    for (size_t i = 0; i < MQTT_MAX_SUBSCRIPTIONS; i++) {
+        if (client->subscriptions[i] != NULL && strcmp(client->subscriptions[i], topic) == 0) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static void drop_connection(struct esp_mqtt_client *client)
+{
+    if (!client->connected) {
+        return;
+    }
+
+    client->connected = false;
+
+    // PUBACKs and messages still on their way are lost with the connection
+    size_t kept = 0;
+    for (size_t i = 0; i < client->pending_count; i++) {
+        if (client->pending[i].kind == PENDING_PUBACK) {
+            stats.lost++;
+        } else if (client->pending[i].kind == PENDING_CONNECT || client->pending[i].kind == PENDING_DISCONNECT) {
+            client->pending[kept++] = client->pending[i];
+        } else {
+            pending_free(&client->pending[i]);
+        }
+    }
+    client->pending_count = kept;
+    client->connection++;
+
+    for (size_t i = 0; i < MQTT_MAX_SUBSCRIPTIONS; i++) {
+        free(client->subscriptions[i]);
+        client->subscriptions[i] = NULL;
+    }
+
+    schedule(client, PENDING_DISCONNECT, 0, 0);
+}
+
+void mqtt_fake_set_online(bool is_online)
+{
+    online = is_online;
+
+    if (!online && the_client != NULL) {
+        drop_connection(the_client);
+    }
+}
+
+void mqtt_fake_network_lost(void)
+{
+    if (the_client != NULL) {
+        drop_connection(the_client);
+    }
+}
+
+void mqtt_fake_set_latency_ms(uint32_t connect_ms, uint32_t puback_ms)
+{
+    connect_latency_ms = connect_ms;
+    puback_latency_ms = puback_ms;
+}
+
+void mqtt_fake_set_topic_alias_max(uint16_t max)
+{
+    alias_max = max < MQTT_MAX_ALIASES ? max : MQTT_MAX_ALIASES;
+}
+
+void mqtt_fake_publish(const char *topic, const void *data, size_t len, bool retain)
+{
+    if (retain) {
+        retained_t *slot = NULL;
+
+        for (size_t i = 0; i < MQTT_MAX_RETAINED && slot == NULL; i++) {
+            if (retained[i].topic != NULL && strcmp(retained[i].topic, topic) == 0) {
+                slot = &retained[i];
+            }
+        }
+        for (size_t i = 0; i < MQTT_MAX_RETAINED && slot == NULL; i++) {
+            if (retained[i].topic == NULL) {
+                slot = &retained[i];
+            }
+        }
+        if (slot == NULL) {
+            ESP_LOGE(TAG, "Broker: no room for the retained message of %s", topic);
+        } else {
+            free(slot->topic);
+            free(slot->data);
+            *slot = (retained_t) { 0 };
+            // an empty retained message deletes the one kept
+            if (len > 0) {
+                slot->topic = strdup(topic);
+                slot->data = malloc(len);
+                memcpy(slot->data, data, len);
+                slot->len = len;
+            }
+        }
+    }
+
+    if (the_client != NULL && the_client->connected && subscribed(the_client, topic)) {
+        schedule_message(the_client, topic, data, len, false);
+    }
+}
+
+const mqtt_capture_t *mqtt_fake_captured(size_t *count)
+{
+    *count = capture_count;
+    return captures;
+}
+
+const mqtt_fake_stats_t *mqtt_fake_stats(void)
+{
+    return &stats;
+}
+
+void mqtt_fake_write_capture(FILE *file)
+{
+    fprintf(file, "time_ms,topic,qos,retain,alias,wire_bytes,payload\n");
+
+    for (size_t i = 0; i < capture_count; i++) {
+        const mqtt_capture_t *capture = &captures[i];
+
+        fprintf(file, "%" PRId64 ",%s,%d,%d,%u,%zu,", capture->time_us / 1000, capture->topic, capture->qos,
+                capture->retain, capture->alias, capture->wire_bytes);
+        for (size_t j = 0; j < capture->len; j++) {
+            fprintf(file, "%02x", capture->payload[j]);
+        }
+        fputc('\n', file);
+    }
+}
+
+static size_t varint_size(size_t value)
+{
+    size_t size = 1;
+
+    while (value >= 128) {
+        value /= 128;
+        size++;
+    }
+
+    return size;
+}
+
+/* MQTT5 PUBLISH: fixed header, topic, packet id for QoS > 0, properties (only the topic alias), payload */
+static size_t publish_wire_bytes(size_t topic_len, size_t len, int qos, uint16_t alias)
+{
+    size_t properties = alias > 0 ? 3 : 0;
+    size_t remaining = 2 + topic_len + (qos > 0 ? 2 : 0) + varint_size(properties) + properties + len;
+
+    return 1 + varint_size(remaining) + remaining;
+}
+
+/* Returns false if the broker would close the connection over the packet */
+static bool broker_receive(struct esp_mqtt_client *client, const char *topic, const char *data, size_t len, int qos,
+                           int retain, uint16_t alias)
+{
+    const char *resolved = topic;
+
+    if (alias > alias_max) {
+        ESP_LOGE(TAG, "Broker: topic alias %u above the maximum of %u", alias, alias_max);
+        stats.protocol_errors++;
+        return false;
+    }
+
+    if (alias > 0 && topic[0] != '\0') {
+        free(client->aliases[alias]);
+        client->aliases[alias] = strdup(topic);
+    } else if (alias > 0) {
+        resolved = client->aliases[alias];
+    }
+
+    if (resolved == NULL || resolved[0] == '\0') {
+        ESP_LOGE(TAG, "Broker: publish without topic, alias %u unknown", alias);
+        stats.protocol_errors++;
+        return false;
+    }
+
+    if (capture_count == capture_capacity) {
+        size_t capacity = capture_capacity > 0 ? capture_capacity * 2 : 256;
+        mqtt_capture_t *grown = realloc(captures, capacity * sizeof(*captures));
+        if (grown == NULL) {
+            abort();
+        }
+        captures = grown;
+        capture_capacity = capacity;
+    }
+
+    mqtt_capture_t *capture = &captures[capture_count++];
+    memset(capture, 0, sizeof(*capture));
+    capture->time_us = sim_now_us();
+    strncpy(capture->topic, resolved, sizeof(capture->topic) - 1);
+    capture->len = len < sizeof(capture->payload) ? len : sizeof(capture->payload);
+    memcpy(capture->payload, data, capture->len);
+    capture->qos = qos;
+    capture->retain = retain;
+    capture->alias = alias;
+    capture->wire_bytes = publish_wire_bytes(strlen(topic), len, qos, alias);
+
+    stats.publishes++;
+    stats.wire_bytes += capture->wire_bytes;
+    return true;
+}
+
+static void outbox_add(struct esp_mqtt_client *client, int msg_id, const char *topic, const char *data, size_t len,
+                       int qos, int retain, uint16_t alias)
+{
+    if (client->outbox_count == MQTT_MAX_PENDING) {
+        ESP_LOGE(TAG, "Outbox full, message %d not kept", msg_id);
+        return;
+    }
+
+    outbox_entry_t *entry = &client->outbox[client->outbox_count++];
+    *entry = (outbox_entry_t) {
+            .msg_id = msg_id,
+            .topic = strdup(topic),
+            .data = malloc(len > 0 ? len : 1),
+            .len = len,
+            .qos = qos,
+            .retain = retain,
+            .alias = alias,
+    };
+    if (entry->topic == NULL || entry->data == NULL) {
+        abort();
+    }
+    memcpy(entry->data, data, len);
+}
+
+static void outbox_remove(struct esp_mqtt_client *client, int msg_id)
+{
+    for (size_t i = 0; i < client->outbox_count; i++) {
+        if (client->outbox[i].msg_id == msg_id) {
+            free(client->outbox[i].topic);
+            free(client->outbox[i].data);
+            client->outbox[i] = client->outbox[--client->outbox_count];
+            return;
+        }
+    }
+}
+
+/* The publishes a disconnect left unacknowledged, byte for byte as they went out the first time */
+static void outbox_resend(struct esp_mqtt_client *client)
+{
+    for (size_t i = 0; i < client->outbox_count && client->connected; i++) {
+        const outbox_entry_t *entry = &client->outbox[i];
+
+        stats.resent++;
+        if (!broker_receive(client, entry->topic, entry->data, entry->len, entry->qos, entry->retain, entry->alias)) {
+            drop_connection(client);
+            return;
+        }
+        schedule(client, PENDING_PUBACK, puback_latency_ms, entry->msg_id);
+    }
+}
+
+/* == Client task ========================================================= */
+
+static void dispatch_event(struct esp_mqtt_client *client, esp_mqtt_event_t *event)
+{
+    event->client = client;
+
+    if (client->handler != NULL) {
+        client->handler(client->handler_arg, MQTT_EVENTS, event->event_id, event);
+    }
+}
+
+static void dispatch(struct esp_mqtt_client *client, esp_mqtt_event_id_t event_id, int msg_id)
+{
+    esp_mqtt_event_t event = {
+            .event_id = event_id,
+            .msg_id = msg_id,
+    };
+
+    dispatch_event(client, &event);
+}
+
+static void deliver(struct esp_mqtt_client *client, pending_event_t event)
+{
+    switch (event.kind) {
+        case PENDING_CONNECT:
+            if (!online || !wifi_is_connected()) {
+                dispatch(client, MQTT_EVENT_DISCONNECTED, 0);
+                break;
+            }
+            // topic aliases only live as long as the network connection
+            for (size_t i = 0; i <= MQTT_MAX_ALIASES; i++) {
+                free(client->aliases[i]);
+                client->aliases[i] = NULL;
+            }
+            client->connected = true;
+            stats.connects++;
+            dispatch(client, MQTT_EVENT_CONNECTED, 0);
+            outbox_resend(client);
+            break;
+        case PENDING_DISCONNECT:
+            dispatch(client, MQTT_EVENT_DISCONNECTED, 0);
+            break;
+        case PENDING_PUBACK:
+            if (event.connection == client->connection) {
+                stats.pubacks++;
+                outbox_remove(client, event.msg_id);
+                dispatch(client, MQTT_EVENT_PUBLISHED, event.msg_id);
+            }
+            break;
+        case PENDING_SUBACK:
+            if (event.connection == client->connection) {
+                dispatch(client, MQTT_EVENT_SUBSCRIBED, event.msg_id);
+            }
+            break;
+        case PENDING_MESSAGE:
+            if (event.connection == client->connection) {
+                size_t offset = 0;
+
+                do {
+                    size_t len = event.len - offset < MQTT_BUFFER_SIZE ? event.len - offset : MQTT_BUFFER_SIZE;
+                    esp_mqtt_event_t data = {
+                            .event_id = MQTT_EVENT_DATA,
+                            .topic = offset == 0 ? event.topic : NULL,
+                            .topic_len = offset == 0 ? (int)strlen(event.topic) : 0,
+                            .data = event.data + offset,
+                            .data_len = (int)len,
+                            .total_data_len = (int)event.len,
+                            .current_data_offset = (int)offset,
+                            .qos = 1,
+                            .retain = event.retain,
+                    };
+
+                    dispatch_event(client, &data);
+                    offset += len;
+                } while (offset < event.len);
+                stats.delivered++;
+            }
+            pending_free(&event);
+            break;
+    }
+}
+
+_Noreturn static void client_task(void *params)
+{
+    struct esp_mqtt_client *client = params;
+
+    while (true) {
+        size_t next = client->pending_count;
+
+        for (size_t i = 0; i < client->pending_count; i++) {
+            if (next == client->pending_count || client->pending[i].due_us < client->pending[next].due_us) {
+                next = i;
+            }
+        }
+
+        if (next == client->pending_count) {
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+            continue;
+        }
+
+        int64_t wait_us = client->pending[next].due_us - sim_now_us();
+        if (wait_us > 0) {
+            TickType_t ticks = (TickType_t)((wait_us * configTICK_RATE_HZ + 999999) / 1000000);
+            ulTaskNotifyTake(pdTRUE, ticks);
+            continue;
+        }
+
+        pending_event_t event = client->pending[next];
+        client->pending[next] = client->pending[--client->pending_count];
+        deliver(client, event);
+    }
+}
+
+/* == esp-mqtt API ======================================================== */
+
+esp_mqtt_client_handle_t esp_mqtt_client_init(const esp_mqtt_client_config_t *config)
+{
+    struct esp_mqtt_client *client = calloc(1, sizeof(*client));
+
+    if (client == NULL) {
+        return NULL;
+    }
+
+    client->next_msg_id = 1;
+    if (xTaskCreate(client_task, "mqtt_client", MQTT_CLIENT_STACK_SIZE, client, MQTT_CLIENT_TASK_PRIORITY,
+                    &client->task) != pdPASS) {
+        free(client);
+        return NULL;
+    }
+
+    the_client = client;
+    return client;
+}
+
+esp_err_t esp_mqtt_client_register_event(esp_mqtt_client_handle_t client, esp_mqtt_event_id_t event,
+                                         esp_event_handler_t event_handler, void *event_handler_arg)
+{
+    client->handler = event_handler;
+    client->handler_arg = event_handler_arg;
+    return ESP_OK;
+}
+
+esp_err_t esp_mqtt_client_start(esp_mqtt_client_handle_t client)
+{
+    schedule(client, PENDING_CONNECT, connect_latency_ms, 0);
+    return ESP_OK;
+}
+
+esp_err_t esp_mqtt_client_reconnect(esp_mqtt_client_handle_t client)
+{
+    if (client->connected) {
+        return ESP_FAIL;
+    }
+
+    schedule(client, PENDING_CONNECT, connect_latency_ms, 0);
+    return ESP_OK;
+}
+
+esp_err_t esp_mqtt_client_disconnect(esp_mqtt_client_handle_t client)
+{
+    drop_connection(client);
+    return ESP_OK;
+}
+
+esp_err_t esp_mqtt_client_stop(esp_mqtt_client_handle_t client)
+{
+    client->connected = false;
+    for (size_t i = 0; i < client->pending_count; i++) {
+        pending_free(&client->pending[i]);
+    }
+    client->pending_count = 0;
+    return ESP_OK;
+}
+
+static int next_msg_id(struct esp_mqtt_client *client)
+{
+    int msg_id = client->next_msg_id;
+
+    client->next_msg_id = client->next_msg_id == 0xFFFF ? 1 : client->next_msg_id + 1;
+    return msg_id;
+}
+
+int esp_mqtt_client_publish(esp_mqtt_client_handle_t client, const char *topic, const char *data, int len, int qos,
+                            int retain)
+{
+    uint16_t alias = client->publish_alias;
+
+    client->publish_alias = 0;
+    if (!client->connected) {
+        return -1;
+    }
+
+    if (len == 0 && data != NULL) {
+        len = (int)strlen(data);
+    }
+
+    if (!broker_receive(client, topic, data, (size_t)len, qos, retain, alias)) {
+        drop_connection(client);
+        return -1;
+    }
+
+    if (qos == 0) {
+        return 0;
+    }
+
+    int msg_id = next_msg_id(client);
+    outbox_add(client, msg_id, topic, data, (size_t)len, qos, retain, alias);
+    schedule(client, PENDING_PUBACK, puback_latency_ms, msg_id);
+    return msg_id;
+}
+
+int esp_mqtt_client_subscribe(esp_mqtt_client_handle_t client, const char *topic, int qos)
+{
+    if (!client->connected) {
+        return -1;
+    }
+
+    if (!subscribed(client, topic)) {
+        size_t slot = 0;
+
+        while (slot < MQTT_MAX_SUBSCRIPTIONS && client->subscriptions[slot] != NULL) {
+            slot++;
+        }
+        if (slot == MQTT_MAX_SUBSCRIPTIONS) {
+            ESP_LOGE(TAG, "Too many subscriptions, %s dropped", topic);
+            return -1;
+        }
+        client->subscriptions[slot] = strdup(topic);
+    }
+
+    int msg_id = next_msg_id(client);
+    stats.subscribes++;
+    schedule(client, PENDING_SUBACK, puback_latency_ms, msg_id);
+
+    // the retained message of the topic follows the SUBACK, with the retain flag set
+    for (size_t i = 0; i < MQTT_MAX_RETAINED; i++) {
+        if (retained[i].topic != NULL && strcmp(retained[i].topic, topic) == 0) {
+            schedule_message(client, retained[i].topic, retained[i].data, retained[i].len, true);
+        }
+    }
+
+    return msg_id;
+}
+
+esp_err_t esp_mqtt5_client_set_user_property(mqtt5_user_property_handle_t *user_property,
+                                             esp_mqtt5_user_property_item_t item[], uint8_t item_num)
+{
+    *user_property = NULL;
+    return ESP_OK;
+}
+
+void esp_mqtt5_client_delete_user_property(mqtt5_user_property_handle_t user_property)
+{
+}
+
+esp_err_t esp_mqtt5_client_set_connect_property(esp_mqtt_client_handle_t client,
+                                                const esp_mqtt5_connection_property_config_t *connect_property)
+{
+    return ESP_OK;
+}
+
+esp_err_t esp_mqtt5_client_set_publish_property(esp_mqtt_client_handle_t client,
+                                                const esp_mqtt5_publish_property_config_t *property)
+{
+    // esp-mqtt checks the alias against the Topic Alias Maximum of the CONNACK
+    if (property->topic_alias > alias_max) {
+        return ESP_FAIL;
+    }
+
+    client->publish_alias = property->topic_alias;
+    return ESP_OK;
+}
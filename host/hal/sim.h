@@ -0,0 +1,190 @@
+#ifndef __SIM_H__
+#define __SIM_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/*
+ * Control side of the host build: the simulated clock and the scriptable stand-ins for the DHT22 line, the
+ * MAX17048, the WiFi station and the broker. Firmware code never includes this, only the harnesses under host/ do.
+ *
+ * Time only moves when every task is blocked (or a task busy-waits with esp_rom_delay_us()), it then jumps to the
+ * next deadline. An hour of operation runs in well under a second and every run is deterministic.
+ */
+
+/* == Scheduler and clock (freertos_sim.c) ================================ */
+
+/**
+ * @brief Turn the calling thread into the first task, "main" at priority 1 like app_main. Call before anything else.
+ */
+void sim_init(void);
+
+/**
+ * @brief Simulated time since sim_init() in microseconds
+ */
+int64_t sim_now_us(void);
+
+/**
+ * @brief Busy-wait: move the clock forward without blocking, as esp_rom_delay_us() does
+ */
+void sim_advance_us(uint32_t us);
+
+/**
+ * @brief Put the WiFi and LwIP tasks under load: every period_us they take busy_us of core 0
+ *
+ * A task pinned to core 1 is not affected. A task on core 0 or without affinity that busy-waits loses the CPU for
+ * every burst, unless it suspended the scheduler: the burst is then deferred, see sim_radio_deferred_us().
+ * A period of 0 turns the load off.
+ */
+void sim_radio_load(uint32_t period_us, uint32_t busy_us);
+
+/**
+ * @brief Radio time held back by tasks that suspended the scheduler on core 0
+ */
+int64_t sim_radio_deferred_us(void);
+
+/* == System (esp_fake.c) ================================================= */
+
+/**
+ * @brief Cap the firmware log level on top of esp_log_level_set(), ESP_LOG_WARN by default
+ */
+void sim_log_set_max_level(int level);
+
+/**
+ * @brief Keep NVS in a file, as the flash of a device keeps it across a reboot
+ *
+ * Loads the entries the file holds, if it exists, and writes all of them back on every nvs_commit() and
+ * nvs_flash_erase(). Without it NVS starts empty and lives in RAM only. Call before app_main().
+ */
+void sim_nvs_set_file(const char *path);
+
+/**
+ * @brief Boot an image from OTA slot 0 or 1, as the bootloader would after an update
+ *
+ * Writes the image to the slot and makes it the running and boot partition. pending_verify boots it as a new image
+ * that has to confirm itself, otherwise it is valid already. The other slot keeps what it holds, the image a
+ * rollback returns to. Without a call the node runs from an empty ota_0. Call before app_main().
+ */
+void sim_ota_set_running(uint8_t slot, const void *image, size_t len, bool pending_verify);
+
+/* == DHT22 line (gpio_fake.c) ============================================ */
+
+/**
+ * @brief Script for the sensor: called once per start signal with the simulated time
+ *
+ * @param data output, the 5 frame bytes to send (humidity, temperature, checksum)
+ * @return false to leave the line idle, the reader times out
+ */
+typedef bool (*dht_line_source_t)(int64_t now_us, uint8_t data[5], void *ctx);
+
+void dht_line_set_source(dht_line_source_t source, void *ctx);
+
+/**
+ * @brief Script for the line of DHT22 sensor n (0 .. CONFIG_ESP_DHT_SENSOR_COUNT - 1), dht_line_set_source() is n = 0
+ */
+void dht_line_set_source_at(uint8_t sensor, dht_line_source_t source, void *ctx);
+
+/**
+ * @brief Frame bytes for a reading in 0.1 units with a valid checksum
+ */
+void dht_line_frame(int16_t temperature, uint16_t humidity, uint8_t data[5]);
+
+/**
+ * @brief Number of start signals the line saw
+ */
+uint32_t dht_line_requests(void);
+
+/**
+ * @brief Number of start signals the line of DHT22 sensor n saw
+ */
+uint32_t dht_line_requests_at(uint8_t sensor);
+
+/**
+ * @brief Drive an input pin, a falling or rising edge runs its ISR handler (e.g. the MAX17048 ALERT pin)
+ */
+void gpio_fake_set_input(int pin, int level);
+
+/* == MAX17048 register model (i2c_fake.c) ================================ */
+
+void max17048_model_set(uint16_t vcell, uint16_t soc);
+void max17048_model_set_present(bool present);
+
+/**
+ * @brief Fail the next count I2C transactions with the device
+ */
+void max17048_model_fail(uint32_t count);
+
+/**
+ * @brief Fail count I2C transactions with the device from the given one on, counted from 1 as
+ *        max17048_model_transactions() counts them
+ */
+void max17048_model_fail_at(uint32_t transaction, uint32_t count);
+
+uint16_t max17048_model_reg(uint8_t address);
+uint32_t max17048_model_transactions(void);
+
+/* == WiFi station (wifi_fake.c) ========================================== */
+
+void wifi_fake_set_available(bool available);
+void wifi_fake_set_latency_ms(uint32_t connect_ms);
+
+/* == Broker and capture sink (mqtt_fake.c) ================================ */
+
+typedef struct {
+    int64_t time_us;
+    char topic[128];            /*!< as the broker sees it, topic aliases resolved */
+    uint8_t payload[1024];
+    size_t len;
+    int qos;
+    int retain;
+    uint16_t alias;             /*!< topic alias property, 0 if none */
+    size_t wire_bytes;          /*!< size of the MQTT5 PUBLISH packet */
+} mqtt_capture_t;
+
+typedef struct {
+    uint32_t connects;
+    uint32_t publishes;
+    uint32_t pubacks;
+    uint32_t lost;              /*!< QoS1 publishes whose PUBACK was lost to a disconnect */
+    uint32_t resent;            /*!< outbox publishes sent again after a reconnect */
+    uint32_t protocol_errors;   /*!< e.g. an unknown topic alias, the broker would have dropped the connection */
+    uint64_t wire_bytes;
+    uint32_t subscribes;
+    uint32_t delivered;         /*!< messages delivered to the client, see mqtt_fake_publish() */
+} mqtt_fake_stats_t;
+
+/**
+ * @brief Bring the broker up or down, going down drops the connection
+ */
+void mqtt_fake_set_online(bool online);
+void mqtt_fake_set_latency_ms(uint32_t connect_ms, uint32_t puback_ms);
+
+/**
+ * @brief Topic Alias Maximum the broker grants in its CONNACK
+ */
+void mqtt_fake_set_topic_alias_max(uint16_t max);
+
+/**
+ * @brief The station lost the AP, the broker connection goes with it. Called by wifi_fake.c.
+ */
+void mqtt_fake_network_lost(void);
+
+/**
+ * @brief Publish to the broker as another client would, e.g. a configuration message for the node
+ *
+ * Reaches the client as MQTT_EVENT_DATA if it subscribed to the topic on the current connection, exact matches
+ * only. A retained message is also kept for later subscriptions, an empty one deletes it.
+ */
+void mqtt_fake_publish(const char *topic, const void *data, size_t len, bool retain);
+
+const mqtt_capture_t *mqtt_fake_captured(size_t *count);
+const mqtt_fake_stats_t *mqtt_fake_stats(void);
+
+/**
+ * @brief Write the captured publishes as CSV: time_ms,topic,qos,retain,alias,wire_bytes,payload (hex)
+ */
+void mqtt_fake_write_capture(FILE *file);
+
+#endif // __SIM_H__
@@ -0,0 +1,98 @@
+#include "freertos/FreeRTOS.h"
+#include "freertos/timers.h"
+#include "esp_log.h"
+#include "esp_wifi.h"
+#include "wifi.h"
+#include "diag.h"
+#include "connectivity.h"
+#include "sim.h"
+
+/*
+ * Stands in for main/wifi.c as a whole: a connect attempt reports CONN_EVENT_WIFI_UP or _DOWN to the connectivity
+ * manager after the configured latency, depending on whether the harness made the AP available.
+ */
+
+static const char *TAG = "WiFi";
+
+static bool available = true;
+static uint32_t latency_ms = 1500;
+static bool connected = false;
+static bool radio_on = false;
+static TimerHandle_t attempt_timer = NULL;
+
+static void attempt_done(TimerHandle_t timer)
+{
+    if (!available) {
+        ESP_LOGI(TAG, "connect to the AP fail");
+        connectivity_notify(CONN_EVENT_WIFI_DOWN);
+        return;
+    }
+
+    connected = true;
+    ESP_LOGI(TAG, "got ip:192.168.1.50");
+    if (diag_milestone(DIAG_MILESTONE_IP)) {
+        ESP_LOGI(TAG, "Boot to IP: %" PRIu32 " ms", diag_milestone_ms(DIAG_MILESTONE_IP));
+    }
+    connectivity_notify(CONN_EVENT_WIFI_UP);
+}
+
+void wifi_fake_set_available(bool is_available)
+{
+    available = is_available;
+
+    if (!available && connected) {
+        connected = false;
+        ESP_LOGI(TAG, "lost the AP");
+        mqtt_fake_network_lost();
+        connectivity_notify(CONN_EVENT_WIFI_DOWN);
+    }
+}
+
+void wifi_fake_set_latency_ms(uint32_t connect_ms)
+{
+    latency_ms = connect_ms;
+}
+
+esp_err_t wifi_init_sta(void)
+{
+    attempt_timer = xTimerCreate("wifi_attempt", pdMS_TO_TICKS(latency_ms), pdFALSE, NULL, attempt_done);
+    if (attempt_timer == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    radio_on = true;
+    ESP_LOGI(TAG, "wifi_init_sta finished.");
+    return ESP_OK;
+}
+
+void wifi_connect(void)
+{
+    radio_on = true;
+    ESP_LOGI(TAG, "connecting to SSID:%s", ESP_WIFI_SSID);
+    xTimerChangePeriod(attempt_timer, pdMS_TO_TICKS(latency_ms) > 0 ? pdMS_TO_TICKS(latency_ms) : 1, 0);
+}
+
+void wifi_radio_off(void)
+{
+    if (radio_on && !connected) {
+        ESP_LOGI(TAG, "radio off until the next attempt");
+        radio_on = false;
+    }
+}
+
+bool wifi_is_connected(void)
+{
+    return connected;
+}
+
+esp_err_t esp_wifi_set_ps(wifi_ps_type_t type)
+{
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_stop(void)
+{
+    connected = false;
+    radio_on = false;
+    return ESP_OK;
+}
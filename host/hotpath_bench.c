@@ -0,0 +1,44 @@
+/*
+ * Runs the hot path micro-benchmarks of main/bench.c on the host, one JSON line per benchmark on stdout. The times
+ * are nanoseconds of this machine: good for comparing two versions of the code on the same machine, not for cycle
+ * budgets on the device. The queue benchmarks measure the FreeRTOS stand-in of host/hal, not FreeRTOS.
+ *
+ *   hotpath_bench [-n iterations] > results.jsonl
+ *   bench_compare baseline.jsonl results.jsonl      (tools/bench_compare.c)
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "esp_log.h"
+#include "bench.h"
+#include "sim.h"
+
+int main(int argc, char **argv)
+{
+    uint32_t iterations = CONFIG_ESP_BENCHMARK_ITERATIONS;
+    int opt;
+
+    sim_init();
+    // log_esp_logi formats at the INFO level of app_main(), the lines themselves are dropped
+    sim_log_set_max_level(ESP_LOG_INFO);
+
+    while ((opt = getopt(argc, argv, "n:")) != -1) {
+        switch (opt) {
+            case 'n':
+                iterations = (uint32_t)atoi(optarg);
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-n iterations]\n", argv[0]);
+                return 2;
+        }
+    }
+    if (iterations == 0) {
+        fprintf(stderr, "iterations must be at least 1\n");
+        return 2;
+    }
+
+    bench_run_all(iterations);
+    return 0;
+}
@@ -0,0 +1,14 @@
+#ifndef __HOST_ESP_APP_DESC_H__
+#define __HOST_ESP_APP_DESC_H__
+
+typedef struct {
+    char version[32];           /*!< git describe of the tree, HOST_APP_VERSION */
+    char project_name[32];
+    char time[16];
+    char date[16];
+    char idf_ver[32];
+} esp_app_desc_t;
+
+const esp_app_desc_t *esp_app_get_description(void);
+
+#endif // __HOST_ESP_APP_DESC_H__
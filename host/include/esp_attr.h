@@ -0,0 +1,7 @@
+#ifndef __HOST_ESP_ATTR_H__
+#define __HOST_ESP_ATTR_H__
+
+#define IRAM_ATTR
+#define RTC_DATA_ATTR
+
+#endif // __HOST_ESP_ATTR_H__
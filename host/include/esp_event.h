@@ -0,0 +1,13 @@
+#ifndef __HOST_ESP_EVENT_H__
+#define __HOST_ESP_EVENT_H__
+
+#include <stdint.h>
+
+#include "esp_err.h"
+
+typedef const char *esp_event_base_t;
+typedef void (*esp_event_handler_t)(void *args, esp_event_base_t base, int32_t event_id, void *event_data);
+
+#define ESP_EVENT_ANY_ID    -1
+
+#endif // __HOST_ESP_EVENT_H__
@@ -0,0 +1,43 @@
+#ifndef __HOST_ESP_LOG_H__
+#define __HOST_ESP_LOG_H__
+
+#include <inttypes.h>
+#include <stdarg.h>
+
+#include "esp_err.h"
+
+/* Same levels and line format as ESP-IDF, the timestamp is simulated time in ms */
+
+typedef enum {
+    ESP_LOG_NONE = 0,
+    ESP_LOG_ERROR,
+    ESP_LOG_WARN,
+    ESP_LOG_INFO,
+    ESP_LOG_DEBUG,
+    ESP_LOG_VERBOSE,
+} esp_log_level_t;
+
+typedef int (*vprintf_like_t)(const char *format, va_list args);
+
+void esp_log_level_set(const char *tag, esp_log_level_t level);
+
+/**
+ * @brief Send the log lines somewhere else than stdout, returns the function used so far
+ */
+vprintf_like_t esp_log_set_vprintf(vprintf_like_t func);
+
+void esp_log_write(esp_log_level_t level, const char *tag, const char *format, ...)
+        __attribute__((format(printf, 3, 4)));
+
+#define ESP_LOG_LEVEL_LOCAL(level, tag, letter, format, ...) \
+    esp_log_write(level, tag, letter " (%" PRIu32 ") %s: " format "\n", esp_log_timestamp(), tag, ##__VA_ARGS__)
+
+#define ESP_LOGE(tag, format, ...)  ESP_LOG_LEVEL_LOCAL(ESP_LOG_ERROR, tag, "E", format, ##__VA_ARGS__)
+#define ESP_LOGW(tag, format, ...)  ESP_LOG_LEVEL_LOCAL(ESP_LOG_WARN, tag, "W", format, ##__VA_ARGS__)
+#define ESP_LOGI(tag, format, ...)  ESP_LOG_LEVEL_LOCAL(ESP_LOG_INFO, tag, "I", format, ##__VA_ARGS__)
+#define ESP_LOGD(tag, format, ...)  ESP_LOG_LEVEL_LOCAL(ESP_LOG_DEBUG, tag, "D", format, ##__VA_ARGS__)
+#define ESP_LOGV(tag, format, ...)  ESP_LOG_LEVEL_LOCAL(ESP_LOG_VERBOSE, tag, "V", format, ##__VA_ARGS__)
+
+uint32_t esp_log_timestamp(void);
+
+#endif // __HOST_ESP_LOG_H__
@@ -0,0 +1,11 @@
+#ifndef __HOST_ESP_RANDOM_H__
+#define __HOST_ESP_RANDOM_H__
+
+#include <stdint.h>
+
+/**
+ * @brief Deterministic pseudo-random sequence, the same on every run
+ */
+uint32_t esp_random(void);
+
+#endif // __HOST_ESP_RANDOM_H__
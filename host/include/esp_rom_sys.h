@@ -0,0 +1,11 @@
+#ifndef __HOST_ESP_ROM_SYS_H__
+#define __HOST_ESP_ROM_SYS_H__
+
+#include <stdint.h>
+
+/**
+ * @brief Busy-wait, advances the simulated clock
+ */
+void esp_rom_delay_us(uint32_t us);
+
+#endif // __HOST_ESP_ROM_SYS_H__
@@ -0,0 +1,15 @@
+#ifndef __HOST_ESP_SLEEP_H__
+#define __HOST_ESP_SLEEP_H__
+
+#include <stdint.h>
+
+#include "esp_err.h"
+
+esp_err_t esp_sleep_enable_timer_wakeup(uint64_t time_in_us);
+
+/**
+ * @brief Ends the simulation, there is no wake-up on the host
+ */
+void esp_deep_sleep_start(void) __attribute__((noreturn));
+
+#endif // __HOST_ESP_SLEEP_H__
@@ -0,0 +1,14 @@
+#ifndef __HOST_ESP_SYSTEM_H__
+#define __HOST_ESP_SYSTEM_H__
+
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "esp_rom_sys.h"
+
+uint32_t esp_get_free_heap_size(void);
+uint32_t esp_get_minimum_free_heap_size(void);
+const char *esp_get_idf_version(void);
+void esp_restart(void) __attribute__((noreturn));
+
+#endif // __HOST_ESP_SYSTEM_H__
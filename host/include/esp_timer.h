@@ -0,0 +1,11 @@
+#ifndef __HOST_ESP_TIMER_H__
+#define __HOST_ESP_TIMER_H__
+
+#include <stdint.h>
+
+/**
+ * @brief Simulated time since boot in microseconds
+ */
+int64_t esp_timer_get_time(void);
+
+#endif // __HOST_ESP_TIMER_H__
@@ -0,0 +1,17 @@
+#ifndef __HOST_ESP_WIFI_H__
+#define __HOST_ESP_WIFI_H__
+
+#include "esp_err.h"
+
+/* Only the power save calls, the station itself is replaced as a whole by host/hal/wifi_fake.c */
+
+typedef enum {
+    WIFI_PS_NONE = 0,
+    WIFI_PS_MIN_MODEM,
+    WIFI_PS_MAX_MODEM,
+} wifi_ps_type_t;
+
+esp_err_t esp_wifi_set_ps(wifi_ps_type_t type);
+esp_err_t esp_wifi_stop(void);
+
+#endif // __HOST_ESP_WIFI_H__
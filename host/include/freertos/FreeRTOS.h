@@ -0,0 +1,170 @@
+#ifndef __HOST_FREERTOS_H__
+#define __HOST_FREERTOS_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <inttypes.h>
+
+/*
+ * FreeRTOS stand-in for the host build, the subset of the API the firmware uses. Tasks are threads, but only one
+ * of them runs at a time and the clock is simulated, see host/hal/freertos_sim.c. Dynamic tasks and queues take
+ * their stack and storage from the heap as on the device, the static variants take none for them. Control blocks
+ * are always allocated and left out of that.
+ */
+
+#define configTICK_RATE_HZ          CONFIG_FREERTOS_HZ
+#define configMINIMAL_STACK_SIZE    768
+#define configMAX_PRIORITIES        25
+
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint8_t StackType_t;            /*!< ESP-IDF counts stack depth in bytes */
+typedef uint32_t EventBits_t;
+
+#define pdFALSE                     0
+#define pdTRUE                      1
+#define pdFAIL                      pdFALSE
+#define pdPASS                      pdTRUE
+#define portMAX_DELAY               ((TickType_t)0xFFFFFFFF)
+#define portTICK_PERIOD_MS          (1000 / configTICK_RATE_HZ)
+#define pdMS_TO_TICKS(ms)           ((TickType_t)(((uint64_t)(ms) * configTICK_RATE_HZ) / 1000))
+#define pdTICKS_TO_MS(ticks)        ((uint32_t)(((uint64_t)(ticks) * 1000) / configTICK_RATE_HZ))
+#define tskNO_AFFINITY              0x7FFFFFFF
+#define portNUM_PROCESSORS          2           /*!< as the ESP32, so tasks are pinned the way the device pins them */
+
+#define BIT0                        0x00000001
+#define BIT1                        0x00000002
+#define BIT2                        0x00000004
+#define BIT3                        0x00000008
+
+/* only one task runs at a time, critical sections have nothing to exclude */
+typedef struct {
+    int unused;
+} portMUX_TYPE;
+
+#define portMUX_INITIALIZER_UNLOCKED    { 0 }
+#define portENTER_CRITICAL(mux)         ((void)(mux))
+#define portEXIT_CRITICAL(mux)          ((void)(mux))
+#define portENTER_CRITICAL_ISR(mux)     ((void)(mux))
+#define portEXIT_CRITICAL_ISR(mux)      ((void)(mux))
+#define taskENTER_CRITICAL(mux)         ((void)(mux))
+#define taskEXIT_CRITICAL(mux)          ((void)(mux))
+#define portYIELD_FROM_ISR(woken)       do { if (woken) { taskYIELD(); } } while (0)
+#define taskYIELD()                     sim_yield()
+
+/* == Tasks =============================================================== */
+
+typedef struct sim_task *TaskHandle_t;
+typedef void (*TaskFunction_t)(void *);
+
+typedef struct {
+    int unused;
+} StaticTask_t;
+
+BaseType_t xTaskCreate(TaskFunction_t function, const char *name, uint32_t stack_depth, void *params,
+                       UBaseType_t priority, TaskHandle_t *task);
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t function, const char *name, uint32_t stack_depth, void *params,
+                                   UBaseType_t priority, TaskHandle_t *task, BaseType_t core);
+TaskHandle_t xTaskCreateStatic(TaskFunction_t function, const char *name, uint32_t stack_depth, void *params,
+                               UBaseType_t priority, StackType_t *stack, StaticTask_t *tcb);
+TaskHandle_t xTaskCreateStaticPinnedToCore(TaskFunction_t function, const char *name, uint32_t stack_depth,
+                                           void *params, UBaseType_t priority, StackType_t *stack, StaticTask_t *tcb,
+                                           BaseType_t core);
+void vTaskDelete(TaskHandle_t task);
+void vTaskDelay(TickType_t ticks);
+void vTaskSuspend(TaskHandle_t task);
+void vTaskSuspendAll(void);
+BaseType_t xTaskResumeAll(void);
+void vTaskResume(TaskHandle_t task);
+TickType_t xTaskGetTickCount(void);
+TickType_t xTaskGetTickCountFromISR(void);
+TaskHandle_t xTaskGetCurrentTaskHandle(void);
+const char *pcTaskGetName(TaskHandle_t task);
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task);
+UBaseType_t uxTaskPriorityGet(TaskHandle_t task);
+BaseType_t xTaskGetCoreID(TaskHandle_t task);
+uint32_t ulTaskNotifyTake(BaseType_t clear_on_exit, TickType_t ticks);
+BaseType_t xTaskNotifyGive(TaskHandle_t task);
+void vTaskNotifyGiveFromISR(TaskHandle_t task, BaseType_t *higher_priority_task_woken);
+void sim_yield(void);
+
+/* == Queues and queue sets =============================================== */
+
+typedef struct sim_queue *QueueHandle_t;
+typedef struct sim_queue *QueueSetHandle_t;
+typedef struct sim_queue *QueueSetMemberHandle_t;
+
+typedef struct {
+    int unused;
+} StaticQueue_t;
+
+#define queueSEND_TO_BACK           0
+#define queueSEND_TO_FRONT          1
+#define queueOVERWRITE              2
+
+#define queueQUEUE_TYPE_BASE        0
+#define queueQUEUE_TYPE_SET         0
+
+QueueHandle_t xQueueGenericCreate(UBaseType_t length, UBaseType_t item_size, uint8_t type);
+QueueHandle_t xQueueGenericCreateStatic(UBaseType_t length, UBaseType_t item_size, uint8_t *storage,
+                                        StaticQueue_t *buffer, uint8_t type);
+QueueSetHandle_t xQueueCreateSet(UBaseType_t length);
+void vQueueDelete(QueueHandle_t queue);
+BaseType_t xQueueGenericSend(QueueHandle_t queue, const void *item, TickType_t ticks, BaseType_t position);
+BaseType_t xQueueGenericSendFromISR(QueueHandle_t queue, const void *item, BaseType_t *higher_priority_task_woken,
+                                    BaseType_t position);
+BaseType_t xQueueReceive(QueueHandle_t queue, void *buffer, TickType_t ticks);
+BaseType_t xQueuePeek(QueueHandle_t queue, void *buffer, TickType_t ticks);
+BaseType_t xQueueReset(QueueHandle_t queue);
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue);
+BaseType_t xQueueAddToSet(QueueSetMemberHandle_t member, QueueSetHandle_t set);
+QueueSetMemberHandle_t xQueueSelectFromSet(QueueSetHandle_t set, TickType_t ticks);
+
+#define xQueueCreate(length, item_size) \
+    xQueueGenericCreate((length), (item_size), queueQUEUE_TYPE_BASE)
+#define xQueueCreateStatic(length, item_size, storage, buffer) \
+    xQueueGenericCreateStatic((length), (item_size), (storage), (buffer), queueQUEUE_TYPE_BASE)
+#define xQueueSend(queue, item, ticks)                  xQueueGenericSend((queue), (item), (ticks), queueSEND_TO_BACK)
+#define xQueueSendToBack(queue, item, ticks)            xQueueGenericSend((queue), (item), (ticks), queueSEND_TO_BACK)
+#define xQueueSendToFront(queue, item, ticks)           xQueueGenericSend((queue), (item), (ticks), queueSEND_TO_FRONT)
+#define xQueueOverwrite(queue, item)                    xQueueGenericSend((queue), (item), 0, queueOVERWRITE)
+#define xQueueSendFromISR(queue, item, woken)           xQueueGenericSendFromISR((queue), (item), (woken), queueSEND_TO_BACK)
+#define xQueueOverwriteFromISR(queue, item, woken)      xQueueGenericSendFromISR((queue), (item), (woken), queueOVERWRITE)
+
+/* == Event groups ======================================================== */
+
+typedef struct sim_event_group *EventGroupHandle_t;
+
+typedef struct {
+    int unused;
+} StaticEventGroup_t;
+
+EventGroupHandle_t xEventGroupCreate(void);
+EventGroupHandle_t xEventGroupCreateStatic(StaticEventGroup_t *buffer);
+EventBits_t xEventGroupSetBits(EventGroupHandle_t group, EventBits_t bits);
+EventBits_t xEventGroupClearBits(EventGroupHandle_t group, EventBits_t bits);
+EventBits_t xEventGroupGetBits(EventGroupHandle_t group);
+EventBits_t xEventGroupWaitBits(EventGroupHandle_t group, EventBits_t bits, BaseType_t clear_on_exit,
+                                BaseType_t wait_for_all, TickType_t ticks);
+
+/* == Software timers ===================================================== */
+
+typedef struct sim_timer *TimerHandle_t;
+typedef void (*TimerCallbackFunction_t)(TimerHandle_t timer);
+
+typedef struct {
+    int unused;
+} StaticTimer_t;
+
+TimerHandle_t xTimerCreate(const char *name, TickType_t period, UBaseType_t auto_reload, void *id,
+                           TimerCallbackFunction_t callback);
+TimerHandle_t xTimerCreateStatic(const char *name, TickType_t period, UBaseType_t auto_reload, void *id,
+                                 TimerCallbackFunction_t callback, StaticTimer_t *buffer);
+BaseType_t xTimerStart(TimerHandle_t timer, TickType_t ticks);
+BaseType_t xTimerStop(TimerHandle_t timer, TickType_t ticks);
+BaseType_t xTimerChangePeriod(TimerHandle_t timer, TickType_t period, TickType_t ticks);
+void *pvTimerGetTimerID(TimerHandle_t timer);
+
+#endif // __HOST_FREERTOS_H__
@@ -0,0 +1,7 @@
+#ifndef __HOST_FREERTOS_EVENT_GROUPS_H__
+#define __HOST_FREERTOS_EVENT_GROUPS_H__
+
+/* The whole FreeRTOS stand-in API lives in FreeRTOS.h */
+#include "freertos/FreeRTOS.h"
+
+#endif // __HOST_FREERTOS_EVENT_GROUPS_H__
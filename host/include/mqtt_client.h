@@ -0,0 +1,149 @@
+#ifndef __HOST_MQTT_CLIENT_H__
+#define __HOST_MQTT_CLIENT_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "esp_event.h"
+#include "esp_system.h"
+
+/*
+ * esp-mqtt stand-in, the configuration and event shapes the firmware uses. The client talks to the simulated broker
+ * of host/hal/mqtt_fake.c and delivers its events from its own task, as esp-mqtt does. Publishing while
+ * disconnected fails for every QoS (MQTT_SKIP_PUBLISH_IF_DISCONNECTED). Messages arrive whole, in one
+ * MQTT_EVENT_DATA.
+ */
+
+typedef struct esp_mqtt_client *esp_mqtt_client_handle_t;
+
+typedef enum {
+    MQTT_PROTOCOL_UNDEFINED = 0,
+    MQTT_PROTOCOL_V_3_1,
+    MQTT_PROTOCOL_V_3_1_1,
+    MQTT_PROTOCOL_V_5,
+} esp_mqtt_protocol_ver_t;
+
+typedef enum {
+    MQTT_EVENT_ANY = -1,
+    MQTT_EVENT_ERROR = 0,
+    MQTT_EVENT_CONNECTED,
+    MQTT_EVENT_DISCONNECTED,
+    MQTT_EVENT_SUBSCRIBED,
+    MQTT_EVENT_UNSUBSCRIBED,
+    MQTT_EVENT_PUBLISHED,
+    MQTT_EVENT_DATA,
+    MQTT_EVENT_BEFORE_CONNECT,
+    MQTT_EVENT_DELETED,
+    MQTT_USER_EVENT,
+} esp_mqtt_event_id_t;
+
+typedef struct esp_mqtt_event {
+    esp_mqtt_event_id_t event_id;
+    esp_mqtt_client_handle_t client;
+    char *data;
+    int data_len;
+    char *topic;
+    int topic_len;
+    int msg_id;
+    int session_present;
+    int total_data_len;
+    int current_data_offset;
+    int qos;
+    bool retain;
+} esp_mqtt_event_t;
+
+typedef esp_mqtt_event_t *esp_mqtt_event_handle_t;
+
+typedef struct {
+    struct {
+        struct {
+            const char *uri;
+        } address;
+    } broker;
+    struct {
+        const char *username;
+        const char *client_id;
+        struct {
+            const char *password;
+        } authentication;
+    } credentials;
+    struct {
+        struct {
+            const char *topic;
+            const char *msg;
+            int msg_len;
+            int qos;
+            int retain;
+        } last_will;
+        bool disable_clean_session;
+        int keepalive;
+        esp_mqtt_protocol_ver_t protocol_ver;
+    } session;
+    struct {
+        int reconnect_timeout_ms;
+        int timeout_ms;
+        bool disable_auto_reconnect;
+    } network;
+} esp_mqtt_client_config_t;
+
+/* == MQTT5 properties ==================================================== */
+
+typedef struct mqtt5_user_property_list_t *mqtt5_user_property_handle_t;
+
+typedef struct {
+    const char *key;
+    const char *value;
+} esp_mqtt5_user_property_item_t;
+
+typedef struct {
+    uint32_t session_expiry_interval;
+    uint32_t maximum_packet_size;
+    uint16_t receive_maximum;
+    uint16_t topic_alias_maximum;
+    bool request_resp_info;
+    bool request_problem_info;
+    mqtt5_user_property_handle_t user_property;
+    uint32_t will_delay_interval;
+    uint32_t message_expiry_interval;
+    bool payload_format_indicator;
+    const char *content_type;
+    const char *response_topic;
+    const char *correlation_data;
+    uint16_t correlation_data_len;
+    mqtt5_user_property_handle_t will_user_property;
+} esp_mqtt5_connection_property_config_t;
+
+typedef struct {
+    bool payload_format_indicator;
+    uint32_t message_expiry_interval;
+    uint16_t topic_alias;
+    const char *response_topic;
+    const char *correlation_data;
+    uint16_t correlation_data_len;
+    const char *content_type;
+    mqtt5_user_property_handle_t user_property;
+} esp_mqtt5_publish_property_config_t;
+
+esp_mqtt_client_handle_t esp_mqtt_client_init(const esp_mqtt_client_config_t *config);
+esp_err_t esp_mqtt_client_register_event(esp_mqtt_client_handle_t client, esp_mqtt_event_id_t event,
+                                         esp_event_handler_t event_handler, void *event_handler_arg);
+esp_err_t esp_mqtt_client_start(esp_mqtt_client_handle_t client);
+esp_err_t esp_mqtt_client_reconnect(esp_mqtt_client_handle_t client);
+esp_err_t esp_mqtt_client_disconnect(esp_mqtt_client_handle_t client);
+esp_err_t esp_mqtt_client_stop(esp_mqtt_client_handle_t client);
+int esp_mqtt_client_publish(esp_mqtt_client_handle_t client, const char *topic, const char *data, int len, int qos,
+                            int retain);
+/* a _Generic macro over a single topic and a topic list in esp-mqtt, the firmware only subscribes to single topics */
+int esp_mqtt_client_subscribe(esp_mqtt_client_handle_t client, const char *topic, int qos);
+
+esp_err_t esp_mqtt5_client_set_user_property(mqtt5_user_property_handle_t *user_property,
+                                             esp_mqtt5_user_property_item_t item[], uint8_t item_num);
+void esp_mqtt5_client_delete_user_property(mqtt5_user_property_handle_t user_property);
+esp_err_t esp_mqtt5_client_set_connect_property(esp_mqtt_client_handle_t client,
+                                                const esp_mqtt5_connection_property_config_t *connect_property);
+esp_err_t esp_mqtt5_client_set_publish_property(esp_mqtt_client_handle_t client,
+                                                const esp_mqtt5_publish_property_config_t *property);
+
+#endif // __HOST_MQTT_CLIENT_H__
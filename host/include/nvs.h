@@ -0,0 +1,28 @@
+#ifndef __HOST_NVS_H__
+#define __HOST_NVS_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+
+/* Blob entries of NVS held in RAM, and in a file across runs with sim_nvs_set_file() (sim.h) */
+
+#define ESP_ERR_NVS_NOT_FOUND           0x1102
+#define ESP_ERR_NVS_NOT_ENOUGH_SPACE    0x1105
+#define ESP_ERR_NVS_INVALID_LENGTH      0x110c
+
+typedef uint32_t nvs_handle_t;
+
+typedef enum {
+    NVS_READONLY = 0,
+    NVS_READWRITE,
+} nvs_open_mode_t;
+
+esp_err_t nvs_open(const char *name, nvs_open_mode_t open_mode, nvs_handle_t *out_handle);
+esp_err_t nvs_get_blob(nvs_handle_t handle, const char *key, void *out_value, size_t *length);
+esp_err_t nvs_set_blob(nvs_handle_t handle, const char *key, const void *value, size_t length);
+esp_err_t nvs_commit(nvs_handle_t handle);
+void nvs_close(nvs_handle_t handle);
+
+#endif // __HOST_NVS_H__
@@ -0,0 +1,9 @@
+#ifndef __HOST_NVS_FLASH_H__
+#define __HOST_NVS_FLASH_H__
+
+#include "esp_err.h"
+
+esp_err_t nvs_flash_init(void);
+esp_err_t nvs_flash_erase(void);
+
+#endif // __HOST_NVS_FLASH_H__
@@ -0,0 +1,410 @@
+/*
+ * Drives firmware updates through the firmware on the host: app_main() with the real MQTT event handler, mqtt_task,
+ * patch decoder and OTA state, against the broker, flash and otadata stand-ins of host/hal.
+ *
+ * The node runs a synthetic image from ota_0. Its second version moves code around the way a change to the source
+ * does: a function is inserted, every address above it shifts, a string changes. Patches are made with the encoder
+ * of tools/delta_make.c and published like an operator would, the broker hands them over in buffer-sized pieces.
+ *
+ * Without options a patch made for another image is published first and has to be rejected, then one signed with
+ * another key than the one of CONFIG_ESP_OTA_PUBLIC_KEY, which must leave the boot partition alone, then the right
+ * one. Checks that the new image lands byte for byte in ota_1, that ota_1 boots next, that the node restarts once
+ * the state report is acknowledged and that the report carries the patch size and the time it took. The restart
+ * ends the process, the checks run from there.
+ *
+ * -p boots the new image pending verification and checks that the first PUBACK confirms it, -r does the same with
+ * the broker offline and checks that the image is rolled back after ESP_OTA_CONFIRM_TIMEOUT_SEC. Exits with 1 if a
+ * check fails; without CONFIG_ESP_OTA (the default, see sdkconfig.h) there is nothing to check.
+ *
+ *   ota_sim [-p | -r] [-v]
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_ota_ops.h"
+#include "esp_partition.h"
+#include "delta.h"
+#include "delta_encode.h"
+#include "ed25519.h"
+#include "mqtt.h"
+#include "sim.h"
+#include "test.h"
+
+#define IMAGE_SIZE              (192 * 1024)
+#define IMAGE_LOAD_ADDRESS      0x400D0020u
+#define INSERT_OFFSET           (IMAGE_SIZE * 2 / 5)
+#define INSERT_SIZE             96              /*!< the new function */
+#define VERSION_OFFSET          0x20
+
+#define WRONG_PATCH_S           30
+#define FORGED_PATCH_S          45
+#define PATCH_S                 60
+#define RUN_S                   120
+#define ROLLBACK_RUN_S          (CONFIG_ESP_OTA_CONFIRM_TIMEOUT_SEC + 100)
+
+typedef enum {
+    MODE_UPDATE = 0,
+    MODE_CONFIRM,
+    MODE_ROLLBACK,
+} sim_mode_t;
+
+void app_main(void);
+
+#if CONFIG_ESP_OTA
+/* The private key of CONFIG_ESP_OTA_PUBLIC_KEY, test 1 of RFC 8032, and the one of test 2 as a forger's */
+static const uint8_t release_seed[ED25519_SEED_SIZE] = {
+        0x9d, 0x61, 0xb1, 0x9d, 0xef, 0xfd, 0x5a, 0x60, 0xba, 0x84, 0x4a, 0xf4, 0x92, 0xec, 0x2c, 0xc4,
+        0x44, 0x49, 0xc5, 0x69, 0x7b, 0x32, 0x69, 0x19, 0x70, 0x3b, 0xac, 0x03, 0x1c, 0xae, 0x7f, 0x60,
+};
+static const uint8_t forged_seed[ED25519_SEED_SIZE] = {
+        0x4c, 0xcd, 0x08, 0x9b, 0x28, 0xff, 0x96, 0xda, 0x9d, 0xb6, 0xc3, 0x46, 0xec, 0x11, 0x4e, 0x0f,
+        0x5b, 0x8a, 0x31, 0x9f, 0x35, 0xab, 0xa6, 0x24, 0xda, 0x8c, 0xf6, 0xed, 0x4f, 0xb8, 0xa6, 0xfb,
+};
+
+static uint8_t image_v1[IMAGE_SIZE];
+static uint8_t image_v2[IMAGE_SIZE + INSERT_SIZE];
+static size_t patch_len;
+static sim_mode_t mode;
+static int failures;
+
+static void put_le32(uint8_t *bytes, uint32_t value)
+{
+    memcpy(bytes, &value, sizeof(value));
+}
+
+static uint32_t get_le32(const uint8_t *bytes)
+{
+    uint32_t value;
+
+    memcpy(&value, bytes, sizeof(value));
+    return value;
+}
+
+/*
+ * Code-like filler: instruction words from a small set, every 16th word an absolute address into the image. The
+ * positions of the addresses are recorded as a linker would relocate them.
+ */
+static void make_images(void)
+{
+    static bool pointer[IMAGE_SIZE / 4];
+    uint32_t state = 0x1234567;
+
+    image_v1[0] = 0xE9;
+    memcpy(image_v1 + VERSION_OFFSET, "esp32-temp v1.0.0", 17);
+    for (size_t word = 64 / 4; word < IMAGE_SIZE / 4; word++) {
+        uint32_t r = test_random(&state);
+
+        pointer[word] = word % 16 == 0;
+        put_le32(image_v1 + word * 4, pointer[word] ? IMAGE_LOAD_ADDRESS + (r % IMAGE_SIZE & ~3u) :
+                                      0x00A0E000u | (r % 24) << 4 | (r >> 8) % 8);
+    }
+
+    memcpy(image_v2, image_v1, INSERT_OFFSET);
+    for (size_t i = 0; i < INSERT_SIZE; i++) {
+        image_v2[INSERT_OFFSET + i] = (uint8_t)(0x36 + i % 7);
+    }
+    memcpy(image_v2 + INSERT_OFFSET + INSERT_SIZE, image_v1 + INSERT_OFFSET, IMAGE_SIZE - INSERT_OFFSET);
+    memcpy(image_v2 + VERSION_OFFSET, "esp32-temp v1.1.0", 17);
+
+    // relocate: addresses past the insertion point move up
+    for (size_t word = 0; word < IMAGE_SIZE / 4; word++) {
+        size_t at = word * 4 < INSERT_OFFSET ? word * 4 : word * 4 + INSERT_SIZE;
+        uint32_t address = get_le32(image_v1 + word * 4);
+
+        if (pointer[word] && address >= IMAGE_LOAD_ADDRESS + INSERT_OFFSET) {
+            put_le32(image_v2 + at, address + INSERT_SIZE);
+        }
+    }
+}
+
+static bool payload_contains(const mqtt_capture_t *capture, const char *text)
+{
+    char payload[sizeof(capture->payload) + 1];
+
+    memcpy(payload, capture->payload, capture->len);
+    payload[capture->len] = '\0';
+    return strstr(payload, text) != NULL;
+}
+
+static void print_states(void)
+{
+    size_t count;
+    const mqtt_capture_t *captures = mqtt_fake_captured(&count);
+
+    for (size_t i = 0; i < count; i++) {
+        if (strcmp(captures[i].topic, ESP_MQTT_TOPIC_OTA_STATE) == 0) {
+            printf("%8.3f s  %.*s\n", captures[i].time_us / 1e6, (int)captures[i].len, captures[i].payload);
+        }
+    }
+}
+
+/* The published state reports that contain text */
+static uint32_t states_with(const char *text)
+{
+    size_t count;
+    const mqtt_capture_t *captures = mqtt_fake_captured(&count);
+    uint32_t states = 0;
+
+    for (size_t i = 0; i < count; i++) {
+        if (strcmp(captures[i].topic, ESP_MQTT_TOPIC_OTA_STATE) == 0 && captures[i].retain &&
+            payload_contains(&captures[i], text)) {
+            states++;
+        }
+    }
+
+    return states;
+}
+
+static void run_until(uint32_t *now_s, uint32_t second)
+{
+    while (*now_s < second) {
+        vTaskDelay(pdMS_TO_TICKS(1000));
+        (*now_s)++;
+    }
+}
+
+static int codec_read(void *ctx, uint32_t offset, void *dst, size_t len)
+{
+    memcpy(dst, image_v1 + offset, len);
+    return 0;
+}
+
+static int codec_write(void *ctx, const void *src, size_t len)
+{
+    size_t *written = ctx;
+
+    if (*written + len > sizeof(image_v2) || memcmp(image_v2 + *written, src, len) != 0) {
+        return -1;
+    }
+    *written += len;
+    return 0;
+}
+
+/* The decoder on its own, the patch fed in pieces of the given size */
+static delta_result_t apply(const uint8_t *patch, size_t piece)
+{
+    static delta_t delta;
+    uint8_t public_key[ED25519_PUBLIC_KEY_SIZE];
+    size_t written = 0;
+    delta_result_t result = DELTA_OK;
+
+    ed25519_public_key(public_key, release_seed);
+    delta_init(&delta, public_key, codec_read, codec_write, &written);
+    for (size_t offset = 0; offset < patch_len && result == DELTA_OK; offset += piece) {
+        result = delta_feed(&delta, patch + offset, patch_len - offset < piece ? patch_len - offset : piece);
+    }
+
+    return result == DELTA_OK ? delta_finish(&delta) : result;
+}
+
+/* RFC 8032 test 1: the empty message */
+static bool signature_check_value(void)
+{
+    static const uint8_t expected[ED25519_SIGNATURE_SIZE] = {
+            0xe5, 0x56, 0x43, 0x00, 0xc3, 0x60, 0xac, 0x72, 0x90, 0x86, 0xe2, 0xcc, 0x80, 0x6e, 0x82, 0x8a,
+            0x84, 0x87, 0x7f, 0x1e, 0xb8, 0xe5, 0xd9, 0x74, 0xd8, 0x73, 0xe0, 0x65, 0x22, 0x49, 0x01, 0x55,
+            0x5f, 0xb8, 0x82, 0x15, 0x90, 0xa3, 0x3b, 0xac, 0xc6, 0x1e, 0x39, 0x70, 0x1c, 0xf9, 0xb4, 0x6b,
+            0xd2, 0x5b, 0xf5, 0xf0, 0x59, 0x5b, 0xbe, 0x24, 0x65, 0x51, 0x41, 0x43, 0x8e, 0x7a, 0x10, 0x0b,
+    };
+    uint8_t signature[ED25519_SIGNATURE_SIZE];
+    uint8_t public_key[ED25519_PUBLIC_KEY_SIZE];
+    ed25519_verify_t verify;
+
+    ed25519_sign(signature, release_seed, "", 0);
+    ed25519_public_key(public_key, release_seed);
+    ed25519_verify_start(&verify, public_key, expected);
+    return memcmp(signature, expected, sizeof(expected)) == 0 && ed25519_verify_finish(&verify);
+}
+
+static int check_codec(const uint8_t *patch, const uint8_t *forged)
+{
+    uint8_t *corrupt = malloc(patch_len);
+    int result = 0;
+
+    // the CRC-32 check value of zlib and the bootloader
+    result += expect(delta_crc32(0, "123456789", 9) == 0xCBF43926u, "CRC-32 check value");
+    result += expect(signature_check_value(), "Ed25519 signature of RFC 8032 test 1");
+    result += expect(apply(patch, 1) == DELTA_OK && apply(patch, 1000) == DELTA_OK, "patch applies in any pieces");
+
+    // a flipped bit in the body is caught at the latest by the CRC of the image
+    memcpy(corrupt, patch, patch_len);
+    corrupt[DELTA_HEADER_SIZE + (patch_len - DELTA_HEADER_SIZE) / 2] ^= 0x10;
+    result += expect(apply(corrupt, 1000) != DELTA_OK, "corrupt patch rejected");
+
+    // the same image signed with another key, and the right one with a flipped bit in its signature
+    result += expect(apply(forged, 1000) == DELTA_ERR_SIGNATURE, "patch signed with another key rejected");
+    memcpy(corrupt, patch, patch_len);
+    corrupt[DELTA_HEADER_SIZE - 1] ^= 0x01;
+    result += expect(apply(corrupt, 1000) == DELTA_ERR_SIGNATURE, "patch with a damaged signature rejected");
+
+    free(corrupt);
+    return result;
+}
+
+/* esp_restart() ends the process, what it left behind is checked here */
+static void restarted(void)
+{
+    if (mode == MODE_UPDATE) {
+        const esp_partition_t *boot = esp_ota_get_boot_partition();
+        uint8_t *written = malloc(sizeof(image_v2));
+
+        print_states();
+        printf("patch %zu bytes for a %zu byte image (%.1f%%), restart at %.3f s\n", patch_len, sizeof(image_v2),
+               100.0 * patch_len / sizeof(image_v2), sim_now_us() / 1e6);
+
+        failures += expect(states_with("\"state\":\"running\"") == 1, "running version reported on connect");
+        failures += expect(states_with("\"error\":\"made for another image\"") == 1, "patch for another image rejected");
+        failures += expect(states_with("\"error\":\"signature not valid\"") == 1, "patch of another key rejected");
+        failures += expect(boot != NULL && strcmp(boot->label, "ota_1") == 0, "ota_1 boots next");
+        failures += expect(boot != NULL && esp_partition_read(boot, 0, written, sizeof(image_v2)) == ESP_OK &&
+                           memcmp(written, image_v2, sizeof(image_v2)) == 0, "new image written byte for byte");
+        failures += expect(states_with("\"state\":\"applied\"") == 1 && states_with("\"apply_ms\":") == 3 &&
+                           states_with("\"full_image\":false") == 1, "update reported with size and time");
+        failures += expect(patch_len * 10 < sizeof(image_v2), "patch under 10% of the image");
+        failures += expect(sim_now_us() < (PATCH_S + 15) * 1000000LL, "restart after the report went out");
+        free(written);
+    } else if (mode == MODE_ROLLBACK) {
+        const esp_partition_t *boot = esp_ota_get_boot_partition();
+        const esp_partition_t *invalid = esp_ota_get_last_invalid_partition();
+
+        printf("restart at %.3f s\n", sim_now_us() / 1e6);
+        failures += expect(sim_now_us() >= CONFIG_ESP_OTA_CONFIRM_TIMEOUT_SEC * 1000000LL,
+                           "rollback not before the timeout");
+        failures += expect(invalid != NULL && strcmp(invalid->label, "ota_1") == 0, "new image marked invalid");
+        failures += expect(boot != NULL && strcmp(boot->label, "ota_0") == 0, "previous image boots next");
+    } else {
+        failures += expect(false, "no restart");
+    }
+
+    fflush(stdout);
+    _exit(failures ? 1 : 0);
+}
+
+static int update(void)
+{
+    uint32_t now_s = 0;
+    uint8_t *wrong_base = malloc(sizeof(image_v1));
+    size_t wrong_len, forged_len;
+
+    memcpy(wrong_base, image_v1, sizeof(image_v1));
+    wrong_base[VERSION_OFFSET + 11] = '0';
+    uint8_t *wrong = delta_encode(wrong_base, sizeof(image_v1), image_v2, sizeof(image_v2), release_seed,
+                                  &wrong_len, NULL);
+    uint8_t *forged = delta_encode(image_v1, sizeof(image_v1), image_v2, sizeof(image_v2), forged_seed,
+                                   &forged_len, NULL);
+    uint8_t *patch = delta_encode(image_v1, sizeof(image_v1), image_v2, sizeof(image_v2), release_seed,
+                                  &patch_len, NULL);
+
+    failures += check_codec(patch, forged);
+    sim_ota_set_running(0, image_v1, sizeof(image_v1), false);
+    app_main();
+
+    run_until(&now_s, WRONG_PATCH_S);
+    mqtt_fake_publish(ESP_MQTT_TOPIC_OTA, wrong, wrong_len, false);
+    run_until(&now_s, FORGED_PATCH_S);
+    mqtt_fake_publish(ESP_MQTT_TOPIC_OTA, forged, forged_len, false);
+    run_until(&now_s, PATCH_S);
+    failures += expect(strcmp(esp_ota_get_boot_partition()->label, "ota_0") == 0,
+                       "patch of another key left the boot partition alone");
+    mqtt_fake_publish(ESP_MQTT_TOPIC_OTA, patch, patch_len, false);
+    run_until(&now_s, RUN_S);
+
+    // only gets here if the node did not restart
+    free(wrong_base);
+    free(wrong);
+    free(forged);
+    free(patch);
+    return failures;
+}
+
+static int confirm(void)
+{
+    uint32_t now_s = 0;
+    esp_ota_img_states_t state = ESP_OTA_IMG_UNDEFINED;
+
+    sim_ota_set_running(0, image_v1, sizeof(image_v1), false);
+    sim_ota_set_running(1, image_v2, sizeof(image_v2), true);
+    app_main();
+    run_until(&now_s, ROLLBACK_RUN_S);
+
+    print_states();
+    failures += expect(esp_ota_get_state_partition(esp_ota_get_running_partition(), &state) == ESP_OK &&
+                       state == ESP_OTA_IMG_VALID, "new image confirmed");
+    failures += expect(states_with("\"state\":\"pending\"") == 1 && states_with("\"state\":\"confirmed\"") == 1,
+                       "pending and confirmed reported");
+    failures += expect(mqtt_fake_stats()->protocol_errors == 0, "no protocol errors");
+
+    return failures;
+}
+
+static int rollback(void)
+{
+    uint32_t now_s = 0;
+
+    sim_ota_set_running(0, image_v1, sizeof(image_v1), false);
+    sim_ota_set_running(1, image_v2, sizeof(image_v2), true);
+    mqtt_fake_set_online(false);
+    app_main();
+    run_until(&now_s, ROLLBACK_RUN_S);
+
+    return failures;
+}
+
+static bool dht_script(int64_t now_us, uint8_t data[5], void *ctx)
+{
+    dht_line_frame(dht_line_requests() % 2 ? 210 : 230, 500, data);
+    return true;
+}
+#endif
+
+int main(int argc, char **argv)
+{
+    sim_mode_t selected = MODE_UPDATE;
+    int opt;
+
+    sim_init();
+
+    while ((opt = getopt(argc, argv, "prv")) != -1) {
+        switch (opt) {
+            case 'p':
+                selected = MODE_CONFIRM;
+                break;
+            case 'r':
+                selected = MODE_ROLLBACK;
+                break;
+            case 'v':
+                sim_log_set_max_level(ESP_LOG_INFO);
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-p | -r] [-v]\n", argv[0]);
+                return 2;
+        }
+    }
+
+#if CONFIG_ESP_OTA
+    mode = selected;
+    make_images();
+    dht_line_set_source(dht_script, NULL);
+    max17048_model_set(4100 * 64 / 5, 90 * 256);
+    atexit(restarted);
+
+    int result = mode == MODE_UPDATE ? update() : mode == MODE_CONFIRM ? confirm() : rollback();
+    if (mode == MODE_UPDATE || mode == MODE_ROLLBACK) {
+        // the restart was expected by now
+        restarted();
+    }
+    fflush(stdout);
+    _exit(result ? 1 : 0);
+#else
+    (void)selected;
+    printf("firmware updates are off (CONFIG_ESP_OTA), nothing to check\n");
+    return 0;
+#endif
+}
@@ -0,0 +1,421 @@
+/*
+ * Runs the firmware's sampling-to-publish pipeline on the host: app_main() with the real sensor drivers, scheduler,
+ * publisher, deadband, store and forward and MQTT code, against the scripted DHT22 line, MAX17048 model and broker
+ * of host/hal. An hour of simulated time takes well under a second.
+ *
+ * The script: temperature and humidity drift, every 25th DHT22 frame has a bad checksum, the battery discharges, and
+ * the broker is unreachable for five minutes in the middle of the run, with the PUBACKs of the minute before it never
+ * arriving: at QoS1 the client sends those publishes again after the reconnect. The MAX17048 does not acknowledge the
+ * first write that sets it up, nor its retries: the next reading has to set it up again. With
+ * CONFIG_ESP_DHT_SENSOR_COUNT > 1 every further DHT22 line reports the same curve one degree higher per sensor. Checks
+ * that every published value was produced by a sensor, that the checksum errors were counted, that the samples taken
+ * during the outage arrived through the backlog (without CONFIG_ESP_STORE_FORWARD they are lost) and that the broker
+ * saw no protocol errors. Exits with 1 if a check fails.
+ *
+ * -l puts the radio under publish load: the WiFi and LwIP tasks take 120 us of core 0 about every 10 ms. A DHT22
+ * capture that runs there loses bits to it (extra checksum errors and timeouts), one that holds the scheduler there
+ * stalls the radio instead; the sensor task on core 1 (CONFIG_ESP_TASK_SENSOR_CORE) sees neither.
+ *
+ * -q sends the live values at QoS1, as without CONFIG_ESP_MQTT_TOPIC_ALIAS, so that they go through the outbox.
+ *
+ *   pipeline_sim [-d seconds] [-l] [-q] [-o capture.csv] [-v]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_system.h"
+#include "backlog.h"
+#include "battery.h"
+#include "diag.h"
+#include "fixed.h"
+#include "mqtt.h"
+#include "remote_config.h"
+#include "sim.h"
+#include "test.h"
+
+#define DHT_CRC_EVERY           25
+#define OUTAGE_START_S          1200
+#define OUTAGE_END_S            1500
+#define SLOW_ACKS_S             60          /*!< before the outage the broker holds PUBACKs back, they are lost */
+
+#define RADIO_PERIOD_US         10000
+#define RADIO_BUSY_US           120
+
+#define TEMPERATURE_MIN         -400        /* 0.1 °C, the DHT22 range */
+#define TEMPERATURE_MAX         800
+#define HUMIDITY_MAX            1000
+
+void app_main(void);
+
+/* Every value a sensor produced, published values must be among them */
+static bool temperature_seen[TEMPERATURE_MAX - TEMPERATURE_MIN + 1];
+static bool humidity_seen[HUMIDITY_MAX + 1];
+static bool vcell_seen[65536];
+static bool soc_seen[65536];
+static uint32_t crc_errors_sent = 0;
+
+static const char *const dht_topic_suffixes[ESP_DHT_SENSOR_COUNT] = {
+        "",
+#if ESP_DHT_SENSOR_COUNT >= 2
+        CONFIG_ESP_DHT_TOPIC_SUFFIX_1,
+#endif
+#if ESP_DHT_SENSOR_COUNT >= 3
+        CONFIG_ESP_DHT_TOPIC_SUFFIX_2,
+#endif
+#if ESP_DHT_SENSOR_COUNT >= 4
+        CONFIG_ESP_DHT_TOPIC_SUFFIX_3,
+#endif
+};
+
+static bool dht_script(int64_t now_us, uint8_t data[5], void *ctx)
+{
+    uint8_t sensor = (uint8_t)(uintptr_t)ctx;
+    uint32_t request = dht_line_requests_at(sensor);
+    int32_t minute = (int32_t)(now_us / 60000000);
+
+    // a slow triangle wave, one step every minute
+    int16_t temperature = (int16_t)(215 + sensor * 10 + (minute % 40 < 20 ? minute % 40 : 40 - minute % 40) * 3);
+    uint16_t humidity = (uint16_t)(450 + (minute % 30) * 4);
+
+    dht_line_frame(temperature, humidity, data);
+
+    if (request % DHT_CRC_EVERY == 0) {
+        data[4] ^= 0x01;
+        crc_errors_sent++;
+        return true;
+    }
+
+    temperature_seen[temperature - TEMPERATURE_MIN] = true;
+    humidity_seen[humidity] = true;
+    return true;
+}
+
+static void battery_script(uint32_t second)
+{
+    // 4.10 V and 90 % at boot, losing 1 mV and 1/256 % every 10 s
+    uint16_t vcell = (uint16_t)(4100 * 64 / 5 - (second / 10) * 64 / 5);
+    uint16_t soc = (uint16_t)(90 * 256 - second / 10);
+
+    max17048_model_set(vcell, soc);
+    vcell_seen[vcell] = true;
+    soc_seen[soc] = true;
+}
+
+/* Parses a published "%.2f" value back into units of den, false if it is not one */
+static bool parse_value(const mqtt_capture_t *capture, uint32_t den, int32_t *raw, bool *exact)
+{
+    char string[FIXED_STRING_SIZE];
+
+    if (capture->len == 0 || capture->len >= sizeof(string)) {
+        return false;
+    }
+
+    memcpy(string, capture->payload, capture->len);
+    string[capture->len] = '\0';
+
+    char *end;
+    double value = strtod(string, &end);
+    if (*end != '\0') {
+        return false;
+    }
+
+    // the formatter rounds to hundredths, recover the raw value and verify it formats to the same text
+    *raw = (int32_t)(value * den + (value < 0 ? -0.5 : 0.5));
+    char check[FIXED_STRING_SIZE];
+    fixed_format(*raw, den, check, sizeof(check));
+    *exact = strcmp(check, string) == 0;
+    return true;
+}
+
+typedef struct {
+    const char *topic;
+    uint32_t count;
+    uint32_t invalid;
+} topic_check_t;
+
+/* Whether topic is base with the suffix of one of the DHT22 sensors, counts the publish per sensor if asked to */
+static bool dht_topic(const char *topic, const char *base, uint32_t *per_sensor)
+{
+    size_t len = strlen(base);
+
+    if (strncmp(topic, base, len) != 0) {
+        return false;
+    }
+
+    for (size_t i = 0; i < ESP_DHT_SENSOR_COUNT; i++) {
+        if (strcmp(topic + len, dht_topic_suffixes[i]) == 0) {
+            if (per_sensor != NULL) {
+                per_sensor[i]++;
+            }
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static int check_capture(topic_check_t *topics, size_t topic_count, uint32_t *backlog_publishes,
+                         uint32_t *frame_publishes, uint32_t *stats_publishes, uint32_t *dht_publishes)
+{
+    size_t count;
+    const mqtt_capture_t *captures = mqtt_fake_captured(&count);
+    int failures = 0;
+
+    for (size_t i = 0; i < count; i++) {
+        const mqtt_capture_t *capture = &captures[i];
+        int32_t raw = 0;
+        bool exact = false;
+        bool valid = true;
+
+#if CONFIG_ESP_STORE_FORWARD
+        if (strcmp(capture->topic, ESP_MQTT_TOPIC_BACKLOG) == 0) {
+            (*backlog_publishes)++;
+            continue;
+        }
+#endif
+
+#if CONFIG_ESP_MQTT_FRAME
+        if (strcmp(capture->topic, ESP_MQTT_TOPIC_FRAME) == 0) {
+            (*frame_publishes)++;
+            continue;
+        }
+#endif
+
+#if ESP_MQTT_DHT_STATS
+        if (dht_topic(capture->topic, ESP_MQTT_TOPIC_DHT_STATS, NULL)) {
+            (*stats_publishes)++;
+            continue;
+        }
+#endif
+
+        if (dht_topic(capture->topic, ESP_MQTT_TOPIC_TEMPERATURE, dht_publishes)) {
+            valid = parse_value(capture, FIXED_DHT_DEN, &raw, &exact) && exact && raw >= TEMPERATURE_MIN &&
+                    raw <= TEMPERATURE_MAX && temperature_seen[raw - TEMPERATURE_MIN];
+        } else if (dht_topic(capture->topic, ESP_MQTT_TOPIC_HUMIDITY, dht_publishes)) {
+            valid = parse_value(capture, FIXED_DHT_DEN, &raw, &exact) && exact && raw >= 0 && raw <= HUMIDITY_MAX &&
+                    humidity_seen[raw];
+        } else if (strcmp(capture->topic, ESP_MQTT_TOPIC_BATTERY_VOLTAGE) == 0) {
+            // hundredths of a volt do not identify one VCELL value, look for any that formats the same
+            valid = false;
+            if (parse_value(capture, FIXED_VCELL_DEN, &raw, &exact)) {
+                for (int32_t vcell = raw - 128; vcell <= raw + 128 && !valid; vcell++) {
+                    char string[FIXED_STRING_SIZE];
+                    int len = vcell >= 0 && vcell <= 0xFFFF && vcell_seen[vcell] ?
+                              fixed_format(vcell, FIXED_VCELL_DEN, string, sizeof(string)) : -1;
+                    valid = len == (int)capture->len && memcmp(string, capture->payload, capture->len) == 0;
+                }
+            }
+        } else if (strcmp(capture->topic, ESP_MQTT_TOPIC_BATTERY_SOC) == 0) {
+            valid = false;
+            if (parse_value(capture, FIXED_SOC_DEN, &raw, &exact)) {
+                for (int32_t soc = raw - 2; soc <= raw + 2 && !valid; soc++) {
+                    char string[FIXED_STRING_SIZE];
+                    int len = soc >= 0 && soc <= 0xFFFF && soc_seen[soc] ?
+                              fixed_format(soc, FIXED_SOC_DEN, string, sizeof(string)) : -1;
+                    valid = len == (int)capture->len && memcmp(string, capture->payload, capture->len) == 0;
+                }
+            }
+        }
+
+        for (size_t j = 0; j < topic_count; j++) {
+            if (strcmp(capture->topic, topics[j].topic) == 0) {
+                topics[j].count++;
+                if (!valid) {
+                    topics[j].invalid++;
+                }
+            }
+        }
+
+        if (!valid && failures++ < 10) {
+            fprintf(stderr, "FAIL: %s published \"%.*s\", not a value the sensor produced\n", capture->topic,
+                    (int)capture->len, capture->payload);
+        }
+    }
+
+    return failures;
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t duration_s = 3600;
+    const char *capture_path = NULL;
+    bool radio_load = false;
+    bool live_qos1 = false;
+    int opt;
+
+    sim_init();
+
+    while ((opt = getopt(argc, argv, "d:lqo:v")) != -1) {
+        switch (opt) {
+            case 'd':
+                duration_s = (uint32_t)atoi(optarg);
+                break;
+            case 'l':
+                radio_load = true;
+                break;
+            case 'q':
+                live_qos1 = true;
+                break;
+            case 'o':
+                capture_path = optarg;
+                break;
+            case 'v':
+                sim_log_set_max_level(ESP_LOG_INFO);
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-d seconds] [-l] [-q] [-o capture.csv] [-v]\n", argv[0]);
+                return 2;
+        }
+    }
+
+    struct timespec wall_start;
+    clock_gettime(CLOCK_MONOTONIC, &wall_start);
+
+    for (uint8_t sensor = 0; sensor < ESP_DHT_SENSOR_COUNT; sensor++) {
+        dht_line_set_source_at(sensor, dht_script, (void *)(uintptr_t)sensor);
+    }
+    battery_script(0);
+    // probe, version, then the first write of the setup and its retries
+    max17048_model_fail_at(3, I2C_MASTER_RETRIES);
+    if (radio_load) {
+        sim_radio_load(RADIO_PERIOD_US, RADIO_BUSY_US);
+    }
+
+    uint32_t heap_before = esp_get_free_heap_size();
+    app_main();
+    uint32_t heap_taken = heap_before - esp_get_free_heap_size();
+    if (live_qos1) {
+        char error[64];
+
+        // as a configuration message right after the boot would
+        remote_config_update("{\"qos\":1}", 9, error, sizeof(error));
+    }
+
+    // the harness carries on as the main task and changes the world once per simulated second
+    for (uint32_t second = 1; second <= duration_s; second++) {
+        vTaskDelay(pdMS_TO_TICKS(1000));
+        battery_script(second);
+
+        if (second == OUTAGE_START_S - SLOW_ACKS_S) {
+            mqtt_fake_set_latency_ms(50, (SLOW_ACKS_S + 1) * 1000);
+        } else if (second == OUTAGE_START_S) {
+            mqtt_fake_set_online(false);
+        } else if (second == OUTAGE_END_S) {
+            mqtt_fake_set_latency_ms(50, 20);
+            mqtt_fake_set_online(true);
+        }
+    }
+
+    // the last samples get their PUBACKs
+    vTaskDelay(pdMS_TO_TICKS(1000));
+
+    struct timespec wall_end;
+    clock_gettime(CLOCK_MONOTONIC, &wall_end);
+    double wall_s = (double)(wall_end.tv_sec - wall_start.tv_sec) + (wall_end.tv_nsec - wall_start.tv_nsec) / 1e9;
+
+    if (capture_path != NULL) {
+        FILE *file = fopen(capture_path, "w");
+        if (file == NULL) {
+            perror(capture_path);
+            return 2;
+        }
+        mqtt_fake_write_capture(file);
+        fclose(file);
+    }
+
+    topic_check_t topics[] = {
+            { ESP_MQTT_TOPIC_TEMPERATURE, 0, 0 },
+            { ESP_MQTT_TOPIC_HUMIDITY, 0, 0 },
+            { ESP_MQTT_TOPIC_BATTERY_VOLTAGE, 0, 0 },
+            { ESP_MQTT_TOPIC_BATTERY_SOC, 0, 0 },
+    };
+    size_t topic_count = sizeof(topics) / sizeof(topics[0]);
+    uint32_t backlog_publishes = 0;
+    uint32_t frame_publishes = 0;
+    uint32_t stats_publishes = 0;
+    uint32_t dht_publishes[ESP_DHT_SENSOR_COUNT] = { 0 };
+    int failures = check_capture(topics, topic_count, &backlog_publishes, &frame_publishes, &stats_publishes,
+                                 dht_publishes);
+
+    const mqtt_fake_stats_t *stats = mqtt_fake_stats();
+    diag_snapshot_t snapshot;
+    diag_snapshot(&snapshot);
+
+    printf("simulated %" PRIu32 " s in %.3f s wall time (%.0fx)\n", duration_s, wall_s, duration_s / wall_s);
+#if CONFIG_ESP_STATIC_ALLOCATION
+    printf("heap taken by app_main: %" PRIu32 " bytes, static allocation\n", heap_taken);
+#else
+    printf("heap taken by app_main: %" PRIu32 " bytes, dynamic allocation\n", heap_taken);
+#endif
+    printf("DHT22 start signals %" PRIu32 ", MAX17048 transactions %" PRIu32 "\n", dht_line_requests(),
+           max17048_model_transactions());
+    printf("broker: %" PRIu32 " connects, %" PRIu32 " publishes, %" PRIu32 " PUBACKs, %" PRIu32 " lost, %" PRIu32
+           " resent, %" PRIu64 " bytes\n", stats->connects, stats->publishes, stats->pubacks, stats->lost,
+           stats->resent, stats->wire_bytes);
+    for (size_t i = 0; i < topic_count; i++) {
+        printf("  %-40s %5" PRIu32 " publishes, %" PRIu32 " invalid\n", topics[i].topic, topics[i].count,
+               topics[i].invalid);
+    }
+    for (size_t i = 1; i < ESP_DHT_SENSOR_COUNT; i++) {
+        printf("  DHT22 sensor %-27u %5" PRIu32 " publishes on *%s\n", (unsigned)i, dht_publishes[i],
+               dht_topic_suffixes[i]);
+    }
+#if CONFIG_ESP_MQTT_FRAME
+    printf("  %-40s %5" PRIu32 " publishes\n", ESP_MQTT_TOPIC_FRAME, frame_publishes);
+#endif
+#if ESP_MQTT_DHT_STATS
+    printf("  %-40s %5" PRIu32 " publishes\n", ESP_MQTT_TOPIC_DHT_STATS, stats_publishes);
+#endif
+#if CONFIG_ESP_STORE_FORWARD
+    printf("  %-40s %5" PRIu32 " publishes\n", ESP_MQTT_TOPIC_BACKLOG, backlog_publishes);
+#endif
+    printf("diag: DHT CRC %" PRIu32 ", DHT timeout %" PRIu32 ", DHT rejected %" PRIu32 ", queue drops %" PRIu32
+           ", deadband suppressed %" PRIu32 "\n", snapshot.counters[DIAG_COUNTER_DHT_CRC],
+           snapshot.counters[DIAG_COUNTER_DHT_TIMEOUT], snapshot.counters[DIAG_COUNTER_DHT_REJECTED],
+           snapshot.counters[DIAG_COUNTER_QUEUE_DROP], snapshot.counters[DIAG_COUNTER_DEADBAND_SUPPRESSED]);
+    if (radio_load) {
+        printf("radio: %" PRIu32 " us about every %" PRIu32 " us on core 0, %" PRId64 " us held back by captures\n",
+               (uint32_t)RADIO_BUSY_US, (uint32_t)RADIO_PERIOD_US, sim_radio_deferred_us());
+    }
+
+#if !CONFIG_ESP_MQTT_FRAME || CONFIG_ESP_MQTT_FRAME_KEEP_TOPICS
+    for (size_t i = 0; i < topic_count; i++) {
+        failures += expect(topics[i].count > 0, topics[i].topic);
+    }
+    for (size_t i = 1; i < ESP_DHT_SENSOR_COUNT; i++) {
+        failures += expect(dht_publishes[i] > 0, "extra DHT22 sensor published on its own topics");
+    }
+#endif
+#if CONFIG_ESP_MQTT_FRAME
+    failures += expect(frame_publishes > 0, ESP_MQTT_TOPIC_FRAME);
+#endif
+#if ESP_MQTT_DHT_STATS
+    failures += expect(stats_publishes > 0, ESP_MQTT_TOPIC_DHT_STATS);
+#endif
+    failures += expect(snapshot.counters[DIAG_COUNTER_DHT_CRC] == crc_errors_sent, "checksum errors counted");
+    failures += expect(snapshot.counters[DIAG_COUNTER_DHT_TIMEOUT] == 0, "no DHT22 timeouts");
+    failures += expect(stats->protocol_errors == 0, "no protocol errors");
+#if CONFIG_ESP_TASK_SENSOR_CORE == 1
+    failures += expect(sim_radio_deferred_us() == 0, "radio never held back by a capture");
+#endif
+    if (duration_s > OUTAGE_END_S) {
+        failures += expect(stats->connects >= 2, "reconnected after the broker outage");
+        if (remote_config_get()->qos > 0) {
+            failures += expect(stats->lost > 0 && stats->resent >= stats->lost,
+                               "publishes without PUBACK sent again from the outbox after the reconnect");
+        }
+#if CONFIG_ESP_STORE_FORWARD
+        failures += expect(backlog_publishes > 0, "outage samples uploaded from the backlog");
+        failures += expect(backlog_count() == 0, "backlog drained");
+#endif
+    }
+
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,235 @@
+/*
+ * Runs the publisher of main/publisher.c on the host: a reference source sends a sample every second while seven
+ * more sources share the queue set with it, and a consumer task takes the frames as mqtt_task does, each costing
+ * PUBLISH_US of CPU. The sender runs at the priority of the sensor scheduler, above the consumer.
+ *
+ * Each 20 s phase measures how long the reference samples wait in the publisher. The other sources are first
+ * registered but silent, as a missing sensor: they must add nothing. Then they send at their own times, one of them
+ * rate-limited: at most the publish in progress. Then all of them send at the same instant as the reference: one
+ * publish per source ahead of it, however many sources there are. Last, one source floods its queue: at most its
+ * queue depth ahead, and no reference sample is lost.
+ *
+ *   publisher_sim [-v]
+ *
+ * Exits with 1 if a check fails.
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "publisher.h"
+#include "task_plan.h"
+#include "sim.h"
+#include "test.h"
+
+#define REF_PERIOD_MS       1000
+#define PHASE_MS            20000
+#define PUBLISH_US          4000        /*!< encode and client write of one frame */
+#define EXTRA_COUNT         (PUBLISHER_MAX_SOURCES - 1)
+#define EXTRA_DEPTH         3
+#define FLOOD_PER_TICK      5
+#define REF                 EXTRA_COUNT /*!< index of the reference source */
+
+enum {
+    PHASE_SILENT = 0,
+    PHASE_OWN_TIMES,
+    PHASE_SAME_TIME,
+    PHASE_FLOOD,
+    PHASE_COUNT,
+};
+
+typedef struct {
+    uint8_t id;
+    uint32_t sent_us;
+} item_t;
+
+typedef struct {
+    uint32_t sent;
+    uint32_t received;
+    uint64_t total_wait_us;
+    uint32_t max_wait_us;
+} wait_stats_t;
+
+static const char *phase_names[] = { "others silent", "others at own times", "others at the same time",
+                                     "one other floods" };
+
+static publisher_source_t sources[PUBLISHER_MAX_SOURCES];
+static wait_stats_t stats[PHASE_COUNT];
+static volatile bool producer_done = false;
+
+static uint32_t now_us(void)
+{
+    return (uint32_t)sim_now_us();
+}
+
+static void to_frame(const void *item, sensor_frame_t *frame)
+{
+    const item_t *sample = item;
+
+    frame->temperature = sample->id;
+    frame->timestamp = sample->sent_us;
+}
+
+static void send(uint8_t id)
+{
+    item_t item = { .id = id, .sent_us = now_us() };
+
+    if (publisher_send(&sources[id], &item) && id == REF) {
+        stats[item.sent_us / 1000 / PHASE_MS].sent++;
+    }
+}
+
+/* Sends from one task on the tick, as the sensor scheduler does */
+static void producer_task(void *params)
+{
+    while (true) {
+        uint32_t t_ms = pdTICKS_TO_MS(xTaskGetTickCount());
+        uint32_t phase = t_ms / PHASE_MS;
+        uint32_t in_period_ms = t_ms % REF_PERIOD_MS;
+
+        if (phase == PHASE_COUNT) {
+            break;
+        }
+
+        switch (phase) {
+            case PHASE_OWN_TIMES:
+                for (uint8_t i = 0; i < EXTRA_COUNT - 1; i++) {
+                    if (in_period_ms == 100 * (i + 1)) {
+                        send(i);
+                    }
+                }
+                // the rate-limited one samples on every tick
+                send(EXTRA_COUNT - 1);
+                break;
+            case PHASE_SAME_TIME:
+                if (in_period_ms == 0) {
+                    for (uint8_t i = 0; i < EXTRA_COUNT; i++) {
+                        send(i);
+                    }
+                }
+                break;
+            case PHASE_FLOOD:
+                for (int i = 0; i < FLOOD_PER_TICK; i++) {
+                    send(0);
+                }
+                break;
+            default:
+                break;
+        }
+
+        if (in_period_ms == 0) {
+            send(REF);
+        }
+
+        vTaskDelay(1);
+    }
+
+    producer_done = true;
+    vTaskDelete(NULL);
+}
+
+/* Takes the frames as mqtt_task does, the publish of each one keeps the CPU for PUBLISH_US */
+_Noreturn static void consumer_task(void *params)
+{
+    sensor_frame_t frame;
+
+    while (true) {
+        if (!publisher_receive(&frame, portMAX_DELAY)) {
+            continue;
+        }
+
+        if (frame.temperature == REF) {
+            wait_stats_t *phase = &stats[frame.timestamp / 1000 / PHASE_MS];
+            uint32_t wait_us = now_us() - frame.timestamp;
+
+            phase->received++;
+            phase->total_wait_us += wait_us;
+            if (wait_us > phase->max_wait_us) {
+                phase->max_wait_us = wait_us;
+            }
+        }
+        sim_advance_us(PUBLISH_US);
+    }
+}
+
+static void add_source(uint8_t id, const char *name, publisher_policy_t policy, UBaseType_t depth,
+                       uint32_t min_interval_ms)
+{
+    sources[id] = (publisher_source_t) {
+            .name = name,
+            .policy = policy,
+            .depth = depth,
+            .item_size = sizeof(item_t),
+            .min_interval_ms = min_interval_ms,
+            .to_frame = to_frame,
+    };
+    ESP_ERROR_CHECK(publisher_add_source(&sources[id]));
+}
+
+int main(int argc, char **argv)
+{
+    static const char *extra_names[] = { "extra0", "extra1", "extra2", "extra3", "extra4", "extra5", "extra6" };
+    int failures = 0;
+    int opt;
+    char what[96];
+
+    sim_init();
+
+    while ((opt = getopt(argc, argv, "v")) != -1) {
+        switch (opt) {
+            case 'v':
+                sim_log_set_max_level(ESP_LOG_INFO);
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-v]\n", argv[0]);
+                return 2;
+        }
+    }
+
+    ESP_ERROR_CHECK(publisher_init());
+    for (uint8_t i = 0; i < EXTRA_COUNT - 1; i++) {
+        add_source(i, extra_names[i], PUBLISHER_POLICY_FIFO, EXTRA_DEPTH, 0);
+    }
+    add_source(EXTRA_COUNT - 1, extra_names[EXTRA_COUNT - 1], PUBLISHER_POLICY_LATEST, 1, 3000);
+    add_source(REF, "reference", PUBLISHER_POLICY_FIFO, 4, 0);
+
+    xTaskCreate(consumer_task, "consumer", 4096, NULL, TASK_PRIORITY_MQTT, NULL);
+    xTaskCreate(producer_task, "producer", 4096, NULL, TASK_PRIORITY_SENSOR, NULL);
+
+    while (!producer_done) {
+        vTaskDelay(pdMS_TO_TICKS(1000));
+    }
+    vTaskDelay(pdMS_TO_TICKS(1000));
+
+    printf("-- wait of the reference samples in the publisher, %d other sources, %d us per publish\n",
+           EXTRA_COUNT, PUBLISH_US);
+    for (int phase = 0; phase < PHASE_COUNT; phase++) {
+        printf("%-24s %2" PRIu32 " of %2" PRIu32 " received, mean %5" PRIu64 " us, max %5" PRIu32 " us\n",
+               phase_names[phase], stats[phase].received, stats[phase].sent,
+               stats[phase].received > 0 ? stats[phase].total_wait_us / stats[phase].received : 0,
+               stats[phase].max_wait_us);
+    }
+    printf("extra0 dropped %" PRIu32 ", extra6 coalesced %" PRIu32 "\n", sources[0].dropped,
+           sources[EXTRA_COUNT - 1].coalesced);
+
+    for (int phase = 0; phase < PHASE_COUNT; phase++) {
+        snprintf(what, sizeof(what), "%s: every reference sample received", phase_names[phase]);
+        failures += expect(stats[phase].sent == PHASE_MS / REF_PERIOD_MS && stats[phase].received == stats[phase].sent,
+                           what);
+    }
+    failures += expect(stats[PHASE_SILENT].max_wait_us == 0, "silent sources add no wait");
+    failures += expect(stats[PHASE_OWN_TIMES].max_wait_us <= PUBLISH_US,
+                       "sources at their own times: at most the publish in progress");
+    failures += expect(stats[PHASE_SAME_TIME].max_wait_us <= EXTRA_COUNT * PUBLISH_US,
+                       "sources at the same time: at most one publish per source");
+    failures += expect(stats[PHASE_FLOOD].max_wait_us <= (EXTRA_DEPTH + 1) * PUBLISH_US && sources[0].dropped > 0,
+                       "a flooding source: at most its queue depth, its own samples dropped");
+    failures += expect(sources[EXTRA_COUNT - 1].coalesced > 0, "the rate-limited source coalesced its samples");
+
+    printf("%d check(s) failed\n", failures);
+    return failures > 0 ? 1 : 0;
+}
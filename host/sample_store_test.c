@@ -0,0 +1,314 @@
+/*
+ * Runs the store and forward buffer of main/sample_store.c against a NOR flash stand-in: erase sets a sector to
+ * 0xFF, a write can only clear bits, and a write can be torn by a power loss after any number of bytes. Checks that
+ * samples come back oldest first and without gaps through the RAM ring, spills to flash and the wrap of the flash
+ * log, that a torn page write is skipped on recovery, that a page drained in part is not sent again after a restart
+ * that kept the RTC state, and that no write needed an erase it did not get. Prints the page writes and sector
+ * erases per scenario.
+ *
+ *   sample_store_test
+ *
+ * Exits with 1 if a check fails.
+ */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "sample_store.h"
+#include "test.h"
+
+#define SECTOR_SIZE         4096
+#define SECTOR_COUNT        4
+
+typedef struct {
+    uint8_t data[SECTOR_COUNT * SECTOR_SIZE];
+    uint32_t erases[SECTOR_COUNT];
+    uint32_t writes;
+    uint32_t bits_set;          /*!< writes that needed a 0 -> 1 transition, which NOR flash can not do */
+    int tear_after;             /*!< bytes the next write gets to before the power goes, -1 for none */
+    bool power_lost;
+} nor_flash_t;
+
+static nor_flash_t nor;
+
+static int nor_read(void *ctx, size_t offset, void *dst, size_t len)
+{
+    nor_flash_t *flash = ctx;
+
+    if (offset + len > sizeof(flash->data)) {
+        return -1;
+    }
+    memcpy(dst, flash->data + offset, len);
+    return 0;
+}
+
+static int nor_write(void *ctx, size_t offset, const void *src, size_t len)
+{
+    nor_flash_t *flash = ctx;
+    const uint8_t *bytes = src;
+
+    if (flash->power_lost || offset + len > sizeof(flash->data)) {
+        return -1;
+    }
+
+    if (flash->tear_after >= 0 && (size_t)flash->tear_after < len) {
+        len = (size_t)flash->tear_after;
+        flash->power_lost = true;
+    }
+    flash->tear_after = -1;
+
+    for (size_t i = 0; i < len; i++) {
+        if (bytes[i] & ~flash->data[offset + i]) {
+            flash->bits_set++;
+        }
+        flash->data[offset + i] &= bytes[i];
+    }
+    flash->writes++;
+    return flash->power_lost ? -1 : 0;
+}
+
+static int nor_erase_sector(void *ctx, size_t offset)
+{
+    nor_flash_t *flash = ctx;
+
+    if (flash->power_lost || offset % SECTOR_SIZE != 0 || offset >= sizeof(flash->data)) {
+        return -1;
+    }
+    memset(flash->data + offset, 0xFF, SECTOR_SIZE);
+    flash->erases[offset / SECTOR_SIZE]++;
+    return 0;
+}
+
+static const store_flash_t flash = {
+        .ctx = &nor,
+        .sector_size = SECTOR_SIZE,
+        .sector_count = SECTOR_COUNT,
+        .read = nor_read,
+        .write = nor_write,
+        .erase_sector = nor_erase_sector,
+};
+
+/* Flash as it leaves the factory, erased */
+static void nor_reset(void)
+{
+    memset(&nor, 0, sizeof(nor));
+    memset(nor.data, 0xFF, sizeof(nor.data));
+    nor.tear_after = -1;
+}
+
+static void push_range(sample_store_t *store, uint32_t first, uint32_t count)
+{
+    for (uint32_t seq = first; seq < first + count; seq++) {
+        sensor_frame_t frame = { .flags = PAYLOAD_HAS_DHT, .seq = seq, .temperature = (int16_t)(seq % 500) };
+        sample_store_push(store, &frame);
+    }
+}
+
+/*
+ * Drains up to max samples in batches of batch, as publish_backlog() does. Returns the number drained, false in
+ * *ordered if a sample did not follow the previous one; *first is the sequence number of the first.
+ */
+static uint32_t drain(sample_store_t *store, size_t batch, uint32_t max, uint32_t *first, bool *ordered)
+{
+    sensor_frame_t frames[16];
+    uint32_t drained = 0;
+    uint32_t expected = 0;
+
+    *ordered = true;
+    while (drained < max) {
+        size_t count = sample_store_peek(store, frames, batch < max - drained ? batch : max - drained);
+        if (count == 0) {
+            break;
+        }
+
+        for (size_t i = 0; i < count; i++) {
+            if (drained + i == 0) {
+                *first = frames[i].seq;
+            } else if (frames[i].seq != expected) {
+                *ordered = false;
+            }
+            expected = frames[i].seq + 1;
+        }
+        sample_store_consume(store, count);
+        drained += (uint32_t)count;
+    }
+
+    return drained;
+}
+
+static void report(const char *scenario, const sample_store_t *store, uint32_t samples)
+{
+    uint32_t min = nor.erases[0], max = nor.erases[0];
+
+    for (size_t i = 1; i < SECTOR_COUNT; i++) {
+        min = nor.erases[i] < min ? nor.erases[i] : min;
+        max = nor.erases[i] > max ? nor.erases[i] : max;
+    }
+    printf("%s: %u samples, %u page writes, %u sector erases (%u..%u per sector), %u flash writes, %u dropped\n",
+           scenario, samples, store->stats.page_writes, store->stats.sector_erases, min, max, nor.writes,
+           store->stats.dropped);
+}
+
+static int check_ram_only(void)
+{
+    static sample_store_t store;
+    uint32_t first = 0;
+    bool ordered;
+    int failures = 0;
+
+    sample_store_init(&store, NULL);
+    push_range(&store, 0, SAMPLE_STORE_RAM_SLOTS + 8);
+
+    failures += expect(sample_store_count(&store) == SAMPLE_STORE_RAM_SLOTS && store.stats.dropped == 8,
+                       "RAM only: the oldest samples dropped when full");
+    uint32_t drained = drain(&store, 8, UINT32_MAX, &first, &ordered);
+    failures += expect(drained == SAMPLE_STORE_RAM_SLOTS && first == 8 && ordered, "RAM only: drained oldest first");
+    return failures;
+}
+
+static int check_spill(void)
+{
+    static sample_store_t store;
+    uint32_t samples = SAMPLE_STORE_RAM_SLOTS + 5 * SAMPLE_STORE_PAGE_RECORDS;
+    uint32_t first = 0;
+    bool ordered;
+    int failures = 0;
+
+    nor_reset();
+    sample_store_init(&store, &flash);
+    push_range(&store, 0, samples);
+    report("spill", &store, samples);
+
+    failures += expect(store.stats.page_writes == 5 && store.stats.sector_erases == 1 && store.stats.dropped == 0,
+                       "spill: one page write per page of samples, one erase for the first sector");
+    failures += expect(sample_store_count(&store) == samples, "spill: every sample counted");
+
+    uint32_t writes = nor.writes;
+    uint32_t drained = drain(&store, 8, UINT32_MAX, &first, &ordered);
+    failures += expect(drained == samples && first == 0 && ordered, "spill: drained oldest first, flash then RAM");
+    failures += expect(nor.writes - writes == 5, "spill: one state write per drained page, no erase");
+    failures += expect(nor.bits_set == 0, "spill: no write needed an erase");
+    return failures;
+}
+
+static int check_wrap(void)
+{
+    static sample_store_t store;
+    uint32_t samples = 0;
+    uint32_t first = 0;
+    bool ordered;
+    int failures = 0;
+
+    nor_reset();
+    sample_store_init(&store, &flash);
+
+    // until the log wrapped twice over every sector
+    while (nor.erases[0] < 3) {
+        push_range(&store, samples, SAMPLE_STORE_PAGE_RECORDS);
+        samples += SAMPLE_STORE_PAGE_RECORDS;
+    }
+    report("wrap", &store, samples);
+
+    uint32_t count = sample_store_count(&store);
+    failures += expect(store.stats.dropped > 0 && count + store.stats.dropped == samples,
+                       "wrap: the oldest sector dropped, every sample either kept or counted as dropped");
+
+    uint32_t min = nor.erases[0], max = nor.erases[0];
+    for (size_t i = 1; i < SECTOR_COUNT; i++) {
+        min = nor.erases[i] < min ? nor.erases[i] : min;
+        max = nor.erases[i] > max ? nor.erases[i] : max;
+    }
+    failures += expect(max - min <= 1, "wrap: erases spread evenly over the sectors");
+
+    uint32_t drained = drain(&store, 8, UINT32_MAX, &first, &ordered);
+    failures += expect(drained == count && first == store.stats.dropped && ordered,
+                       "wrap: the newest samples drained without gaps");
+    failures += expect(nor.bits_set == 0, "wrap: no write needed an erase");
+    return failures;
+}
+
+static int check_torn_write(void)
+{
+    static sample_store_t store;
+    uint32_t first = 0;
+    bool ordered;
+    int failures = 0;
+
+    nor_reset();
+    sample_store_init(&store, &flash);
+    push_range(&store, 0, SAMPLE_STORE_RAM_SLOTS + 3 * SAMPLE_STORE_PAGE_RECORDS);
+
+    // the power goes halfway through the fourth page, RTC RAM is lost with it
+    nor.tear_after = 100;
+    push_range(&store, SAMPLE_STORE_RAM_SLOTS + 3 * SAMPLE_STORE_PAGE_RECORDS, 1);
+    failures += expect(nor.power_lost, "torn write: the power went during a page write");
+
+    nor.power_lost = false;
+    memset(&store, 0, sizeof(store));
+    sample_store_init(&store, &flash);
+    failures += expect(sample_store_count(&store) == 3 * SAMPLE_STORE_PAGE_RECORDS,
+                       "torn write: the complete pages recovered, the torn one skipped");
+
+    // the log goes on behind the torn page, in the next sector
+    uint32_t erases = store.stats.sector_erases;
+    push_range(&store, 1000, SAMPLE_STORE_RAM_SLOTS + SAMPLE_STORE_PAGE_RECORDS);
+    failures += expect(store.stats.sector_erases == erases + 1 && nor.bits_set == 0,
+                       "torn write: the next page goes to a freshly erased sector");
+
+    uint32_t drained = drain(&store, 8, 3 * SAMPLE_STORE_PAGE_RECORDS, &first, &ordered);
+    failures += expect(drained == 3 * SAMPLE_STORE_PAGE_RECORDS && first == 0 && ordered,
+                       "torn write: the recovered samples drained first, in order");
+    drained = drain(&store, 8, UINT32_MAX, &first, &ordered);
+    failures += expect(drained == SAMPLE_STORE_RAM_SLOTS + SAMPLE_STORE_PAGE_RECORDS && first == 1000 && ordered,
+                       "torn write: then the samples taken after the restart");
+    report("torn write, after the restart", &store, SAMPLE_STORE_RAM_SLOTS + SAMPLE_STORE_PAGE_RECORDS);
+    return failures;
+}
+
+static int check_partial_drain(void)
+{
+    static sample_store_t store;
+    static sample_store_t cold;
+    uint32_t first = 0;
+    bool ordered;
+    int failures = 0;
+
+    nor_reset();
+    sample_store_init(&store, &flash);
+    push_range(&store, 0, SAMPLE_STORE_RAM_SLOTS + 2 * SAMPLE_STORE_PAGE_RECORDS);
+
+    // half of the first page uploaded, then a deep sleep: RTC RAM keeps the state
+    drain(&store, 8, SAMPLE_STORE_PAGE_RECORDS / 2, &first, &ordered);
+    uint32_t writes = nor.writes;
+    sample_store_init(&store, &flash);
+    failures += expect(nor.writes == writes, "partial drain: nothing written for half a page");
+
+    uint32_t drained = drain(&store, 8, 1, &first, &ordered);
+    failures += expect(drained == 1 && first == SAMPLE_STORE_PAGE_RECORDS / 2,
+                       "partial drain: resumes after the drained half when RTC RAM kept the state");
+    failures += expect(sample_store_count(&store) ==
+                       SAMPLE_STORE_RAM_SLOTS + 2 * SAMPLE_STORE_PAGE_RECORDS - SAMPLE_STORE_PAGE_RECORDS / 2 - 1,
+                       "partial drain: the count goes on from there");
+
+    // a cold boot has only the flash: the half page goes again, nothing is lost
+    sample_store_init(&cold, &flash);
+    drained = drain(&cold, 8, UINT32_MAX, &first, &ordered);
+    failures += expect(drained == 2 * SAMPLE_STORE_PAGE_RECORDS && first == 0 && ordered,
+                       "partial drain: after a power loss the page goes again from its start");
+    return failures;
+}
+
+int main(void)
+{
+    int failures = 0;
+
+    failures += check_ram_only();
+    failures += check_spill();
+    failures += check_wrap();
+    failures += check_torn_write();
+    failures += check_partial_drain();
+
+    printf("%d check(s) failed\n", failures);
+    return failures > 0 ? 1 : 0;
+}
@@ -0,0 +1,376 @@
+/*
+ * Runs the sensor scheduler of main/sensor_scheduler.c on the host with fake drivers, without the rest of app_main():
+ * one sampled every second, one every 7 s, one whose read busy-waits 300 ms, one that feeds a filter and publishes
+ * every fourth reading, one whose reads fail, one sampled on trigger only and one whose hardware is missing. A
+ * consumer task takes the readings from the publisher as mqtt_task does.
+ *
+ * The first minute checks the counts and that the deadlines stay on the whole second despite the slow read. Then
+ * one period is halved and another set to 0, and a read stalls the scheduler for 5 s: the missed periods have to be
+ * skipped, not sampled in a burst. Ends with the RAM the sensor tasks take, one reader task per sensor as before
+ * the scheduler against the scheduler task.
+ *
+ *   scheduler_sim [-v]
+ *
+ * Exits with 1 if a check fails.
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "sensor.h"
+#include "sim.h"
+#include "test.h"
+
+#define SLOW_READ_MS        300
+#define STALL_MS            5000
+#define PERIOD_CHANGE_MS    60000
+#define STALL_AT_MS         80000
+#define END_MS              100000
+#define TICK_MS             (1000 / CONFIG_FREERTOS_HZ)
+#define MAX_SAMPLES         256
+/* what dht22.c and battery.c gave their reader tasks before the scheduler */
+#define READER_TASK_STACK   (configMINIMAL_STACK_SIZE * 4)
+
+enum {
+    FAST = 0,
+    SLOW,
+    SLOW_READ,
+    FILTERED,
+    FAILING,
+    TRIGGERED,
+    MISSING,
+    DRIVER_COUNT,
+};
+
+typedef struct {
+    uint8_t id;
+    uint32_t n;
+} fake_reading_t;
+
+typedef struct {
+    uint32_t count;
+    uint32_t at_ms[MAX_SAMPLES];
+    uint32_t period_ms[MAX_SAMPLES];    /*!< in effect when the sample was taken */
+    uint32_t frames;                    /*!< readings the consumer received */
+} sample_log_t;
+
+static sensor_driver_t drivers[DRIVER_COUNT];
+static sample_log_t logs[DRIVER_COUNT];
+static volatile bool stall_next = false;
+static uint32_t stalled_at_ms = 0;
+
+static uint32_t now_ms(void)
+{
+    return (uint32_t)(sim_now_us() / 1000);
+}
+
+static esp_err_t take(uint8_t id, void *reading)
+{
+    sample_log_t *log = &logs[id];
+    fake_reading_t *fake = reading;
+
+    if (log->count < MAX_SAMPLES) {
+        log->at_ms[log->count] = now_ms();
+        log->period_ms[log->count] = drivers[id].period_ms;
+    }
+    fake->id = id;
+    fake->n = log->count++;
+
+    return ESP_OK;
+}
+
+static esp_err_t init_present(void)
+{
+    return ESP_OK;
+}
+
+static esp_err_t init_missing(void)
+{
+    return ESP_ERR_NOT_FOUND;
+}
+
+static esp_err_t sample_fast(void *reading)
+{
+    esp_err_t err = take(FAST, reading);
+
+    if (stall_next) {
+        stall_next = false;
+        stalled_at_ms = now_ms();
+        sim_advance_us(STALL_MS * 1000);
+    }
+    return err;
+}
+
+static esp_err_t sample_slow(void *reading)
+{
+    return take(SLOW, reading);
+}
+
+static esp_err_t sample_slow_read(void *reading)
+{
+    esp_err_t err = take(SLOW_READ, reading);
+
+    // a read that polls its sensor, the scheduler task is busy meanwhile
+    sim_advance_us(SLOW_READ_MS * 1000);
+    return err;
+}
+
+static esp_err_t sample_filtered(void *reading)
+{
+    take(FILTERED, reading);
+    return ((fake_reading_t *)reading)->n % 4 == 3 ? ESP_OK : ESP_ERR_NOT_FINISHED;
+}
+
+static esp_err_t sample_failing(void *reading)
+{
+    take(FAILING, reading);
+    return ESP_FAIL;
+}
+
+static esp_err_t sample_triggered(void *reading)
+{
+    return take(TRIGGERED, reading);
+}
+
+static esp_err_t sample_missing(void *reading)
+{
+    return take(MISSING, reading);
+}
+
+static void format(const void *reading, sensor_frame_t *frame)
+{
+    const fake_reading_t *fake = reading;
+
+    frame->temperature = fake->id;
+    frame->humidity = (uint16_t)fake->n;
+}
+
+static void define_driver(uint8_t id, const char *name, uint32_t period_ms, esp_err_t (*init)(void),
+                          esp_err_t (*sample)(void *reading))
+{
+    drivers[id] = (sensor_driver_t) {
+            .name = name,
+            .period_ms = period_ms,
+            .reading_size = sizeof(fake_reading_t),
+            .init = init,
+            .sample = sample,
+            .format = format,
+            .source = { .policy = PUBLISHER_POLICY_FIFO, .depth = 4 },
+    };
+}
+
+/* Takes the readings as mqtt_task does, one frame at a time from whichever driver has one */
+_Noreturn static void consumer_task(void *params)
+{
+    sensor_frame_t frame;
+
+    while (true) {
+        if (publisher_receive(&frame, portMAX_DELAY) && frame.temperature >= 0 && frame.temperature < DRIVER_COUNT) {
+            logs[frame.temperature].frames++;
+        }
+    }
+}
+
+static void run_until(uint32_t at_ms)
+{
+    uint32_t now = now_ms();
+
+    if (at_ms > now) {
+        vTaskDelay(pdMS_TO_TICKS(at_ms - now));
+    }
+}
+
+static uint32_t count_between(uint8_t id, uint32_t from_ms, uint32_t to_ms)
+{
+    uint32_t count = 0;
+
+    for (uint32_t i = 0; i < logs[id].count && i < MAX_SAMPLES; i++) {
+        count += logs[id].at_ms[i] >= from_ms && logs[id].at_ms[i] < to_ms;
+    }
+    return count;
+}
+
+/* Samples of a periodic driver in the first minute are each late by at most a slow read, not by the sum of them */
+static bool on_schedule(uint8_t id)
+{
+    for (uint32_t i = 0; i < logs[id].count && logs[id].at_ms[i] < PERIOD_CHANGE_MS; i++) {
+        uint32_t due_ms = i * logs[id].period_ms[i];
+
+        if (logs[id].at_ms[i] < due_ms || logs[id].at_ms[i] > due_ms + SLOW_READ_MS + TICK_MS) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+ * Never more than two samples within a period: after a stall a driver is sampled once and then back on its schedule,
+ * the missed periods are skipped, not caught up in a burst
+ */
+static bool no_burst(uint8_t id, uint32_t *min_gap_ms)
+{
+    bool ok = true;
+
+    *min_gap_ms = UINT32_MAX;
+    for (uint32_t i = 1; i < logs[id].count && i < MAX_SAMPLES; i++) {
+        uint32_t gap_ms = logs[id].at_ms[i] - logs[id].at_ms[i - 1];
+
+        if (gap_ms < *min_gap_ms) {
+            *min_gap_ms = gap_ms;
+        }
+        if (i >= 2 && logs[id].at_ms[i] - logs[id].at_ms[i - 2] < logs[id].period_ms[i]) {
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+static int check_schedule(void)
+{
+    const uint8_t periodic[] = { FAST, SLOW, SLOW_READ, FILTERED, FAILING };
+    int failures = 0;
+    char what[96];
+
+    for (uint8_t id = 0; id < DRIVER_COUNT; id++) {
+        printf("%-10s %3" PRIu32 " samples, %3" PRIu32 " published, %3" PRIu32 " errors\n", drivers[id].name,
+               logs[id].count, logs[id].frames, drivers[id].errors);
+    }
+
+    failures += expect(count_between(FAST, 0, PERIOD_CHANGE_MS) == PERIOD_CHANGE_MS / 1000,
+                       "fast: one sample per second in the first minute");
+    failures += expect(count_between(SLOW, 0, PERIOD_CHANGE_MS) == (PERIOD_CHANGE_MS + 6999) / 7000,
+                       "slow: one sample per 7 s in the first minute");
+    failures += expect(on_schedule(FAST) && on_schedule(FILTERED) && on_schedule(SLOW_READ),
+                       "deadlines stay on the period, a slow read does not shift the later samples");
+
+    failures += expect(count_between(FAST, PERIOD_CHANGE_MS, STALL_AT_MS) >= (STALL_AT_MS - PERIOD_CHANGE_MS) / 500 - 1,
+                       "fast: a new period takes effect while the scheduler runs");
+    failures += expect(count_between(SLOW, PERIOD_CHANGE_MS, END_MS) == 0, "slow: period 0 stops the sampling");
+
+    for (size_t i = 0; i < sizeof(periodic); i++) {
+        uint32_t min_gap_ms;
+        bool ok = no_burst(periodic[i], &min_gap_ms);
+
+        snprintf(what, sizeof(what), "%s: no burst after the stall, closest samples %" PRIu32 " ms apart",
+                 drivers[periodic[i]].name, min_gap_ms);
+        failures += expect(ok, what);
+    }
+    failures += expect(stalled_at_ms >= STALL_AT_MS &&
+                       count_between(SLOW_READ, stalled_at_ms, stalled_at_ms + STALL_MS + SLOW_READ_MS) <= 1,
+                       "slow_read: the periods missed during the stall are skipped");
+
+    failures += expect(logs[FAST].frames == logs[FAST].count && logs[SLOW_READ].frames == logs[SLOW_READ].count,
+                       "every reading reaches the consumer");
+    failures += expect(logs[FILTERED].frames == logs[FILTERED].count / 4, "filtered: only finished readings published");
+    failures += expect(logs[FAILING].frames == 0 && drivers[FAILING].errors == logs[FAILING].count,
+                       "failing: errors counted, nothing published");
+    failures += expect(logs[MISSING].count == 0, "missing: not scheduled");
+
+    return failures;
+}
+
+/* Triggers from the main task at times that do and do not fall on other deadlines */
+static int run_triggers(uint32_t *max_latency_ms)
+{
+    const uint32_t trigger_ms[] = { 10250, 25500, 30000, 44003 };
+    bool ok = true;
+
+    *max_latency_ms = 0;
+    for (size_t i = 0; i < sizeof(trigger_ms) / sizeof(trigger_ms[0]); i++) {
+        run_until(trigger_ms[i]);
+
+        uint32_t before = logs[TRIGGERED].count;
+        uint32_t at_ms = now_ms();
+
+        sensor_trigger_from_isr(&drivers[TRIGGERED]);
+        // the scheduler outranks this task, wait for it to block again
+        while (logs[TRIGGERED].count == before && now_ms() < at_ms + 1000) {
+            vTaskDelay(1);
+        }
+        if (logs[TRIGGERED].count != before + 1) {
+            ok = false;
+            continue;
+        }
+        uint32_t latency_ms = logs[TRIGGERED].at_ms[before] - at_ms;
+        if (latency_ms > *max_latency_ms) {
+            *max_latency_ms = latency_ms;
+        }
+    }
+    return ok ? 0 : 1;
+}
+
+/*
+ * Stack bytes of the sensor tasks, before the scheduler (a reader task per sensor) and now. Every task also has a
+ * TCB of the port; the driver structs are sized for this host, they are smaller on the 32-bit target.
+ */
+static void report_ram(void)
+{
+    printf("-- sensor task RAM, a %u-byte reader task per sensor before, one %u-byte scheduler task now\n",
+           READER_TASK_STACK, SENSOR_TASK_STACK_SIZE);
+    for (unsigned int n = 1; n <= SENSOR_MAX_DRIVERS; n++) {
+        unsigned int before = n * READER_TASK_STACK;
+        unsigned int now = SENSOR_TASK_STACK_SIZE + n * sizeof(sensor_driver_t);
+
+        printf("%u sensor(s): %u task(s) %5u bytes, now 1 task %5u bytes, %+6d bytes\n", n, n, before, now,
+               (int)now - (int)before);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    int failures = 0;
+    int opt;
+
+    sim_init();
+
+    while ((opt = getopt(argc, argv, "v")) != -1) {
+        switch (opt) {
+            case 'v':
+                sim_log_set_max_level(ESP_LOG_INFO);
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-v]\n", argv[0]);
+                return 2;
+        }
+    }
+
+    define_driver(FAST, "fast", 1000, init_present, sample_fast);
+    define_driver(SLOW, "slow", 7000, init_present, sample_slow);
+    define_driver(SLOW_READ, "slow_read", 2000, init_present, sample_slow_read);
+    define_driver(FILTERED, "filtered", 1000, init_present, sample_filtered);
+    define_driver(FAILING, "failing", 5000, init_present, sample_failing);
+    define_driver(TRIGGERED, "triggered", 0, init_present, sample_triggered);
+    define_driver(MISSING, "missing", 1000, init_missing, sample_missing);
+
+    ESP_ERROR_CHECK(publisher_init());
+    for (uint8_t id = 0; id < MISSING; id++) {
+        ESP_ERROR_CHECK(sensor_register(&drivers[id]));
+    }
+    failures += expect(sensor_register(&drivers[MISSING]) == ESP_ERR_NOT_FOUND, "missing: init error returned");
+    ESP_ERROR_CHECK(sensor_scheduler_start());
+    xTaskCreate(consumer_task, "consumer", 4096, NULL, 3, NULL);
+
+    uint32_t max_latency_ms;
+    failures += expect(run_triggers(&max_latency_ms) == 0, "triggered: one sample per trigger");
+    printf("triggered: at most %" PRIu32 " ms from the trigger to the sample\n", max_latency_ms);
+    failures += expect(max_latency_ms <= TICK_MS, "triggered: sampled within a tick");
+
+    run_until(PERIOD_CHANGE_MS);
+    sensor_set_period(&drivers[FAST], 500);
+    sensor_set_period(&drivers[SLOW], 0);
+
+    run_until(STALL_AT_MS);
+    stall_next = true;
+
+    run_until(END_MS);
+    failures += check_schedule();
+    report_ram();
+
+    printf("%d check(s) failed\n", failures);
+    return failures > 0 ? 1 : 0;
+}
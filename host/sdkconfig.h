@@ -0,0 +1,316 @@
+#ifndef __HOST_SDKCONFIG_H__
+#define __HOST_SDKCONFIG_H__
+
+/*
+ * Kconfig for the host build, the defaults of main/Kconfig.projbuild. Force-included into every source. Override an
+ * option on the CMake command line, e.g. -DHOST_CONFIG="CONFIG_ESP_MQTT_FRAME=1;CONFIG_ESP_STATIC_ALLOCATION=1".
+ *
+ * The DHT22 is read through the GPIO backend, the RMT peripheral has no stand-in.
+ */
+
+#define CONFIG_FREERTOS_HZ                              100
+#define CONFIG_IDF_TARGET                               "linux"
+#define CONFIG_IDF_TARGET_LINUX                         1
+
+/* == WiFi ================================================================ */
+
+#ifndef CONFIG_ESP_WIFI_SSID
+#define CONFIG_ESP_WIFI_SSID                            "myssid"
+#endif
+#ifndef CONFIG_ESP_WIFI_PASSWORD
+#define CONFIG_ESP_WIFI_PASSWORD                        "mypassword"
+#endif
+
+/* == MQTT ================================================================ */
+
+#ifndef CONFIG_ESP_BROKER_URL
+#define CONFIG_ESP_BROKER_URL                           "mqtt://mqtt.eclipseprojects.io"
+#endif
+/* CONFIG_ESP_MQTT_TLS is off by default, main/tls_transport.c has no stand-in, see host/tls_connect_bench */
+#ifndef CONFIG_ESP_MQTT_USERNAME
+#define CONFIG_ESP_MQTT_USERNAME                        "iot"
+#endif
+#ifndef CONFIG_ESP_MQTT_PASSWORD
+#define CONFIG_ESP_MQTT_PASSWORD                        "mypassword"
+#endif
+#ifndef CONFIG_ESP_MQTT_TOPIC_TEMPERATURE
+#define CONFIG_ESP_MQTT_TOPIC_TEMPERATURE               "dt/hub/barn/esp32dhtA/temperature"
+#endif
+#ifndef CONFIG_ESP_MQTT_TOPIC_HUMIDITY
+#define CONFIG_ESP_MQTT_TOPIC_HUMIDITY                  "dt/hub/barn/esp32dhtA/humidity"
+#endif
+#ifndef CONFIG_ESP_MQTT_TOPIC_BATTERY_VOLTAGE
+#define CONFIG_ESP_MQTT_TOPIC_BATTERY_VOLTAGE           "dt/hub/barn/esp32dhtA/battery_voltage"
+#endif
+#ifndef CONFIG_ESP_MQTT_TOPIC_BATTERY_SOC
+#define CONFIG_ESP_MQTT_TOPIC_BATTERY_SOC               "dt/hub/barn/esp32dhtA/battery_soc"
+#endif
+
+#ifndef CONFIG_ESP_MQTT_DEADBAND
+#define CONFIG_ESP_MQTT_DEADBAND                        1
+#endif
+#ifndef CONFIG_ESP_MQTT_DEADBAND_TEMPERATURE
+#define CONFIG_ESP_MQTT_DEADBAND_TEMPERATURE            10
+#endif
+#ifndef CONFIG_ESP_MQTT_DEADBAND_HUMIDITY
+#define CONFIG_ESP_MQTT_DEADBAND_HUMIDITY               50
+#endif
+#ifndef CONFIG_ESP_MQTT_DEADBAND_BATTERY_VOLTAGE
+#define CONFIG_ESP_MQTT_DEADBAND_BATTERY_VOLTAGE        20
+#endif
+#ifndef CONFIG_ESP_MQTT_DEADBAND_BATTERY_SOC
+#define CONFIG_ESP_MQTT_DEADBAND_BATTERY_SOC            100
+#endif
+#ifndef CONFIG_ESP_MQTT_HEARTBEAT_SEC
+#define CONFIG_ESP_MQTT_HEARTBEAT_SEC                   900
+#endif
+
+/* CONFIG_ESP_MQTT_FRAME is off by default */
+#ifndef CONFIG_ESP_MQTT_TOPIC_FRAME
+#define CONFIG_ESP_MQTT_TOPIC_FRAME                     "dt/hub/barn/esp32dhtA/frame"
+#endif
+#if !defined(CONFIG_ESP_MQTT_FRAME_FORMAT_JSON) && !defined(CONFIG_ESP_MQTT_FRAME_FORMAT_BINARY)
+#define CONFIG_ESP_MQTT_FRAME_FORMAT_CBOR               1
+#endif
+
+#ifndef CONFIG_ESP_MQTT_TOPIC_ALIAS
+#define CONFIG_ESP_MQTT_TOPIC_ALIAS                     1
+#endif
+#ifndef CONFIG_ESP_MQTT_TOPIC_ALIAS_MAX
+#define CONFIG_ESP_MQTT_TOPIC_ALIAS_MAX                 8
+#endif
+
+#ifndef CONFIG_ESP_MQTT_TOPIC_DHT_STATS
+#define CONFIG_ESP_MQTT_TOPIC_DHT_STATS                 "dt/hub/barn/esp32dhtA/dht_stats"
+#endif
+
+#ifndef CONFIG_ESP_MQTT_DIAG
+#define CONFIG_ESP_MQTT_DIAG                            1
+#endif
+#ifndef CONFIG_ESP_MQTT_TOPIC_DIAG
+#define CONFIG_ESP_MQTT_TOPIC_DIAG                      "dt/hub/barn/esp32dhtA/diag"
+#endif
+#ifndef CONFIG_ESP_MQTT_DIAG_INTERVAL_SEC
+#define CONFIG_ESP_MQTT_DIAG_INTERVAL_SEC               60
+#endif
+
+#if !defined(CONFIG_ESP_REMOTE_CONFIG) && !CONFIG_ESP_DUTY_CYCLE_MODE
+#define CONFIG_ESP_REMOTE_CONFIG                        1
+#endif
+#ifndef CONFIG_ESP_MQTT_TOPIC_CONFIG
+#define CONFIG_ESP_MQTT_TOPIC_CONFIG                    "cmd/hub/barn/esp32dhtA/config"
+#endif
+#ifndef CONFIG_ESP_MQTT_TOPIC_CONFIG_STATE
+#define CONFIG_ESP_MQTT_TOPIC_CONFIG_STATE              "dt/hub/barn/esp32dhtA/config"
+#endif
+
+/* CONFIG_ESP_OTA is off by default; Kconfig ties it to CONFIG_ESP_MQTT_TLS, which has no stand-in, so the ota
+ * variant of CMakeLists.txt turns it on without */
+#ifndef CONFIG_ESP_OTA_PUBLIC_KEY
+/* test 1 of RFC 8032, a published key pair: host/ota_sim.c signs with its private key */
+#define CONFIG_ESP_OTA_PUBLIC_KEY                       "d75a980182b10ab7d54bfed3c964073a0ee172f3daa62325af021a68f707511a"
+#endif
+#ifndef CONFIG_ESP_MQTT_TOPIC_OTA
+#define CONFIG_ESP_MQTT_TOPIC_OTA                       "cmd/hub/barn/esp32dhtA/ota"
+#endif
+#ifndef CONFIG_ESP_MQTT_TOPIC_OTA_STATE
+#define CONFIG_ESP_MQTT_TOPIC_OTA_STATE                 "dt/hub/barn/esp32dhtA/ota"
+#endif
+#ifndef CONFIG_ESP_OTA_CONFIRM_TIMEOUT_SEC
+#define CONFIG_ESP_OTA_CONFIRM_TIMEOUT_SEC              300
+#endif
+
+#if !defined(CONFIG_ESP_BINLOG) && !CONFIG_ESP_DUTY_CYCLE_MODE
+#define CONFIG_ESP_BINLOG                               1
+#endif
+#ifndef CONFIG_ESP_BINLOG_SIZE
+#define CONFIG_ESP_BINLOG_SIZE                          4096
+#endif
+#ifndef CONFIG_ESP_MQTT_TOPIC_LOG
+#define CONFIG_ESP_MQTT_TOPIC_LOG                       "cmd/hub/barn/esp32dhtA/log"
+#endif
+#ifndef CONFIG_ESP_MQTT_TOPIC_LOG_DUMP
+#define CONFIG_ESP_MQTT_TOPIC_LOG_DUMP                  "dt/hub/barn/esp32dhtA/log"
+#endif
+
+/* == Connectivity ======================================================== */
+
+#ifndef CONFIG_ESP_CONN_BACKOFF_INITIAL_MS
+#define CONFIG_ESP_CONN_BACKOFF_INITIAL_MS              1000
+#endif
+#ifndef CONFIG_ESP_CONN_BACKOFF_MAX_SEC
+#define CONFIG_ESP_CONN_BACKOFF_MAX_SEC                 300
+#endif
+#ifndef CONFIG_ESP_CONN_BACKOFF_JITTER_PCT
+#define CONFIG_ESP_CONN_BACKOFF_JITTER_PCT              25
+#endif
+#ifndef CONFIG_ESP_CONN_ATTEMPT_TIMEOUT_MS
+#define CONFIG_ESP_CONN_ATTEMPT_TIMEOUT_MS              15000
+#endif
+
+/* == Store and forward =================================================== */
+
+#ifndef CONFIG_ESP_STORE_FORWARD
+#define CONFIG_ESP_STORE_FORWARD                        1
+#endif
+#ifndef CONFIG_ESP_MQTT_TOPIC_BACKLOG
+#define CONFIG_ESP_MQTT_TOPIC_BACKLOG                   "dt/hub/barn/esp32dhtA/backlog"
+#endif
+#ifndef CONFIG_ESP_STORE_DRAIN_BATCH
+#define CONFIG_ESP_STORE_DRAIN_BATCH                    8
+#endif
+#ifndef CONFIG_ESP_STORE_MAX_IN_FLIGHT
+#define CONFIG_ESP_STORE_MAX_IN_FLIGHT                  2
+#endif
+
+/* == DHT22 =============================================================== */
+
+#ifndef CONFIG_ESP_DHT_SENSOR_COUNT
+#define CONFIG_ESP_DHT_SENSOR_COUNT                     1
+#endif
+#ifndef CONFIG_ESP_DHT_GPIO_PIN
+#define CONFIG_ESP_DHT_GPIO_PIN                         1
+#endif
+#if CONFIG_ESP_DHT_SENSOR_COUNT >= 2
+#define CONFIG_ESP_DHT_GPIO_PIN_1                       4
+#define CONFIG_ESP_DHT_TOPIC_SUFFIX_1                   "/1"
+#endif
+#if CONFIG_ESP_DHT_SENSOR_COUNT >= 3
+#define CONFIG_ESP_DHT_GPIO_PIN_2                       5
+#define CONFIG_ESP_DHT_TOPIC_SUFFIX_2                   "/2"
+#endif
+#if CONFIG_ESP_DHT_SENSOR_COUNT >= 4
+#define CONFIG_ESP_DHT_GPIO_PIN_3                       6
+#define CONFIG_ESP_DHT_TOPIC_SUFFIX_3                   "/3"
+#endif
+#ifndef CONFIG_ESP_DHT_SAMPLE_PERIOD_MS
+#define CONFIG_ESP_DHT_SAMPLE_PERIOD_MS                 5000
+#endif
+#define CONFIG_ESP_DHT_BACKEND_GPIO                     1
+#ifndef CONFIG_ESP_DHT_CAPTURE_GUARD
+#define CONFIG_ESP_DHT_CAPTURE_GUARD                    1
+#endif
+#ifndef CONFIG_ESP_DHT_PUBLISH_LATEST
+#define CONFIG_ESP_DHT_PUBLISH_FIFO                     1
+#endif
+#ifndef CONFIG_ESP_DHT_QUEUE_DEPTH
+#define CONFIG_ESP_DHT_QUEUE_DEPTH                      10
+#endif
+#ifndef CONFIG_ESP_DHT_MIN_PUBLISH_INTERVAL_MS
+#define CONFIG_ESP_DHT_MIN_PUBLISH_INTERVAL_MS          0
+#endif
+/* CONFIG_ESP_DHT_FILTER is off by default */
+#if !defined(CONFIG_ESP_DHT_FILTER_SMOOTH_KALMAN) && !defined(CONFIG_ESP_DHT_FILTER_SMOOTH_NONE)
+#define CONFIG_ESP_DHT_FILTER_SMOOTH_MEDIAN             1
+#endif
+#ifndef CONFIG_ESP_DHT_FILTER_MEDIAN_SIZE
+#define CONFIG_ESP_DHT_FILTER_MEDIAN_SIZE               5
+#endif
+#ifndef CONFIG_ESP_DHT_FILTER_MAX_RATE_TEMPERATURE
+#define CONFIG_ESP_DHT_FILTER_MAX_RATE_TEMPERATURE      20
+#endif
+#ifndef CONFIG_ESP_DHT_FILTER_MAX_RATE_HUMIDITY
+#define CONFIG_ESP_DHT_FILTER_MAX_RATE_HUMIDITY         100
+#endif
+#ifndef CONFIG_ESP_DHT_FILTER_MAX_REJECTS
+#define CONFIG_ESP_DHT_FILTER_MAX_REJECTS               3
+#endif
+#ifndef CONFIG_ESP_DHT_FILTER_WINDOW_SEC
+#define CONFIG_ESP_DHT_FILTER_WINDOW_SEC                60
+#endif
+
+/* == Battery monitor ===================================================== */
+
+#ifndef CONFIG_ESP_I2C_MASTER_SCL
+#define CONFIG_ESP_I2C_MASTER_SCL                       1
+#endif
+#ifndef CONFIG_ESP_I2C_MASTER_SDA
+#define CONFIG_ESP_I2C_MASTER_SDA                       2
+#endif
+#ifndef CONFIG_ESP_BATTERY_SAMPLE_PERIOD_MS
+#define CONFIG_ESP_BATTERY_SAMPLE_PERIOD_MS             5000
+#endif
+#ifndef CONFIG_ESP_BATTERY_HIBERNATE
+#define CONFIG_ESP_BATTERY_HIBERNATE                    1
+#endif
+/* CONFIG_ESP_BATTERY_ALERT is off by default */
+#ifndef CONFIG_ESP_BATTERY_ALERT_GPIO
+#define CONFIG_ESP_BATTERY_ALERT_GPIO                   3
+#endif
+#ifndef CONFIG_ESP_BATTERY_ALERT_EMPTY_PCT
+#define CONFIG_ESP_BATTERY_ALERT_EMPTY_PCT              10
+#endif
+#ifndef CONFIG_ESP_BATTERY_ALERT_FALLBACK_SEC
+#define CONFIG_ESP_BATTERY_ALERT_FALLBACK_SEC           3600
+#endif
+#ifndef CONFIG_ESP_BATTERY_PUBLISH_FIFO
+#define CONFIG_ESP_BATTERY_PUBLISH_LATEST               1
+#endif
+#ifndef CONFIG_ESP_BATTERY_QUEUE_DEPTH
+#define CONFIG_ESP_BATTERY_QUEUE_DEPTH                  1
+#endif
+#ifndef CONFIG_ESP_BATTERY_MIN_PUBLISH_INTERVAL_MS
+#define CONFIG_ESP_BATTERY_MIN_PUBLISH_INTERVAL_MS      0
+#endif
+
+/* == Duty cycle ========================================================== */
+
+/* CONFIG_ESP_DUTY_CYCLE_MODE is off by default */
+#ifndef CONFIG_ESP_DUTY_CYCLE_PERIOD_SEC
+#define CONFIG_ESP_DUTY_CYCLE_PERIOD_SEC                300
+#endif
+#ifndef CONFIG_ESP_DUTY_CYCLE_CONNECT_TIMEOUT_MS
+#define CONFIG_ESP_DUTY_CYCLE_CONNECT_TIMEOUT_MS        10000
+#endif
+#ifndef CONFIG_ESP_DUTY_CYCLE_ACK_TIMEOUT_MS
+#define CONFIG_ESP_DUTY_CYCLE_ACK_TIMEOUT_MS            2000
+#endif
+#ifndef CONFIG_ESP_DUTY_CYCLE_MAX_AWAKE_MS
+#define CONFIG_ESP_DUTY_CYCLE_MAX_AWAKE_MS              20000
+#endif
+#ifndef CONFIG_ESP_DUTY_CYCLE_ACTIVE_CURRENT_UA
+#define CONFIG_ESP_DUTY_CYCLE_ACTIVE_CURRENT_UA         110000
+#endif
+#ifndef CONFIG_ESP_DUTY_CYCLE_SLEEP_CURRENT_UA
+#define CONFIG_ESP_DUTY_CYCLE_SLEEP_CURRENT_UA          100
+#endif
+#ifndef CONFIG_ESP_DUTY_CYCLE_BATTERY_CAPACITY_MAH
+#define CONFIG_ESP_DUTY_CYCLE_BATTERY_CAPACITY_MAH      2000
+#endif
+
+/* == Task placement ====================================================== */
+
+#ifndef CONFIG_ESP_TASK_SENSOR_CORE
+#define CONFIG_ESP_TASK_SENSOR_CORE                     1
+#endif
+#ifndef CONFIG_ESP_TASK_MQTT_CORE
+#define CONFIG_ESP_TASK_MQTT_CORE                       -1
+#endif
+#ifndef CONFIG_ESP_TASK_CONN_CORE
+#define CONFIG_ESP_TASK_CONN_CORE                       -1
+#endif
+
+/* == Memory ============================================================== */
+
+/* CONFIG_ESP_STATIC_ALLOCATION is off by default */
+#ifndef CONFIG_ESP_SENSOR_TASK_STACK_SIZE
+#define CONFIG_ESP_SENSOR_TASK_STACK_SIZE               3584
+#endif
+#ifndef CONFIG_ESP_MQTT_TASK_STACK_SIZE
+#define CONFIG_ESP_MQTT_TASK_STACK_SIZE                 6144
+#endif
+#ifndef CONFIG_ESP_CONN_TASK_STACK_SIZE
+#define CONFIG_ESP_CONN_TASK_STACK_SIZE                 3072
+#endif
+#ifndef CONFIG_ESP_MEM_REPORT_INTERVAL_SEC
+#define CONFIG_ESP_MEM_REPORT_INTERVAL_SEC              600
+#endif
+
+/* == Benchmarks ========================================================== */
+
+/* CONFIG_ESP_BENCHMARK is off by default, host/hotpath_bench runs the suite directly */
+#ifndef CONFIG_ESP_BENCHMARK_ITERATIONS
+#define CONFIG_ESP_BENCHMARK_ITERATIONS                 1000
+#endif
+
+#endif // __HOST_SDKCONFIG_H__
@@ -0,0 +1,36 @@
+#ifndef __TEST_H__
+#define __TEST_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/*
+ * Shared by the simulations and tests under host/. Every check prints one line, "ok  " or "FAIL" and what it
+ * checks; main() ends with the number that failed and exits with 1 if any did. Header only, so that the tests that
+ * build a few sources of main/ on their own need no harness library.
+ */
+
+/**
+ * @brief Print the outcome of a check
+ *
+ * @return 1 if it failed, to add up the failures
+ */
+static inline int expect(bool condition, const char *what)
+{
+    printf("%s %s\n", condition ? "ok  " : "FAIL", what);
+    return condition ? 0 : 1;
+}
+
+/**
+ * @brief xorshift32, the same sequence on every run from the same state; the state must not be 0
+ */
+static inline uint32_t test_random(uint32_t *state)
+{
+    *state ^= *state << 13;
+    *state ^= *state >> 17;
+    *state ^= *state << 5;
+    return *state;
+}
+
+#endif // __TEST_H__
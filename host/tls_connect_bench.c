@@ -0,0 +1,342 @@
+/*
+ * Connect time over TLS with a full handshake versus a resumed session, against the TLS listener of the broker in
+ * docker/ (docker/mosquitto/gen-certs.sh). Each round makes one connect without a session and one that offers the
+ * session of the previous connect, as the node does after a reconnect or a wake from deep sleep
+ * (main/tls_transport.c). Both use TLS 1.2 like the node. A connect is timed in three phases: the TCP connect, the TLS
+ * handshake and the MQTT CONNECT until its CONNACK. The broker's CPU time and the round trips show here; the
+ * node's own crypto cost is in the DIAG_STAGE_TLS_FULL and DIAG_STAGE_TLS_RESUMED histograms of its diagnostics.
+ *
+ *   tls_connect_bench [-h host] [-p port] [-c ca.crt] [-u user] [-P password] [-n rounds] [-t]
+ *
+ * -t stops after the handshake, for a plain TLS server such as openssl s_server. Not part of ctest, it needs a
+ * broker. Exits with 1 if a connect failed or the server never resumed a session.
+ */
+
+#include <inttypes.h>
+#include <netdb.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+#include <openssl/err.h>
+#include <openssl/ssl.h>
+
+#include "mqtt_session.h"
+
+#define MAX_ROUNDS              1000
+#define PACKET_SIZE             256
+
+#define MQTT_CONNECT            0x10
+#define MQTT_CONNACK            0x20
+#define MQTT_DISCONNECT         0xe0
+
+typedef enum {
+    PHASE_TCP = 0,
+    PHASE_TLS,
+    PHASE_CONNACK,
+    PHASE_TOTAL,
+    PHASE_COUNT,
+} phase_t;
+
+static const char *const phase_names[PHASE_COUNT] = { "TCP connect", "TLS handshake", "CONNECT-CONNACK", "total" };
+
+typedef struct {
+    int64_t us[PHASE_COUNT][MAX_ROUNDS];
+    uint32_t count;
+    uint32_t reused;            /*!< connects on which the server resumed the session */
+} samples_t;
+
+static struct {
+    const char *host;
+    const char *port;
+    const char *ca_file;
+    const char *username;
+    const char *password;
+    uint32_t rounds;
+    bool tls_only;
+} options = {
+        .host = "localhost",
+        .port = "8883",
+        .ca_file = DEFAULT_CA_FILE,
+        .username = "",
+        .password = "",
+        .rounds = 20,
+};
+
+static int64_t now_us(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static int tcp_connect(const struct addrinfo *broker)
+{
+    for (const struct addrinfo *ai = broker; ai != NULL; ai = ai->ai_next) {
+        int fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        int one = 1;
+
+        if (fd < 0) {
+            continue;
+        }
+        if (connect(fd, ai->ai_addr, ai->ai_addrlen) == 0) {
+            // as the node's small writes go out
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+            return fd;
+        }
+        close(fd);
+    }
+
+    return -1;
+}
+
+static void put_string(uint8_t *packet, size_t *len, const char *string)
+{
+    size_t string_len = strlen(string);
+
+    packet[(*len)++] = (uint8_t)(string_len >> 8);
+    packet[(*len)++] = (uint8_t)(string_len & 0xff);
+    memcpy(&packet[*len], string, string_len);
+    *len += string_len;
+}
+
+/* MQTT5 CONNECT, clean start without properties: the session of the node is not what is measured here */
+static size_t encode_connect(uint8_t *packet, uint32_t round)
+{
+    uint8_t body[PACKET_SIZE - 2];
+    size_t len = 0;
+    uint8_t flags = 0x02;
+    char client_id[32];
+
+    snprintf(client_id, sizeof(client_id), "tls-bench-%" PRIu32, round);
+    if (options.username[0] != '\0') {
+        flags |= 0x80;
+    }
+    if (options.password[0] != '\0') {
+        flags |= 0x40;
+    }
+
+    put_string(body, &len, "MQTT");
+    body[len++] = 5;
+    body[len++] = flags;
+    body[len++] = MQTT_SESSION_KEEPALIVE_SEC >> 8;
+    body[len++] = MQTT_SESSION_KEEPALIVE_SEC & 0xff;
+    body[len++] = 0;            // no properties
+    put_string(body, &len, client_id);
+    if (options.username[0] != '\0') {
+        put_string(body, &len, options.username);
+    }
+    if (options.password[0] != '\0') {
+        put_string(body, &len, options.password);
+    }
+
+    // the body stays below 128 bytes, a one byte remaining length
+    packet[0] = MQTT_CONNECT;
+    packet[1] = (uint8_t)len;
+    memcpy(&packet[2], body, len);
+    return len + 2;
+}
+
+static bool mqtt_connect(SSL *ssl, uint32_t round)
+{
+    uint8_t packet[PACKET_SIZE];
+    size_t len = encode_connect(packet, round);
+
+    if (SSL_write(ssl, packet, (int)len) != (int)len) {
+        return false;
+    }
+
+    // fixed header, remaining length and the reason code are in the first record
+    int received = SSL_read(ssl, packet, sizeof(packet));
+    if (received < 4 || packet[0] != MQTT_CONNACK) {
+        fprintf(stderr, "no CONNACK\n");
+        return false;
+    }
+    if (packet[3] != 0) {
+        fprintf(stderr, "CONNACK reason code 0x%02x\n", packet[3]);
+        return false;
+    }
+
+    static const uint8_t disconnect[] = { MQTT_DISCONNECT, 0 };
+    SSL_write(ssl, disconnect, sizeof(disconnect));
+    return true;
+}
+
+/*
+ * One connect, offering *session if set. On success *session is replaced by the session of this connect.
+ */
+static bool measure(SSL_CTX *ctx, const struct addrinfo *broker, SSL_SESSION **session, uint32_t round,
+                    samples_t *samples)
+{
+    int64_t start = now_us();
+    bool ok = false;
+
+    int fd = tcp_connect(broker);
+    if (fd < 0) {
+        perror("connect");
+        return false;
+    }
+    int64_t tcp_done = now_us();
+
+    SSL *ssl = SSL_new(ctx);
+    SSL_set_fd(ssl, fd);
+    SSL_set_tlsext_host_name(ssl, options.host);
+    SSL_set1_host(ssl, options.host);
+    if (*session != NULL) {
+        SSL_set_session(ssl, *session);
+    }
+
+    if (SSL_connect(ssl) != 1) {
+        ERR_print_errors_fp(stderr);
+        goto done;
+    }
+    int64_t tls_done = now_us();
+
+    if (!options.tls_only && !mqtt_connect(ssl, round)) {
+        goto done;
+    }
+    int64_t connack_done = now_us();
+
+    samples->us[PHASE_TCP][samples->count] = tcp_done - start;
+    samples->us[PHASE_TLS][samples->count] = tls_done - tcp_done;
+    samples->us[PHASE_CONNACK][samples->count] = connack_done - tls_done;
+    samples->us[PHASE_TOTAL][samples->count] = connack_done - start;
+    samples->count++;
+    if (SSL_session_reused(ssl)) {
+        samples->reused++;
+    }
+
+    SSL_SESSION_free(*session);
+    *session = SSL_get1_session(ssl);
+    ok = true;
+
+done:
+    SSL_shutdown(ssl);
+    SSL_free(ssl);
+    close(fd);
+    return ok;
+}
+
+static int compare_us(const void *a, const void *b)
+{
+    int64_t x = *(const int64_t *)a;
+    int64_t y = *(const int64_t *)b;
+
+    return (x > y) - (x < y);
+}
+
+static double percentile_ms(int64_t *us, uint32_t count, double percentile)
+{
+    size_t index = (size_t)(percentile / 100.0 * (count - 1) + 0.5);
+
+    return us[index] / 1000.0;
+}
+
+static void report(const char *name, samples_t *samples)
+{
+    printf("%s: %" PRIu32 " connects, %" PRIu32 " resumed by the server\n", name, samples->count, samples->reused);
+    if (samples->count == 0) {
+        return;
+    }
+
+    for (int phase = 0; phase < PHASE_COUNT; phase++) {
+        int64_t *us = samples->us[phase];
+
+        if (options.tls_only && phase == PHASE_CONNACK) {
+            continue;
+        }
+        qsort(us, samples->count, sizeof(us[0]), compare_us);
+        printf("  %-16s p50 %7.2f ms  p90 %7.2f ms  max %7.2f ms\n", phase_names[phase],
+               percentile_ms(us, samples->count, 50), percentile_ms(us, samples->count, 90),
+               us[samples->count - 1] / 1000.0);
+    }
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr, "usage: %s [-h host] [-p port] [-c ca.crt] [-u user] [-P password] [-n rounds] [-t]\n", name);
+}
+
+int main(int argc, char **argv)
+{
+    struct addrinfo hints = { .ai_family = AF_UNSPEC, .ai_socktype = SOCK_STREAM };
+    struct addrinfo *broker;
+    static samples_t warmup;
+    static samples_t full;
+    static samples_t resumed;
+    SSL_SESSION *session = NULL;
+    int failures = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "h:p:c:u:P:n:t")) != -1) {
+        switch (opt) {
+            case 'h': options.host = optarg; break;
+            case 'p': options.port = optarg; break;
+            case 'c': options.ca_file = optarg; break;
+            case 'u': options.username = optarg; break;
+            case 'P': options.password = optarg; break;
+            case 'n': options.rounds = (uint32_t)atoi(optarg); break;
+            case 't': options.tls_only = true; break;
+            default:
+                usage(argv[0]);
+                return 2;
+        }
+    }
+    if (options.rounds == 0 || options.rounds > MAX_ROUNDS) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    int error = getaddrinfo(options.host, options.port, &hints, &broker);
+    if (error != 0) {
+        fprintf(stderr, "%s:%s: %s\n", options.host, options.port, gai_strerror(error));
+        return 2;
+    }
+
+    SSL_CTX *ctx = SSL_CTX_new(TLS_client_method());
+    SSL_CTX_set_min_proto_version(ctx, TLS1_2_VERSION);
+    SSL_CTX_set_max_proto_version(ctx, TLS1_2_VERSION);
+    SSL_CTX_set_verify(ctx, SSL_VERIFY_PEER, NULL);
+    if (SSL_CTX_load_verify_locations(ctx, options.ca_file, NULL) != 1) {
+        fprintf(stderr, "%s: cannot load the CA\n", options.ca_file);
+        return 2;
+    }
+
+    printf("%" PRIu32 " rounds against %s:%s%s\n", options.rounds, options.host, options.port,
+           options.tls_only ? ", TLS only" : "");
+
+    // the first connect gets the session the resumed ones start from, it is not counted
+    if (!measure(ctx, broker, &session, 0, &warmup)) {
+        return 1;
+    }
+
+    // alternating, so a drift of the server or the network hits both the same
+    for (uint32_t round = 1; round <= options.rounds; round++) {
+        SSL_SESSION *none = NULL;
+
+        failures += measure(ctx, broker, &none, round, &full) ? 0 : 1;
+        SSL_SESSION_free(none);
+        failures += measure(ctx, broker, &session, round, &resumed) ? 0 : 1;
+    }
+
+    report("full handshake", &full);
+    report("resumed session", &resumed);
+    if (full.count > 0 && resumed.count > 0) {
+        printf("resumption saves %.2f ms of %.2f ms per connect (p50)\n",
+               percentile_ms(full.us[PHASE_TOTAL], full.count, 50) -
+               percentile_ms(resumed.us[PHASE_TOTAL], resumed.count, 50),
+               percentile_ms(full.us[PHASE_TOTAL], full.count, 50));
+    }
+
+    SSL_SESSION_free(session);
+    SSL_CTX_free(ctx);
+    freeaddrinfo(broker);
+    return failures > 0 || resumed.reused == 0 ? 1 : 0;
+}
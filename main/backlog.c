@@ -0,0 +1,76 @@
+#include "esp_log.h"
+#include "esp_attr.h"
+#include "esp_partition.h"
+#include "backlog.h"
+#include "sample_store.h"
+
+static const char *TAG = "BACKLOG";
+
+RTC_DATA_ATTR static sample_store_t store;
+static store_flash_t flash;
+
+static int partition_read(void *ctx, size_t offset, void *dst, size_t len)
+{
+    return esp_partition_read((const esp_partition_t *)ctx, offset, dst, len) == ESP_OK ? 0 : -1;
+}
+
+static int partition_write(void *ctx, size_t offset, const void *src, size_t len)
+{
+    return esp_partition_write((const esp_partition_t *)ctx, offset, src, len) == ESP_OK ? 0 : -1;
+}
+
+static int partition_erase_sector(void *ctx, size_t offset)
+{
+    const esp_partition_t *partition = ctx;
+    return esp_partition_erase_range(partition, offset, partition->erase_size) == ESP_OK ? 0 : -1;
+}
+
+esp_err_t backlog_init(void)
+{
+    const esp_partition_t *partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY,
+                                                                BACKLOG_PARTITION_LABEL);
+
+    if (partition == NULL) {
+        ESP_LOGW(TAG, "No \"%s\" partition, the backlog is kept in RTC RAM only", BACKLOG_PARTITION_LABEL);
+        sample_store_init(&store, NULL);
+    } else {
+        flash = (store_flash_t) {
+                .ctx = (void *)partition,
+                .sector_size = partition->erase_size,
+                .sector_count = partition->size / partition->erase_size,
+                .read = partition_read,
+                .write = partition_write,
+                .erase_sector = partition_erase_sector,
+        };
+        sample_store_init(&store, &flash);
+    }
+
+    ESP_LOGI(TAG, "%" PRIu32 " samples waiting", sample_store_count(&store));
+    return ESP_OK;
+}
+
+void backlog_push(const sensor_frame_t *frame)
+{
+    uint32_t dropped = store.stats.dropped;
+
+    sample_store_push(&store, frame);
+
+    if (store.stats.dropped != dropped) {
+        ESP_LOGW(TAG, "Backlog full, %" PRIu32 " samples dropped so far", store.stats.dropped);
+    }
+}
+
+size_t backlog_peek(sensor_frame_t *frames, size_t max)
+{
+    return sample_store_peek(&store, frames, max);
+}
+
+void backlog_consume(size_t count)
+{
+    sample_store_consume(&store, count);
+}
+
+uint32_t backlog_count(void)
+{
+    return sample_store_count(&store);
+}
@@ -0,0 +1,21 @@
+#ifndef __BACKLOG_H__
+#define __BACKLOG_H__
+
+#include <esp_err.h>
+
+#include "payload.h"
+
+#define BACKLOG_PARTITION_LABEL     "samples"
+
+/*
+ * Device glue for sample_store: the RAM ring lives in RTC RAM and spills into the "samples" data partition.
+ * Used from a single task at a time (mqtt_task, or app_main in duty-cycle mode).
+ */
+
+esp_err_t backlog_init(void);
+void backlog_push(const sensor_frame_t *frame);
+size_t backlog_peek(sensor_frame_t *frames, size_t max);
+void backlog_consume(size_t count);
+uint32_t backlog_count(void);
+
+#endif // __BACKLOG_H__
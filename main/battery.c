@@ -1,175 +1,312 @@
 #include <esp_log.h>
 
 #include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "driver/gpio.h"
 #include "driver/i2c_master.h"
 #include "battery.h"
+#include "sensor.h"
+#include "diag.h"
+#include "binlog.h"
 
 static const char *TAG = "BATTERY";
 
-QueueHandle_t battery_reading_queue = NULL;
+static void battery_to_frame(const void *item, sensor_frame_t *frame)
+{
+    const battery_reading_t *reading = item;
+    frame->flags |= PAYLOAD_HAS_BATTERY;
+    frame->voltage = reading->voltage;
+    frame->soc = reading->soc;
+}
 
 i2c_master_dev_handle_t dev_handle;
 
-esp_err_t read_16(uint8_t address, uint16_t* result) {
-    bool success = false;
-    uint8_t retries = 3;
-    uint8_t addr[2] = {address };
-    uint8_t buffer[2] = { 0, 0 };
-
-    while ((success == false) && (retries > 0))
-    {
-        esp_err_t err = i2c_master_transmit_receive(dev_handle, addr, sizeof(addr), buffer, 2, -1);
+/* Reads len bytes of consecutive registers starting at address in one transaction */
+static esp_err_t read_regs(uint8_t address, uint8_t *buffer, size_t len)
+{
+    esp_err_t err = ESP_FAIL;
 
+    for (uint8_t retries = I2C_MASTER_RETRIES; retries > 0; retries--) {
+        err = i2c_master_transmit_receive(dev_handle, &address, 1, buffer, len, I2C_MASTER_TIMEOUT_MS);
         if (err == ESP_OK) {
-            *result = ((uint16_t)buffer[0] << 8) | buffer[1];
-            success = true;
-        } else {
-            ESP_LOGW(TAG, "Failed to read battery monitor register: %X", address);
-            retries--;
-            esp_rom_delay_us( 500 );
+            return ESP_OK;
         }
+
+        ESP_LOGW(TAG, "Failed to read battery monitor register %X: %s", address, esp_err_to_name(err));
+        vTaskDelay(pdMS_TO_TICKS(I2C_MASTER_RETRY_DELAY_MS));
     }
 
-    return success ? ESP_OK : ESP_ERR_INVALID_ARG;
+    return err;
 }
 
-esp_err_t read_voltage(float* voltage) {
-    uint16_t buffer = 0;
-    esp_err_t err = read_16(MAX17048_VCELL, &buffer);
+esp_err_t read_16(uint8_t address, uint16_t* result) {
+    uint8_t buffer[2] = { 0, 0 };
+    esp_err_t err = read_regs(address, buffer, sizeof(buffer));
 
-    if (err != ESP_OK) {
-        return err;
+    if (err == ESP_OK) {
+        *result = ((uint16_t)buffer[0] << 8) | buffer[1];
     }
 
-    float _full_scale = 5.12f; // specific to MAX17048
-    float divider = 65536.0f / _full_scale;
-    *voltage = (((float)buffer) / divider);
-    return ESP_OK;
+    return err;
 }
 
-esp_err_t read_soc(float* percent) {
-    uint16_t buffer = 0;
-    esp_err_t err = read_16(MAX17048_SOC, &buffer);
+esp_err_t write_16(uint8_t address, uint16_t value) {
+    uint8_t buffer[3] = { address, value >> 8, value & 0xFF };
+    esp_err_t err = ESP_FAIL;
+
+    for (uint8_t retries = I2C_MASTER_RETRIES; retries > 0; retries--) {
+        err = i2c_master_transmit(dev_handle, buffer, sizeof(buffer), I2C_MASTER_TIMEOUT_MS);
+        if (err == ESP_OK) {
+            return ESP_OK;
+        }
+
+        ESP_LOGW(TAG, "Failed to write battery monitor register %X: %s", address, esp_err_to_name(err));
+        vTaskDelay(pdMS_TO_TICKS(I2C_MASTER_RETRY_DELAY_MS));
+    }
+
+    return err;
+}
+
+/* VCELL and SOC are adjacent, one 4 byte read gets both from the same conversion */
+static esp_err_t read_vcell_soc(battery_reading_t *reading)
+{
+    uint8_t buffer[4];
+    int64_t start = diag_start();
+    esp_err_t err = read_regs(MAX17048_VCELL, buffer, sizeof(buffer));
+
+    diag_record(DIAG_STAGE_BATTERY_READ, start);
 
     if (err != ESP_OK) {
         return err;
     }
 
-    *percent = (float)((buffer & 0xFF00) >> 8);
-    *percent += ((float)(buffer & 0x00FF)) / 256.0f;
+    // both registers are kept in their native units, 78.125 uV (5.12 V full scale) and 1/256 %, see fixed.h
+    reading->voltage = ((uint16_t)buffer[0] << 8) | buffer[1];
+    reading->soc = ((uint16_t)buffer[2] << 8) | buffer[3];
 
     return ESP_OK;
 }
 
-_Noreturn static void battery_reader_task(void *pvParameter) {
-    while(true) {
-        esp_err_t err;
-        float voltage;
-        float soc;
+#if CONFIG_ESP_BATTERY_ALERT
+/* Clears the alert flags, which releases the ALERT pin */
+static esp_err_t clear_alert(void)
+{
+    uint16_t status = 0;
+    uint16_t config = 0;
+    esp_err_t err = read_16(MAX17048_STATUS, &status);
+
+    if (err == ESP_OK && (status & MAX17048_STATUS_ALERTS)) {
+        ESP_LOGI(TAG, "Alert, status %04X", status);
+        err = write_16(MAX17048_STATUS, status & ~MAX17048_STATUS_ALERTS);
+    }
 
-        err = read_voltage(&voltage);
+    if (err == ESP_OK) {
+        err = read_16(MAX17048_CONFIG, &config);
+    }
 
-        if (err != ESP_OK) {
-            ESP_LOGE(TAG, "Failed reading voltage");
-            continue;
-        }
+    if (err == ESP_OK && (config & MAX17048_CONFIG_ALRT)) {
+        err = write_16(MAX17048_CONFIG, config & ~MAX17048_CONFIG_ALRT);
+    }
 
-        err = read_soc(&soc);
+    return err;
+}
 
-        if (err != ESP_OK) {
-            ESP_LOGE(TAG, "Failed reading soc");
-            continue;
-        }
+/* Keeps RCOMP, alerts on every 1 % SOC change and below the empty threshold */
+static esp_err_t configure_alert(void)
+{
+    uint16_t config = 0;
+    esp_err_t err = read_16(MAX17048_CONFIG, &config);
 
-        ESP_LOGI(TAG, "Voltage: %.2f, SOC: %.2f%%", voltage, soc);
+    if (err != ESP_OK) {
+        return err;
+    }
 
-        battery_reading_t reading = {
-                .voltage = voltage,
-                .soc = soc,
-        };
+    config &= 0xFF00;
+    config |= MAX17048_CONFIG_ALSC | ((32 - ESP_BATTERY_EMPTY_PCT) & MAX17048_CONFIG_ATHD_MASK);
 
-        BaseType_t status = xQueueSend(battery_reading_queue, &reading, 0);
+    return write_16(MAX17048_CONFIG, config);
+}
+#endif
 
-        if (status != pdPASS) {
-            ESP_LOGW(TAG, "battery_reader_task(): Failed to send the message");
-        }
+/* Version and the mode the readings rely on, after every probe that found the monitor */
+static esp_err_t battery_monitor_setup(void)
+{
+    uint16_t version = 0;
+    esp_err_t err = read_16(MAX17048_VERSION_REG_ADDR, &version);
+    if (err != ESP_OK) {
+        return err;
+    }
+    ESP_LOGI(TAG, "VERSION = %X", version);
 
-        vTaskDelay(pdMS_TO_TICKS(5000));
+#if CONFIG_ESP_BATTERY_ALERT
+    err = configure_alert();
+    if (err != ESP_OK) {
+        return err;
     }
+    err = clear_alert();
+    if (err != ESP_OK) {
+        return err;
+    }
+#endif
+#if CONFIG_ESP_BATTERY_HIBERNATE
+    err = write_16(MAX17048_HIBRT, MAX17048_HIBRT_FORCE);
+#endif
+
+    return err;
 }
 
-esp_err_t battery_init(void) {
-    ESP_LOGI(TAG, "Init");
-    int i2c_master_port = I2C_MASTER_NUM;
-    battery_reading_queue = xQueueCreate(10, sizeof(battery_reading_t));
+static esp_err_t battery_monitor_init(void)
+{
+    static i2c_master_bus_handle_t bus_handle = NULL;
+    static bool found = false;
 
-    if (battery_reading_queue == NULL) {
-        ESP_LOGE(TAG, "battery_reading_queue: Queue was not created. Could not allocate required memory");
-        return ESP_ERR_NO_MEM;
+    if (found) {
+        return ESP_OK;
     }
 
-    i2c_master_bus_config_t i2c_mst_config = {
-            .clk_source = I2C_CLK_SRC_DEFAULT,
-            .i2c_port = i2c_master_port,                     // auto assign
-            .scl_io_num = I2C_MASTER_SCL_IO,
-            .sda_io_num = I2C_MASTER_SDA_IO,
-            .glitch_ignore_cnt = 7,
-            .flags.enable_internal_pullup = true,
-    };
+    if (bus_handle == NULL) {
+        i2c_master_bus_config_t i2c_mst_config = {
+                .clk_source = I2C_CLK_SRC_DEFAULT,
+                .i2c_port = I2C_MASTER_NUM,                      // auto assign
+                .scl_io_num = I2C_MASTER_SCL_IO,
+                .sda_io_num = I2C_MASTER_SDA_IO,
+                .glitch_ignore_cnt = 7,
+                .flags.enable_internal_pullup = true,
+        };
 
-    i2c_master_bus_handle_t bus_handle;
-    ESP_ERROR_CHECK(i2c_new_master_bus(&i2c_mst_config, &bus_handle));
+        ESP_ERROR_CHECK(i2c_new_master_bus(&i2c_mst_config, &bus_handle));
 
-    i2c_device_config_t dev_cfg = {
-            .dev_addr_length = I2C_ADDR_BIT_LEN_7,
-            .device_address = MAX17048_SENSOR_ADDR,
-            .scl_speed_hz = I2C_MASTER_FREQ_HZ,
-    };
+        i2c_device_config_t dev_cfg = {
+                .dev_addr_length = I2C_ADDR_BIT_LEN_7,
+                .device_address = MAX17048_SENSOR_ADDR,
+                .scl_speed_hz = I2C_MASTER_FREQ_HZ,
+        };
 
-    ESP_ERROR_CHECK(i2c_master_bus_add_device(bus_handle, &dev_cfg, &dev_handle));
+        ESP_ERROR_CHECK(i2c_master_bus_add_device(bus_handle, &dev_cfg, &dev_handle));
+    }
 
-    uint8_t retries = 3;
-    bool success = false;
+    uint8_t retries = I2C_MASTER_RETRIES;
 
-    while ((success == false) && (retries > 0)){
-        esp_err_t err = i2c_master_probe(bus_handle, dev_cfg.device_address, -1);
+    while ((found == false) && (retries > 0)){
+        esp_err_t err = i2c_master_probe(bus_handle, MAX17048_SENSOR_ADDR, I2C_MASTER_TIMEOUT_MS);
 
         if (err == ESP_OK) {
-            success = true;
+            found = true;
             ESP_LOGI(TAG, "Battery monitor connected");
         } else {
             retries--;
             ESP_LOGW(TAG, "Battery monitor not connected, retrying...");
-            esp_rom_delay_us( 1000 );
+            vTaskDelay(pdMS_TO_TICKS(I2C_MASTER_RETRY_DELAY_MS));
         }
     }
 
-    if (success) {
-        uint16_t version = 0;
-        float voltage = 0;
-        float soc = 0;
-        ESP_ERROR_CHECK(read_16(MAX17048_VERSION_REG_ADDR, &version));
-        ESP_LOGI(TAG, "VERSION = %X", version);
+    if (!found) {
+        ESP_LOGE(TAG, "Battery monitor not found");
+        return ESP_ERR_NOT_FOUND;
+    }
 
-        ESP_ERROR_CHECK(read_voltage( &voltage));
-        ESP_LOGI(TAG, "Battery voltage: %.2fV", voltage);
+    // the monitor is optional: a NAK here costs this reading, the next one probes and sets it up again
+    esp_err_t err = battery_monitor_setup();
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to set up the battery monitor: %s", esp_err_to_name(err));
+        found = false;
+        return err;
+    }
 
-        ESP_ERROR_CHECK(read_soc( &soc));
-        ESP_LOGI(TAG, "Battery SOC: %.2f%%", soc);
+    return ESP_OK;
+}
 
-        BaseType_t status = xTaskCreate(battery_reader_task, "battery_reader_task", configMINIMAL_STACK_SIZE * 4, NULL,
-                                        4, NULL);
+esp_err_t battery_read_once(battery_reading_t *reading)
+{
+    esp_err_t err = battery_monitor_init();
+    if (err != ESP_OK) {
+        return err;
+    }
 
-        if (status != pdPASS) {
-            ESP_LOGE(TAG, "battery_reader_task(): Task was not created. Could not allocate required memory");
-            return ESP_ERR_NO_MEM;
-        }
-    } else {
-        ESP_LOGE(TAG, "Battery monitor not found");
+#if CONFIG_ESP_BATTERY_HIBERNATE && !CONFIG_ESP_BATTERY_ALERT
+    // leave hibernate for one active conversion, the hibernating ADC only updates every 45 s
+    err = write_16(MAX17048_HIBRT, MAX17048_HIBRT_DISABLE);
+    if (err != ESP_OK) {
+        return err;
     }
+    vTaskDelay(pdMS_TO_TICKS(MAX17048_ACTIVE_CONVERSION_MS));
+#endif
 
-    //ESP_ERROR_CHECK(i2c_master_bus_rm_device(dev_handle));
-    //ESP_ERROR_CHECK(i2c_del_master_bus(bus_handle));
+    err = read_vcell_soc(reading);
 
+#if CONFIG_ESP_BATTERY_HIBERNATE && !CONFIG_ESP_BATTERY_ALERT
+    if (write_16(MAX17048_HIBRT, MAX17048_HIBRT_FORCE) != ESP_OK) {
+        ESP_LOGW(TAG, "Failed to hibernate the battery monitor");
+    }
+#endif
+#if CONFIG_ESP_BATTERY_ALERT
+    if (clear_alert() != ESP_OK) {
+        ESP_LOGW(TAG, "Failed to clear the battery alert");
+    }
+#endif
+
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed reading voltage and soc");
+        return err;
+    }
+
+    BINLOG(BATTERY_READING, reading->voltage, reading->soc);
     return ESP_OK;
-}
\ No newline at end of file
+}
+
+static esp_err_t battery_sample(void *reading)
+{
+    return battery_read_once(reading);
+}
+
+#if CONFIG_ESP_BATTERY_ALERT
+static void IRAM_ATTR battery_alert_isr(void *arg)
+{
+    sensor_trigger_from_isr(&max17048_driver);
+}
+#endif
+
+static esp_err_t battery_driver_init(void)
+{
+    // only a missing monitor is left out, one that NAKed its setup is set up again by the next reading
+    esp_err_t err = battery_monitor_init();
+    if (err == ESP_ERR_NOT_FOUND) {
+        return err;
+    }
+
+#if CONFIG_ESP_BATTERY_ALERT
+    // ALERT is open drain and active low
+    gpio_config_t io_conf = {
+            .pin_bit_mask = 1ULL << ESP_BATTERY_ALERT_GPIO,
+            .mode = GPIO_MODE_INPUT,
+            .pull_up_en = GPIO_PULLUP_ENABLE,
+            .intr_type = GPIO_INTR_NEGEDGE,
+    };
+    ESP_ERROR_CHECK(gpio_config(&io_conf));
+
+    err = gpio_install_isr_service(0);
+    if (err != ESP_OK && err != ESP_ERR_INVALID_STATE) {
+        return err;
+    }
+    ESP_ERROR_CHECK(gpio_isr_handler_add(ESP_BATTERY_ALERT_GPIO, battery_alert_isr, NULL));
+
+    // take the first reading now, afterwards only on alerts and the fallback period
+    max17048_driver.triggered = true;
+#endif
+
+    return ESP_OK;
+}
+
+sensor_driver_t max17048_driver = {
+        .name = "max17048",
+        .period_ms = ESP_BATTERY_SAMPLE_PERIOD_MS,
+        .reading_size = sizeof(battery_reading_t),
+        .init = battery_driver_init,
+        .sample = battery_sample,
+        .format = battery_to_frame,
+        .source = {
+                .policy = ESP_BATTERY_PUBLISH_POLICY,
+                .depth = CONFIG_ESP_BATTERY_QUEUE_DEPTH,
+                .min_interval_ms = CONFIG_ESP_BATTERY_MIN_PUBLISH_INTERVAL_MS,
+        },
+};
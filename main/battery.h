@@ -3,13 +3,23 @@
 
 #include <esp_err.h>
 
+#include "sensor.h"
+
 #define I2C_MASTER_NUM              0                          /*!< I2C master i2c port number, the number of i2c peripheral interfaces available will depend on the chip */
 #define I2C_MASTER_SCL_IO           CONFIG_ESP_I2C_MASTER_SCL  /*!< GPIO number used for I2C master clock */
 #define I2C_MASTER_SDA_IO           CONFIG_ESP_I2C_MASTER_SDA  /*!< GPIO number used for I2C master data  */
 #define I2C_MASTER_FREQ_HZ          400000                     /*!< I2C master clock frequency */
 #define I2C_MASTER_TX_BUF_DISABLE   0                          /*!< I2C master doesn't need buffer */
 #define I2C_MASTER_RX_BUF_DISABLE   0                          /*!< I2C master doesn't need buffer */
-#define I2C_MASTER_TIMEOUT_MS       1000
+#define I2C_MASTER_TIMEOUT_MS       50                         /*!< bound for one I2C transaction */
+#define I2C_MASTER_RETRIES          3
+#define I2C_MASTER_RETRY_DELAY_MS   10
+
+#if CONFIG_ESP_BATTERY_PUBLISH_LATEST
+#define ESP_BATTERY_PUBLISH_POLICY  PUBLISHER_POLICY_LATEST
+#else
+#define ESP_BATTERY_PUBLISH_POLICY  PUBLISHER_POLICY_FIFO
+#endif
 
 #define MAX17048_SENSOR_ADDR        0x36
 
@@ -18,14 +28,40 @@
 #define MAX17048_VCELL              0x02         /*!< R - 16-bit A/D measurement of battery voltage */
 #define MAX17048_SOC                0x04         /*!< R - 16-bit state of charge (SOC) */
 #define MAX17048_VERSION_REG_ADDR   0x08         /*!< Returns 2 byte version */
+#define MAX17048_HIBRT              0x0A         /*!< RW - hibernate thresholds, high byte HibThr, low byte ActThr */
+#define MAX17048_CONFIG             0x0C         /*!< RW - high byte RCOMP, low byte SLEEP, ALSC, ALRT, ATHD[4:0] */
+#define MAX17048_STATUS             0x1A         /*!< RW - high byte alert flags, cleared by writing 0 */
+
+#define MAX17048_HIBRT_FORCE        0xFFFF       /*!< always hibernate */
+#define MAX17048_HIBRT_DISABLE      0x0000       /*!< never hibernate */
+
+#define MAX17048_CONFIG_ALSC        (1 << 6)     /*!< alert on every 1 % SOC change */
+#define MAX17048_CONFIG_ALRT        (1 << 5)     /*!< alert pending, cleared by writing 0 */
+#define MAX17048_CONFIG_ATHD_MASK   0x1F         /*!< empty alert threshold, 32 - ATHD percent */
 
-esp_err_t battery_init(void);
+#define MAX17048_STATUS_ALERTS      0x3E00       /*!< VH, VL, VR, HD and SC alert flags */
 
-extern QueueHandle_t battery_reading_queue;
+// VCELL is updated every 250 ms while active and every 45 s while hibernating
+#define MAX17048_ACTIVE_CONVERSION_MS   250
+
+#if CONFIG_ESP_BATTERY_ALERT
+#define ESP_BATTERY_ALERT_GPIO      CONFIG_ESP_BATTERY_ALERT_GPIO
+#define ESP_BATTERY_EMPTY_PCT       CONFIG_ESP_BATTERY_ALERT_EMPTY_PCT
+#define ESP_BATTERY_SAMPLE_PERIOD_MS (CONFIG_ESP_BATTERY_ALERT_FALLBACK_SEC * 1000)
+#else
+#define ESP_BATTERY_SAMPLE_PERIOD_MS CONFIG_ESP_BATTERY_SAMPLE_PERIOD_MS
+#endif
 
 typedef struct {
-    float voltage;
-    float soc;
+    uint16_t voltage;       /*!< VCELL, 78.125 uV */
+    uint16_t soc;           /*!< SOC, 1/256 % */
 } battery_reading_t;
 
+/**
+ * @brief Take a single reading, initialising the I2C bus and probing the monitor on first use
+ */
+esp_err_t battery_read_once(battery_reading_t *reading);
+
+extern sensor_driver_t max17048_driver;
+
 #endif
\ No newline at end of file
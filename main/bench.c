@@ -0,0 +1,628 @@
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "esp_app_desc.h"
+#include "esp_log.h"
+
+#include "bench.h"
+#include "dht22.h"
+#include "dht22_decode.h"
+#include "fixed.h"
+#include "payload.h"
+#include "topic_alias.h"
+#include "deadband.h"
+#include "binlog.h"
+
+static const char *TAG = "BENCH";
+
+#if CONFIG_IDF_TARGET_LINUX
+#include <time.h>
+
+#define BENCH_UNIT  "ns"
+
+static inline uint32_t bench_clock(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint32_t)((uint64_t)now.tv_sec * 1000000000u + (uint64_t)now.tv_nsec);
+}
+#else
+#include "esp_cpu.h"
+
+#define BENCH_UNIT  "cycles"
+
+static inline uint32_t bench_clock(void)
+{
+    return esp_cpu_get_cycle_count();
+}
+#endif
+
+#define BENCH_BATCH_FRAMES  8
+#define BENCH_QUEUE_LENGTH  4
+
+typedef struct {
+    const char *name;
+    void (*run)(uint32_t iterations);
+    size_t (*bytes)(size_t *wire_bytes);     /*!< output of one operation, NULL if it produces none */
+} bench_case_t;
+
+/* Results go through here so the compiler cannot drop the work */
+static volatile uint32_t sink;
+
+/* == Fixtures ============================================================ */
+
+static uint8_t frame_bytes[DHT_DATA_BYTES];
+static dht_pulse_t bit_pulses[DHT_DATA_BITS * 2];
+static dht_pulse_t rmt_pulses[DHT_DATA_BITS * 2 + 4];
+static sensor_frame_t frame;
+static sensor_frame_t batch[BENCH_BATCH_FRAMES];
+static topic_alias_t aliases;
+static deadband_t deadband;
+static uint32_t deadband_ms;
+
+static const char *const value_topics[] = {
+        CONFIG_ESP_MQTT_TOPIC_TEMPERATURE,
+        CONFIG_ESP_MQTT_TOPIC_HUMIDITY,
+        CONFIG_ESP_MQTT_TOPIC_BATTERY_VOLTAGE,
+        CONFIG_ESP_MQTT_TOPIC_BATTERY_SOC,
+};
+
+/* the Kconfig defaults in the units of the readings: 0.1 °C, 0.5 %, 20 mV and 1 %, a 15 minute heartbeat */
+static const deadband_config_t deadband_config[DEADBAND_METRIC_COUNT] = {
+        [DEADBAND_TEMPERATURE] = { 1, 900000 },
+        [DEADBAND_HUMIDITY] = { 5, 900000 },
+        [DEADBAND_VOLTAGE] = { 256, 900000 },
+        [DEADBAND_SOC] = { 256, 900000 },
+};
+
+static size_t varint_size(size_t value)
+{
+    size_t size = 1;
+
+    while (value >= 128) {
+        value /= 128;
+        size++;
+    }
+
+    return size;
+}
+
+/* MQTT5 PUBLISH at QoS 1 on an established topic alias: empty topic, packet id, the alias property, payload */
+static size_t publish_wire_bytes(size_t len)
+{
+    size_t properties = 3;
+    size_t remaining = 2 + 2 + varint_size(properties) + properties + len;
+
+    return 1 + varint_size(remaining) + remaining;
+}
+
+static bool fixtures_init(void)
+{
+    uint8_t data[DHT_DATA_BYTES];
+
+    // 23.4 °C, 56.7 % as the sensor sends it: a 50 us low and a 26 or 70 us high per bit, MSB first
+    frame_bytes[0] = 567 >> 8;
+    frame_bytes[1] = 567 & 0xff;
+    frame_bytes[2] = 234 >> 8;
+    frame_bytes[3] = 234 & 0xff;
+    frame_bytes[4] = (uint8_t)(frame_bytes[0] + frame_bytes[1] + frame_bytes[2] + frame_bytes[3]);
+
+    for (int bit = 0; bit < DHT_DATA_BITS; bit++) {
+        bool one = frame_bytes[bit / 8] & (0x80 >> (bit % 8));
+
+        bit_pulses[bit * 2] = (dht_pulse_t) { .level = 0, .duration_us = 50 };
+        bit_pulses[bit * 2 + 1] = (dht_pulse_t) { .level = 1, .duration_us = one ? 70 : 26 };
+    }
+
+    // the RMT capture also holds the end of the start signal and the 80/80 us response
+    rmt_pulses[0] = (dht_pulse_t) { .level = 1, .duration_us = 30 };
+    rmt_pulses[1] = (dht_pulse_t) { .level = 0, .duration_us = 80 };
+    rmt_pulses[2] = (dht_pulse_t) { .level = 1, .duration_us = 80 };
+    memcpy(&rmt_pulses[3], bit_pulses, sizeof(bit_pulses));
+    rmt_pulses[3 + DHT_DATA_BITS * 2] = (dht_pulse_t) { .level = 1, .duration_us = 0 };
+
+    frame = (sensor_frame_t) {
+            .flags = PAYLOAD_HAS_DHT | PAYLOAD_HAS_BATTERY,
+            .seq = 123456,
+            .timestamp = 1700000000,
+            .temperature = 234,
+            .humidity = 567,
+            .voltage = 3987 * 128 / 10,
+            .soc = 87 * 256 + 128,
+    };
+    for (int i = 0; i < BENCH_BATCH_FRAMES; i++) {
+        batch[i] = frame;
+        batch[i].seq += i;
+        batch[i].timestamp += i * 30;
+        batch[i].temperature += i;
+    }
+
+    // every topic has its alias, as on a connection that has been up for a while
+    topic_alias_reset(&aliases, TOPIC_ALIAS_MAX);
+    for (int i = 0; i < sizeof(value_topics) / sizeof(value_topics[0]); i++) {
+        bool established;
+
+        topic_alias_confirm(&aliases, topic_alias_get(&aliases, value_topics[i], &established));
+    }
+
+    deadband_init(&deadband, deadband_config);
+    deadband_ms = 0;
+
+    // timing the error paths instead would look like a speed-up
+    return dht_decode_bits(bit_pulses, DHT_DATA_BITS * 2, data) == DHT_DECODE_OK &&
+           dht_decode_pulses(rmt_pulses, sizeof(rmt_pulses) / sizeof(rmt_pulses[0]), data) == DHT_DECODE_OK;
+}
+
+/* == DHT22 decode ======================================================== */
+
+static void run_dht_decode_bits(uint32_t iterations)
+{
+    uint8_t data[DHT_DATA_BYTES];
+
+    for (uint32_t i = 0; i < iterations; i++) {
+        sink += dht_decode_bits(bit_pulses, DHT_DATA_BITS * 2, data);
+    }
+}
+
+static void run_dht_decode_pulses(uint32_t iterations)
+{
+    uint8_t data[DHT_DATA_BYTES];
+
+    for (uint32_t i = 0; i < iterations; i++) {
+        sink += dht_decode_pulses(rmt_pulses, sizeof(rmt_pulses) / sizeof(rmt_pulses[0]), data);
+    }
+}
+
+static void run_dht_decode_check(uint32_t iterations)
+{
+    for (uint32_t i = 0; i < iterations; i++) {
+        sink += dht_decode_check(frame_bytes);
+    }
+}
+
+static void run_dht_decode_values(uint32_t iterations)
+{
+    int16_t temperature;
+    uint16_t humidity;
+
+    for (uint32_t i = 0; i < iterations; i++) {
+        dht_decode_values(frame_bytes, &temperature, &humidity);
+        sink += temperature + humidity;
+    }
+}
+
+/* == Values, topics and payloads ========================================= */
+
+static void run_format(uint32_t iterations, int32_t raw, uint32_t den)
+{
+    char string[FIXED_STRING_SIZE];
+
+    for (uint32_t i = 0; i < iterations; i++) {
+        sink += fixed_format(raw, den, string, sizeof(string));
+    }
+}
+
+static void run_format_temperature(uint32_t iterations)
+{
+    run_format(iterations, frame.temperature, FIXED_DHT_DEN);
+}
+
+static void run_format_voltage(uint32_t iterations)
+{
+    run_format(iterations, frame.voltage, FIXED_VCELL_DEN);
+}
+
+static void run_format_soc(uint32_t iterations)
+{
+    run_format(iterations, frame.soc, FIXED_SOC_DEN);
+}
+
+static size_t format_bytes(int32_t raw, uint32_t den, size_t *wire_bytes)
+{
+    char string[FIXED_STRING_SIZE];
+    int len = fixed_format(raw, den, string, sizeof(string));
+
+    *wire_bytes = publish_wire_bytes(len);
+    return len;
+}
+
+static size_t bytes_format_temperature(size_t *wire_bytes)
+{
+    return format_bytes(frame.temperature, FIXED_DHT_DEN, wire_bytes);
+}
+
+static size_t bytes_format_voltage(size_t *wire_bytes)
+{
+    return format_bytes(frame.voltage, FIXED_VCELL_DEN, wire_bytes);
+}
+
+static size_t bytes_format_soc(size_t *wire_bytes)
+{
+    return format_bytes(frame.soc, FIXED_SOC_DEN, wire_bytes);
+}
+
+static void run_fixed_rescale(uint32_t iterations)
+{
+    for (uint32_t i = 0; i < iterations; i++) {
+        sink += fixed_rescale(frame.voltage, FIXED_VCELL_DEN, 1000);
+    }
+}
+
+static void run_topic_alias_get(uint32_t iterations)
+{
+    bool established;
+
+    // the last configured topic, the longest lookup
+    for (uint32_t i = 0; i < iterations; i++) {
+        sink += topic_alias_get(&aliases, CONFIG_ESP_MQTT_TOPIC_BATTERY_SOC, &established);
+    }
+}
+
+static void run_payload(uint32_t iterations, payload_format_t format)
+{
+    uint8_t buffer[PAYLOAD_MAX_SIZE];
+
+    for (uint32_t i = 0; i < iterations; i++) {
+        sink += payload_encode(format, &frame, buffer, sizeof(buffer));
+    }
+}
+
+static size_t payload_bytes(payload_format_t format, size_t *wire_bytes)
+{
+    uint8_t buffer[PAYLOAD_MAX_SIZE];
+    int len = payload_encode(format, &frame, buffer, sizeof(buffer));
+
+    *wire_bytes = publish_wire_bytes(len);
+    return len;
+}
+
+static void run_payload_json(uint32_t iterations)
+{
+    run_payload(iterations, PAYLOAD_FORMAT_JSON);
+}
+
+static void run_payload_cbor(uint32_t iterations)
+{
+    run_payload(iterations, PAYLOAD_FORMAT_CBOR);
+}
+
+static void run_payload_binary(uint32_t iterations)
+{
+    run_payload(iterations, PAYLOAD_FORMAT_BINARY);
+}
+
+static size_t bytes_payload_json(size_t *wire_bytes)
+{
+    return payload_bytes(PAYLOAD_FORMAT_JSON, wire_bytes);
+}
+
+static size_t bytes_payload_cbor(size_t *wire_bytes)
+{
+    return payload_bytes(PAYLOAD_FORMAT_CBOR, wire_bytes);
+}
+
+static size_t bytes_payload_binary(size_t *wire_bytes)
+{
+    return payload_bytes(PAYLOAD_FORMAT_BINARY, wire_bytes);
+}
+
+static void run_payload_batch(uint32_t iterations, payload_format_t format)
+{
+    static uint8_t buffer[PAYLOAD_MAX_SIZE * BENCH_BATCH_FRAMES];
+
+    for (uint32_t i = 0; i < iterations; i++) {
+        sink += payload_encode_batch(format, batch, BENCH_BATCH_FRAMES, buffer, sizeof(buffer));
+    }
+}
+
+static size_t payload_batch_bytes(payload_format_t format, size_t *wire_bytes)
+{
+    static uint8_t buffer[PAYLOAD_MAX_SIZE * BENCH_BATCH_FRAMES];
+    int len = payload_encode_batch(format, batch, BENCH_BATCH_FRAMES, buffer, sizeof(buffer));
+
+    *wire_bytes = publish_wire_bytes(len);
+    return len;
+}
+
+static void run_payload_batch_json(uint32_t iterations)
+{
+    run_payload_batch(iterations, PAYLOAD_FORMAT_JSON);
+}
+
+static void run_payload_batch_cbor(uint32_t iterations)
+{
+    run_payload_batch(iterations, PAYLOAD_FORMAT_CBOR);
+}
+
+static void run_payload_batch_binary(uint32_t iterations)
+{
+    run_payload_batch(iterations, PAYLOAD_FORMAT_BINARY);
+}
+
+static size_t bytes_payload_batch_json(size_t *wire_bytes)
+{
+    return payload_batch_bytes(PAYLOAD_FORMAT_JSON, wire_bytes);
+}
+
+static size_t bytes_payload_batch_cbor(size_t *wire_bytes)
+{
+    return payload_batch_bytes(PAYLOAD_FORMAT_CBOR, wire_bytes);
+}
+
+static size_t bytes_payload_batch_binary(size_t *wire_bytes)
+{
+    return payload_batch_bytes(PAYLOAD_FORMAT_BINARY, wire_bytes);
+}
+
+static void run_deadband_filter(uint32_t iterations)
+{
+    for (uint32_t i = 0; i < iterations; i++) {
+        deadband_ms += 1000;
+        sink += deadband_filter(&deadband, &frame, deadband_ms);
+    }
+}
+
+/* == One sample end to end =============================================== */
+
+/*
+ * Everything the CPU does for one DHT22 and battery sample between the line and esp_mqtt_client_publish(): decode
+ * and check the frame, run the deadband, then look up the alias and format the value of every per-value topic.
+ */
+static void run_sample_pipeline(uint32_t iterations)
+{
+    uint8_t data[DHT_DATA_BYTES];
+    sensor_frame_t sample = frame;
+    char string[FIXED_STRING_SIZE];
+    bool established;
+
+    for (uint32_t i = 0; i < iterations; i++) {
+        if (dht_decode_bits(bit_pulses, DHT_DATA_BITS * 2, data) != DHT_DECODE_OK) {
+            continue;
+        }
+        dht_decode_values(data, &sample.temperature, &sample.humidity);
+        deadband_ms += 1000;
+        sink += deadband_filter(&deadband, &sample, deadband_ms);
+
+        sink += topic_alias_get(&aliases, CONFIG_ESP_MQTT_TOPIC_TEMPERATURE, &established);
+        sink += fixed_format(sample.temperature, FIXED_DHT_DEN, string, sizeof(string));
+        sink += topic_alias_get(&aliases, CONFIG_ESP_MQTT_TOPIC_HUMIDITY, &established);
+        sink += fixed_format(sample.humidity, FIXED_DHT_DEN, string, sizeof(string));
+        sink += topic_alias_get(&aliases, CONFIG_ESP_MQTT_TOPIC_BATTERY_VOLTAGE, &established);
+        sink += fixed_format(sample.voltage, FIXED_VCELL_DEN, string, sizeof(string));
+        sink += topic_alias_get(&aliases, CONFIG_ESP_MQTT_TOPIC_BATTERY_SOC, &established);
+        sink += fixed_format(sample.soc, FIXED_SOC_DEN, string, sizeof(string));
+    }
+}
+
+static size_t bytes_sample_pipeline(size_t *wire_bytes)
+{
+    size_t bytes = 0;
+    size_t wire;
+
+    *wire_bytes = 0;
+    bytes += bytes_format_temperature(&wire);
+    *wire_bytes += wire;
+    bytes += format_bytes(frame.humidity, FIXED_DHT_DEN, &wire);
+    *wire_bytes += wire;
+    bytes += bytes_format_voltage(&wire);
+    *wire_bytes += wire;
+    bytes += bytes_format_soc(&wire);
+    *wire_bytes += wire;
+
+    return bytes;
+}
+
+/* == Reader to publisher handoff ========================================= */
+
+static QueueHandle_t queue;
+static QueueSetHandle_t queue_set;
+
+/* Send and receive in the same task, the bare copy-in and copy-out of a publisher source queue */
+static void run_queue_send_receive(uint32_t iterations)
+{
+    dht_reading_t reading = { .temperature = frame.temperature, .humidity = frame.humidity };
+
+    for (uint32_t i = 0; i < iterations; i++) {
+        xQueueSend(queue, &reading, 0);
+        xQueueReceive(queue, &reading, 0);
+    }
+    sink += reading.temperature;
+}
+
+/* The same through a queue set as publisher_receive() does it, still without a context switch */
+static void run_queue_set_handoff(uint32_t iterations)
+{
+    dht_reading_t reading = { .temperature = frame.temperature, .humidity = frame.humidity };
+
+    for (uint32_t i = 0; i < iterations; i++) {
+        xQueueSend(queue, &reading, 0);
+        QueueSetMemberHandle_t member = xQueueSelectFromSet(queue_set, 0);
+        xQueueReceive(member, &reading, 0);
+    }
+    sink += reading.temperature;
+}
+
+static void consumer_task(void *arg)
+{
+    dht_reading_t reading;
+
+    for (;;) {
+        QueueSetMemberHandle_t member = xQueueSelectFromSet(queue_set, portMAX_DELAY);
+        if (member != NULL && xQueueReceive(member, &reading, 0) == pdTRUE) {
+            sink += reading.humidity;
+        }
+    }
+}
+
+/* A reader handing samples to a waiting higher priority publisher: send, switch, select, receive, switch back */
+static void run_queue_task_handoff(uint32_t iterations)
+{
+    dht_reading_t reading = { .temperature = frame.temperature, .humidity = frame.humidity };
+
+    for (uint32_t i = 0; i < iterations; i++) {
+        xQueueSend(queue, &reading, portMAX_DELAY);
+    }
+}
+
+/* == Logging ============================================================= */
+
+static char log_line[128];
+static int log_line_len;
+
+/* Stands in for the UART: the line is formatted as for the console and dropped, the UART time comes on top */
+static int log_discard(const char *format, va_list args)
+{
+    log_line_len = vsnprintf(log_line, sizeof(log_line), format, args);
+    return log_line_len;
+}
+
+/* A DHT22 reading logged the way dht_take() did before the deferred log */
+static void run_log_esp_logi(uint32_t iterations)
+{
+    vprintf_like_t console = esp_log_set_vprintf(log_discard);
+    char humidity[FIXED_STRING_SIZE];
+    char temperature[FIXED_STRING_SIZE];
+
+    for (uint32_t i = 0; i < iterations; i++) {
+        fixed_format(frame.humidity, FIXED_DHT_DEN, humidity, sizeof(humidity));
+        fixed_format(frame.temperature, FIXED_DHT_DEN, temperature, sizeof(temperature));
+        ESP_LOGI("DHT22", "Sensor %u: Humidity: %s, temperature: %s°C", 0, humidity, temperature);
+    }
+    esp_log_set_vprintf(console);
+    sink += log_line_len;
+}
+
+/* The same reading through the deferred log, formatted right away without CONFIG_ESP_BINLOG */
+static void run_log_binlog(uint32_t iterations)
+{
+    vprintf_like_t console = esp_log_set_vprintf(log_discard);
+
+    for (uint32_t i = 0; i < iterations; i++) {
+        BINLOG(DHT_READING, 0, frame.humidity, frame.temperature);
+    }
+    esp_log_set_vprintf(console);
+}
+
+/* bytes is what goes to the UART, or into the ring */
+static size_t bytes_log_esp_logi(size_t *wire_bytes)
+{
+    run_log_esp_logi(1);
+    return log_line_len;
+}
+
+static size_t bytes_log_binlog(size_t *wire_bytes)
+{
+#if CONFIG_ESP_BINLOG
+    return 5 * sizeof(uint32_t);
+#else
+    run_log_binlog(1);
+    return log_line_len;
+#endif
+}
+
+/* ======================================================================== */
+
+static const bench_case_t cases[] = {
+        { "dht_decode_bits", run_dht_decode_bits, NULL },
+        { "dht_decode_pulses", run_dht_decode_pulses, NULL },
+        { "dht_decode_check", run_dht_decode_check, NULL },
+        { "dht_decode_values", run_dht_decode_values, NULL },
+        { "fixed_format_temperature", run_format_temperature, bytes_format_temperature },
+        { "fixed_format_voltage", run_format_voltage, bytes_format_voltage },
+        { "fixed_format_soc", run_format_soc, bytes_format_soc },
+        { "fixed_rescale", run_fixed_rescale, NULL },
+        { "topic_alias_get", run_topic_alias_get, NULL },
+        { "payload_json", run_payload_json, bytes_payload_json },
+        { "payload_cbor", run_payload_cbor, bytes_payload_cbor },
+        { "payload_binary", run_payload_binary, bytes_payload_binary },
+        { "payload_batch_json", run_payload_batch_json, bytes_payload_batch_json },
+        { "payload_batch_cbor", run_payload_batch_cbor, bytes_payload_batch_cbor },
+        { "payload_batch_binary", run_payload_batch_binary, bytes_payload_batch_binary },
+        { "deadband_filter", run_deadband_filter, NULL },
+        { "sample_pipeline", run_sample_pipeline, bytes_sample_pipeline },
+        { "queue_send_receive", run_queue_send_receive, NULL },
+        { "queue_set_handoff", run_queue_set_handoff, NULL },
+        { "log_esp_logi", run_log_esp_logi, bytes_log_esp_logi },
+        { "log_binlog", run_log_binlog, bytes_log_binlog },
+};
+
+static void sort_rounds(uint32_t *rounds, int count)
+{
+    for (int i = 1; i < count; i++) {
+        uint32_t value = rounds[i];
+        int j = i;
+
+        for (; j > 0 && rounds[j - 1] > value; j--) {
+            rounds[j] = rounds[j - 1];
+        }
+        rounds[j] = value;
+    }
+}
+
+static void bench_measure(const char *name, void (*run)(uint32_t), size_t (*bytes)(size_t *), uint32_t iterations)
+{
+    uint32_t rounds[BENCH_ROUNDS];
+    size_t payload = 0;
+    size_t wire_bytes = 0;
+
+    // one untimed round warms the caches and the flash cache lines of the code under test
+    run(iterations);
+    for (int round = 0; round < BENCH_ROUNDS; round++) {
+        uint32_t start = bench_clock();
+        run(iterations);
+        rounds[round] = bench_clock() - start;
+    }
+    sort_rounds(rounds, BENCH_ROUNDS);
+
+    if (bytes != NULL) {
+        payload = bytes(&wire_bytes);
+    }
+
+    printf("{\"bench\":\"%s\",\"target\":\"%s\",\"version\":\"%s\",\"unit\":\"" BENCH_UNIT "\",\"iterations\":%" PRIu32
+           ",\"min\":%.1f,\"median\":%.1f,\"bytes\":%u,\"wire_bytes\":%u}\n",
+           name, CONFIG_IDF_TARGET, esp_app_get_description()->version, iterations,
+           (double)rounds[0] / iterations, (double)rounds[BENCH_ROUNDS / 2] / iterations,
+           (unsigned)payload, (unsigned)wire_bytes);
+}
+
+void bench_run_all(uint32_t iterations)
+{
+    TaskHandle_t consumer = NULL;
+
+    ESP_LOGI(TAG, "Running %u benchmarks, %d rounds of %" PRIu32 " iterations",
+             (unsigned)(sizeof(cases) / sizeof(cases[0]) + 1), BENCH_ROUNDS, iterations);
+
+    if (!fixtures_init()) {
+        ESP_LOGE(TAG, "The DHT22 fixture does not decode");
+        return;
+    }
+    queue = xQueueCreate(BENCH_QUEUE_LENGTH, sizeof(dht_reading_t));
+    queue_set = xQueueCreateSet(BENCH_QUEUE_LENGTH);
+    if (queue == NULL || queue_set == NULL || xQueueAddToSet(queue, queue_set) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create the queues");
+        return;
+    }
+
+    for (int i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        bench_measure(cases[i].name, cases[i].run, cases[i].bytes, iterations);
+    }
+
+    // the consumer preempts every send, the queue never holds more than one sample
+    if (xTaskCreate(consumer_task, "bench", 2048, NULL, uxTaskPriorityGet(NULL) + 1, &consumer) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create the consumer task");
+        return;
+    }
+    bench_measure("queue_task_handoff", run_queue_task_handoff, NULL, iterations);
+
+    // the queues stay: the consumer may still reference the set until it is deleted
+    vTaskDelete(consumer);
+    // the made-up readings of log_binlog are not the node's
+    binlog_clear();
+    fflush(stdout);
+}
@@ -0,0 +1,28 @@
+#ifndef __BENCH_H__
+#define __BENCH_H__
+
+#include <stdint.h>
+
+/*
+ * Micro-benchmarks of the per-sample hot paths: DHT22 decode, value formatting, topic and payload assembly, the
+ * deadband and the queue handoff from the sensor scheduler to the publisher. On the device they are timed with the
+ * CPU cycle counter, on the host (host/hotpath_bench) in nanoseconds.
+ *
+ * Every result is one JSON line on stdout so runs of different firmware versions can be diffed, see
+ * tools/bench_compare.c:
+ *   {"bench":"dht_decode_bits","target":"esp32s3","version":"v1.2","unit":"cycles","iterations":1000,
+ *    "min":812.0,"median":830.5,"bytes":0,"wire_bytes":0}
+ * min and median are per operation over BENCH_ROUNDS rounds. bytes is the payload an operation produces and
+ * wire_bytes the MQTT5 PUBLISH packets it would send, with the topic alias already established.
+ */
+
+#define BENCH_ROUNDS    7
+
+/**
+ * @brief Run every benchmark and print the results. Call before the application tasks start.
+ *
+ * @param iterations operations per round
+ */
+void bench_run_all(uint32_t iterations);
+
+#endif // __BENCH_H__
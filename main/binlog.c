@@ -0,0 +1,210 @@
+#include <inttypes.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "binlog.h"
+
+#if CONFIG_ESP_BINLOG
+
+#define RING_WORDS          (CONFIG_ESP_BINLOG_SIZE / 4)
+#define RECORD_WORDS(argc)  (2 + (argc))
+
+/* Records wrap word by word, the oldest ones are overwritten to make room */
+static uint32_t ring[RING_WORDS];
+static uint32_t head = 0;               /*!< word the next record starts at */
+static uint32_t tail = 0;               /*!< word the oldest record starts at */
+static uint32_t used = 0;               /*!< words */
+static uint32_t written = 0;            /*!< records since boot */
+static uint32_t overwritten = 0;
+static portMUX_TYPE lock = portMUX_INITIALIZER_UNLOCKED;
+
+static inline uint32_t next_word(uint32_t word)
+{
+    return word + 1 < RING_WORDS ? word + 1 : 0;
+}
+
+static uint32_t record_words(uint32_t start)
+{
+    return RECORD_WORDS((ring[next_word(start)] >> 16) & 0xff);
+}
+
+void binlog_write(binlog_id_t id, const int32_t *args, size_t argc)
+{
+    uint32_t time_ms = esp_log_timestamp();
+
+    if (argc > BINLOG_MAX_ARGS) {
+        argc = BINLOG_MAX_ARGS;
+    }
+
+    taskENTER_CRITICAL(&lock);
+    while (used + RECORD_WORDS(argc) > RING_WORDS) {
+        uint32_t words = record_words(tail);
+
+        tail = (tail + words) % RING_WORDS;
+        used -= words;
+        overwritten++;
+    }
+
+    ring[head] = time_ms;
+    head = next_word(head);
+    ring[head] = (uint32_t)id | (uint32_t)argc << 16;
+    head = next_word(head);
+    for (size_t i = 0; i < argc; i++) {
+        ring[head] = (uint32_t)args[i];
+        head = next_word(head);
+    }
+    used += RECORD_WORDS(argc);
+    written++;
+    taskEXIT_CRITICAL(&lock);
+}
+
+uint32_t binlog_written(void)
+{
+    taskENTER_CRITICAL(&lock);
+    uint32_t count = written;
+    taskEXIT_CRITICAL(&lock);
+
+    return count;
+}
+
+/* Takes the lock for one record, with interrupts off on this core only as long as a write keeps them off */
+static bool record_copy(uint32_t seq, uint32_t *word, uint32_t record[RECORD_WORDS(BINLOG_MAX_ARGS)],
+                        uint32_t *words)
+{
+    bool copied = false;
+
+    taskENTER_CRITICAL(&lock);
+    // a record overwritten since the caller found its word is gone, the word holds another one now
+    if (seq >= overwritten && seq < written) {
+        *words = record_words(*word);
+        for (uint32_t i = 0; i < *words; i++, *word = next_word(*word)) {
+            record[i] = ring[*word];
+        }
+        copied = true;
+    }
+    taskEXIT_CRITICAL(&lock);
+
+    return copied;
+}
+
+size_t binlog_dump(uint32_t *next, uint32_t end, void *chunk, size_t size)
+{
+    // where the previous chunk stopped, so that a dump does not walk the ring from its tail for every chunk
+    static uint32_t cursor_seq = 0;
+    static uint32_t cursor_word = 0;
+    uint8_t *out = chunk;
+    binlog_dump_header_t header = {
+            .magic = BINLOG_MAGIC,
+            .messages = BINLOG_MESSAGE_COUNT,
+    };
+    size_t len = sizeof(header);
+    uint32_t record[RECORD_WORDS(BINLOG_MAX_ARGS)];
+    uint32_t words;
+
+    if (size < sizeof(header)) {
+        return 0;
+    }
+
+    taskENTER_CRITICAL(&lock);
+    uint32_t seq = cursor_seq;
+    uint32_t word = cursor_word;
+    if (seq < overwritten || seq > *next) {
+        seq = overwritten;
+        word = tail;
+    }
+    header.overwritten = overwritten;
+    taskEXIT_CRITICAL(&lock);
+
+    // skip to *next, or start at the oldest record if *next is gone
+    while (seq < *next) {
+        if (record_copy(seq, &word, record, &words)) {
+            seq++;
+            continue;
+        }
+
+        taskENTER_CRITICAL(&lock);
+        bool wrapped = seq < overwritten;
+        if (wrapped) {
+            seq = overwritten;
+            word = tail;
+        }
+        taskEXIT_CRITICAL(&lock);
+        if (!wrapped) {
+            break;
+        }
+    }
+    header.first = seq;
+
+    // the records stay in the ring while they are copied, a chunk ends early at one overwritten meanwhile
+    while (seq < end) {
+        uint32_t start = word;
+
+        if (!record_copy(seq, &word, record, &words)) {
+            break;
+        }
+        if (len + words * 4 > size) {
+            word = start;
+            break;
+        }
+        memcpy(out + len, record, words * 4);
+        len += words * 4;
+        header.records++;
+        seq++;
+    }
+
+    *next = seq;
+    cursor_seq = seq;
+    cursor_word = word;
+    if (header.records == 0) {
+        return 0;
+    }
+
+    memcpy(out, &header, sizeof(header));
+    return len;
+}
+
+void binlog_clear(void)
+{
+    taskENTER_CRITICAL(&lock);
+    // the sequence numbers go on, a dump shows the cleared records as overwritten
+    overwritten = written;
+    head = 0;
+    tail = 0;
+    used = 0;
+    taskEXIT_CRITICAL(&lock);
+}
+
+#else
+
+/* Formatted now, as ESP_LOGx would */
+void binlog_write(binlog_id_t id, const int32_t *args, size_t argc)
+{
+    static const char letters[] = "NEWIDV";
+    const binlog_message_t *message = &binlog_messages[id];
+    char text[128];
+
+    if (binlog_format(id, args, argc, text, sizeof(text)) < 0) {
+        return;
+    }
+
+    esp_log_write(message->level, message->tag, "%c (%" PRIu32 ") %s: %s\n", letters[message->level],
+                  esp_log_timestamp(), message->tag, text);
+}
+
+uint32_t binlog_written(void)
+{
+    return 0;
+}
+
+size_t binlog_dump(uint32_t *next, uint32_t end, void *chunk, size_t size)
+{
+    return 0;
+}
+
+void binlog_clear(void)
+{
+}
+
+#endif
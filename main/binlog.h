@@ -0,0 +1,123 @@
+#ifndef __BINLOG_H__
+#define __BINLOG_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "fixed.h"
+
+/*
+ * Deferred binary log of the sample path. A call stores the message ID, a millisecond timestamp and the raw integer
+ * arguments in a RAM ring, nothing is formatted and nothing goes to the UART. The ring is dumped over MQTT on
+ * request and tools/binlog_decode.c turns the dump into ESP_LOG lines off the device, with the formats of the table
+ * below. Without CONFIG_ESP_BINLOG every call is formatted and written with esp_log_write() right away instead.
+ *
+ * Record, in 32-bit words: the timestamp (ms since boot), the message ID in the low 16 bits and the argument count
+ * in bits 16..23, then the arguments. A dump is a series of chunks, each one binlog_dump_header_t followed by
+ * whole records, oldest first. Both are little endian. No ESP-IDF dependencies outside binlog.c, the decoder uses
+ * this header, binlog_format.c and fixed.c as they are.
+ */
+
+#define BINLOG_LEVEL_ERROR      1           /*!< the values of esp_log_level_t */
+#define BINLOG_LEVEL_WARN       2
+#define BINLOG_LEVEL_INFO       3
+#define BINLOG_LEVEL_DEBUG      4
+
+#if CONFIG_ESP_BINLOG_DEBUG
+#define BINLOG_MAX_LEVEL        BINLOG_LEVEL_DEBUG
+#else
+#define BINLOG_MAX_LEVEL        BINLOG_LEVEL_INFO
+#endif
+
+#define BINLOG_MAX_ARGS         4
+#define BINLOG_MAGIC            0x31474C42u     /*!< "BLG1" */
+#define BINLOG_DUMP_CHUNK_SIZE  1024            /*!< one MQTT message, the default buffer of esp-mqtt */
+
+/*
+ * Every message: ID, level, tag, format, and the denominator of each argument, 1 for an integer and the one of
+ * fixed.h for a fixed-point value. Formats take %d %i %u %x %X %c with the usual flags and width, and %f for a
+ * fixed-point argument, printed as fixed_format() does ("%.2f"). IDs are positions in this list: append new
+ * messages and never reuse one, the decoder must be built from the same list as the firmware that made the dump.
+ */
+#define BINLOG_MESSAGES(X) \
+        X(DHT_READING, BINLOG_LEVEL_INFO, "DHT22", "Sensor %u: Humidity: %f, temperature: %f°C", \
+          1, FIXED_DHT_DEN, FIXED_DHT_DEN) \
+        X(BATTERY_READING, BINLOG_LEVEL_INFO, "BATTERY", "Voltage: %f, SOC: %f%%", FIXED_VCELL_DEN, FIXED_SOC_DEN) \
+        X(PUBLISH_DHT, BINLOG_LEVEL_DEBUG, "MQTT5", "Publish humidity: %u, temperature: %d (0.1 units)", 1, 1) \
+        X(PUBLISH_BATTERY, BINLOG_LEVEL_DEBUG, "MQTT5", "Publish VCELL: %u, SOC: %u (raw)", 1, 1) \
+        X(PUBLISH_FRAME, BINLOG_LEVEL_DEBUG, "MQTT5", "Publish frame %u, %d bytes", 1, 1)
+
+#define BINLOG_ID(id, level, tag, format, ...)      BINLOG_##id,
+#define BINLOG_LEVEL_OF(id, level, tag, format, ...) BINLOG_LEVEL_OF_##id = level,
+
+typedef enum {
+    BINLOG_MESSAGES(BINLOG_ID)
+    BINLOG_MESSAGE_COUNT,
+} binlog_id_t;
+
+enum {
+    BINLOG_MESSAGES(BINLOG_LEVEL_OF)
+};
+
+typedef struct {
+    uint8_t level;
+    uint8_t argc;
+    const char *tag;
+    const char *format;
+    uint32_t den[BINLOG_MAX_ARGS];
+} binlog_message_t;
+
+typedef struct {
+    uint32_t magic;             /*!< BINLOG_MAGIC */
+    uint16_t messages;          /*!< BINLOG_MESSAGE_COUNT of the firmware */
+    uint16_t records;           /*!< in this chunk */
+    uint32_t first;             /*!< sequence number of the first record, counted since boot */
+    uint32_t overwritten;       /*!< records lost to the ring wrapping since boot */
+} binlog_dump_header_t;
+
+/**
+ * @brief Log a message of the table with its arguments, e.g. BINLOG(DHT_READING, sensor, humidity, temperature)
+ *
+ * Messages above BINLOG_MAX_LEVEL are compiled out. Task context only.
+ */
+#define BINLOG(id, ...) do {                                                                        \
+        if (BINLOG_LEVEL_OF_##id <= BINLOG_MAX_LEVEL) {                                             \
+            const int32_t binlog_args_[] = { __VA_ARGS__ };                                         \
+            binlog_write(BINLOG_##id, binlog_args_, sizeof(binlog_args_) / sizeof(binlog_args_[0]));   \
+        }                                                                                           \
+    } while (0)
+
+extern const binlog_message_t binlog_messages[BINLOG_MESSAGE_COUNT];
+
+void binlog_write(binlog_id_t id, const int32_t *args, size_t argc);
+
+/**
+ * @brief Number of records written since boot, the sequence number of the next one
+ */
+uint32_t binlog_written(void);
+
+/**
+ * @brief Copy the next records into one dump chunk
+ *
+ * Starts at record *next, or at the oldest one still in the ring if *next was overwritten, and stops before record
+ * end or when the chunk is full. Pass binlog_written() taken before the first chunk as end, so a dump does not chase
+ * the records written while it goes out.
+ *
+ * @param next sequence number of the first record to copy, moved past the last one copied
+ * @return size of the chunk, 0 if there is nothing left to copy
+ */
+size_t binlog_dump(uint32_t *next, uint32_t end, void *chunk, size_t size);
+
+/**
+ * @brief Drop every record, e.g. after the benchmarks filled the ring with made-up readings
+ */
+void binlog_clear(void);
+
+/**
+ * @brief Format a record as its message with the arguments in place, without the level, time and tag
+ *
+ * @return length of the text without the NUL, or -1 if the ID is unknown or text is too small
+ */
+int binlog_format(uint16_t id, const int32_t *args, size_t argc, char *text, size_t size);
+
+#endif // __BINLOG_H__
@@ -0,0 +1,88 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "binlog.h"
+
+#define BINLOG_ARGC(...)    (sizeof((uint32_t[]) { __VA_ARGS__ }) / sizeof(uint32_t))
+#define BINLOG_ENTRY(id, level, tag, format, ...) \
+        [BINLOG_##id] = { level, BINLOG_ARGC(__VA_ARGS__), tag, format, { __VA_ARGS__ } },
+
+/* On the device only the fallback without CONFIG_ESP_BINLOG references the table, the linker drops it otherwise */
+const binlog_message_t binlog_messages[BINLOG_MESSAGE_COUNT] = {
+        BINLOG_MESSAGES(BINLOG_ENTRY)
+};
+
+static bool append(char *text, size_t size, size_t *len, const char *string, size_t string_len)
+{
+    if (*len + string_len >= size) {
+        return false;
+    }
+
+    memcpy(text + *len, string, string_len);
+    *len += string_len;
+    text[*len] = '\0';
+    return true;
+}
+
+int binlog_format(uint16_t id, const int32_t *args, size_t argc, char *text, size_t size)
+{
+    if (id >= BINLOG_MESSAGE_COUNT || size == 0) {
+        return -1;
+    }
+
+    const binlog_message_t *message = &binlog_messages[id];
+    const char *format = message->format;
+    size_t len = 0;
+    size_t arg = 0;
+
+    text[0] = '\0';
+    while (*format != '\0') {
+        const char *percent = strchr(format, '%');
+        size_t literal = percent != NULL ? (size_t)(percent - format) : strlen(format);
+
+        if (!append(text, size, &len, format, literal)) {
+            return -1;
+        }
+        format += literal;
+        if (*format == '\0') {
+            break;
+        }
+
+        // flags, width and precision pass through to snprintf, there are no length modifiers
+        size_t spec_len = 1 + strspn(format + 1, "-+ #0123456789.");
+        char conversion = format[spec_len];
+        char spec[16];
+        char value[FIXED_STRING_SIZE];
+        int value_len;
+
+        if (conversion == '\0' || spec_len + 2 > sizeof(spec)) {
+            return -1;
+        }
+        memcpy(spec, format, spec_len + 1);
+        spec[spec_len + 1] = '\0';
+        format += spec_len + 1;
+
+        if (conversion == '%') {
+            value_len = snprintf(value, sizeof(value), "%%");
+        } else if (arg >= argc) {
+            // a record from another firmware version
+            value_len = snprintf(value, sizeof(value), "?");
+        } else if (conversion == 'f') {
+            uint32_t den = arg < BINLOG_MAX_ARGS && message->den[arg] > 0 ? message->den[arg] : 1;
+            value_len = fixed_format(args[arg++], den, value, sizeof(value));
+        } else if (conversion == 'd' || conversion == 'i' || conversion == 'c') {
+            value_len = snprintf(value, sizeof(value), spec, (int)args[arg++]);
+        } else if (conversion == 'u' || conversion == 'x' || conversion == 'X') {
+            value_len = snprintf(value, sizeof(value), spec, (unsigned int)(uint32_t)args[arg++]);
+        } else {
+            return -1;
+        }
+
+        if (value_len < 0 || (size_t)value_len >= sizeof(value) || !append(text, size, &len, value, value_len)) {
+            return -1;
+        }
+    }
+
+    return (int)len;
+}
@@ -0,0 +1,170 @@
+#include "conn_policy.h"
+
+static uint32_t jittered(const conn_policy_config_t *config, uint32_t delay_ms, uint32_t random)
+{
+    uint32_t jitter = (uint32_t)((uint64_t)delay_ms * config->jitter_pct / 100);
+
+    if (jitter == 0) {
+        return delay_ms;
+    }
+
+    return delay_ms - random % (jitter + 1);
+}
+
+static void link_reset(conn_link_t *link, uint32_t now_ms)
+{
+    link->state = CONN_LINK_DOWN;
+    link->backoff_ms = 0;
+    link->retry_at_ms = now_ms;
+}
+
+static void link_up(conn_link_t *link, uint32_t now_ms)
+{
+    if (link->was_up && link->state != CONN_LINK_UP) {
+        uint32_t outage_ms = now_ms - link->down_since_ms;
+
+        link->downtime_ms += outage_ms;
+        if (outage_ms > link->longest_outage_ms) {
+            link->longest_outage_ms = outage_ms;
+        }
+    }
+
+    link->state = CONN_LINK_UP;
+    link->was_up = true;
+    link->backoff_ms = 0;
+    link->attempts = 0;
+}
+
+static void link_lost(conn_link_t *link, uint32_t now_ms)
+{
+    if (link->state == CONN_LINK_UP) {
+        link->down_since_ms = now_ms;
+        link->outages++;
+    }
+}
+
+/* Failed attempt or lost link: the next attempt waits one backoff step */
+static void link_down(const conn_policy_config_t *config, conn_link_t *link, uint32_t now_ms, uint32_t random)
+{
+    if (link->state == CONN_LINK_DOWN) {
+        return;
+    }
+
+    link_lost(link, now_ms);
+
+    if (link->backoff_ms == 0) {
+        link->backoff_ms = config->initial_ms;
+    } else {
+        link->backoff_ms = link->backoff_ms > config->max_ms / 2 ? config->max_ms : link->backoff_ms * 2;
+    }
+
+    link->state = CONN_LINK_DOWN;
+    link->retry_at_ms = now_ms + jittered(config, link->backoff_ms, random);
+}
+
+static bool link_due(const conn_link_t *link, uint32_t now_ms)
+{
+    return link->state == CONN_LINK_DOWN && (int32_t)(now_ms - link->retry_at_ms) >= 0;
+}
+
+static bool attempt_timed_out(const conn_policy_config_t *config, const conn_link_t *link, uint32_t now_ms)
+{
+    return link->state == CONN_LINK_CONNECTING && now_ms - link->attempt_ms >= config->attempt_timeout_ms;
+}
+
+static void start_attempt(conn_link_t *link, uint32_t now_ms)
+{
+    link->state = CONN_LINK_CONNECTING;
+    link->attempt_ms = now_ms;
+    link->attempts++;
+}
+
+void conn_policy_init(conn_policy_t *policy, const conn_policy_config_t *config, uint32_t now_ms)
+{
+    *policy = (conn_policy_t) { .config = *config };
+    link_reset(&policy->wifi, now_ms);
+    link_reset(&policy->mqtt, now_ms);
+}
+
+void conn_policy_event(conn_policy_t *policy, conn_event_t event, uint32_t now_ms, uint32_t random)
+{
+    switch (event) {
+        case CONN_EVENT_WIFI_UP:
+            link_up(&policy->wifi, now_ms);
+            break;
+        case CONN_EVENT_WIFI_DOWN:
+            link_down(&policy->config, &policy->wifi, now_ms, random);
+            // the broker is unreachable without WiFi, that is not a reason to back off from it
+            link_lost(&policy->mqtt, now_ms);
+            link_reset(&policy->mqtt, now_ms);
+            break;
+        case CONN_EVENT_MQTT_UP:
+            link_up(&policy->mqtt, now_ms);
+            break;
+        case CONN_EVENT_MQTT_DOWN:
+            link_down(&policy->config, &policy->mqtt, now_ms, random);
+            break;
+        default:
+            break;
+    }
+}
+
+conn_action_t conn_policy_poll(conn_policy_t *policy, uint32_t now_ms, uint32_t random)
+{
+    const conn_policy_config_t *config = &policy->config;
+
+    if (attempt_timed_out(config, &policy->wifi, now_ms)) {
+        conn_policy_event(policy, CONN_EVENT_WIFI_DOWN, now_ms, random);
+    }
+
+    if (attempt_timed_out(config, &policy->mqtt, now_ms)) {
+        conn_policy_event(policy, CONN_EVENT_MQTT_DOWN, now_ms, random);
+    }
+
+    if (link_due(&policy->wifi, now_ms)) {
+        start_attempt(&policy->wifi, now_ms);
+        return CONN_ACTION_CONNECT_WIFI;
+    }
+
+    if (policy->wifi.state == CONN_LINK_UP && link_due(&policy->mqtt, now_ms)) {
+        start_attempt(&policy->mqtt, now_ms);
+        return CONN_ACTION_CONNECT_MQTT;
+    }
+
+    return CONN_ACTION_NONE;
+}
+
+static uint32_t link_next_ms(const conn_policy_config_t *config, const conn_link_t *link, uint32_t now_ms)
+{
+    switch (link->state) {
+        case CONN_LINK_DOWN:
+            return (int32_t)(link->retry_at_ms - now_ms) > 0 ? link->retry_at_ms - now_ms : 0;
+        case CONN_LINK_CONNECTING: {
+            uint32_t elapsed = now_ms - link->attempt_ms;
+            return elapsed < config->attempt_timeout_ms ? config->attempt_timeout_ms - elapsed : 0;
+        }
+        default:
+            return UINT32_MAX;
+    }
+}
+
+uint32_t conn_policy_next_ms(const conn_policy_t *policy, uint32_t now_ms)
+{
+    uint32_t next = link_next_ms(&policy->config, &policy->wifi, now_ms);
+
+    if (policy->wifi.state == CONN_LINK_UP) {
+        uint32_t mqtt = link_next_ms(&policy->config, &policy->mqtt, now_ms);
+        next = mqtt < next ? mqtt : next;
+    }
+
+    return next;
+}
+
+uint32_t conn_link_downtime_ms(const conn_link_t *link, uint32_t now_ms)
+{
+    if (link->was_up && link->state != CONN_LINK_UP) {
+        return link->downtime_ms + (now_ms - link->down_since_ms);
+    }
+
+    return link->downtime_ms;
+}
@@ -0,0 +1,90 @@
+#ifndef __CONN_POLICY_H__
+#define __CONN_POLICY_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Reconnect policy for the WiFi and MQTT links. Like the duty cycle it does not touch any hardware: the caller
+ * reports link events with the current time, asks conn_policy_poll() what to do next and performs that action, so
+ * the backoff and outage accounting run unchanged against a fake clock on the host.
+ *
+ * A failed attempt or a lost link schedules the next attempt after a jittered exponential backoff. MQTT is only
+ * attempted while WiFi is up, and losing WiFi resets the MQTT backoff so the broker is tried right after the
+ * station gets its IP back.
+ */
+
+typedef enum {
+    CONN_LINK_DOWN = 0,     /*!< waiting for the next attempt */
+    CONN_LINK_CONNECTING,   /*!< attempt in progress */
+    CONN_LINK_UP,
+} conn_link_state_t;
+
+typedef enum {
+    CONN_EVENT_WIFI_UP = 0, /*!< station has an IP address */
+    CONN_EVENT_WIFI_DOWN,   /*!< attempt failed or the station lost the AP */
+    CONN_EVENT_MQTT_UP,     /*!< CONNACK received */
+    CONN_EVENT_MQTT_DOWN,   /*!< attempt failed or the broker connection dropped */
+} conn_event_t;
+
+typedef enum {
+    CONN_ACTION_NONE = 0,
+    CONN_ACTION_CONNECT_WIFI,
+    CONN_ACTION_CONNECT_MQTT,
+} conn_action_t;
+
+typedef struct {
+    uint32_t initial_ms;        /*!< backoff after the first failure */
+    uint32_t max_ms;            /*!< backoff cap */
+    uint8_t jitter_pct;         /*!< the delay is randomly shortened by up to this share */
+    uint32_t attempt_timeout_ms;    /*!< an attempt without result counts as failed after this time */
+} conn_policy_config_t;
+
+typedef struct {
+    conn_link_state_t state;
+    uint32_t backoff_ms;        /*!< un-jittered delay before the next attempt, 0 = retry immediately */
+    uint32_t retry_at_ms;
+    uint32_t attempt_ms;        /*!< start of the attempt in progress */
+    uint32_t attempts;          /*!< attempts since the link was last up */
+
+    /* outage accounting */
+    bool was_up;                /*!< an outage only starts once the link was up */
+    uint32_t down_since_ms;
+    uint32_t downtime_ms;       /*!< completed outages */
+    uint32_t longest_outage_ms;
+    uint32_t outages;
+} conn_link_t;
+
+typedef struct {
+    conn_policy_config_t config;
+    conn_link_t wifi;
+    conn_link_t mqtt;
+} conn_policy_t;
+
+void conn_policy_init(conn_policy_t *policy, const conn_policy_config_t *config, uint32_t now_ms);
+
+/**
+ * @brief Feed a link event
+ *
+ * @param random uniformly distributed value used for the jitter of a newly scheduled retry
+ */
+void conn_policy_event(conn_policy_t *policy, conn_event_t event, uint32_t now_ms, uint32_t random);
+
+/**
+ * @brief Decide the next action, the link of a returned connect action is marked as connecting
+ *
+ * @param random used if an attempt in progress timed out and a retry has to be scheduled
+ */
+conn_action_t conn_policy_poll(conn_policy_t *policy, uint32_t now_ms, uint32_t random);
+
+/**
+ * @brief Time until conn_policy_poll() may have something to do, UINT32_MAX if only an event can change that
+ */
+uint32_t conn_policy_next_ms(const conn_policy_t *policy, uint32_t now_ms);
+
+/**
+ * @brief Total time the link was down after having been up, including an outage still in progress
+ */
+uint32_t conn_link_downtime_ms(const conn_link_t *link, uint32_t now_ms);
+
+#endif // __CONN_POLICY_H__
@@ -0,0 +1,173 @@
+#include <sys/cdefs.h>
+#include <stdatomic.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_random.h"
+#include "esp_timer.h"
+#include "esp_wifi.h"
+#include "connectivity.h"
+#include "wifi.h"
+#include "mqtt.h"
+#include "diag.h"
+#include "mem_report.h"
+#include "task_plan.h"
+
+static const char *TAG = "CONN";
+
+static const conn_policy_config_t conn_config = {
+        .initial_ms = CONN_BACKOFF_INITIAL_MS,
+        .max_ms = CONN_BACKOFF_MAX_MS,
+        .jitter_pct = CONN_BACKOFF_JITTER_PCT,
+        .attempt_timeout_ms = CONN_ATTEMPT_TIMEOUT_MS,
+};
+
+static QueueHandle_t conn_events = NULL;
+static TaskHandle_t conn_task = NULL;
+
+#if CONFIG_ESP_STATIC_ALLOCATION
+static uint8_t conn_events_storage[CONN_EVENT_QUEUE_LENGTH * sizeof(conn_event_t)];
+static StaticQueue_t conn_events_buffer;
+static StackType_t conn_stack[CONN_TASK_STACK_SIZE];
+static StaticTask_t conn_tcb;
+#endif
+static atomic_bool stopped = false;
+
+static uint32_t now_ms(void)
+{
+    return (uint32_t)(esp_timer_get_time() / 1000);
+}
+
+static void update_gauges(const conn_policy_t *policy, uint32_t now)
+{
+    diag_gauge(DIAG_GAUGE_WIFI_DOWNTIME_MS, conn_link_downtime_ms(&policy->wifi, now));
+    diag_gauge(DIAG_GAUGE_WIFI_LONGEST_OUTAGE_MS, policy->wifi.longest_outage_ms);
+    diag_gauge(DIAG_GAUGE_WIFI_OUTAGES, policy->wifi.outages);
+    diag_gauge(DIAG_GAUGE_MQTT_DOWNTIME_MS, conn_link_downtime_ms(&policy->mqtt, now));
+    diag_gauge(DIAG_GAUGE_MQTT_LONGEST_OUTAGE_MS, policy->mqtt.longest_outage_ms);
+    diag_gauge(DIAG_GAUGE_MQTT_OUTAGES, policy->mqtt.outages);
+}
+
+/* Sleep as deep as the pending retry allows */
+static void update_power_save(const conn_policy_t *policy, uint32_t wait_ms)
+{
+    static wifi_ps_type_t current = WIFI_PS_MIN_MODEM;
+
+    if (policy->wifi.state == CONN_LINK_UP) {
+        wifi_ps_type_t wanted = policy->mqtt.state == CONN_LINK_DOWN ? WIFI_PS_MAX_MODEM : WIFI_PS_MIN_MODEM;
+        if (wanted != current && esp_wifi_set_ps(wanted) == ESP_OK) {
+            current = wanted;
+        }
+    } else if (policy->wifi.state == CONN_LINK_DOWN && wait_ms >= CONN_RADIO_OFF_MIN_MS) {
+        wifi_radio_off();
+    }
+}
+
+static void log_event(const conn_policy_t *policy, conn_event_t event, uint32_t now)
+{
+    switch (event) {
+        case CONN_EVENT_WIFI_UP:
+            ESP_LOGI(TAG, "WiFi up, %" PRIu32 " ms without WiFi so far", conn_link_downtime_ms(&policy->wifi, now));
+            break;
+        case CONN_EVENT_WIFI_DOWN:
+            ESP_LOGI(TAG, "WiFi down, attempt %" PRIu32 ", next in %" PRIu32 " ms", policy->wifi.attempts,
+                     policy->wifi.retry_at_ms - now);
+            break;
+        case CONN_EVENT_MQTT_UP:
+            ESP_LOGI(TAG, "Broker up, %" PRIu32 " ms without broker so far",
+                     conn_link_downtime_ms(&policy->mqtt, now));
+            break;
+        case CONN_EVENT_MQTT_DOWN:
+            if (policy->wifi.state == CONN_LINK_UP) {
+                ESP_LOGI(TAG, "Broker down, attempt %" PRIu32 ", next in %" PRIu32 " ms", policy->mqtt.attempts,
+                         policy->mqtt.retry_at_ms - now);
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+_Noreturn static void connectivity_task(void *params)
+{
+    conn_policy_t policy;
+    conn_event_t event;
+
+    conn_policy_init(&policy, &conn_config, now_ms());
+
+    while (true) {
+        uint32_t now = now_ms();
+        conn_action_t action;
+
+        while (!atomic_load(&stopped) && (action = conn_policy_poll(&policy, now, esp_random())) != CONN_ACTION_NONE) {
+            if (action == CONN_ACTION_CONNECT_WIFI) {
+                wifi_connect();
+            } else if (action == CONN_ACTION_CONNECT_MQTT) {
+                mqtt5_connect();
+            }
+        }
+
+        uint32_t wait_ms = conn_policy_next_ms(&policy, now);
+        update_gauges(&policy, now);
+        if (!atomic_load(&stopped)) {
+            update_power_save(&policy, wait_ms);
+        }
+
+        TickType_t wait = portMAX_DELAY;
+        if (wait_ms != UINT32_MAX && !atomic_load(&stopped)) {
+            wait = pdMS_TO_TICKS(wait_ms) + 1;
+        }
+
+        if (xQueueReceive(conn_events, &event, wait) == pdTRUE) {
+            now = now_ms();
+            conn_policy_event(&policy, event, now, esp_random());
+            log_event(&policy, event, now);
+        }
+    }
+}
+
+esp_err_t connectivity_start(void)
+{
+#if CONFIG_ESP_STATIC_ALLOCATION
+    conn_events = xQueueCreateStatic(CONN_EVENT_QUEUE_LENGTH, sizeof(conn_event_t), conn_events_storage,
+                                     &conn_events_buffer);
+    conn_task = xTaskCreateStaticPinnedToCore(connectivity_task, "connectivity", CONN_TASK_STACK_SIZE, NULL,
+                                              TASK_PRIORITY_CONN, conn_stack, &conn_tcb, TASK_CORE_CONN);
+#else
+    conn_events = xQueueCreate(CONN_EVENT_QUEUE_LENGTH, sizeof(conn_event_t));
+    if (conn_events == NULL) {
+        ESP_LOGE(TAG, "conn_events: Queue was not created. Could not allocate required memory");
+        return ESP_ERR_NO_MEM;
+    }
+
+    BaseType_t status = xTaskCreatePinnedToCore(connectivity_task, "connectivity", CONN_TASK_STACK_SIZE, NULL,
+                                                TASK_PRIORITY_CONN, &conn_task, TASK_CORE_CONN);
+
+    if (status != pdPASS) {
+        ESP_LOGE(TAG, "connectivity_task(): Task was not created. Could not allocate required memory");
+        return ESP_ERR_NO_MEM;
+    }
+#endif
+
+    mem_report_task(conn_task, CONN_TASK_STACK_SIZE, MEM_STATIC_ALLOCATION);
+
+    return ESP_OK;
+}
+
+void connectivity_notify(conn_event_t event)
+{
+    if (conn_events == NULL) {
+        return;
+    }
+
+    if (xQueueSend(conn_events, &event, 0) != pdPASS) {
+        ESP_LOGW(TAG, "Event queue full, event %d lost", event);
+    }
+}
+
+void connectivity_stop(void)
+{
+    atomic_store(&stopped, true);
+}
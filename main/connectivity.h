@@ -0,0 +1,40 @@
+#ifndef __CONNECTIVITY_H__
+#define __CONNECTIVITY_H__
+
+#include <esp_err.h>
+
+#include "conn_policy.h"
+
+/*
+ * Connectivity manager: one task owns all WiFi and MQTT (re)connect attempts. The WiFi and MQTT event handlers only
+ * report link events, conn_policy decides when to try again. While a retry is pending the modem sleeps: with WiFi
+ * up and the broker unreachable the station uses maximum modem sleep, without WiFi the radio is switched off when
+ * the wait is long enough.
+ */
+
+#define CONN_BACKOFF_INITIAL_MS     CONFIG_ESP_CONN_BACKOFF_INITIAL_MS
+#define CONN_BACKOFF_MAX_MS         (CONFIG_ESP_CONN_BACKOFF_MAX_SEC * 1000)
+#define CONN_BACKOFF_JITTER_PCT     CONFIG_ESP_CONN_BACKOFF_JITTER_PCT
+#define CONN_ATTEMPT_TIMEOUT_MS     CONFIG_ESP_CONN_ATTEMPT_TIMEOUT_MS
+#define CONN_RADIO_OFF_MIN_MS       5000    /*!< only switch the radio off for waits at least this long */
+#define CONN_EVENT_QUEUE_LENGTH     8
+#define CONN_TASK_STACK_SIZE        CONFIG_ESP_CONN_TASK_STACK_SIZE
+
+/**
+ * @brief Start the manager task, which makes the first WiFi attempt right away
+ *
+ * wifi_init_sta() and mqtt5_init() must have run.
+ */
+esp_err_t connectivity_start(void);
+
+/**
+ * @brief Report a link event, safe to call from the WiFi and MQTT event handlers
+ */
+void connectivity_notify(conn_event_t event);
+
+/**
+ * @brief Stop making attempts, used before shutting the links down for deep sleep
+ */
+void connectivity_stop(void);
+
+#endif // __CONNECTIVITY_H__
@@ -0,0 +1,63 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "deadband.h"
+
+static bool should_publish(deadband_t *deadband, deadband_metric_t metric, int32_t value, uint32_t now_ms)
+{
+    const deadband_config_t *config = &deadband->config[metric];
+    deadband_stats_t *stats = &deadband->stats[metric];
+
+    stats->samples++;
+
+    if (!(deadband->published & DEADBAND_BIT(metric)) || config->threshold == 0 ||
+        (uint32_t)abs(value - deadband->last[metric]) > config->threshold) {
+        stats->changes++;
+    } else if (config->heartbeat_ms > 0 && now_ms - deadband->last_ms[metric] >= config->heartbeat_ms) {
+        stats->heartbeats++;
+    } else {
+        return false;
+    }
+
+    deadband->last[metric] = value;
+    deadband->last_ms[metric] = now_ms;
+    deadband->published |= DEADBAND_BIT(metric);
+
+    return true;
+}
+
+void deadband_init(deadband_t *deadband, const deadband_config_t config[DEADBAND_METRIC_COUNT])
+{
+    memset(deadband, 0, sizeof(*deadband));
+    memcpy(deadband->config, config, sizeof(deadband->config));
+}
+
+void deadband_set_config(deadband_t *deadband, const deadband_config_t config[DEADBAND_METRIC_COUNT])
+{
+    memcpy(deadband->config, config, sizeof(deadband->config));
+}
+
+uint8_t deadband_filter(deadband_t *deadband, const sensor_frame_t *frame, uint32_t now_ms)
+{
+    uint8_t mask = 0;
+
+    if (frame->flags & PAYLOAD_HAS_DHT) {
+        if (should_publish(deadband, DEADBAND_TEMPERATURE, frame->temperature, now_ms)) {
+            mask |= DEADBAND_BIT(DEADBAND_TEMPERATURE);
+        }
+        if (should_publish(deadband, DEADBAND_HUMIDITY, frame->humidity, now_ms)) {
+            mask |= DEADBAND_BIT(DEADBAND_HUMIDITY);
+        }
+    }
+
+    if (frame->flags & PAYLOAD_HAS_BATTERY) {
+        if (should_publish(deadband, DEADBAND_VOLTAGE, frame->voltage, now_ms)) {
+            mask |= DEADBAND_BIT(DEADBAND_VOLTAGE);
+        }
+        if (should_publish(deadband, DEADBAND_SOC, frame->soc, now_ms)) {
+            mask |= DEADBAND_BIT(DEADBAND_SOC);
+        }
+    }
+
+    return mask;
+}
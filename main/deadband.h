@@ -0,0 +1,63 @@
+#ifndef __DEADBAND_H__
+#define __DEADBAND_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "payload.h"
+
+/*
+ * Change-only publishing. A metric is published when it moved by more than its threshold since the value last
+ * published, or when it has been silent for its heartbeat interval. Sits between the sensor queues and the
+ * publisher, no ESP-IDF dependencies so recorded traces can be replayed on the host (tools/deadband_replay.c).
+ */
+
+typedef enum {
+    DEADBAND_TEMPERATURE = 0,
+    DEADBAND_HUMIDITY,
+    DEADBAND_VOLTAGE,
+    DEADBAND_SOC,
+    DEADBAND_METRIC_COUNT,
+} deadband_metric_t;
+
+#define DEADBAND_BIT(metric)    (1u << (metric))
+#define DEADBAND_DHT_MASK       (DEADBAND_BIT(DEADBAND_TEMPERATURE) | DEADBAND_BIT(DEADBAND_HUMIDITY))
+#define DEADBAND_BATTERY_MASK   (DEADBAND_BIT(DEADBAND_VOLTAGE) | DEADBAND_BIT(DEADBAND_SOC))
+
+typedef struct {
+    uint32_t threshold;         /*!< in the units of the value, publish when it moved by more than this, 0 publishes
+                                     every sample */
+    uint32_t heartbeat_ms;      /*!< publish at least this often even without change, 0 = never */
+} deadband_config_t;
+
+typedef struct {
+    uint32_t samples;           /*!< values offered */
+    uint32_t changes;           /*!< published because they moved past the threshold (or were the first) */
+    uint32_t heartbeats;        /*!< published because of the heartbeat */
+} deadband_stats_t;
+
+typedef struct {
+    deadband_config_t config[DEADBAND_METRIC_COUNT];
+    int32_t last[DEADBAND_METRIC_COUNT];        /*!< last published value */
+    uint32_t last_ms[DEADBAND_METRIC_COUNT];    /*!< when it was published */
+    uint8_t published;                          /*!< DEADBAND_BIT of the metrics published at least once */
+    deadband_stats_t stats[DEADBAND_METRIC_COUNT];
+} deadband_t;
+
+void deadband_init(deadband_t *deadband, const deadband_config_t config[DEADBAND_METRIC_COUNT]);
+
+/**
+ * @brief Change the thresholds and heartbeats, the last published values and the statistics are kept
+ */
+void deadband_set_config(deadband_t *deadband, const deadband_config_t config[DEADBAND_METRIC_COUNT]);
+
+/**
+ * @brief Decide which values of a frame to publish and remember them as published
+ *
+ * @param frame sample, only the values whose PAYLOAD_HAS_* flag is set are considered
+ * @param now_ms monotonic time in ms
+ * @return DEADBAND_BIT mask of the metrics to publish
+ */
+uint8_t deadband_filter(deadband_t *deadband, const sensor_frame_t *frame, uint32_t now_ms);
+
+#endif // __DEADBAND_H__
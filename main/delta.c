@@ -0,0 +1,357 @@
+#include <string.h>
+
+#include "delta.h"
+
+#define WINDOW_MASK     (DELTA_WINDOW_SIZE - 1)
+#define VARINT_MAX_SHIFT 28
+
+/* Half-byte table, 64 bytes instead of the 1 KiB of the usual one: the image is checked once per update */
+static const uint32_t crc32_nibble[16] = {
+        0x00000000, 0x1db71064, 0x3b6e20c8, 0x26d930ac, 0x76dc4190, 0x6b6b51f4, 0x4db26158, 0x5005713c,
+        0xedb88320, 0xf00f9344, 0xd6d6a3e8, 0xcb61b38c, 0x9b64c2b0, 0x86d3d2d4, 0xa00ae278, 0xbdbdf21c,
+};
+
+uint32_t delta_crc32(uint32_t crc, const void *data, size_t len)
+{
+    const uint8_t *bytes = data;
+
+    crc = ~crc;
+    for (size_t i = 0; i < len; i++) {
+        crc ^= bytes[i];
+        crc = (crc >> 4) ^ crc32_nibble[crc & 0x0f];
+        crc = (crc >> 4) ^ crc32_nibble[crc & 0x0f];
+    }
+
+    return ~crc;
+}
+
+static uint32_t get_le32(const uint8_t *bytes)
+{
+    return (uint32_t)bytes[0] | (uint32_t)bytes[1] << 8 | (uint32_t)bytes[2] << 16 | (uint32_t)bytes[3] << 24;
+}
+
+static delta_result_t fail(delta_t *delta, delta_result_t result)
+{
+    if (delta->result == DELTA_OK) {
+        delta->result = result;
+    }
+
+    return delta->result;
+}
+
+void delta_init(delta_t *delta, const uint8_t *public_key, delta_read_t read, delta_write_t write, void *ctx)
+{
+    memset(delta, 0, sizeof(*delta));
+    delta->public_key = public_key;
+    delta->read = read;
+    delta->write = write;
+    delta->ctx = ctx;
+}
+
+const delta_header_t *delta_header(const delta_t *delta)
+{
+    return delta->header_len == DELTA_HEADER_SIZE ? &delta->header : NULL;
+}
+
+/* Reads the whole source once, a patch only applies to the image it was made against */
+static delta_result_t check_source(delta_t *delta)
+{
+    uint32_t crc = 0;
+
+    for (uint32_t offset = 0; offset < delta->header.source_size; offset += DELTA_BUFFER_SIZE) {
+        uint32_t len = delta->header.source_size - offset;
+
+        if (len > DELTA_BUFFER_SIZE) {
+            len = DELTA_BUFFER_SIZE;
+        }
+        // a source larger than the partition fails to read, it is not the running image either
+        if (delta->read(delta->ctx, offset, delta->source_buffer, len) != 0) {
+            return DELTA_ERR_SOURCE;
+        }
+        crc = delta_crc32(crc, delta->source_buffer, len);
+    }
+
+    return crc == delta->header.source_crc ? DELTA_OK : DELTA_ERR_SOURCE;
+}
+
+static delta_result_t parse_header(delta_t *delta)
+{
+    const uint8_t *bytes = delta->header_bytes;
+
+    if (get_le32(&bytes[0]) != DELTA_MAGIC) {
+        return DELTA_ERR_HEADER;
+    }
+
+    delta->header = (delta_header_t) {
+            .source_size = get_le32(&bytes[4]),
+            .source_crc = get_le32(&bytes[8]),
+            .target_size = get_le32(&bytes[12]),
+            .target_crc = get_le32(&bytes[16]),
+    };
+    if (delta->header.target_size == 0) {
+        return DELTA_ERR_HEADER;
+    }
+    memcpy(delta->header.signature, &bytes[20], DELTA_SIGNATURE_SIZE);
+    ed25519_verify_start(&delta->verify, delta->public_key, delta->header.signature);
+
+    return check_source(delta);
+}
+
+static delta_result_t flush_target(delta_t *delta)
+{
+    if (delta->target_buffer_len == 0) {
+        return DELTA_OK;
+    }
+
+    delta->target_crc = delta_crc32(delta->target_crc, delta->target_buffer, delta->target_buffer_len);
+    ed25519_verify_update(&delta->verify, delta->target_buffer, delta->target_buffer_len);
+    if (delta->write(delta->ctx, delta->target_buffer, delta->target_buffer_len) != 0) {
+        return DELTA_ERR_IO;
+    }
+
+    delta->target_buffer_len = 0;
+    return DELTA_OK;
+}
+
+static delta_result_t put_target(delta_t *delta, uint8_t byte)
+{
+    delta->target_buffer[delta->target_buffer_len++] = byte;
+    delta->target_pos++;
+
+    return delta->target_buffer_len == DELTA_BUFFER_SIZE ? flush_target(delta) : DELTA_OK;
+}
+
+/* The diff runs read the source forward, a buffer refill per DELTA_BUFFER_SIZE bytes */
+static delta_result_t get_source(delta_t *delta, uint8_t *byte)
+{
+    uint32_t pos = (uint32_t)delta->source_pos;
+
+    if (pos < delta->source_buffer_pos || pos >= delta->source_buffer_pos + delta->source_buffer_len) {
+        uint32_t len = delta->header.source_size - pos;
+
+        if (len > DELTA_BUFFER_SIZE) {
+            len = DELTA_BUFFER_SIZE;
+        }
+        if (delta->read(delta->ctx, pos, delta->source_buffer, len) != 0) {
+            return DELTA_ERR_IO;
+        }
+        delta->source_buffer_pos = pos;
+        delta->source_buffer_len = len;
+    }
+
+    *byte = delta->source_buffer[pos - delta->source_buffer_pos];
+    delta->source_pos++;
+    return DELTA_OK;
+}
+
+static delta_result_t end_block(delta_t *delta)
+{
+    uint32_t seek = delta->control[2];
+
+    // zigzag: 0, -1, 1, -2, ...
+    delta->source_pos += (seek & 1) ? -(int64_t)(seek >> 1) - 1 : (int64_t)(seek >> 1);
+
+    if (delta->target_pos == delta->header.target_size) {
+        delta->state = DELTA_STATE_DONE;
+        return flush_target(delta);
+    }
+
+    delta->state = DELTA_STATE_CONTROL;
+    delta->control_index = 0;
+    delta->control_shift = 0;
+    delta->control[0] = delta->control[1] = delta->control[2] = 0;
+    return DELTA_OK;
+}
+
+static delta_result_t start_block(delta_t *delta)
+{
+    uint32_t diff_len = delta->control[0];
+    uint32_t extra_len = delta->control[1];
+
+    if ((uint64_t)delta->target_pos + diff_len + extra_len > delta->header.target_size ||
+        (diff_len > 0 && (delta->source_pos < 0 || delta->source_pos + diff_len > delta->header.source_size))) {
+        return DELTA_ERR_CORRUPT;
+    }
+
+    if (diff_len > 0) {
+        delta->state = DELTA_STATE_DIFF;
+        delta->remaining = diff_len;
+    } else if (extra_len > 0) {
+        delta->state = DELTA_STATE_EXTRA;
+        delta->remaining = extra_len;
+    } else {
+        return end_block(delta);
+    }
+
+    return DELTA_OK;
+}
+
+/* One byte of the decompressed block stream */
+static delta_result_t patch_byte(delta_t *delta, uint8_t byte)
+{
+    delta_result_t result;
+    uint8_t source;
+
+    switch (delta->state) {
+        case DELTA_STATE_CONTROL:
+            if (delta->control_shift > VARINT_MAX_SHIFT) {
+                return DELTA_ERR_CORRUPT;
+            }
+            delta->control[delta->control_index] |= (uint32_t)(byte & 0x7f) << delta->control_shift;
+            if (byte & 0x80) {
+                delta->control_shift += 7;
+                return DELTA_OK;
+            }
+            delta->control_shift = 0;
+            return ++delta->control_index == 3 ? start_block(delta) : DELTA_OK;
+        case DELTA_STATE_DIFF:
+            result = get_source(delta, &source);
+            if (result == DELTA_OK) {
+                result = put_target(delta, (uint8_t)(source + byte));
+            }
+            if (result != DELTA_OK || --delta->remaining > 0) {
+                return result;
+            }
+            if (delta->control[1] > 0) {
+                delta->state = DELTA_STATE_EXTRA;
+                delta->remaining = delta->control[1];
+                return DELTA_OK;
+            }
+            return end_block(delta);
+        case DELTA_STATE_EXTRA:
+            result = put_target(delta, byte);
+            if (result != DELTA_OK || --delta->remaining > 0) {
+                return result;
+            }
+            return end_block(delta);
+        default:
+            // the target is complete, nothing may follow
+            return DELTA_ERR_CORRUPT;
+    }
+}
+
+static delta_result_t window_put(delta_t *delta, uint8_t byte)
+{
+    delta->window[delta->window_pos++ & WINDOW_MASK] = byte;
+    return patch_byte(delta, byte);
+}
+
+/* A match token is complete, copy from the window; source and destination may overlap */
+static delta_result_t copy_match(delta_t *delta)
+{
+    uint32_t distance = ((uint32_t)delta->token[0] | (uint32_t)(delta->token[1] & 0x0f) << 8) + 1;
+    uint32_t code = delta->token[1] >> 4;
+    uint32_t len = code < 15 ? code + DELTA_MIN_MATCH : DELTA_MIN_MATCH + 15 + delta->token[2];
+
+    if (distance > delta->window_pos) {
+        return DELTA_ERR_CORRUPT;
+    }
+
+    for (uint32_t i = 0; i < len; i++) {
+        delta_result_t result = window_put(delta, delta->window[(delta->window_pos - distance) & WINDOW_MASK]);
+
+        if (result != DELTA_OK) {
+            return result;
+        }
+    }
+
+    return DELTA_OK;
+}
+
+static delta_result_t lzss_byte(delta_t *delta, uint8_t byte)
+{
+    delta_result_t result;
+
+    if (delta->flag_bits == 0) {
+        delta->flags = byte;
+        delta->flag_bits = 8;
+        return DELTA_OK;
+    }
+
+    if (delta->flags & 1) {
+        result = window_put(delta, byte);
+    } else {
+        delta->token[delta->token_len++] = byte;
+        if (delta->token_len < 2 || (delta->token_len == 2 && (delta->token[1] >> 4) == 15)) {
+            return DELTA_OK;
+        }
+        delta->token_len = 0;
+        result = copy_match(delta);
+    }
+
+    delta->flags >>= 1;
+    delta->flag_bits--;
+    return result;
+}
+
+delta_result_t delta_feed(delta_t *delta, const void *data, size_t len)
+{
+    const uint8_t *bytes = data;
+    size_t i = 0;
+
+    if (delta->result != DELTA_OK) {
+        return delta->result;
+    }
+
+    for (; i < len && delta->header_len < DELTA_HEADER_SIZE; i++) {
+        delta->header_bytes[delta->header_len++] = bytes[i];
+        if (delta->header_len == DELTA_HEADER_SIZE) {
+            delta_result_t result = parse_header(delta);
+
+            if (result != DELTA_OK) {
+                return fail(delta, result);
+            }
+            delta->state = DELTA_STATE_CONTROL;
+        }
+    }
+
+    for (; i < len; i++) {
+        delta_result_t result = lzss_byte(delta, bytes[i]);
+
+        if (result != DELTA_OK) {
+            return fail(delta, result);
+        }
+    }
+
+    return DELTA_OK;
+}
+
+delta_result_t delta_finish(delta_t *delta)
+{
+    if (delta->result != DELTA_OK) {
+        return delta->result;
+    }
+    if (delta_header(delta) == NULL) {
+        return fail(delta, DELTA_ERR_HEADER);
+    }
+    if (delta->state != DELTA_STATE_DONE || delta->target_crc != delta->header.target_crc) {
+        return fail(delta, DELTA_ERR_TARGET);
+    }
+    if (!ed25519_verify_finish(&delta->verify)) {
+        return fail(delta, DELTA_ERR_SIGNATURE);
+    }
+
+    return DELTA_OK;
+}
+
+const char *delta_result_name(delta_result_t result)
+{
+    switch (result) {
+        case DELTA_OK:
+            return "ok";
+        case DELTA_ERR_HEADER:
+            return "not a patch";
+        case DELTA_ERR_SOURCE:
+            return "made for another image";
+        case DELTA_ERR_CORRUPT:
+            return "corrupt patch";
+        case DELTA_ERR_TARGET:
+            return "image incomplete or CRC mismatch";
+        case DELTA_ERR_IO:
+            return "flash error";
+        case DELTA_ERR_SIGNATURE:
+            return "signature not valid";
+        default:
+            return "unknown";
+    }
+}
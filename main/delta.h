@@ -0,0 +1,156 @@
+#ifndef __DELTA_H__
+#define __DELTA_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "ed25519.h"
+
+/*
+ * Update patches: the new application image as a binary diff against the one the node runs, compressed.
+ * tools/delta_make.c writes them. A patch is applied as it arrives, in pieces of any size, with the running image
+ * read back from flash and the new one written out in order, so neither has to fit in RAM.
+ *
+ * Layout, little endian:
+ *
+ *   header   magic "DLT2", source size, source CRC-32, target size, target CRC-32 (5 x uint32), then the
+ *            Ed25519 signature of the target image (64 bytes); not compressed
+ *   body     LZSS-compressed (4 KiB window) sequence of blocks until the target size is reached:
+ *              varint diff length, varint extra length, zigzag varint seek
+ *              diff bytes:  target byte = source byte + diff byte, source and target advance together
+ *              extra bytes: target bytes as they are
+ *              the source position then moves by seek
+ *
+ * Code that moved keeps most of its bytes at the same place relative to the source, its diff bytes are mostly zero
+ * and compress to almost nothing; only changed code travels as extra bytes. A source size of 0 makes a patch of
+ * the whole image, e.g. for a node whose running image is not at hand. The CRCs catch a patch made against another
+ * image or damaged on the way. The signature is over the target image as it is written out, made with the private
+ * key of the release and checked against the public key the decoder is given: only whoever holds that key can
+ * make an image the decoder accepts, whoever can publish to the node can not. "DLT1" patches had no signature and
+ * are not accepted.
+ *
+ * No ESP-IDF dependencies, main/ota.c feeds the patches received over MQTT, host/ota_sim.c tests both ends.
+ */
+
+#define DELTA_MAGIC                 0x32544C44  // "DLT2"
+#define DELTA_SIGNATURE_SIZE        ED25519_SIGNATURE_SIZE
+#define DELTA_HEADER_SIZE           (20 + DELTA_SIGNATURE_SIZE)
+#define DELTA_WINDOW_SIZE           4096        /*!< LZSS window, the distance of a match is 1 .. 4096 */
+#define DELTA_MIN_MATCH             3
+#define DELTA_MAX_MATCH             (DELTA_MIN_MATCH + 15 + 255)
+#define DELTA_BUFFER_SIZE           256         /*!< source read-ahead and target write-behind */
+
+typedef enum {
+    DELTA_OK = 0,
+    DELTA_ERR_HEADER,           /*!< not a patch */
+    DELTA_ERR_SOURCE,           /*!< made against another image than the running one */
+    DELTA_ERR_CORRUPT,          /*!< a block reaches outside the source or past the target size */
+    DELTA_ERR_TARGET,           /*!< the result does not have the size or CRC of the header */
+    DELTA_ERR_IO,               /*!< a read or write callback failed */
+    DELTA_ERR_SIGNATURE,        /*!< the image is not signed with the key the decoder was given */
+} delta_result_t;
+
+typedef struct {
+    uint32_t source_size;
+    uint32_t source_crc;
+    uint32_t target_size;
+    uint32_t target_crc;
+    uint8_t signature[DELTA_SIGNATURE_SIZE];
+} delta_header_t;
+
+/**
+ * @brief Read len bytes of the running image at offset, 0 on success
+ */
+typedef int (*delta_read_t)(void *ctx, uint32_t offset, void *dst, size_t len);
+
+/**
+ * @brief Append len bytes to the new image, 0 on success
+ */
+typedef int (*delta_write_t)(void *ctx, const void *src, size_t len);
+
+typedef enum {
+    DELTA_STATE_HEADER = 0,
+    DELTA_STATE_CONTROL,
+    DELTA_STATE_DIFF,
+    DELTA_STATE_EXTRA,
+    DELTA_STATE_DONE,
+} delta_state_t;
+
+/* Decoder state, about 5 KiB: keep it static rather than on a task stack */
+typedef struct {
+    const uint8_t *public_key;
+    delta_read_t read;
+    delta_write_t write;
+    void *ctx;
+    delta_result_t result;      /*!< the first error, every later call returns it */
+
+    delta_header_t header;
+    uint8_t header_bytes[DELTA_HEADER_SIZE];
+    size_t header_len;
+
+    // LZSS: the flag byte of the current group and the bits left in it, a match split across feeds
+    uint8_t window[DELTA_WINDOW_SIZE];
+    uint32_t window_pos;
+    uint8_t flags;
+    uint8_t flag_bits;
+    uint8_t token[3];
+    uint8_t token_len;
+
+    // blocks
+    delta_state_t state;
+    uint32_t control[3];
+    uint8_t control_index;
+    uint8_t control_shift;
+    uint32_t remaining;         /*!< bytes left in the current diff or extra run */
+    int64_t source_pos;
+    uint32_t target_pos;
+
+    uint8_t source_buffer[DELTA_BUFFER_SIZE];
+    uint32_t source_buffer_pos; /*!< source offset of source_buffer[0] */
+    uint32_t source_buffer_len;
+    uint8_t target_buffer[DELTA_BUFFER_SIZE];
+    uint32_t target_buffer_len;
+    uint32_t target_crc;
+    ed25519_verify_t verify;    /*!< hash of the target image so far */
+} delta_t;
+
+/**
+ * @brief Start applying a patch
+ *
+ * @param public_key ED25519_PUBLIC_KEY_SIZE bytes the image must be signed with, kept until delta_finish()
+ * @param read reads the running image, only called within the source size of the patch
+ * @param write receives the new image in order
+ */
+void delta_init(delta_t *delta, const uint8_t *public_key, delta_read_t read, delta_write_t write, void *ctx);
+
+/**
+ * @brief Apply the next len bytes of the patch
+ *
+ * Once the header is complete the source is checked against its size and CRC, which reads all of it once.
+ *
+ * @return DELTA_OK, or the first error; the new image is then incomplete and must not be booted
+ */
+delta_result_t delta_feed(delta_t *delta, const void *data, size_t len);
+
+/**
+ * @brief After the last byte of the patch: whether the new image is complete, has the CRC of the header and is
+ * signed with the public key
+ *
+ * Only boot the new image on DELTA_OK. The signature check takes in the order of a second on the ESP32.
+ */
+delta_result_t delta_finish(delta_t *delta);
+
+/**
+ * @brief Header of the patch, NULL until delta_feed() received all of it
+ */
+const delta_header_t *delta_header(const delta_t *delta);
+
+/**
+ * @brief CRC-32 (IEEE 802.3, as zlib's crc32()), start with crc = 0
+ */
+uint32_t delta_crc32(uint32_t crc, const void *data, size_t len);
+
+const char *delta_result_name(delta_result_t result);
+
+#endif // __DELTA_H__
@@ -2,28 +2,58 @@
 
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "freertos/queue.h"
 #include "esp_system.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 #include "dht22.h"
+#include "dht22_decode.h"
+#include "sensor.h"
+#include "diag.h"
+#include "fixed.h"
+#include "binlog.h"
 #include "driver/gpio.h"
+#if CONFIG_ESP_DHT_BACKEND_RMT
+#include "driver/rmt_rx.h"
+#endif
 
 static const char* TAG = "DHT22";
-QueueHandle_t dht_reading_queue = NULL;
 
-int getSignalLevel( int usTimeOut, bool state )
+/* Every sensor has its own publisher queue, together with the battery monitor they share the queue set */
+#define DHT_QUEUE_DEPTH_SHARE   ((PUBLISHER_SET_LENGTH - CONFIG_ESP_BATTERY_QUEUE_DEPTH) / ESP_DHT_SENSOR_COUNT)
+#define DHT_QUEUE_DEPTH         (CONFIG_ESP_DHT_QUEUE_DEPTH < DHT_QUEUE_DEPTH_SHARE ? \
+                                 CONFIG_ESP_DHT_QUEUE_DEPTH : DHT_QUEUE_DEPTH_SHARE)
+
+static const gpio_num_t dht_pins[ESP_DHT_SENSOR_COUNT] = {
+        ESP_DHT_GPIO_PIN,
+#if ESP_DHT_SENSOR_COUNT >= 2
+        CONFIG_ESP_DHT_GPIO_PIN_1,
+#endif
+#if ESP_DHT_SENSOR_COUNT >= 3
+        CONFIG_ESP_DHT_GPIO_PIN_2,
+#endif
+#if ESP_DHT_SENSOR_COUNT >= 4
+        CONFIG_ESP_DHT_GPIO_PIN_3,
+#endif
+};
+
+/* The outcome of the last capture for every sensor, until that sensor's driver takes it */
+typedef struct {
+    dht_reading_t reading;
+    esp_err_t err;
+    bool pending;
+} dht_result_t;
+
+static dht_result_t results[ESP_DHT_SENSOR_COUNT];
+
+_Static_assert(ESP_DHT_SENSOR_COUNT <= DHT_MAX_CHANNELS, "one capture carries at most DHT_MAX_CHANNELS lines");
+
+static void dht_to_frame(const void *item, sensor_frame_t *frame)
 {
-
-    int uSec = 0;
-    while( gpio_get_level(ESP_DHT_GPIO_PIN)==state ) {
-
-        if( uSec > usTimeOut )
-            return -1;
-
-        ++uSec;
-        esp_rom_delay_us(1);		// uSec delay
-    }
-
-    return uSec;
+    const dht_reading_t *reading = item;
+    frame->flags |= PAYLOAD_HAS_DHT | PAYLOAD_DHT_SENSOR_FLAGS(reading->sensor);
+    frame->temperature = reading->temperature;
+    frame->humidity = reading->humidity;
 }
 
 /*----------------------------------------------------------------------------
@@ -54,161 +84,534 @@ To request data from DHT:
 	1: 70 us
 ;----------------------------------------------------------------------------*/
 
-#define MAXdhtData 5	// to complete 40 = 5*8 Bits
+#define DHT_LINE_PULSES     (DHT_DATA_BITS * 2 + 8)     // response, 40 bits and the edges around them
 
-esp_err_t readDHT(float* temperature, float* humidity)
+static esp_err_t dht_convert(dht_decode_result_t result, const uint8_t *dhtData, int16_t* temperature,
+                             uint16_t* humidity)
 {
-    int uSec = 0;
-
-    uint8_t dhtData[MAXdhtData];
-    uint8_t byteInx = 0;
-    uint8_t bitInx = 7;
+    switch (result) {
+        case DHT_DECODE_OK:
+            dht_decode_values(dhtData, temperature, humidity);
+            return ESP_OK;
+        case DHT_DECODE_BAD_CRC:
+            return ESP_ERR_INVALID_CRC;
+        default:
+            return ESP_ERR_TIMEOUT;
+    }
+}
 
-    for (int k = 0; k<MAXdhtData; k++)
-        dhtData[k] = 0;
+#if CONFIG_ESP_DHT_BACKEND_GPIO
 
-    // == Send start signal to DHT sensor ===========
+#define DHT_CAPTURE_EDGES       (1 + DHT_LINE_PULSES * ESP_DHT_SENSOR_COUNT)
+#define DHT_CAPTURE_TIMEOUT_US  8000    // a frame takes at most 160 us + 40 * 145 us
+#define DHT_IDLE_US             200     // all lines high for longer than any pulse: every sensor is done
+#define DHT_ALL_HIGH            ((1 << ESP_DHT_SENSOR_COUNT) - 1)
 
-    gpio_set_direction( ESP_DHT_GPIO_PIN, GPIO_MODE_OUTPUT );
+static dht_edge_t capture_edges[DHT_CAPTURE_EDGES];
+static dht_pulse_t line_pulses[DHT_LINE_PULSES];
 
-    // pull down for 3 ms for a smooth and nice wake up
-    gpio_set_level( ESP_DHT_GPIO_PIN, 0 );
-    esp_rom_delay_us( 3000 );
+static uint8_t read_levels(void)
+{
+    uint8_t levels = 0;
 
-    // pull up for 25 us for a gentile asking for data
-    gpio_set_level( ESP_DHT_GPIO_PIN, 1 );
-    esp_rom_delay_us( 25 );
+    for (uint8_t i = 0; i < ESP_DHT_SENSOR_COUNT; i++) {
+        levels |= (uint8_t)((gpio_get_level(dht_pins[i]) ? 1 : 0) << i);
+    }
 
-    gpio_set_direction( ESP_DHT_GPIO_PIN, GPIO_MODE_INPUT );		// change to input mode
+    return levels;
+}
 
-    // == DHT will keep the line low for 80 us and then high for 80us ====
+/*
+ * All lines are polled in one busy-wait loop and every level change is recorded with its time, so the sensors
+ * answer in parallel and the capture takes as long as the slowest one.
+ */
+static size_t capture_lines(void)
+{
+    // == Send start signal to all DHT sensors at once ===========
 
-    uSec = getSignalLevel( 85, 0 );
-//	ESP_LOGI( TAG, "Response = %d", uSec );
-    if( uSec < 0 ) return ESP_ERR_TIMEOUT;
+    for (uint8_t i = 0; i < ESP_DHT_SENSOR_COUNT; i++) {
+        gpio_set_direction(dht_pins[i], GPIO_MODE_OUTPUT);
+        gpio_set_level(dht_pins[i], 0);     // pull down for 3 ms for a smooth and nice wake up
+    }
+    esp_rom_delay_us(3000);
 
-    // -- 80us up ------------------------
+#if CONFIG_ESP_DHT_CAPTURE_GUARD
+    // no task switch on this core until the frame is in, interrupts and the other core keep running
+    vTaskSuspendAll();
+#endif
 
-    uSec = getSignalLevel( 85, 1 );
-//	ESP_LOGI( TAG, "Response = %d", uSec );
-    if( uSec < 0 ) return ESP_ERR_TIMEOUT;
+    for (uint8_t i = 0; i < ESP_DHT_SENSOR_COUNT; i++) {
+        gpio_set_level(dht_pins[i], 1);     // pull up for 25 us for a gentile asking for data
+    }
+    esp_rom_delay_us(25);
 
-    // == No errors, read the 40 data bits ================
+    for (uint8_t i = 0; i < ESP_DHT_SENSOR_COUNT; i++) {
+        gpio_set_direction(dht_pins[i], GPIO_MODE_INPUT);
+    }
 
-    for( int k = 0; k < 40; k++ ) {
+    // == Record the response and the 40 data bits of every line ================
 
-        // -- starts new data transmission with >50us low signal
+    int64_t start = esp_timer_get_time();
+    uint8_t levels = read_levels();
+    uint32_t last_edge_us = 0;
+    size_t count = 0;
 
-        uSec = getSignalLevel( 56, 0 );
-        if( uSec<0 ) return ESP_ERR_TIMEOUT;
+    capture_edges[count++] = (dht_edge_t) { .time_us = 0, .levels = levels };
 
-        // -- check to see if after >70us rx data is a 0 or a 1
+    while (true) {
+        esp_rom_delay_us(1);
 
-        uSec = getSignalLevel( 75, 1 );
-        if( uSec<0 ) return ESP_ERR_TIMEOUT;
+        uint32_t elapsed_us = (uint32_t)(esp_timer_get_time() - start);
+        uint8_t now = read_levels();
 
-        // add the current read to the output data
-        // since all dhtData array where set to 0 at the start,
-        // only look for "1" (>28us us)
+        if (now != levels) {
+            if (count < DHT_CAPTURE_EDGES) {
+                capture_edges[count++] = (dht_edge_t) { .time_us = (uint16_t)elapsed_us, .levels = now };
+            }
+            levels = now;
+            last_edge_us = elapsed_us;
+        }
 
-        if (uSec > 40) {
-            dhtData[ byteInx ] |= (1 << bitInx);
+        if (elapsed_us >= DHT_CAPTURE_TIMEOUT_US ||
+            (levels == DHT_ALL_HIGH && elapsed_us - last_edge_us >= DHT_IDLE_US)) {
+            break;
         }
+    }
+
+#if CONFIG_ESP_DHT_CAPTURE_GUARD
+    xTaskResumeAll();
+#endif
+
+    return count;
+}
+
+static void dht_capture(void)
+{
+    size_t count = capture_lines();
+    uint8_t dhtData[DHT_DATA_BYTES];
+
+    for (uint8_t i = 0; i < ESP_DHT_SENSOR_COUNT; i++) {
+        size_t pulses = dht_edges_to_pulses(capture_edges, count, i, line_pulses, DHT_LINE_PULSES);
+        dht_reading_t *reading = &results[i].reading;
+
+        results[i].err = dht_convert(dht_decode_pulses(line_pulses, pulses, dhtData), dhtData,
+                                     &reading->temperature, &reading->humidity);
+    }
+}
+
+#elif CONFIG_ESP_DHT_BACKEND_RMT
+
+#define DHT_RMT_RESOLUTION_HZ   1000000     // 1 tick = 1 us, symbol durations are pulse widths in us
+#define DHT_RMT_MEM_SYMBOLS     64          // 41 symbols (response + 40 bits) plus the tail of the start signal
+#define DHT_RMT_TIMEOUT_MS      20          // a full frame takes ~5 ms
+#define DHT_START_SIGNAL_TICKS  2           // >= 1 full tick: 1-20 ms low depending on the tick rate
+
+/* One RX channel per sensor, they all capture at the same time */
+typedef struct {
+    rmt_channel_handle_t channel;
+    uint8_t sensor;
+    size_t num_symbols;
+    rmt_symbol_word_t symbols[DHT_RMT_MEM_SYMBOLS];
+} dht_rmt_line_t;
+
+static dht_rmt_line_t rmt_lines[ESP_DHT_SENSOR_COUNT];
+static QueueHandle_t rx_done_queue = NULL;
+#if CONFIG_ESP_STATIC_ALLOCATION
+static uint8_t rx_done_storage[ESP_DHT_SENSOR_COUNT];
+static StaticQueue_t rx_done_buffer;
+#endif
+static dht_pulse_t rx_pulses[DHT_RMT_MEM_SYMBOLS * 2];
+
+static const rmt_receive_config_t rx_config = {
+        .signal_range_min_ns = 1000,            // anything shorter than 1 us is a glitch
+        .signal_range_max_ns = 200 * 1000,      // line idle for 200 us ends the frame
+};
+
+static bool IRAM_ATTR rx_done_callback(rmt_channel_handle_t channel, const rmt_rx_done_event_data_t *edata,
+                                       void *user_data)
+{
+    BaseType_t high_task_wakeup = pdFALSE;
+    dht_rmt_line_t *line = user_data;
+
+    // received_symbols is line->symbols, only the count needs to reach the task
+    line->num_symbols = edata->num_symbols;
+    xQueueSendFromISR(rx_done_queue, &line->sensor, &high_task_wakeup);
+    return high_task_wakeup == pdTRUE;
+}
+
+static esp_err_t dht_rmt_init(void)
+{
+#if CONFIG_ESP_STATIC_ALLOCATION
+    rx_done_queue = xQueueCreateStatic(ESP_DHT_SENSOR_COUNT, sizeof(uint8_t), rx_done_storage, &rx_done_buffer);
+#else
+    rx_done_queue = xQueueCreate(ESP_DHT_SENSOR_COUNT, sizeof(uint8_t));
+#endif
+    if (rx_done_queue == NULL) {
+        ESP_LOGE(TAG, "rx_done_queue: Queue was not created. Could not allocate required memory");
+        return ESP_ERR_NO_MEM;
+    }
+
+    rmt_rx_event_callbacks_t callbacks = {
+            .on_recv_done = rx_done_callback,
+    };
+
+    for (uint8_t i = 0; i < ESP_DHT_SENSOR_COUNT; i++) {
+        dht_rmt_line_t *line = &rmt_lines[i];
+        rmt_rx_channel_config_t rx_channel_cfg = {
+                .gpio_num = dht_pins[i],
+                .clk_src = RMT_CLK_SRC_DEFAULT,
+                .resolution_hz = DHT_RMT_RESOLUTION_HZ,
+                .mem_block_symbols = DHT_RMT_MEM_SYMBOLS,
+        };
+
+        line->sensor = i;
+        ESP_ERROR_CHECK(rmt_new_rx_channel(&rx_channel_cfg, &line->channel));
+        ESP_ERROR_CHECK(rmt_rx_register_event_callbacks(line->channel, &callbacks, line));
+        ESP_ERROR_CHECK(rmt_enable(line->channel));
+
+        // RMT only samples the pin, the start signal is driven through the GPIO matrix as open drain
+        ESP_ERROR_CHECK(gpio_set_direction(dht_pins[i], GPIO_MODE_INPUT_OUTPUT_OD));
+        ESP_ERROR_CHECK(gpio_set_pull_mode(dht_pins[i], GPIO_PULLUP_ONLY));
+        gpio_set_level(dht_pins[i], 1);
+    }
+
+    return ESP_OK;
+}
+
+static void dht_capture(void)
+{
+    uint8_t dhtData[DHT_DATA_BYTES];
+    bool started[ESP_DHT_SENSOR_COUNT];
+    bool done[ESP_DHT_SENSOR_COUNT] = { false };
+    size_t waiting = 0;
+
+    // a channel that timed out last time may still have signalled since
+    xQueueReset(rx_done_queue);
+
+    // == Send start signal to all DHT sensors at once, the task sleeps instead of spinning ===========
+
+    for (uint8_t i = 0; i < ESP_DHT_SENSOR_COUNT; i++) {
+        gpio_set_level(dht_pins[i], 0);
+    }
+    vTaskDelay(DHT_START_SIGNAL_TICKS);
 
-        // index to next byte
+    for (uint8_t i = 0; i < ESP_DHT_SENSOR_COUNT; i++) {
+        results[i].err = rmt_receive(rmt_lines[i].channel, rmt_lines[i].symbols, sizeof(rmt_lines[i].symbols),
+                                     &rx_config);
+        started[i] = results[i].err == ESP_OK;
+        waiting += started[i];
+    }
 
-        if (bitInx == 0) { bitInx = 7; ++byteInx; }
-        else bitInx--;
+    // release the lines, the pull-ups give the DHTs their 20-40 us high and RMT captures the rest
+    for (uint8_t i = 0; i < ESP_DHT_SENSOR_COUNT; i++) {
+        gpio_set_level(dht_pins[i], 1);
     }
 
-    // == get humidity from Data[0] and Data[1] ==========================
+    TickType_t deadline = xTaskGetTickCount() + pdMS_TO_TICKS(DHT_RMT_TIMEOUT_MS);
+    while (waiting > 0) {
+        TickType_t now = xTaskGetTickCount();
+        uint8_t sensor;
 
-    *humidity = dhtData[0];
-    *humidity *= 0x100;					// >> 8
-    *humidity += dhtData[1];
-    *humidity /= 10;						// get the decimal
+        if ((int32_t)(deadline - now) <= 0 || xQueueReceive(rx_done_queue, &sensor, deadline - now) != pdPASS) {
+            break;
+        }
+        done[sensor] = true;
+        waiting--;
+    }
 
-    // == get temp from Data[2] and Data[3]
+    for (uint8_t i = 0; i < ESP_DHT_SENSOR_COUNT; i++) {
+        dht_rmt_line_t *line = &rmt_lines[i];
+        dht_reading_t *reading = &results[i].reading;
+        size_t count = 0;
 
-    *temperature = dhtData[2] & 0x7F;
-    *temperature *= 0x100;				// >> 8
-    *temperature += dhtData[3];
-    *temperature /= 10;
+        if (!started[i]) {
+            continue;
+        }
 
-    if( dhtData[2] & 0x80 ) 			// negative temp, brrr it's freezing
-        *temperature *= -1;
+        if (!done[i]) {
+            // abort the pending receive so the next reading starts from a clean channel
+            rmt_disable(line->channel);
+            rmt_enable(line->channel);
+            results[i].err = ESP_ERR_TIMEOUT;
+            continue;
+        }
 
+        for (size_t k = 0; k < line->num_symbols; k++) {
+            const rmt_symbol_word_t *symbol = &line->symbols[k];
 
-    // == verify if checksum is ok ===========================================
-    // Checksum is the sum of Data 8 bits masked out 0xFF
+            if (symbol->duration0) {
+                rx_pulses[count++] = (dht_pulse_t) { .level = symbol->level0, .duration_us = symbol->duration0 };
+            }
 
-    if (dhtData[4] == ((dhtData[0] + dhtData[1] + dhtData[2] + dhtData[3]) & 0xFF))
+            if (symbol->duration1) {
+                rx_pulses[count++] = (dht_pulse_t) { .level = symbol->level1, .duration_us = symbol->duration1 };
+            }
+        }
 
-        return ESP_OK;
-    else
-        return ESP_ERR_INVALID_CRC;
+        results[i].err = dht_convert(dht_decode_pulses(rx_pulses, count, dhtData), dhtData, &reading->temperature,
+                                     &reading->humidity);
+    }
 }
 
-void errorHandler(esp_err_t response)
+#endif
+
+void errorHandler(uint8_t sensor, esp_err_t response)
 {
     switch(response) {
         case ESP_ERR_TIMEOUT :
-            ESP_LOGE( TAG, "Sensor Timeout\n" );
+            diag_count_dht(sensor, DIAG_DHT_ERROR_TIMEOUT);
+            ESP_LOGE( TAG, "Sensor %u: Sensor Timeout\n", sensor );
             break;
         case ESP_ERR_INVALID_CRC:
-            ESP_LOGE( TAG, "CheckSum error\n" );
+            diag_count_dht(sensor, DIAG_DHT_ERROR_CRC);
+            ESP_LOGE( TAG, "Sensor %u: CheckSum error\n", sensor );
             break;
         default :
-            ESP_LOGE( TAG, "Unknown error\n" );
+            ESP_LOGE( TAG, "Sensor %u: Unknown error\n", sensor );
     }
 }
 
-_Noreturn static void dht_reader_task(void *pvParameter)
+static esp_err_t dht_hw_init(void)
 {
-    while(true) {
-        esp_err_t err;
-        float temperature;
-        float humidity;
+#if CONFIG_ESP_DHT_BACKEND_RMT
+    if (rx_done_queue == NULL) {
+        return dht_rmt_init();
+    }
+#endif
 
-        err = readDHT(&temperature, &humidity);
+    return ESP_OK;
+}
 
-        if (err != ESP_OK) {
-            errorHandler(err);
-            vTaskDelay(pdMS_TO_TICKS(5000));
-            continue;
-        }
+/* One capture of all lines, every sensor gets a result to take */
+static void dht_read_all(void)
+{
+    int64_t start = diag_start();
+    dht_capture();
+    diag_record(DIAG_STAGE_DHT_READ, start);
 
-        ESP_LOGI(TAG, "Humidity: %.2f, temperature: %.2f°C", humidity, temperature);
+    for (uint8_t i = 0; i < ESP_DHT_SENSOR_COUNT; i++) {
+        results[i].reading.sensor = i;
+        results[i].pending = true;
+    }
+}
 
-        dht_reading_t reading = {
-                .humidity = humidity,
-                .temperature = temperature
-        };
+/*
+ * The sensor whose result was already taken starts the next capture. With every driver at the same period the
+ * first one sampled captures all lines and the others, sampled right after it, take their results.
+ */
+static esp_err_t dht_take(uint8_t sensor, dht_reading_t *reading)
+{
+    if (!results[sensor].pending) {
+        dht_read_all();
+    }
+    results[sensor].pending = false;
 
-        BaseType_t status = xQueueSend(dht_reading_queue, &reading, 0);
-        if (status != pdPASS) {
-            ESP_LOGW(TAG, "dht_reader_task(): Failed to send the message");
-        }
+    esp_err_t err = results[sensor].err;
+    if (err != ESP_OK) {
+        errorHandler(sensor, err);
+        return err;
+    }
 
-        vTaskDelay(pdMS_TO_TICKS(5000));
+    *reading = results[sensor].reading;
+    BINLOG(DHT_READING, sensor, reading->humidity, reading->temperature);
+    return ESP_OK;
+}
+
+esp_err_t dht_read_once(dht_reading_t *reading)
+{
+    esp_err_t err = dht_hw_init();
+    if (err != ESP_OK) {
+        return err;
     }
+
+    dht_read_all();
+    return dht_take(0, reading);
 }
 
-esp_err_t dht_init(void) {
-    ESP_LOGI(TAG, "Init");
-    dht_reading_queue = xQueueCreate(10, sizeof(dht_reading_t));
-    if (dht_reading_queue == NULL) {
-        ESP_LOGE(TAG, "dht_reading_queue: Queue was not created. Could not allocate required memory");
-        return ESP_ERR_NO_MEM;
+#if CONFIG_ESP_DHT_FILTER
+
+/* DHT22 datasheet: -40..80 °C, 0..100 %RH, accuracy +-0.5 °C and +-2 %RH covers the noise between two readings */
+static const filter_config_t temperature_filter_config = {
+        .min = -400,
+        .max = 800,
+        .max_step = 5,
+        .max_rate = CONFIG_ESP_DHT_FILTER_MAX_RATE_TEMPERATURE,
+        .max_rejects = CONFIG_ESP_DHT_FILTER_MAX_REJECTS,
+        .smooth = ESP_DHT_FILTER_SMOOTH,
+        .median_size = CONFIG_ESP_DHT_FILTER_MEDIAN_SIZE,
+        .kalman_q = 16,         /* 0.025 °C drift per sample */
+        .kalman_r = 256,        /* 0.1 °C measurement noise */
+        .window_ms = ESP_DHT_FILTER_WINDOW_MS,
+};
+
+static const filter_config_t humidity_filter_config = {
+        .min = 0,
+        .max = 1000,
+        .max_step = 20,
+        .max_rate = CONFIG_ESP_DHT_FILTER_MAX_RATE_HUMIDITY,
+        .max_rejects = CONFIG_ESP_DHT_FILTER_MAX_REJECTS,
+        .smooth = ESP_DHT_FILTER_SMOOTH,
+        .median_size = CONFIG_ESP_DHT_FILTER_MEDIAN_SIZE,
+        .kalman_q = 64,         /* 0.05 % drift per sample */
+        .kalman_r = 1024,       /* 0.2 % measurement noise */
+        .window_ms = ESP_DHT_FILTER_WINDOW_MS,
+};
+
+static filter_t temperature_filters[ESP_DHT_SENSOR_COUNT];
+static filter_t humidity_filters[ESP_DHT_SENSOR_COUNT];
+
+/* The last closed window of each sensor, written by the sensor scheduler and taken by the publisher */
+static portMUX_TYPE window_lock = portMUX_INITIALIZER_UNLOCKED;
+static dht_window_stats_t window_stats[ESP_DHT_SENSOR_COUNT];
+static bool window_stats_ready[ESP_DHT_SENSOR_COUNT];
+
+static void dht_filter_init(uint8_t sensor)
+{
+    uint32_t now_ms = pdTICKS_TO_MS(xTaskGetTickCount());
+
+    filter_init(&temperature_filters[sensor], &temperature_filter_config, now_ms);
+    filter_init(&humidity_filters[sensor], &humidity_filter_config, now_ms);
+}
+
+static bool dht_filter_push(uint8_t sensor, filter_t *filter, int32_t raw, uint32_t now_ms, int32_t *value,
+                            const char *metric)
+{
+    filter_result_t result = filter_push(filter, raw, now_ms, value);
+
+    if (result != FILTER_ACCEPTED) {
+        diag_count_dht(sensor, DIAG_DHT_ERROR_REJECTED);
+        ESP_LOGW(TAG, "Sensor %u: Rejected %s %" PRIi32 " (0.1 units): %s", sensor, metric, raw,
+                 result == FILTER_REJECTED_RANGE ? "out of range" : "jump");
+        return false;
     }
 
-    BaseType_t status = xTaskCreate(dht_reader_task, "dht_reader_task", configMINIMAL_STACK_SIZE * 4, NULL,
-                                    4, NULL);
+    return true;
+}
 
-    if (status != pdPASS) {
-        ESP_LOGE(TAG, "dht_reader_task(): Task was not created. Could not allocate required memory");
-        return ESP_ERR_NO_MEM;
+/*
+ * Without a window every reading that passes both filters is published smoothed. With a window the readings only
+ * feed the statistics and the window mean is published once per window.
+ */
+static esp_err_t dht_filter(dht_reading_t *reading)
+{
+    uint8_t sensor = reading->sensor;
+    filter_t *temperature_filter = &temperature_filters[sensor];
+    filter_t *humidity_filter = &humidity_filters[sensor];
+    uint32_t now_ms = pdTICKS_TO_MS(xTaskGetTickCount());
+    int32_t temperature;
+    int32_t humidity;
+
+    bool accepted = dht_filter_push(sensor, temperature_filter, reading->temperature, now_ms, &temperature,
+                                    "temperature");
+    accepted &= dht_filter_push(sensor, humidity_filter, reading->humidity, now_ms, &humidity, "humidity");
+
+#if CONFIG_ESP_DHT_FILTER_WINDOW_SEC > 0
+    dht_window_stats_t stats;
+
+    // a rejected reading just does not count towards the window
+    (void)accepted;
+
+    // both windows started together and close together
+    bool closed = filter_window_take(temperature_filter, now_ms, &stats.temperature);
+    closed &= filter_window_take(humidity_filter, now_ms, &stats.humidity);
+    if (!closed) {
+        return ESP_ERR_NOT_FINISHED;
+    }
+
+    portENTER_CRITICAL(&window_lock);
+    window_stats[sensor] = stats;
+    window_stats_ready[sensor] = true;
+    portEXIT_CRITICAL(&window_lock);
+
+    reading->temperature = (int16_t)fixed_rescale(stats.temperature.mean, FILTER_STATS_SCALE, 1);
+    reading->humidity = (uint16_t)fixed_rescale(stats.humidity.mean, FILTER_STATS_SCALE, 1);
+    return ESP_OK;
+#else
+    if (!accepted) {
+        return ESP_ERR_NOT_FINISHED;
     }
 
+    reading->temperature = (int16_t)temperature;
+    reading->humidity = (uint16_t)humidity;
     return ESP_OK;
-}
\ No newline at end of file
+#endif
+}
+
+bool dht_take_window_stats(uint8_t sensor, dht_window_stats_t *stats)
+{
+    portENTER_CRITICAL(&window_lock);
+    bool ready = window_stats_ready[sensor];
+    if (ready) {
+        *stats = window_stats[sensor];
+        window_stats_ready[sensor] = false;
+    }
+    portEXIT_CRITICAL(&window_lock);
+
+    return ready;
+}
+
+#endif
+
+static esp_err_t dht_init(uint8_t sensor)
+{
+#if CONFIG_ESP_DHT_FILTER
+    dht_filter_init(sensor);
+#endif
+
+    return dht_hw_init();
+}
+
+static esp_err_t dht_sample(uint8_t sensor, void *reading)
+{
+    esp_err_t err = dht_take(sensor, reading);
+
+#if CONFIG_ESP_DHT_FILTER
+    if (err == ESP_OK) {
+        err = dht_filter(reading);
+    }
+#endif
+
+    return err;
+}
+
+#define DHT_DRIVER_CALLBACKS(n) \
+        static esp_err_t dht_init_##n(void) { return dht_init(n); } \
+        static esp_err_t dht_sample_##n(void *reading) { return dht_sample(n, reading); }
+
+#define DHT_DRIVER(n, driver_name) { \
+        .name = driver_name, \
+        .period_ms = CONFIG_ESP_DHT_SAMPLE_PERIOD_MS, \
+        .reading_size = sizeof(dht_reading_t), \
+        .init = dht_init_##n, \
+        .sample = dht_sample_##n, \
+        .format = dht_to_frame, \
+        .source = { \
+                .policy = ESP_DHT_PUBLISH_POLICY, \
+                .depth = DHT_QUEUE_DEPTH, \
+                .min_interval_ms = CONFIG_ESP_DHT_MIN_PUBLISH_INTERVAL_MS, \
+        }, \
+}
+
+DHT_DRIVER_CALLBACKS(0)
+#if ESP_DHT_SENSOR_COUNT >= 2
+DHT_DRIVER_CALLBACKS(1)
+#endif
+#if ESP_DHT_SENSOR_COUNT >= 3
+DHT_DRIVER_CALLBACKS(2)
+#endif
+#if ESP_DHT_SENSOR_COUNT >= 4
+DHT_DRIVER_CALLBACKS(3)
+#endif
+
+sensor_driver_t dht22_drivers[ESP_DHT_SENSOR_COUNT] = {
+        DHT_DRIVER(0, "dht22"),
+#if ESP_DHT_SENSOR_COUNT >= 2
+        DHT_DRIVER(1, "dht22_1"),
+#endif
+#if ESP_DHT_SENSOR_COUNT >= 3
+        DHT_DRIVER(2, "dht22_2"),
+#endif
+#if ESP_DHT_SENSOR_COUNT >= 4
+        DHT_DRIVER(3, "dht22_3"),
+#endif
+};
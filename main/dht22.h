@@ -3,15 +3,54 @@
 
 #include <stdbool.h>
 #include "freertos/FreeRTOS.h"
+#include "sensor.h"
 
 #define ESP_DHT_GPIO_PIN       CONFIG_ESP_DHT_GPIO_PIN
+#define ESP_DHT_SENSOR_COUNT   CONFIG_ESP_DHT_SENSOR_COUNT
+
+#if CONFIG_ESP_DHT_PUBLISH_LATEST
+#define ESP_DHT_PUBLISH_POLICY PUBLISHER_POLICY_LATEST
+#else
+#define ESP_DHT_PUBLISH_POLICY PUBLISHER_POLICY_FIFO
+#endif
 
 typedef struct {
-    float temperature;
-    float humidity;
+    int16_t temperature;    /*!< 0.1 °C */
+    uint16_t humidity;      /*!< 0.1 % */
+    uint8_t sensor;         /*!< 0 .. ESP_DHT_SENSOR_COUNT - 1, sensor 0 is on ESP_DHT_GPIO_PIN */
 } dht_reading_t;
 
-extern QueueHandle_t dht_reading_queue;
-esp_err_t dht_init(void);
+#if CONFIG_ESP_DHT_FILTER
+#include "filter.h"
+
+#if CONFIG_ESP_DHT_FILTER_SMOOTH_MEDIAN
+#define ESP_DHT_FILTER_SMOOTH           FILTER_SMOOTH_MEDIAN
+#elif CONFIG_ESP_DHT_FILTER_SMOOTH_KALMAN
+#define ESP_DHT_FILTER_SMOOTH           FILTER_SMOOTH_KALMAN
+#else
+#define ESP_DHT_FILTER_SMOOTH           FILTER_SMOOTH_NONE
+#endif
+#define ESP_DHT_FILTER_WINDOW_MS        (CONFIG_ESP_DHT_FILTER_WINDOW_SEC * 1000)
+
+typedef struct {
+    filter_stats_t temperature;     /*!< 0.1 °C, mean and stddev 0.01 °C */
+    filter_stats_t humidity;        /*!< 0.1 %, mean and stddev 0.01 % */
+} dht_window_stats_t;
+
+/**
+ * @brief Take the statistics of the last closed aggregation window of a sensor, each window is returned once
+ *
+ * @return false if no window closed since the previous call
+ */
+bool dht_take_window_stats(uint8_t sensor, dht_window_stats_t *stats);
+#endif
+
+/**
+ * @brief Take a single reading of sensor 0, initialising the hardware on first use
+ */
+esp_err_t dht_read_once(dht_reading_t *reading);
+
+/* One driver per sensor. The first one sampled in a period captures all lines, the others take their result. */
+extern sensor_driver_t dht22_drivers[ESP_DHT_SENSOR_COUNT];
 
 #endif // __DHT22_H__
\ No newline at end of file
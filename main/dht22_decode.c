@@ -0,0 +1,109 @@
+#include <string.h>
+
+#include "dht22_decode.h"
+
+static inline int in_range(uint16_t value, uint16_t min, uint16_t max)
+{
+    return value >= min && value <= max;
+}
+
+/* Returns the index of the first data bit low pulse, or count if no response is found */
+static size_t find_response(const dht_pulse_t *pulses, size_t count)
+{
+    for (size_t i = 0; i + 1 < count; i++) {
+        if (pulses[i].level == 0 && pulses[i + 1].level == 1 &&
+            in_range(pulses[i].duration_us, DHT_RESPONSE_MIN_US, DHT_RESPONSE_MAX_US) &&
+            in_range(pulses[i + 1].duration_us, DHT_RESPONSE_MIN_US, DHT_RESPONSE_MAX_US)) {
+            return i + 2;
+        }
+    }
+
+    return count;
+}
+
+dht_decode_result_t dht_decode_pulses(const dht_pulse_t *pulses, size_t count, uint8_t *data)
+{
+    size_t start = find_response(pulses, count);
+    return dht_decode_bits(pulses + start, count - start, data);
+}
+
+dht_decode_result_t dht_decode_bits(const dht_pulse_t *pulses, size_t count, uint8_t *data)
+{
+    memset(data, 0, DHT_DATA_BYTES);
+
+    if (count < DHT_DATA_BITS * 2) {
+        return DHT_DECODE_TIMEOUT;
+    }
+
+    for (int k = 0; k < DHT_DATA_BITS; k++) {
+        const dht_pulse_t *low = &pulses[2 * k];
+        const dht_pulse_t *high = &pulses[2 * k + 1];
+
+        if (low->level != 0 || !in_range(low->duration_us, DHT_BIT_LOW_MIN_US, DHT_BIT_LOW_MAX_US)) {
+            return DHT_DECODE_TIMEOUT;
+        }
+
+        if (high->level != 1 || high->duration_us > DHT_BIT_HIGH_MAX_US) {
+            return DHT_DECODE_TIMEOUT;
+        }
+
+        // data was zeroed above, only "1" bits (> 28 us) need to be set
+        if (high->duration_us > DHT_BIT_ONE_MIN_US) {
+            data[k / 8] |= (uint8_t)(1 << (7 - (k % 8)));
+        }
+    }
+
+    return dht_decode_check(data);
+}
+
+size_t dht_edges_to_pulses(const dht_edge_t *edges, size_t count, uint8_t channel, dht_pulse_t *pulses, size_t max)
+{
+    uint8_t mask = (uint8_t)(1 << channel);
+    size_t written = 0;
+
+    if (count == 0) {
+        return 0;
+    }
+
+    uint8_t level = edges[0].levels & mask;
+    uint16_t since_us = edges[0].time_us;
+
+    for (size_t i = 1; i < count && written < max; i++) {
+        if ((edges[i].levels & mask) == level) {
+            continue;
+        }
+
+        pulses[written++] = (dht_pulse_t) {
+                .level = level ? 1 : 0,
+                .duration_us = (uint16_t)(edges[i].time_us - since_us),
+        };
+        level = edges[i].levels & mask;
+        since_us = edges[i].time_us;
+    }
+
+    return written;
+}
+
+dht_decode_result_t dht_decode_check(const uint8_t *data)
+{
+    // Checksum is the sum of Data 8 bits masked out 0xFF
+    if (data[4] == ((data[0] + data[1] + data[2] + data[3]) & 0xFF)) {
+        return DHT_DECODE_OK;
+    }
+
+    return DHT_DECODE_BAD_CRC;
+}
+
+void dht_decode_values(const uint8_t *data, int16_t *temperature, uint16_t *humidity)
+{
+    // == get humidity from Data[0] and Data[1], already in 0.1 % ===========
+
+    *humidity = (uint16_t)((data[0] << 8) | data[1]);
+
+    // == get temp from Data[2] and Data[3] in 0.1 °C, highest bit is the sign
+
+    *temperature = (int16_t)(((data[2] & 0x7F) << 8) | data[3]);
+
+    if (data[2] & 0x80)             // negative temp, brrr it's freezing
+        *temperature = -*temperature;
+}
@@ -0,0 +1,87 @@
+#ifndef __DHT22_DECODE_H__
+#define __DHT22_DECODE_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Pure DHT22 frame decoder. It has no ESP-IDF dependencies so it can be built and fed recorded pulse traces on
+ * the host. Both DHT backends (GPIO busy-wait and RMT capture) turn the line into a list of pulses and hand it here.
+ * The GPIO backend samples all sensor lines in one loop and records the level changes as dht_edge_t, which
+ * dht_edges_to_pulses() splits into the pulses of each line.
+ */
+
+#define DHT_DATA_BYTES          5       /*!< 40 bits = 16 bits RH + 16 bits T + 8 bits checksum */
+#define DHT_DATA_BITS           (DHT_DATA_BYTES * 8)
+
+#define DHT_RESPONSE_MIN_US     60      /*!< DHT holds the line low, then high, for ~80 us each as response */
+#define DHT_RESPONSE_MAX_US     100
+#define DHT_BIT_LOW_MIN_US      20      /*!< every bit starts with a ~50 us low level */
+#define DHT_BIT_LOW_MAX_US      90
+#define DHT_BIT_HIGH_MAX_US     100     /*!< high level is 26-28 us for "0" and 70 us for "1" */
+#define DHT_BIT_ONE_MIN_US      40
+
+typedef struct {
+    uint8_t level;          /*!< line level during the pulse, 0 or 1 */
+    uint16_t duration_us;   /*!< pulse width in microseconds */
+} dht_pulse_t;
+
+#define DHT_MAX_CHANNELS        8       /*!< lines one edge capture can carry */
+
+typedef struct {
+    uint16_t time_us;       /*!< since the capture started */
+    uint8_t levels;         /*!< level of every line from this time on, bit n = channel n */
+} dht_edge_t;
+
+typedef enum {
+    DHT_DECODE_OK = 0,
+    DHT_DECODE_TIMEOUT,     /*!< no response found or the frame is truncated / out of spec */
+    DHT_DECODE_BAD_CRC,     /*!< 40 bits were decoded but the checksum does not match */
+} dht_decode_result_t;
+
+/**
+ * @brief Decode a captured pulse train into the 5 DHT data bytes
+ *
+ * Leading pulses (the tail of the start signal) are skipped until the ~80 us low/high response is found, then
+ * 40 low/high pairs are decoded MSB first.
+ *
+ * @param pulses captured pulses in line order
+ * @param count number of entries in pulses
+ * @param data output, DHT_DATA_BYTES bytes
+ */
+dht_decode_result_t dht_decode_pulses(const dht_pulse_t *pulses, size_t count, uint8_t *data);
+
+/**
+ * @brief Decode 40 low/high pulse pairs that directly follow the DHT response
+ *
+ * For captures that time the response separately and only record the data bits.
+ */
+dht_decode_result_t dht_decode_bits(const dht_pulse_t *pulses, size_t count, uint8_t *data);
+
+/**
+ * @brief Extract the pulse train of one line from a multi-line edge capture
+ *
+ * The first edge holds the levels at the start of the capture, every following one the levels after a change on
+ * one or more lines. Edges that do not change this channel are skipped, the level the line holds at the end of
+ * the capture is not a complete pulse and is left out.
+ *
+ * @param edges capture in time order
+ * @param count number of entries in edges
+ * @param channel bit of the line in dht_edge_t.levels
+ * @param pulses output
+ * @param max size of pulses, pulses beyond it are dropped
+ * @return number of pulses written
+ */
+size_t dht_edges_to_pulses(const dht_edge_t *edges, size_t count, uint8_t channel, dht_pulse_t *pulses, size_t max);
+
+/**
+ * @brief Verify the checksum byte of a decoded frame
+ */
+dht_decode_result_t dht_decode_check(const uint8_t *data);
+
+/**
+ * @brief Convert a decoded frame into temperature (0.1 °C) and relative humidity (0.1 %)
+ */
+void dht_decode_values(const uint8_t *data, int16_t *temperature, uint16_t *humidity);
+
+#endif // __DHT22_DECODE_H__
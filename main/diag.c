@@ -0,0 +1,154 @@
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "diag.h"
+
+typedef struct {
+    int msg_id;
+    int64_t sent_us;
+} diag_inflight_t;
+
+static portMUX_TYPE diag_lock = portMUX_INITIALIZER_UNLOCKED;
+static uint32_t counters[DIAG_COUNTER_COUNT];
+static diag_histogram_t stages[DIAG_STAGE_COUNT];
+static diag_inflight_t inflight[DIAG_INFLIGHT_SLOTS];
+static uint32_t gauges[DIAG_GAUGE_COUNT];
+static uint32_t milestones_ms[DIAG_MILESTONE_COUNT];
+static uint32_t dht_errors[DIAG_DHT_SENSORS_MAX][DIAG_DHT_ERROR_COUNT];
+
+_Static_assert(CONFIG_ESP_DHT_SENSOR_COUNT <= DIAG_DHT_SENSORS_MAX, "raise DIAG_DHT_SENSORS_MAX");
+
+static const diag_counter_t dht_error_totals[DIAG_DHT_ERROR_COUNT] = {
+        [DIAG_DHT_ERROR_TIMEOUT] = DIAG_COUNTER_DHT_TIMEOUT,
+        [DIAG_DHT_ERROR_CRC] = DIAG_COUNTER_DHT_CRC,
+        [DIAG_DHT_ERROR_REJECTED] = DIAG_COUNTER_DHT_REJECTED,
+};
+
+static inline unsigned int diag_bucket(uint32_t us)
+{
+    uint32_t scaled = us / DIAG_BUCKET_BASE_US;
+
+    if (scaled == 0) {
+        return 0;
+    }
+
+    unsigned int bucket = 31 - __builtin_clz(scaled);
+    return bucket < DIAG_BUCKETS ? bucket : DIAG_BUCKETS - 1;
+}
+
+static void diag_add(diag_stage_t stage, int64_t elapsed_us)
+{
+    uint32_t us = elapsed_us > UINT32_MAX ? UINT32_MAX : (uint32_t)elapsed_us;
+    unsigned int bucket = diag_bucket(us);
+    diag_histogram_t *histogram = &stages[stage];
+
+    portENTER_CRITICAL(&diag_lock);
+    histogram->count++;
+    histogram->sum_us += us;
+    if (us > histogram->max_us) {
+        histogram->max_us = us;
+    }
+    if (histogram->buckets[bucket] < UINT16_MAX) {
+        histogram->buckets[bucket]++;
+    }
+    portEXIT_CRITICAL(&diag_lock);
+}
+
+int64_t diag_start(void)
+{
+    return esp_timer_get_time();
+}
+
+void diag_record(diag_stage_t stage, int64_t start_us)
+{
+    diag_add(stage, esp_timer_get_time() - start_us);
+}
+
+void diag_count(diag_counter_t counter)
+{
+    portENTER_CRITICAL(&diag_lock);
+    counters[counter]++;
+    portEXIT_CRITICAL(&diag_lock);
+}
+
+void diag_count_dht(uint8_t sensor, diag_dht_error_t error)
+{
+    portENTER_CRITICAL(&diag_lock);
+    dht_errors[sensor][error]++;
+    counters[dht_error_totals[error]]++;
+    portEXIT_CRITICAL(&diag_lock);
+}
+
+void diag_gauge(diag_gauge_t gauge, uint32_t value)
+{
+    // a single aligned word, readers never see a torn value
+    gauges[gauge] = value;
+}
+
+bool diag_milestone(diag_milestone_t milestone)
+{
+    // never 0, which means not reached
+    uint32_t now_ms = (uint32_t)(esp_timer_get_time() / 1000) + 1;
+    bool first = false;
+
+    portENTER_CRITICAL(&diag_lock);
+    if (milestones_ms[milestone] == 0) {
+        milestones_ms[milestone] = now_ms;
+        first = true;
+    }
+    portEXIT_CRITICAL(&diag_lock);
+
+    return first;
+}
+
+uint32_t diag_milestone_ms(diag_milestone_t milestone)
+{
+    return milestones_ms[milestone];
+}
+
+void diag_publish_sent(int msg_id)
+{
+    // a slot is reused by a newer message id if the old one is never acknowledged
+    diag_inflight_t *slot = &inflight[msg_id & (DIAG_INFLIGHT_SLOTS - 1)];
+
+    portENTER_CRITICAL(&diag_lock);
+    slot->msg_id = msg_id;
+    slot->sent_us = esp_timer_get_time();
+    portEXIT_CRITICAL(&diag_lock);
+}
+
+void diag_publish_acked(int msg_id)
+{
+    diag_inflight_t *slot = &inflight[msg_id & (DIAG_INFLIGHT_SLOTS - 1)];
+    int64_t sent_us = -1;
+
+    portENTER_CRITICAL(&diag_lock);
+    if (slot->msg_id == msg_id) {
+        sent_us = slot->sent_us;
+        slot->msg_id = 0;
+    }
+    portEXIT_CRITICAL(&diag_lock);
+
+    if (sent_us >= 0) {
+        diag_record(DIAG_STAGE_PUBACK, sent_us);
+    }
+}
+
+void diag_snapshot(diag_snapshot_t *snapshot)
+{
+    snapshot->uptime_s = (uint32_t)(esp_timer_get_time() / 1000000);
+    snapshot->free_heap = esp_get_free_heap_size();
+    snapshot->min_free_heap = esp_get_minimum_free_heap_size();
+    snapshot->dht_sensors = CONFIG_ESP_DHT_SENSOR_COUNT;
+
+    portENTER_CRITICAL(&diag_lock);
+    memcpy(snapshot->counters, counters, sizeof(counters));
+    memcpy(snapshot->gauges, gauges, sizeof(gauges));
+    memcpy(snapshot->milestones_ms, milestones_ms, sizeof(milestones_ms));
+    memcpy(snapshot->stages, stages, sizeof(stages));
+    memcpy(snapshot->dht_errors, dht_errors, sizeof(dht_errors));
+    memset(stages, 0, sizeof(stages));
+    portEXIT_CRITICAL(&diag_lock);
+}
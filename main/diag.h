@@ -0,0 +1,135 @@
+#ifndef __DIAG_H__
+#define __DIAG_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Always-on stage latency histograms and error counters. Recording costs one esp_timer read and a short critical
+ * section, so it stays enabled in production builds. mqtt_task publishes a snapshot periodically on the
+ * diagnostics topic, see payload_encode_diag() for the layout.
+ *
+ * Histogram bucket 0 counts durations below 2 * DIAG_BUCKET_BASE_US, bucket n (n > 0) counts durations in
+ * [DIAG_BUCKET_BASE_US << n, DIAG_BUCKET_BASE_US << (n + 1)), the last bucket also takes everything above.
+ */
+
+#define DIAG_BUCKETS            16
+#define DIAG_BUCKET_BASE_US     64          /*!< last bucket starts at 64 us << 15 = 2.1 s */
+#define DIAG_INFLIGHT_SLOTS     8           /*!< publishes tracked for PUBACK latency, must be a power of two */
+#define DIAG_DHT_SENSORS_MAX    4           /*!< per-sensor DHT22 error counters, CONFIG_ESP_DHT_SENSOR_COUNT <= this */
+
+typedef enum {
+    DIAG_STAGE_DHT_READ = 0,    /*!< one capture of all DHT22 lines */
+    DIAG_STAGE_BATTERY_READ,    /*!< one MAX17048 register read */
+    DIAG_STAGE_QUEUE_WAIT,      /*!< mqtt_task blocked on the sample queues */
+    DIAG_STAGE_PUBACK,          /*!< QoS1 publish until MQTT_EVENT_PUBLISHED */
+    DIAG_STAGE_TLS_FULL,        /*!< TLS handshake with certificate verification, see tls_transport.h */
+    DIAG_STAGE_TLS_RESUMED,     /*!< TLS handshake that resumed the previous session */
+    DIAG_STAGE_COUNT,
+} diag_stage_t;
+
+typedef enum {
+    DIAG_COUNTER_DHT_TIMEOUT = 0,
+    DIAG_COUNTER_DHT_CRC,
+    DIAG_COUNTER_QUEUE_DROP,    /*!< samples dropped because a source queue was full */
+    DIAG_COUNTER_DEADBAND_SUPPRESSED,   /*!< values not published because they stayed within their deadband */
+    DIAG_COUNTER_DHT_REJECTED,  /*!< DHT22 values dropped by the sample filter, see filter.h */
+    DIAG_COUNTER_COUNT,
+} diag_counter_t;
+
+typedef enum {
+    DIAG_DHT_ERROR_TIMEOUT = 0,     /*!< also counted in DIAG_COUNTER_DHT_TIMEOUT */
+    DIAG_DHT_ERROR_CRC,             /*!< also counted in DIAG_COUNTER_DHT_CRC */
+    DIAG_DHT_ERROR_REJECTED,        /*!< also counted in DIAG_COUNTER_DHT_REJECTED */
+    DIAG_DHT_ERROR_COUNT,
+} diag_dht_error_t;
+
+typedef enum {
+    DIAG_GAUGE_WIFI_DOWNTIME_MS = 0,    /*!< time without WiFi since boot, after the first connect */
+    DIAG_GAUGE_WIFI_LONGEST_OUTAGE_MS,
+    DIAG_GAUGE_WIFI_OUTAGES,
+    DIAG_GAUGE_MQTT_DOWNTIME_MS,        /*!< time without a broker connection since boot, after the first connect */
+    DIAG_GAUGE_MQTT_LONGEST_OUTAGE_MS,
+    DIAG_GAUGE_MQTT_OUTAGES,
+    DIAG_GAUGE_COUNT,
+} diag_gauge_t;
+
+typedef enum {
+    DIAG_MILESTONE_IP = 0,          /*!< boot (or wake from deep sleep) to the first IP address */
+    DIAG_MILESTONE_FIRST_PUBACK,    /*!< boot (or wake from deep sleep) to the first PUBACK */
+    DIAG_MILESTONE_COUNT,
+} diag_milestone_t;
+
+typedef struct {
+    uint32_t count;
+    uint32_t max_us;
+    uint64_t sum_us;
+    uint16_t buckets[DIAG_BUCKETS];     /*!< saturate at UINT16_MAX */
+} diag_histogram_t;
+
+typedef struct {
+    uint32_t uptime_s;
+    uint32_t free_heap;
+    uint32_t min_free_heap;
+    uint32_t counters[DIAG_COUNTER_COUNT];          /*!< totals since boot */
+    uint32_t gauges[DIAG_GAUGE_COUNT];              /*!< last value set */
+    uint32_t milestones_ms[DIAG_MILESTONE_COUNT];   /*!< 0 until reached */
+    diag_histogram_t stages[DIAG_STAGE_COUNT];      /*!< since the previous snapshot */
+    uint8_t dht_sensors;                            /*!< valid rows of dht_errors */
+    uint32_t dht_errors[DIAG_DHT_SENSORS_MAX][DIAG_DHT_ERROR_COUNT];    /*!< totals since boot, per sensor */
+} diag_snapshot_t;
+
+/**
+ * @brief Start timestamp for diag_record()
+ */
+int64_t diag_start(void);
+
+/**
+ * @brief Add the time elapsed since start_us to the histogram of a stage
+ */
+void diag_record(diag_stage_t stage, int64_t start_us);
+
+/**
+ * @brief Increment an error counter
+ */
+void diag_count(diag_counter_t counter);
+
+/**
+ * @brief Increment the error counter of one DHT22 sensor and the matching total
+ */
+void diag_count_dht(uint8_t sensor, diag_dht_error_t error);
+
+/**
+ * @brief Set a gauge to its current value
+ */
+void diag_gauge(diag_gauge_t gauge, uint32_t value);
+
+/**
+ * @brief Record the time since boot of a milestone, only the first call per milestone counts
+ *
+ * @return true if this call recorded the milestone
+ */
+bool diag_milestone(diag_milestone_t milestone);
+
+/**
+ * @brief Time since boot at which a milestone was reached, 0 if not reached yet
+ */
+uint32_t diag_milestone_ms(diag_milestone_t milestone);
+
+/**
+ * @brief Remember when a QoS1 publish with this message id was sent
+ */
+void diag_publish_sent(int msg_id);
+
+/**
+ * @brief Record the PUBACK latency of a message id passed to diag_publish_sent()
+ */
+void diag_publish_acked(int msg_id);
+
+/**
+ * @brief Copy the current values and start new stage histograms
+ */
+void diag_snapshot(diag_snapshot_t *snapshot);
+
+#endif // __DIAG_H__
@@ -0,0 +1,102 @@
+#include "duty_cycle.h"
+
+static void enter(duty_cycle_t *cycle, duty_cycle_state_t state, uint32_t now_ms)
+{
+    cycle->state = state;
+    cycle->state_entered_ms = now_ms;
+}
+
+static void finish(duty_cycle_t *cycle, duty_cycle_result_t result, uint32_t now_ms)
+{
+    cycle->result = result;
+    cycle->awake_ms = now_ms - cycle->wake_ms;
+    enter(cycle, DUTY_CYCLE_SLEEP, now_ms);
+}
+
+void duty_cycle_start(duty_cycle_t *cycle, const duty_cycle_config_t *config, uint32_t now_ms)
+{
+    cycle->config = *config;
+    cycle->result = DUTY_CYCLE_RESULT_NONE;
+    cycle->wake_ms = now_ms;
+    cycle->awake_ms = 0;
+    enter(cycle, DUTY_CYCLE_SAMPLE, now_ms);
+}
+
+duty_cycle_state_t duty_cycle_update(duty_cycle_t *cycle, const duty_cycle_inputs_t *inputs, uint32_t now_ms)
+{
+    const duty_cycle_config_t *config = &cycle->config;
+
+    if (cycle->state == DUTY_CYCLE_SLEEP) {
+        return cycle->state;
+    }
+
+    if (now_ms - cycle->wake_ms >= config->max_awake_ms) {
+        finish(cycle, DUTY_CYCLE_RESULT_AWAKE_TIMEOUT, now_ms);
+        return cycle->state;
+    }
+
+    switch (cycle->state) {
+        case DUTY_CYCLE_SAMPLE:
+            if (inputs->sampled) {
+                enter(cycle, DUTY_CYCLE_CONNECT, now_ms);
+            }
+            break;
+        case DUTY_CYCLE_CONNECT:
+            if (inputs->connected) {
+                enter(cycle, DUTY_CYCLE_PUBLISH, now_ms);
+            } else if (now_ms - cycle->wake_ms >= config->connect_timeout_ms) {
+                finish(cycle, DUTY_CYCLE_RESULT_CONNECT_TIMEOUT, now_ms);
+            }
+            break;
+        case DUTY_CYCLE_PUBLISH:
+            if (inputs->published) {
+                enter(cycle, DUTY_CYCLE_WAIT_ACKS, now_ms);
+            }
+            break;
+        case DUTY_CYCLE_WAIT_ACKS:
+            if (inputs->pending_acks == 0) {
+                finish(cycle, DUTY_CYCLE_RESULT_OK, now_ms);
+            } else if (now_ms - cycle->state_entered_ms >= config->ack_timeout_ms) {
+                finish(cycle, DUTY_CYCLE_RESULT_ACK_TIMEOUT, now_ms);
+            }
+            break;
+        default:
+            break;
+    }
+
+    return cycle->state;
+}
+
+uint32_t duty_cycle_sleep_ms(const duty_cycle_t *cycle)
+{
+    const duty_cycle_config_t *config = &cycle->config;
+
+    if (cycle->awake_ms + config->min_sleep_ms >= config->period_ms) {
+        return config->min_sleep_ms;
+    }
+
+    return config->period_ms - cycle->awake_ms;
+}
+
+uint32_t duty_cycle_projected_hours(const duty_cycle_power_t *power, uint32_t awake_ms, uint32_t period_ms)
+{
+    if (period_ms == 0) {
+        return 0;
+    }
+
+    if (awake_ms > period_ms) {
+        awake_ms = period_ms;
+    }
+
+    // average current in nA over one period, 64-bit to keep the ms * uA products from overflowing
+    uint64_t charge = (uint64_t)power->active_current_ua * awake_ms +
+                      (uint64_t)power->sleep_current_ua * (period_ms - awake_ms);
+    uint64_t average_na = charge * 1000 / period_ms;
+
+    if (average_na == 0) {
+        return UINT32_MAX;
+    }
+
+    // mAh -> nAh, divided by the average draw in nA
+    return (uint32_t)((uint64_t)power->capacity_mah * 1000000 / average_na);
+}
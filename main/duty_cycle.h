@@ -0,0 +1,81 @@
+#ifndef __DUTY_CYCLE_H__
+#define __DUTY_CYCLE_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Wake -> sample -> publish -> sleep state machine for battery nodes. It does not touch any hardware: the caller
+ * performs the action for the returned state, reports what happened through duty_cycle_inputs_t and passes the
+ * current time, so the same code runs on the device and against a simulated clock on the host.
+ */
+
+typedef enum {
+    DUTY_CYCLE_SAMPLE = 0,  /*!< take one reading from every sensor */
+    DUTY_CYCLE_CONNECT,     /*!< bring up WiFi and MQTT */
+    DUTY_CYCLE_PUBLISH,     /*!< publish the readings */
+    DUTY_CYCLE_WAIT_ACKS,   /*!< wait for the QoS1 PUBACKs */
+    DUTY_CYCLE_SLEEP,       /*!< done, enter deep sleep */
+} duty_cycle_state_t;
+
+typedef enum {
+    DUTY_CYCLE_RESULT_NONE = 0,         /*!< cycle still running */
+    DUTY_CYCLE_RESULT_OK,               /*!< all publishes acknowledged */
+    DUTY_CYCLE_RESULT_CONNECT_TIMEOUT,  /*!< no broker connection within connect_timeout_ms */
+    DUTY_CYCLE_RESULT_ACK_TIMEOUT,      /*!< published, but not every PUBACK arrived within ack_timeout_ms */
+    DUTY_CYCLE_RESULT_AWAKE_TIMEOUT,    /*!< max_awake_ms budget exhausted */
+} duty_cycle_result_t;
+
+typedef struct {
+    uint32_t period_ms;             /*!< wake-to-wake period */
+    uint32_t min_sleep_ms;          /*!< lower bound on sleep when a cycle overruns the period */
+    uint32_t connect_timeout_ms;    /*!< measured from wake-up */
+    uint32_t ack_timeout_ms;        /*!< measured from the end of the publish */
+    uint32_t max_awake_ms;          /*!< hard cap on awake time per cycle */
+} duty_cycle_config_t;
+
+typedef struct {
+    bool sampled;
+    bool connected;
+    bool published;
+    uint32_t pending_acks;
+} duty_cycle_inputs_t;
+
+typedef struct {
+    duty_cycle_config_t config;
+    duty_cycle_state_t state;
+    duty_cycle_result_t result;
+    uint32_t wake_ms;
+    uint32_t state_entered_ms;
+    uint32_t awake_ms;              /*!< valid once state is DUTY_CYCLE_SLEEP */
+} duty_cycle_t;
+
+typedef struct {
+    uint32_t active_current_ua;     /*!< average draw while awake with the radio on */
+    uint32_t sleep_current_ua;      /*!< deep sleep draw including the sensors */
+    uint32_t capacity_mah;
+} duty_cycle_power_t;
+
+void duty_cycle_start(duty_cycle_t *cycle, const duty_cycle_config_t *config, uint32_t now_ms);
+
+/**
+ * @brief Advance the state machine
+ *
+ * @param cycle state machine
+ * @param inputs what the caller has achieved so far in this cycle
+ * @param now_ms monotonic time in ms, same clock as passed to duty_cycle_start()
+ * @return the state whose action the caller has to perform next
+ */
+duty_cycle_state_t duty_cycle_update(duty_cycle_t *cycle, const duty_cycle_inputs_t *inputs, uint32_t now_ms);
+
+/**
+ * @brief Time to stay in deep sleep so the next wake-up lands on the period boundary
+ */
+uint32_t duty_cycle_sleep_ms(const duty_cycle_t *cycle);
+
+/**
+ * @brief Projected battery life in hours for a given awake time per period
+ */
+uint32_t duty_cycle_projected_hours(const duty_cycle_power_t *power, uint32_t awake_ms, uint32_t period_ms);
+
+#endif // __DUTY_CYCLE_H__
@@ -0,0 +1,585 @@
+#include <string.h>
+
+#include "ed25519.h"
+
+/*
+ * Field elements mod 2^255 - 19 as 16 limbs of 16 bits in int64_t, points in extended coordinates (X, Y, Z, T).
+ * The arithmetic is the one of TweetNaCl, which is in the public domain.
+ */
+typedef int64_t gf[16];
+
+static const gf gf0 = { 0 };
+static const gf gf1 = { 1 };
+static const gf D = {
+        0x78a3, 0x1359, 0x4dca, 0x75eb, 0xd8ab, 0x4141, 0x0a4d, 0x0070,
+        0xe898, 0x7779, 0x4079, 0x8cc7, 0xfe73, 0x2b6f, 0x6cee, 0x5203,
+};
+static const gf D2 = {
+        0xf159, 0x26b2, 0x9b94, 0xebd6, 0xb156, 0x8283, 0x149a, 0x00e0,
+        0xd130, 0xeef3, 0x80f2, 0x198e, 0xfce7, 0x56df, 0xd9dc, 0x2406,
+};
+static const gf X = {
+        0xd51a, 0x8f25, 0x2d60, 0xc956, 0xa7b2, 0x9525, 0xc760, 0x692c,
+        0xdc5c, 0xfdd6, 0xe231, 0xc0a4, 0x53fe, 0xcd6e, 0x36d3, 0x2169,
+};
+static const gf Y = {
+        0x6658, 0x6666, 0x6666, 0x6666, 0x6666, 0x6666, 0x6666, 0x6666,
+        0x6666, 0x6666, 0x6666, 0x6666, 0x6666, 0x6666, 0x6666, 0x6666,
+};
+static const gf I = {
+        0xa0b0, 0x4a0e, 0x1b27, 0xc4ee, 0xe478, 0xad2f, 0x1806, 0x2f43,
+        0xd7a7, 0x3dfb, 0x0099, 0x2b4d, 0xdf0b, 0x4fc1, 0x2480, 0x2b83,
+};
+
+/* Order of the base point, little endian */
+static const uint8_t L[32] = {
+        0xed, 0xd3, 0xf5, 0x5c, 0x1a, 0x63, 0x12, 0x58, 0xd6, 0x9c, 0xf7, 0xa2, 0xde, 0xf9, 0xde, 0x14,
+        0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x10,
+};
+
+static const uint64_t sha512_k[80] = {
+        0x428a2f98d728ae22, 0x7137449123ef65cd, 0xb5c0fbcfec4d3b2f, 0xe9b5dba58189dbbc, 0x3956c25bf348b538,
+        0x59f111f1b605d019, 0x923f82a4af194f9b, 0xab1c5ed5da6d8118, 0xd807aa98a3030242, 0x12835b0145706fbe,
+        0x243185be4ee4b28c, 0x550c7dc3d5ffb4e2, 0x72be5d74f27b896f, 0x80deb1fe3b1696b1, 0x9bdc06a725c71235,
+        0xc19bf174cf692694, 0xe49b69c19ef14ad2, 0xefbe4786384f25e3, 0x0fc19dc68b8cd5b5, 0x240ca1cc77ac9c65,
+        0x2de92c6f592b0275, 0x4a7484aa6ea6e483, 0x5cb0a9dcbd41fbd4, 0x76f988da831153b5, 0x983e5152ee66dfab,
+        0xa831c66d2db43210, 0xb00327c898fb213f, 0xbf597fc7beef0ee4, 0xc6e00bf33da88fc2, 0xd5a79147930aa725,
+        0x06ca6351e003826f, 0x142929670a0e6e70, 0x27b70a8546d22ffc, 0x2e1b21385c26c926, 0x4d2c6dfc5ac42aed,
+        0x53380d139d95b3df, 0x650a73548baf63de, 0x766a0abb3c77b2a8, 0x81c2c92e47edaee6, 0x92722c851482353b,
+        0xa2bfe8a14cf10364, 0xa81a664bbc423001, 0xc24b8b70d0f89791, 0xc76c51a30654be30, 0xd192e819d6ef5218,
+        0xd69906245565a910, 0xf40e35855771202a, 0x106aa07032bbd1b8, 0x19a4c116b8d2d0c8, 0x1e376c085141ab53,
+        0x2748774cdf8eeb99, 0x34b0bcb5e19b48a8, 0x391c0cb3c5c95a63, 0x4ed8aa4ae3418acb, 0x5b9cca4f7763e373,
+        0x682e6ff3d6b2b8a3, 0x748f82ee5defb2fc, 0x78a5636f43172f60, 0x84c87814a1f0ab72, 0x8cc702081a6439ec,
+        0x90befffa23631e28, 0xa4506cebde82bde9, 0xbef9a3f7b2c67915, 0xc67178f2e372532b, 0xca273eceea26619c,
+        0xd186b8c721c0c207, 0xeada7dd6cde0eb1e, 0xf57d4f7fee6ed178, 0x06f067aa72176fba, 0x0a637dc5a2c898a6,
+        0x113f9804bef90dae, 0x1b710b35131c471b, 0x28db77f523047d84, 0x32caab7b40c72493, 0x3c9ebe0a15c9bebc,
+        0x431d67c49c100d4c, 0x4cc5d4becb3e42b6, 0x597f299cfc657e2a, 0x5fcb6fab3ad6faec, 0x6c44198c4a475817,
+};
+
+/* == SHA-512 ============================================================= */
+
+static uint64_t ror64(uint64_t x, int n)
+{
+    return x >> n | x << (64 - n);
+}
+
+static uint64_t get_be64(const uint8_t *bytes)
+{
+    uint64_t value = 0;
+
+    for (int i = 0; i < 8; i++) {
+        value = value << 8 | bytes[i];
+    }
+    return value;
+}
+
+static void put_be64(uint8_t *bytes, uint64_t value)
+{
+    for (int i = 7; i >= 0; i--) {
+        bytes[i] = (uint8_t)value;
+        value >>= 8;
+    }
+}
+
+static void sha512_block(ed25519_sha512_t *sha, const uint8_t *block)
+{
+    uint64_t w[16];
+    uint64_t v[8];
+
+    for (int i = 0; i < 16; i++) {
+        w[i] = get_be64(block + 8 * i);
+    }
+    memcpy(v, sha->state, sizeof(v));
+
+    // the message schedule in a ring of 16 words instead of 80
+    for (int i = 0; i < 80; i++) {
+        if (i >= 16) {
+            uint64_t w15 = w[(i - 15) & 15];
+            uint64_t w2 = w[(i - 2) & 15];
+
+            w[i & 15] += (ror64(w15, 1) ^ ror64(w15, 8) ^ w15 >> 7) + w[(i - 7) & 15] +
+                         (ror64(w2, 19) ^ ror64(w2, 61) ^ w2 >> 6);
+        }
+
+        uint64_t t1 = v[7] + (ror64(v[4], 14) ^ ror64(v[4], 18) ^ ror64(v[4], 41)) +
+                      ((v[4] & v[5]) ^ (~v[4] & v[6])) + sha512_k[i] + w[i & 15];
+        uint64_t t2 = (ror64(v[0], 28) ^ ror64(v[0], 34) ^ ror64(v[0], 39)) +
+                      ((v[0] & v[1]) ^ (v[0] & v[2]) ^ (v[1] & v[2]));
+
+        memmove(&v[1], &v[0], 7 * sizeof(v[0]));
+        v[4] += t1;
+        v[0] = t1 + t2;
+    }
+
+    for (int i = 0; i < 8; i++) {
+        sha->state[i] += v[i];
+    }
+}
+
+void ed25519_sha512_init(ed25519_sha512_t *sha)
+{
+    static const uint64_t iv[8] = {
+            0x6a09e667f3bcc908, 0xbb67ae8584caa73b, 0x3c6ef372fe94f82b, 0xa54ff53a5f1d36f1,
+            0x510e527fade682d1, 0x9b05688c2b3e6c1f, 0x1f83d9abfb41bd6b, 0x5be0cd19137e2179,
+    };
+
+    memcpy(sha->state, iv, sizeof(iv));
+    sha->bytes = 0;
+}
+
+void ed25519_sha512_update(ed25519_sha512_t *sha, const void *data, size_t len)
+{
+    const uint8_t *bytes = data;
+
+    while (len > 0) {
+        size_t used = (size_t)(sha->bytes % sizeof(sha->block));
+        size_t take = sizeof(sha->block) - used < len ? sizeof(sha->block) - used : len;
+
+        memcpy(sha->block + used, bytes, take);
+        sha->bytes += take;
+        bytes += take;
+        len -= take;
+        if (used + take == sizeof(sha->block)) {
+            sha512_block(sha, sha->block);
+        }
+    }
+}
+
+void ed25519_sha512_finish(ed25519_sha512_t *sha, uint8_t *digest)
+{
+    size_t used = (size_t)(sha->bytes % sizeof(sha->block));
+
+    // a one bit, zeros and the length in bits, in a second block if it no longer fits
+    sha->block[used++] = 0x80;
+    if (used > sizeof(sha->block) - 16) {
+        memset(sha->block + used, 0, sizeof(sha->block) - used);
+        sha512_block(sha, sha->block);
+        used = 0;
+    }
+    memset(sha->block + used, 0, sizeof(sha->block) - 8 - used);
+    put_be64(sha->block + sizeof(sha->block) - 8, sha->bytes << 3);
+    sha512_block(sha, sha->block);
+
+    for (int i = 0; i < 8; i++) {
+        put_be64(digest + 8 * i, sha->state[i]);
+    }
+}
+
+/* == Field arithmetic ==================================================== */
+
+static void set25519(gf r, const gf a)
+{
+    memcpy(r, a, sizeof(gf));
+}
+
+static void car25519(gf o)
+{
+    for (int i = 0; i < 16; i++) {
+        o[i] += (int64_t)1 << 16;
+        int64_t c = o[i] >> 16;
+        // the carry out of the top limb wraps around times 38: 2^256 = 38 mod p
+        o[(i + 1) * (i < 15)] += c - 1 + 37 * (c - 1) * (i == 15);
+        o[i] -= c * 65536;
+    }
+}
+
+static void sel25519(gf p, gf q, int b)
+{
+    int64_t c = ~(int64_t)(b - 1);
+
+    for (int i = 0; i < 16; i++) {
+        int64_t t = c & (p[i] ^ q[i]);
+        p[i] ^= t;
+        q[i] ^= t;
+    }
+}
+
+static void pack25519(uint8_t *o, const gf n)
+{
+    gf m, t;
+
+    set25519(t, n);
+    car25519(t);
+    car25519(t);
+    car25519(t);
+    for (int j = 0; j < 2; j++) {
+        m[0] = t[0] - 0xffed;
+        for (int i = 1; i < 15; i++) {
+            m[i] = t[i] - 0xffff - ((m[i - 1] >> 16) & 1);
+            m[i - 1] &= 0xffff;
+        }
+        m[15] = t[15] - 0x7fff - ((m[14] >> 16) & 1);
+        int b = (int)((m[15] >> 16) & 1);
+        m[14] &= 0xffff;
+        sel25519(t, m, 1 - b);
+    }
+    for (int i = 0; i < 16; i++) {
+        o[2 * i] = (uint8_t)t[i];
+        o[2 * i + 1] = (uint8_t)(t[i] >> 8);
+    }
+}
+
+static bool neq25519(const gf a, const gf b)
+{
+    uint8_t c[32], d[32];
+
+    pack25519(c, a);
+    pack25519(d, b);
+    return memcmp(c, d, sizeof(c)) != 0;
+}
+
+static uint8_t par25519(const gf a)
+{
+    uint8_t d[32];
+
+    pack25519(d, a);
+    return d[0] & 1;
+}
+
+static void unpack25519(gf o, const uint8_t *n)
+{
+    for (int i = 0; i < 16; i++) {
+        o[i] = n[2 * i] + ((int64_t)n[2 * i + 1] << 8);
+    }
+    o[15] &= 0x7fff;
+}
+
+static void add25519(gf o, const gf a, const gf b)
+{
+    for (int i = 0; i < 16; i++) {
+        o[i] = a[i] + b[i];
+    }
+}
+
+static void sub25519(gf o, const gf a, const gf b)
+{
+    for (int i = 0; i < 16; i++) {
+        o[i] = a[i] - b[i];
+    }
+}
+
+static void mul25519(gf o, const gf a, const gf b)
+{
+    int64_t t[31] = { 0 };
+
+    for (int i = 0; i < 16; i++) {
+        for (int j = 0; j < 16; j++) {
+            t[i + j] += a[i] * b[j];
+        }
+    }
+    for (int i = 0; i < 15; i++) {
+        t[i] += 38 * t[i + 16];
+    }
+    memcpy(o, t, sizeof(gf));
+    car25519(o);
+    car25519(o);
+}
+
+static void sq25519(gf o, const gf a)
+{
+    mul25519(o, a, a);
+}
+
+static void inv25519(gf o, const gf i)
+{
+    gf c;
+
+    // i^(p - 2)
+    set25519(c, i);
+    for (int a = 253; a >= 0; a--) {
+        sq25519(c, c);
+        if (a != 2 && a != 4) {
+            mul25519(c, c, i);
+        }
+    }
+    set25519(o, c);
+}
+
+static void pow2523(gf o, const gf i)
+{
+    gf c;
+
+    // i^((p - 5) / 8), for the square root
+    set25519(c, i);
+    for (int a = 250; a >= 0; a--) {
+        sq25519(c, c);
+        if (a != 1) {
+            mul25519(c, c, i);
+        }
+    }
+    set25519(o, c);
+}
+
+/* == Points ============================================================== */
+
+static void point_add(gf p[4], gf q[4])
+{
+    gf a, b, c, d, t, e, f, g, h;
+
+    sub25519(a, p[1], p[0]);
+    sub25519(t, q[1], q[0]);
+    mul25519(a, a, t);
+    add25519(b, p[0], p[1]);
+    add25519(t, q[0], q[1]);
+    mul25519(b, b, t);
+    mul25519(c, p[3], q[3]);
+    mul25519(c, c, D2);
+    mul25519(d, p[2], q[2]);
+    add25519(d, d, d);
+    sub25519(e, b, a);
+    sub25519(f, d, c);
+    add25519(g, d, c);
+    add25519(h, b, a);
+
+    mul25519(p[0], e, f);
+    mul25519(p[1], h, g);
+    mul25519(p[2], g, f);
+    mul25519(p[3], e, h);
+}
+
+static void point_swap(gf p[4], gf q[4], uint8_t b)
+{
+    for (int i = 0; i < 4; i++) {
+        sel25519(p[i], q[i], b);
+    }
+}
+
+static void point_pack(uint8_t *r, gf p[4])
+{
+    gf tx, ty, zi;
+
+    inv25519(zi, p[2]);
+    mul25519(tx, p[0], zi);
+    mul25519(ty, p[1], zi);
+    pack25519(r, ty);
+    r[31] ^= par25519(tx) << 7;
+}
+
+/* p = s * q, s a 32 byte little endian scalar; q is used up */
+static void scalar_mult(gf p[4], gf q[4], const uint8_t *s)
+{
+    set25519(p[0], gf0);
+    set25519(p[1], gf1);
+    set25519(p[2], gf1);
+    set25519(p[3], gf0);
+    for (int i = 255; i >= 0; i--) {
+        uint8_t b = (s[i / 8] >> (i & 7)) & 1;
+
+        point_swap(p, q, b);
+        point_add(q, p);
+        point_add(p, p);
+        point_swap(p, q, b);
+    }
+}
+
+static void scalar_base(gf p[4], const uint8_t *s)
+{
+    gf q[4];
+
+    set25519(q[0], X);
+    set25519(q[1], Y);
+    set25519(q[2], gf1);
+    mul25519(q[3], X, Y);
+    scalar_mult(p, q, s);
+}
+
+/* The negated point of a public key, false if the 32 bytes are not a point of the curve */
+static bool point_unpack_neg(gf r[4], const uint8_t *p)
+{
+    gf t, chk, num, den, den2, den4, den6;
+
+    set25519(r[2], gf1);
+    unpack25519(r[1], p);
+    sq25519(num, r[1]);
+    mul25519(den, num, D);
+    sub25519(num, num, r[2]);
+    add25519(den, r[2], den);
+
+    sq25519(den2, den);
+    sq25519(den4, den2);
+    mul25519(den6, den4, den2);
+    mul25519(t, den6, num);
+    mul25519(t, t, den);
+
+    pow2523(t, t);
+    mul25519(t, t, num);
+    mul25519(t, t, den);
+    mul25519(t, t, den);
+    mul25519(r[0], t, den);
+
+    sq25519(chk, r[0]);
+    mul25519(chk, chk, den);
+    if (neq25519(chk, num)) {
+        mul25519(r[0], r[0], I);
+    }
+
+    sq25519(chk, r[0]);
+    mul25519(chk, chk, den);
+    if (neq25519(chk, num)) {
+        return false;
+    }
+
+    if (par25519(r[0]) == (p[31] >> 7)) {
+        sub25519(r[0], gf0, r[0]);
+    }
+    mul25519(r[3], r[0], r[1]);
+    return true;
+}
+
+/* == Scalars mod L ======================================================= */
+
+static void mod_l(uint8_t *r, int64_t x[64])
+{
+    int64_t carry;
+
+    for (int i = 63; i >= 32; i--) {
+        int j;
+
+        carry = 0;
+        for (j = i - 32; j < i - 12; j++) {
+            x[j] += carry - 16 * x[i] * L[j - (i - 32)];
+            carry = (x[j] + 128) >> 8;
+            x[j] -= carry * 256;
+        }
+        x[j] += carry;
+        x[i] = 0;
+    }
+
+    carry = 0;
+    for (int j = 0; j < 32; j++) {
+        x[j] += carry - (x[31] >> 4) * L[j];
+        carry = x[j] >> 8;
+        x[j] &= 255;
+    }
+    for (int j = 0; j < 32; j++) {
+        x[j] -= carry * L[j];
+    }
+    for (int i = 0; i < 32; i++) {
+        x[i + 1] += x[i] >> 8;
+        r[i] = (uint8_t)(x[i] & 255);
+    }
+}
+
+/* A 64 byte hash reduced mod L, into its first 32 bytes */
+static void reduce(uint8_t *r)
+{
+    int64_t x[64];
+
+    for (int i = 0; i < 64; i++) {
+        x[i] = r[i];
+    }
+    memset(r, 0, 64);
+    mod_l(r, x);
+}
+
+/* S of a signature must be below L, otherwise the same signature has a second valid form */
+static bool scalar_canonical(const uint8_t *s)
+{
+    for (int i = 31; i >= 0; i--) {
+        if (s[i] != L[i]) {
+            return s[i] < L[i];
+        }
+    }
+    return false;
+}
+
+/* == Signatures ========================================================== */
+
+void ed25519_verify_start(ed25519_verify_t *verify, const uint8_t *public_key, const uint8_t *signature)
+{
+    memcpy(verify->signature, signature, ED25519_SIGNATURE_SIZE);
+    memcpy(verify->public_key, public_key, ED25519_PUBLIC_KEY_SIZE);
+
+    // h = SHA-512(R || A || M)
+    ed25519_sha512_init(&verify->hash);
+    ed25519_sha512_update(&verify->hash, signature, 32);
+    ed25519_sha512_update(&verify->hash, public_key, ED25519_PUBLIC_KEY_SIZE);
+}
+
+void ed25519_verify_update(ed25519_verify_t *verify, const void *data, size_t len)
+{
+    ed25519_sha512_update(&verify->hash, data, len);
+}
+
+bool ed25519_verify_finish(ed25519_verify_t *verify)
+{
+    uint8_t h[64];
+    uint8_t r[32];
+    gf p[4], q[4];
+
+    ed25519_sha512_finish(&verify->hash, h);
+    if (!scalar_canonical(verify->signature + 32) || !point_unpack_neg(q, verify->public_key)) {
+        return false;
+    }
+
+    // S * B - h * A has to come out as R
+    reduce(h);
+    scalar_mult(p, q, h);
+    scalar_base(q, verify->signature + 32);
+    point_add(p, q);
+    point_pack(r, p);
+
+    return memcmp(r, verify->signature, sizeof(r)) == 0;
+}
+
+static void expand_seed(uint8_t *d, const uint8_t *seed)
+{
+    ed25519_sha512_t sha;
+
+    ed25519_sha512_init(&sha);
+    ed25519_sha512_update(&sha, seed, ED25519_SEED_SIZE);
+    ed25519_sha512_finish(&sha, d);
+    d[0] &= 248;
+    d[31] &= 127;
+    d[31] |= 64;
+}
+
+void ed25519_public_key(uint8_t *public_key, const uint8_t *seed)
+{
+    uint8_t d[64];
+    gf p[4];
+
+    expand_seed(d, seed);
+    scalar_base(p, d);
+    point_pack(public_key, p);
+}
+
+void ed25519_sign(uint8_t *signature, const uint8_t *seed, const void *message, size_t len)
+{
+    ed25519_sha512_t sha;
+    uint8_t d[64], r[64], h[64];
+    uint8_t public_key[ED25519_PUBLIC_KEY_SIZE];
+    int64_t x[64] = { 0 };
+    gf p[4];
+
+    expand_seed(d, seed);
+    scalar_base(p, d);
+    point_pack(public_key, p);
+
+    // r = SHA-512(prefix || M), R = r * B
+    ed25519_sha512_init(&sha);
+    ed25519_sha512_update(&sha, d + 32, 32);
+    ed25519_sha512_update(&sha, message, len);
+    ed25519_sha512_finish(&sha, r);
+    reduce(r);
+    scalar_base(p, r);
+    point_pack(signature, p);
+
+    // S = r + SHA-512(R || A || M) * a mod L
+    ed25519_sha512_init(&sha);
+    ed25519_sha512_update(&sha, signature, 32);
+    ed25519_sha512_update(&sha, public_key, sizeof(public_key));
+    ed25519_sha512_update(&sha, message, len);
+    ed25519_sha512_finish(&sha, h);
+    reduce(h);
+
+    for (int i = 0; i < 32; i++) {
+        x[i] = r[i];
+    }
+    for (int i = 0; i < 32; i++) {
+        for (int j = 0; j < 32; j++) {
+            x[i + j] += (int64_t)h[i] * d[j];
+        }
+    }
+    mod_l(signature + 32, x);
+}
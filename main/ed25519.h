@@ -0,0 +1,66 @@
+#ifndef __ED25519_H__
+#define __ED25519_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Ed25519 signatures (RFC 8032), for the update patches of main/delta.h. The node only verifies, against a public
+ * key built into the firmware; signing is for tools/delta_make.c and the host tests. The message is streamed
+ * through the verifier, so an image is checked as it is written and never has to fit in RAM.
+ *
+ * Portable C after TweetNaCl, with its own SHA-512: small rather than fast, a verify takes about 3 KB of stack and
+ * in the order of a second on the ESP32. Not constant time, which a verifier of public data does not need; the
+ * signing side runs on the host only. No ESP-IDF dependencies.
+ */
+
+#define ED25519_PUBLIC_KEY_SIZE     32
+#define ED25519_SEED_SIZE           32          /*!< the private key as openssl and RFC 8032 store it */
+#define ED25519_SIGNATURE_SIZE      64
+
+typedef struct {
+    uint64_t state[8];
+    uint64_t bytes;
+    uint8_t block[128];
+} ed25519_sha512_t;
+
+/* A verify in progress: the signature and key it is checked against, and the hash of R, the key and the message */
+typedef struct {
+    ed25519_sha512_t hash;
+    uint8_t signature[ED25519_SIGNATURE_SIZE];
+    uint8_t public_key[ED25519_PUBLIC_KEY_SIZE];
+} ed25519_verify_t;
+
+/**
+ * @brief Start checking a signature, the message then goes through ed25519_verify_update()
+ */
+void ed25519_verify_start(ed25519_verify_t *verify, const uint8_t *public_key, const uint8_t *signature);
+
+void ed25519_verify_update(ed25519_verify_t *verify, const void *data, size_t len);
+
+/**
+ * @brief After the last byte of the message: whether the signature is valid for it and the key
+ */
+bool ed25519_verify_finish(ed25519_verify_t *verify);
+
+/**
+ * @brief Sign a message held in memory, on the host
+ *
+ * @param seed the 32 byte private key
+ */
+void ed25519_sign(uint8_t *signature, const uint8_t *seed, const void *message, size_t len);
+
+/**
+ * @brief Public key of a private key
+ */
+void ed25519_public_key(uint8_t *public_key, const uint8_t *seed);
+
+/**
+ * @brief SHA-512, the hash Ed25519 is built on
+ */
+void ed25519_sha512_init(ed25519_sha512_t *sha);
+void ed25519_sha512_update(ed25519_sha512_t *sha, const void *data, size_t len);
+void ed25519_sha512_finish(ed25519_sha512_t *sha, uint8_t *digest);
+
+#endif // __ED25519_H__
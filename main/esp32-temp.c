@@ -1,24 +1,164 @@
 #include <stdio.h>
 
 #include "esp_system.h"
+#include "esp_sleep.h"
+#include "esp_timer.h"
+#include "esp_wifi.h"
 #include "nvs_flash.h"
 #include "esp_log.h"
+#include "esp_attr.h"
 
 #include "wifi.h"
 #include "mqtt.h"
 #include "dht22.h"
 #include "battery.h"
+#include "duty_cycle.h"
+#include "backlog.h"
+#include "publisher.h"
+#include "sensor.h"
+#include "diag.h"
+#include "connectivity.h"
+#include "remote_config.h"
+#include "ota.h"
+#include "mem_report.h"
+#include "bench.h"
 
 static const char *TAG = "TempSensor";
 
+#if CONFIG_ESP_DUTY_CYCLE_MODE
+
+#define DUTY_CYCLE_RTC_MAGIC    0x44435943  // "DCYC"
+
+/* Survives deep sleep, reset on power-on and on firmware changes */
+typedef struct {
+    uint32_t magic;
+    uint32_t seq;                   /*!< sequence number of the last published sample */
+    uint32_t cycles;
+    uint32_t last_awake_ms;
+    dht_reading_t last_dht;         /*!< last published values */
+    battery_reading_t last_battery;
+} duty_cycle_rtc_t;
+
+RTC_DATA_ATTR static duty_cycle_rtc_t rtc_state;
+
+static const duty_cycle_config_t duty_cycle_config = {
+        .period_ms = CONFIG_ESP_DUTY_CYCLE_PERIOD_SEC * 1000,
+        .min_sleep_ms = 1000,
+        .connect_timeout_ms = CONFIG_ESP_DUTY_CYCLE_CONNECT_TIMEOUT_MS,
+        .ack_timeout_ms = CONFIG_ESP_DUTY_CYCLE_ACK_TIMEOUT_MS,
+        .max_awake_ms = CONFIG_ESP_DUTY_CYCLE_MAX_AWAKE_MS,
+};
+
+static const duty_cycle_power_t duty_cycle_power = {
+        .active_current_ua = CONFIG_ESP_DUTY_CYCLE_ACTIVE_CURRENT_UA,
+        .sleep_current_ua = CONFIG_ESP_DUTY_CYCLE_SLEEP_CURRENT_UA,
+        .capacity_mah = CONFIG_ESP_DUTY_CYCLE_BATTERY_CAPACITY_MAH,
+};
+
+static uint32_t uptime_ms(void)
+{
+    return (uint32_t)(esp_timer_get_time() / 1000);
+}
+
+_Noreturn static void duty_cycle_run(void)
+{
+    duty_cycle_t cycle;
+    duty_cycle_inputs_t inputs = { 0 };
+    duty_cycle_state_t state;
+    dht_reading_t dht_reading;
+    battery_reading_t battery_reading;
+    bool have_dht = false;
+    bool have_battery = false;
+
+    if (rtc_state.magic != DUTY_CYCLE_RTC_MAGIC) {
+        rtc_state = (duty_cycle_rtc_t) { .magic = DUTY_CYCLE_RTC_MAGIC };
+    }
+
+    // association and the broker connect run in the background while the sensors are read
+    ESP_ERROR_CHECK(wifi_init_sta());
+    ESP_ERROR_CHECK(mqtt5_init());
+    ESP_ERROR_CHECK(connectivity_start());
+
+    duty_cycle_start(&cycle, &duty_cycle_config, uptime_ms());
+
+    while ((state = duty_cycle_update(&cycle, &inputs, uptime_ms())) != DUTY_CYCLE_SLEEP) {
+        switch (state) {
+            case DUTY_CYCLE_SAMPLE:
+                have_dht = dht_read_once(&dht_reading) == ESP_OK;
+                have_battery = battery_read_once(&battery_reading) == ESP_OK;
+                if (have_dht || have_battery) {
+                    rtc_state.seq++;
+                }
+                inputs.sampled = true;
+                break;
+            case DUTY_CYCLE_CONNECT:
+                inputs.connected = mqtt5_wait_connected(pdMS_TO_TICKS(50));
+                break;
+            case DUTY_CYCLE_PUBLISH:
+                mqtt5_publish_readings(rtc_state.seq, have_dht ? &dht_reading : NULL,
+                                       have_battery ? &battery_reading : NULL);
+                if (have_dht) {
+                    rtc_state.last_dht = dht_reading;
+                }
+                if (have_battery) {
+                    rtc_state.last_battery = battery_reading;
+                }
+                inputs.published = true;
+                break;
+            case DUTY_CYCLE_WAIT_ACKS:
+#if CONFIG_ESP_STORE_FORWARD
+                // drain what earlier cycles could not publish while the acks are coming in
+                mqtt5_publish_backlog();
+#endif
+                vTaskDelay(pdMS_TO_TICKS(10));
+                inputs.pending_acks = mqtt5_pending_acks();
+                break;
+            default:
+                break;
+        }
+    }
+
+#if CONFIG_ESP_STORE_FORWARD
+    if (!inputs.published) {
+        mqtt5_store_readings(rtc_state.seq, have_dht ? &dht_reading : NULL, have_battery ? &battery_reading : NULL);
+    }
+#endif
+
+    rtc_state.cycles++;
+    rtc_state.last_awake_ms = cycle.awake_ms;
+
+    uint32_t sleep_ms = duty_cycle_sleep_ms(&cycle);
+    ESP_LOGI(TAG, "[APP] Cycle %" PRIu32 " (seq %" PRIu32 ") result %d, awake %" PRIu32 " ms, sleeping %" PRIu32 " ms",
+             rtc_state.cycles, rtc_state.seq, cycle.result, cycle.awake_ms, sleep_ms);
+    ESP_LOGI(TAG, "[APP] Boot to IP %" PRIu32 " ms, boot to first PUBACK %" PRIu32 " ms",
+             diag_milestone_ms(DIAG_MILESTONE_IP), diag_milestone_ms(DIAG_MILESTONE_FIRST_PUBACK));
+    ESP_LOGI(TAG, "[APP] Projected battery life: %" PRIu32 " h",
+             duty_cycle_projected_hours(&duty_cycle_power, cycle.awake_ms, duty_cycle_config.period_ms));
+
+    connectivity_stop();
+    mqtt5_stop();
+    esp_wifi_stop();
+
+    esp_sleep_enable_timer_wakeup((uint64_t)sleep_ms * 1000);
+    esp_deep_sleep_start();
+}
+
+#endif
+
 void app_main(void)
 {
+    mem_report_boot();
     ESP_LOGI(TAG, "[APP] Startup..");
     ESP_LOGI(TAG, "[APP] Free memory: %" PRIu32 " bytes", esp_get_free_heap_size());
     ESP_LOGI(TAG, "[APP] IDF version: %s", esp_get_idf_version());
 
     esp_log_level_set("*", ESP_LOG_INFO);
 
+#if CONFIG_ESP_BENCHMARK
+    // before any other task exists, nothing competes for the CPU
+    bench_run_all(CONFIG_ESP_BENCHMARK_ITERATIONS);
+#endif
+
     //Initialize NVS
     esp_err_t ret = nvs_flash_init();
     if (ret == ESP_ERR_NVS_NO_FREE_PAGES || ret == ESP_ERR_NVS_NEW_VERSION_FOUND) {
@@ -26,8 +166,39 @@ void app_main(void)
         ret = nvs_flash_init();
     }
     ESP_ERROR_CHECK(ret);
+
+    // settings changed over MQTT before the last reboot, in place before any driver starts
+    ESP_ERROR_CHECK(remote_config_init());
+
+#if CONFIG_ESP_OTA
+    // before the first PUBACK, which confirms a new image
+    ESP_ERROR_CHECK(ota_init());
+#endif
+
+#if CONFIG_ESP_STORE_FORWARD
+    ESP_ERROR_CHECK(backlog_init());
+#endif
+
+#if CONFIG_ESP_DUTY_CYCLE_MODE
+    duty_cycle_run();
+#else
+    /*
+     * Nothing here waits for the network:
+     * - wifi_init_sta() starts association and returns, the radio works in the background
+     * - sensor bring-up overlaps with it and sampling starts right away
+     * - the connectivity manager connects to the broker once the station has an IP, readings taken until then
+     *   wait in the publisher queues (or the backlog with store and forward) and are published after the connect
+     */
+    ESP_ERROR_CHECK(publisher_init());
     ESP_ERROR_CHECK(wifi_init_sta());
+    for (size_t i = 0; i < ESP_DHT_SENSOR_COUNT; i++) {
+        ESP_ERROR_CHECK(sensor_register(&dht22_drivers[i]));
+    }
+    // the battery monitor is optional, without it only the DHT22 is sampled
+    sensor_register(&max17048_driver);
+    ESP_ERROR_CHECK(sensor_scheduler_start());
     ESP_ERROR_CHECK(mqtt5_init());
-    ESP_ERROR_CHECK(dht_init());
-    ESP_ERROR_CHECK(battery_init());
+    ESP_ERROR_CHECK(connectivity_start());
+    mem_report_start();
+#endif
 }
@@ -0,0 +1,201 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "filter.h"
+
+#define KALMAN_SCALE    16      /* estimate resolution, 1/16 of a unit */
+
+/* a / b rounded to nearest, b > 0 */
+static int64_t div_round(int64_t a, int64_t b)
+{
+    return a >= 0 ? (a + b / 2) / b : -((-a + b / 2) / b);
+}
+
+static uint32_t isqrt(uint64_t value)
+{
+    uint64_t root = 0;
+    uint64_t bit = (uint64_t)1 << 62;
+
+    while (bit > value) {
+        bit >>= 2;
+    }
+    while (bit != 0) {
+        if (value >= root + bit) {
+            value -= root + bit;
+            root = (root >> 1) + bit;
+        } else {
+            root >>= 1;
+        }
+        bit >>= 2;
+    }
+
+    // round to nearest: value is now the remainder of root^2
+    return (uint32_t)(value > root ? root + 1 : root);
+}
+
+static void window_reset(filter_t *filter, uint32_t now_ms)
+{
+    filter->window_start_ms = now_ms;
+    filter->window_count = 0;
+    filter->window_sum = 0;
+    filter->window_sum_sq = 0;
+}
+
+static void smooth_reset(filter_t *filter)
+{
+    filter->ring_head = 0;
+    filter->ring_count = 0;
+    filter->kalman_p = -1;
+}
+
+static int32_t median(const filter_t *filter)
+{
+    int32_t sorted[FILTER_MEDIAN_MAX];
+    uint8_t count = filter->ring_count;
+
+    // insertion sort, at most FILTER_MEDIAN_MAX values
+    for (uint8_t i = 0; i < count; i++) {
+        int32_t value = filter->ring[i];
+        uint8_t j = i;
+
+        for (; j > 0 && sorted[j - 1] > value; j--) {
+            sorted[j] = sorted[j - 1];
+        }
+        sorted[j] = value;
+    }
+
+    // the lower middle of an even count, a median of the window so far while it fills up
+    return sorted[(count - 1) / 2];
+}
+
+static int32_t smooth(filter_t *filter, int32_t raw)
+{
+    const filter_config_t *config = &filter->config;
+
+    switch (config->smooth) {
+        case FILTER_SMOOTH_MEDIAN:
+            filter->ring[filter->ring_head] = raw;
+            filter->ring_head = (filter->ring_head + 1) % config->median_size;
+            if (filter->ring_count < config->median_size) {
+                filter->ring_count++;
+            }
+            return median(filter);
+
+        case FILTER_SMOOTH_KALMAN: {
+            int64_t measured = (int64_t)raw * KALMAN_SCALE;
+
+            if (filter->kalman_p < 0) {
+                filter->kalman_x = measured;
+                filter->kalman_p = config->kalman_r;
+                return raw;
+            }
+
+            // predict: the value stays, its uncertainty grows; update: move towards the measurement by the gain
+            int64_t p = filter->kalman_p + config->kalman_q;
+            int64_t gain = (p << 16) / (p + config->kalman_r);
+
+            filter->kalman_x += div_round((measured - filter->kalman_x) * gain, 1 << 16);
+            filter->kalman_p = (p * ((1 << 16) - gain)) >> 16;
+            return (int32_t)div_round(filter->kalman_x, KALMAN_SCALE);
+        }
+
+        default:
+            return raw;
+    }
+}
+
+void filter_init(filter_t *filter, const filter_config_t *config, uint32_t now_ms)
+{
+    memset(filter, 0, sizeof(*filter));
+    filter->config = *config;
+    if (filter->config.median_size == 0 || filter->config.median_size > FILTER_MEDIAN_MAX) {
+        filter->config.median_size = FILTER_MEDIAN_MAX;
+    }
+    smooth_reset(filter);
+    window_reset(filter, now_ms);
+}
+
+filter_result_t filter_push(filter_t *filter, int32_t raw, uint32_t now_ms, int32_t *value)
+{
+    const filter_config_t *config = &filter->config;
+
+    *value = filter->value;
+
+    if (raw < config->min || raw > config->max) {
+        filter->rejected++;
+        return FILTER_REJECTED_RANGE;
+    }
+
+    if (filter->seeded && config->max_rejects > 0) {
+        int64_t allowed = config->max_step + (int64_t)config->max_rate * (now_ms - filter->last_ms) / 60000;
+
+        if (llabs((int64_t)raw - filter->last) > allowed) {
+            // glitches scatter, a real change keeps reporting the new level
+            if (filter->rejects > 0 && abs(raw - filter->candidate) <= config->max_step) {
+                filter->rejects++;
+            } else {
+                filter->rejects = 1;
+            }
+            filter->candidate = raw;
+
+            if (filter->rejects < config->max_rejects) {
+                filter->rejected++;
+                return FILTER_REJECTED_JUMP;
+            }
+            // the jumps agree on a new level: a real change, e.g. the node was carried to another room
+            smooth_reset(filter);
+        }
+    }
+
+    filter->seeded = true;
+    filter->last = raw;
+    filter->last_ms = now_ms;
+    filter->rejects = 0;
+    filter->accepted++;
+
+    filter->value = smooth(filter, raw);
+    *value = filter->value;
+
+    if (filter->window_count == 0 || filter->value < filter->window_min) {
+        filter->window_min = filter->value;
+    }
+    if (filter->window_count == 0 || filter->value > filter->window_max) {
+        filter->window_max = filter->value;
+    }
+    if (filter->window_count < UINT16_MAX) {
+        filter->window_count++;
+        filter->window_sum += filter->value;
+        filter->window_sum_sq += (int64_t)filter->value * filter->value;
+    }
+
+    return FILTER_ACCEPTED;
+}
+
+bool filter_window_take(filter_t *filter, uint32_t now_ms, filter_stats_t *stats)
+{
+    uint32_t window_ms = filter->config.window_ms;
+
+    if (window_ms == 0 || now_ms - filter->window_start_ms < window_ms) {
+        return false;
+    }
+
+    int64_t count = filter->window_count;
+    int64_t sum = filter->window_sum;
+    uint64_t spread = (uint64_t)(count * filter->window_sum_sq - sum * sum);
+
+    *stats = (filter_stats_t) {
+            .min = filter->window_min,
+            .max = filter->window_max,
+            .count = filter->window_count,
+    };
+    if (count > 0) {
+        stats->mean = (int32_t)div_round(sum * FILTER_STATS_SCALE, count);
+        stats->stddev = (int32_t)isqrt(spread * FILTER_STATS_SCALE * FILTER_STATS_SCALE / (uint64_t)(count * count));
+    }
+
+    // windows stay aligned to their start, after a long gap the next one starts now
+    uint32_t next_start = filter->window_start_ms + window_ms;
+    window_reset(filter, now_ms - next_start < window_ms ? next_start : now_ms);
+
+    return count > 0;
+}
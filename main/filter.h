@@ -0,0 +1,102 @@
+#ifndef __FILTER_H__
+#define __FILTER_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Per-metric sample filter: range check, rejection of physically impossible jumps, smoothing (median of the last
+ * N samples or a scalar Kalman filter) and windowed min/max/mean/stddev of the smoothed values. Fixed-size state,
+ * integer arithmetic in the units of the readings (see fixed.h), no heap and no ESP-IDF dependencies, so recorded
+ * traces run through it on the host (host/filter_test.c).
+ *
+ * A value outside the configured range is always dropped. A value that moved further from the last accepted one
+ * than max_step plus max_rate for the elapsed time is dropped as a jump, unless max_rejects jumps in a row agree
+ * that the signal really moved (each within max_step of the previous one): that value is accepted and restarts
+ * the smoothing from it.
+ */
+
+#define FILTER_MEDIAN_MAX       9           /*!< longest median window */
+#define FILTER_STATS_SCALE      10          /*!< mean and stddev carry one more decimal than the readings */
+
+typedef enum {
+    FILTER_SMOOTH_NONE = 0,
+    FILTER_SMOOTH_MEDIAN,
+    FILTER_SMOOTH_KALMAN,
+} filter_smooth_t;
+
+typedef enum {
+    FILTER_ACCEPTED = 0,
+    FILTER_REJECTED_RANGE,      /*!< outside [min, max] */
+    FILTER_REJECTED_JUMP,       /*!< moved faster than physically possible */
+} filter_result_t;
+
+typedef struct {
+    int32_t min;                /*!< valid range of the metric */
+    int32_t max;
+    int32_t max_step;           /*!< change always allowed between two samples, covers the sensor noise */
+    int32_t max_rate;           /*!< additional change allowed per minute since the last accepted sample */
+    uint8_t max_rejects;        /*!< jumps in a row after which the new level is accepted, 0 never rejects jumps */
+    filter_smooth_t smooth;
+    uint8_t median_size;        /*!< 1..FILTER_MEDIAN_MAX, odd */
+    uint32_t kalman_q;          /*!< process noise variance, (units / 16)^2 per sample */
+    uint32_t kalman_r;          /*!< measurement noise variance, (units / 16)^2 */
+    uint32_t window_ms;         /*!< aggregation window, 0 = no windowed statistics */
+} filter_config_t;
+
+typedef struct {
+    int32_t min;                /*!< smoothed values, in the units of the readings */
+    int32_t max;
+    int32_t mean;               /*!< units / FILTER_STATS_SCALE */
+    int32_t stddev;             /*!< units / FILTER_STATS_SCALE, population standard deviation */
+    uint16_t count;
+} filter_stats_t;
+
+typedef struct {
+    filter_config_t config;
+
+    /* jump rejection */
+    bool seeded;                /*!< a value was accepted */
+    int32_t last;               /*!< last accepted raw value */
+    uint32_t last_ms;
+    int32_t candidate;          /*!< last rejected jump */
+    uint8_t rejects;            /*!< jumps in a row that agree with each other */
+
+    /* smoothing */
+    int32_t ring[FILTER_MEDIAN_MAX];
+    uint8_t ring_head;
+    uint8_t ring_count;
+    int64_t kalman_x;           /*!< estimate, units * 16 */
+    int64_t kalman_p;           /*!< estimate variance, (units / 16)^2 */
+    int32_t value;              /*!< last smoothed value */
+
+    /* window */
+    uint32_t window_start_ms;
+    uint16_t window_count;
+    int32_t window_min;
+    int32_t window_max;
+    int64_t window_sum;
+    int64_t window_sum_sq;
+
+    uint32_t accepted;
+    uint32_t rejected;
+} filter_t;
+
+void filter_init(filter_t *filter, const filter_config_t *config, uint32_t now_ms);
+
+/**
+ * @brief Run one raw reading through the filter
+ *
+ * @param value output, the smoothed value; on a rejection the previous one
+ * @return FILTER_ACCEPTED if the reading was used
+ */
+filter_result_t filter_push(filter_t *filter, int32_t raw, uint32_t now_ms, int32_t *value);
+
+/**
+ * @brief Close the aggregation window once it has run for window_ms and start the next one
+ *
+ * @return false if the window is still open, or it closed without an accepted sample
+ */
+bool filter_window_take(filter_t *filter, uint32_t now_ms, filter_stats_t *stats);
+
+#endif // __FILTER_H__
@@ -0,0 +1,50 @@
+#include "fixed.h"
+
+int32_t fixed_rescale(int32_t raw, uint32_t den, uint32_t scale)
+{
+    uint64_t magnitude = raw < 0 ? (uint64_t)-(int64_t)raw : (uint64_t)raw;
+    uint64_t product = magnitude * scale;
+    uint64_t quotient = product / den;
+    uint64_t remainder = product % den;
+
+    // an exact half rounds to the even neighbour, like printf does for a value that is exactly representable
+    if (2 * remainder > den || (2 * remainder == den && (quotient & 1))) {
+        quotient++;
+    }
+
+    return raw < 0 ? -(int32_t)quotient : (int32_t)quotient;
+}
+
+int fixed_format(int32_t raw, uint32_t den, char *string, size_t size)
+{
+    char digits[FIXED_STRING_SIZE];
+    int32_t scaled = fixed_rescale(raw, den, 100);
+    uint32_t magnitude = scaled < 0 ? (uint32_t)-(int64_t)scaled : (uint32_t)scaled;
+    size_t count = 0;
+
+    // least significant digit first, at least one integer digit in front of the decimals
+    do {
+        digits[count++] = (char)('0' + magnitude % 10);
+        magnitude /= 10;
+    } while (magnitude > 0 || count <= FIXED_DECIMALS);
+
+    size_t len = count + 1 + (scaled < 0 ? 1 : 0);
+    if (len + 1 > size) {
+        return -1;
+    }
+
+    char *out = string;
+    if (scaled < 0) {
+        *out++ = '-';
+    }
+
+    while (count > 0) {
+        if (count == FIXED_DECIMALS) {
+            *out++ = '.';
+        }
+        *out++ = digits[--count];
+    }
+    *out = '\0';
+
+    return (int)len;
+}
@@ -0,0 +1,43 @@
+#ifndef __FIXED_H__
+#define __FIXED_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Sensor values are carried as scaled integers in the units the sensors deliver, a value is raw / den of its unit:
+ * DHT22 temperature and humidity in 0.1 °C / 0.1 %, MAX17048 VCELL in 78.125 uV (5.12 V / 65536) and SOC in
+ * 1/256 %. The formatter below prints them without floating point or printf. It rounds exactly, half to even, as
+ * printf("%.2f") does for exact binary values. No ESP-IDF dependencies, tools/fixed_bench.c compares it with the
+ * sprintf path it replaces.
+ */
+
+#define FIXED_DHT_DEN           10          /*!< DHT22 temperature and humidity, 0.1 °C / 0.1 % */
+#define FIXED_VCELL_DEN         12800       /*!< MAX17048 VCELL, 78.125 uV per LSB */
+#define FIXED_SOC_DEN           256         /*!< MAX17048 SOC, 1/256 % per LSB */
+
+#define FIXED_DECIMALS          2
+#define FIXED_STRING_SIZE       16          /*!< fits any int32_t value with FIXED_DECIMALS decimals */
+
+/**
+ * @brief Rescale a value to another unit, rounding half to even
+ *
+ * @param raw value in 1/den units
+ * @param den denominator of raw
+ * @param scale denominator of the result, e.g. 100 for hundredths
+ * @return raw * scale / den rounded
+ */
+int32_t fixed_rescale(int32_t raw, uint32_t den, uint32_t scale);
+
+/**
+ * @brief Format a value with FIXED_DECIMALS decimals, the same text as "%.2f"
+ *
+ * @param raw value in 1/den units
+ * @param den denominator of raw
+ * @param string output, NUL terminated
+ * @param size size of string, FIXED_STRING_SIZE always fits
+ * @return number of characters written without the NUL, or -1 if string is too small
+ */
+int fixed_format(int32_t raw, uint32_t den, char *string, size_t size);
+
+#endif // __FIXED_H__
@@ -0,0 +1,90 @@
+#include <stdbool.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/timers.h"
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "esp_system.h"
+#include "mem_report.h"
+
+static const char *TAG = "MEM";
+
+typedef struct {
+    TaskHandle_t handle;
+    uint32_t stack_size;
+    bool is_static;
+} mem_task_t;
+
+static mem_task_t tasks[MEM_REPORT_MAX_TASKS];
+static size_t task_count = 0;
+static uint32_t boot_free_heap = 0;
+
+#if CONFIG_ESP_STATIC_ALLOCATION
+static StaticTimer_t report_timer_buffer;
+#endif
+
+void mem_report_boot(void)
+{
+    boot_free_heap = esp_get_free_heap_size();
+}
+
+void mem_report_task(TaskHandle_t task, uint32_t stack_size, bool is_static)
+{
+    if (task == NULL || task_count == MEM_REPORT_MAX_TASKS) {
+        return;
+    }
+
+    tasks[task_count++] = (mem_task_t) {
+            .handle = task,
+            .stack_size = stack_size,
+            .is_static = is_static,
+    };
+}
+
+void mem_report_log(void)
+{
+    uint32_t free_heap = esp_get_free_heap_size();
+
+    ESP_LOGI(TAG, "Heap: %" PRIu32 " free (%" PRIu32 " at boot, %" PRIu32 " used since), minimum %" PRIu32
+             ", largest block %u", free_heap, boot_free_heap, boot_free_heap - free_heap,
+             esp_get_minimum_free_heap_size(), (unsigned)heap_caps_get_largest_free_block(MALLOC_CAP_8BIT));
+
+    for (size_t i = 0; i < task_count; i++) {
+        // ESP-IDF counts stack depth in bytes
+        uint32_t unused = uxTaskGetStackHighWaterMark(tasks[i].handle);
+        uint32_t peak = tasks[i].stack_size - unused;
+
+        ESP_LOGI(TAG, "Stack %-16s peak %5" PRIu32 " of %5" PRIu32 " bytes (%3" PRIu32 "%%, %s)",
+                 pcTaskGetName(tasks[i].handle), peak, tasks[i].stack_size, peak * 100 / tasks[i].stack_size,
+                 tasks[i].is_static ? "static" : "heap");
+    }
+}
+
+static void report_timer_callback(TimerHandle_t timer)
+{
+    mem_report_log();
+}
+
+esp_err_t mem_report_start(void)
+{
+    mem_report_log();
+
+    if (MEM_REPORT_INTERVAL_MS == 0) {
+        return ESP_OK;
+    }
+
+#if CONFIG_ESP_STATIC_ALLOCATION
+    TimerHandle_t timer = xTimerCreateStatic("mem_report", pdMS_TO_TICKS(MEM_REPORT_INTERVAL_MS), pdTRUE, NULL,
+                                             report_timer_callback, &report_timer_buffer);
+#else
+    TimerHandle_t timer = xTimerCreate("mem_report", pdMS_TO_TICKS(MEM_REPORT_INTERVAL_MS), pdTRUE, NULL,
+                                       report_timer_callback);
+#endif
+    if (timer == NULL || xTimerStart(timer, 0) != pdPASS) {
+        ESP_LOGE(TAG, "mem_report: Timer was not started");
+        return ESP_FAIL;
+    }
+
+    return ESP_OK;
+}
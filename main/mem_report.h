@@ -0,0 +1,51 @@
+#ifndef __MEM_REPORT_H__
+#define __MEM_REPORT_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <esp_err.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+/*
+ * RAM budget report. Every task of the application registers its stack here; the report logs the heap and, per
+ * task, the deepest the stack has ever been so the *_TASK_STACK_SIZE options can be cut to the measured peak plus a
+ * margin. With CONFIG_ESP_STATIC_ALLOCATION the stacks, TCBs and queue storage live in .bss and only the ESP-IDF
+ * components still allocate from the heap.
+ */
+
+#define MEM_REPORT_MAX_TASKS        8
+
+#if CONFIG_ESP_STATIC_ALLOCATION
+#define MEM_STATIC_ALLOCATION       true
+#else
+#define MEM_STATIC_ALLOCATION       false
+#endif
+
+#define MEM_REPORT_INTERVAL_MS      (CONFIG_ESP_MEM_REPORT_INTERVAL_SEC * 1000)  /*!< 0 = once after start-up */
+
+/**
+ * @brief Remember the heap before the application allocates anything, call first thing in app_main
+ */
+void mem_report_boot(void);
+
+/**
+ * @brief Register a task for the stack report
+ *
+ * @param stack_size stack size the task was created with, in bytes
+ * @param is_static true if stack and TCB are statically allocated
+ */
+void mem_report_task(TaskHandle_t task, uint32_t stack_size, bool is_static);
+
+/**
+ * @brief Log heap usage since mem_report_boot() and the stack peak of every registered task
+ */
+void mem_report_log(void);
+
+/**
+ * @brief Log the report now and then every MEM_REPORT_INTERVAL_MS, call once start-up is complete
+ */
+esp_err_t mem_report_start(void);
+
+#endif // __MEM_REPORT_H__
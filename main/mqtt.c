@@ -1,22 +1,201 @@
 #include <sys/cdefs.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <time.h>
 #include "mqtt.h"
+#include "mqtt_session.h"
 #include "esp_log.h"
 #include "esp_event.h"
+#include "esp_system.h"
 #include "mqtt_client.h"
 #include "dht22.h"
 #include "battery.h"
+#include "payload.h"
+#include "fixed.h"
+#include "backlog.h"
+#include "publisher.h"
+#include "diag.h"
+#include "connectivity.h"
+#include "topic_alias.h"
+#include "deadband.h"
+#include "remote_config.h"
+#include "ota.h"
+#include "binlog.h"
+#include "mem_report.h"
+#include "task_plan.h"
+#if CONFIG_ESP_MQTT_TLS
+#include "tls_transport.h"
+#endif
 
 static const char *TAG = "MQTT5";
 
 static esp_mqtt5_user_property_item_t user_property_arr[] = {
-        {"board", "esp32"},
-        {"u", "user"},
-        {"p", "password"}
+        MQTT_SESSION_USER_PROPERTIES
 };
 
 #define USE_PROPERTY_ARR_SIZE   sizeof(user_property_arr)/sizeof(esp_mqtt5_user_property_item_t)
 
 static TaskHandle_t mqtt_task_handle = NULL;
+static esp_mqtt_client_handle_t client = NULL;
+
+#if CONFIG_ESP_STATIC_ALLOCATION
+#if !CONFIG_ESP_DUTY_CYCLE_MODE
+static StackType_t mqtt_task_stack[ESP_MQTT_TASK_STACK_SIZE];
+static StaticTask_t mqtt_task_tcb;
+#endif
+static StaticEventGroup_t mqtt_event_group_buffer;
+#endif
+
+#if CONFIG_ESP_MQTT_TOPIC_ALIAS
+/* Topic aliases are per network connection, the event handler flags them for reset on (re)connect */
+static topic_alias_t topic_aliases;
+static atomic_bool topic_aliases_stale = true;
+#endif
+
+/* The connectivity manager starts the client on the first IP address, not mqtt5_init() */
+static atomic_bool client_started = false;
+
+/* FreeRTOS event group to signal when we are connected to the broker */
+static EventGroupHandle_t mqtt_event_group = NULL;
+#define MQTT_CONNECTED_BIT BIT0
+
+/* QoS1 publishes that have not been acknowledged with a PUBACK yet */
+static atomic_int pending_acks = 0;
+
+/* Sequence number of the last published sample */
+static uint32_t sample_seq = 0;
+
+#if CONFIG_ESP_STORE_FORWARD
+#define BACKLOG_ACK_SLOTS           16
+
+/*
+ * A backlog batch stays in the store until its PUBACK: the esp-mqtt outbox is only in RAM, a batch consumed when it
+ * was handed to the client was lost to a reboot, a deep sleep or a dropped connection before the broker had it.
+ * The event handler notes every PUBACK in the slot of its msg_id, as diag.c does, so one that comes in before the
+ * publishing task has the msg_id of its batch is not missed.
+ */
+static atomic_int publish_acks[BACKLOG_ACK_SLOTS];
+/* Counts lost connections: a batch sent before the last one is not going to be acknowledged */
+static atomic_uint connection_losses = 0;
+
+/* The batch waiting for its PUBACK, only the publishing task touches it */
+static struct {
+    int msg_id;
+    unsigned connection;
+    size_t count;
+} backlog_in_flight;
+#endif
+
+#if CONFIG_ESP_REMOTE_CONFIG || CONFIG_ESP_OTA || CONFIG_ESP_BINLOG
+#define ESP_MQTT_CONTROL            1
+#define CONTROL_QUEUE_DEPTH         PUBLISHER_CONTROL_DEPTH
+
+typedef enum {
+    CONTROL_CONFIG = 0,         /*!< a message of the configuration topic */
+    CONTROL_OTA_STATE,          /*!< an OTA state report is due, ota.c holds it */
+    CONTROL_LOG_DUMP,           /*!< the log ring was asked for */
+} control_kind_t;
+
+/* On its way from the event handler to mqtt_task */
+typedef struct {
+    control_kind_t kind;
+#if CONFIG_ESP_REMOTE_CONFIG
+    bool too_large;
+    size_t len;
+    char data[NODE_CONFIG_MESSAGE_MAX_SIZE];
+#endif
+} control_message_t;
+
+/* In the publisher's queue set, a message wakes mqtt_task like a sample does */
+static QueueHandle_t control_queue = NULL;
+#if CONFIG_ESP_STATIC_ALLOCATION
+static StaticQueue_t control_queue_buffer;
+static uint8_t control_queue_storage[CONTROL_QUEUE_DEPTH * sizeof(control_message_t)];
+#endif
+
+/* Runs in the client's task, applying and answering is left to mqtt_task, the only task that publishes */
+static void control_send(const control_message_t *message)
+{
+    if (xQueueSend(control_queue, message, 0) != pdPASS) {
+        ESP_LOGW(TAG, "Control message %d dropped, %d still waiting", message->kind, CONTROL_QUEUE_DEPTH);
+    }
+}
+
+static bool topic_is(esp_mqtt_event_handle_t event, const char *topic)
+{
+    return event->topic_len == (int)strlen(topic) && memcmp(event->topic, topic, event->topic_len) == 0;
+}
+#endif
+
+#if CONFIG_ESP_REMOTE_CONFIG
+static void config_received(esp_mqtt_event_handle_t event)
+{
+    static control_message_t message = { .kind = CONTROL_CONFIG };
+
+    if (!topic_is(event, ESP_MQTT_TOPIC_CONFIG)) {
+        return;
+    }
+
+    message.too_large = event->data_len != event->total_data_len || event->data_len > (int)sizeof(message.data);
+    message.len = message.too_large ? 0 : (size_t)event->data_len;
+    memcpy(message.data, event->data, message.len);
+    control_send(&message);
+}
+#endif
+
+#if CONFIG_ESP_OTA
+static void ota_report(void)
+{
+    static const control_message_t message = { .kind = CONTROL_OTA_STATE };
+
+    control_send(&message);
+}
+#endif
+
+#if CONFIG_ESP_BINLOG
+static void log_dump_requested(esp_mqtt_event_handle_t event)
+{
+    static const control_message_t message = { .kind = CONTROL_LOG_DUMP };
+
+    // a retained request would dump the ring on every connect
+    if (!event->retain) {
+        control_send(&message);
+    }
+}
+#endif
+
+/* Further chunks of a message larger than the client's buffer come without topic, they belong to the first */
+static void data_received(esp_mqtt_event_handle_t event)
+{
+#if CONFIG_ESP_OTA
+    static bool ota_message = false;
+
+    if (event->current_data_offset == 0) {
+        ota_message = topic_is(event, ESP_MQTT_TOPIC_OTA);
+        if (ota_message && event->retain) {
+            // it would come again on every connect
+            ESP_LOGW(TAG, "Retained update ignored, publish patches without the retain flag");
+            ota_message = false;
+        }
+    }
+    if (ota_message) {
+        if (ota_receive(event->data, (size_t)event->data_len, (size_t)event->current_data_offset,
+                        (size_t)event->total_data_len)) {
+            ota_report();
+        }
+        return;
+    }
+#endif
+#if CONFIG_ESP_BINLOG
+    if (event->current_data_offset == 0 && topic_is(event, ESP_MQTT_TOPIC_LOG)) {
+        log_dump_requested(event);
+        return;
+    }
+#endif
+#if CONFIG_ESP_REMOTE_CONFIG
+    config_received(event);
+#endif
+}
 
 /*
  * @brief Event handler registered to receive MQTT events
@@ -39,7 +218,35 @@ static void event_handler(void *args, esp_event_base_t base, int32_t event_id, v
     switch ((esp_mqtt_event_id_t)event_id) {
         case MQTT_EVENT_CONNECTED:
             ESP_LOGI(TAG, "MQTT_EVENT_CONNECTED");
-            vTaskResume(mqtt_task_handle);
+#if CONFIG_ESP_MQTT_TOPIC_ALIAS
+            atomic_store(&topic_aliases_stale, true);
+#endif
+            xEventGroupSetBits(mqtt_event_group, MQTT_CONNECTED_BIT);
+            connectivity_notify(CONN_EVENT_MQTT_UP);
+#if CONFIG_ESP_REMOTE_CONFIG
+            // again on every connect, the broker follows with the retained configuration a node may have missed
+            if (esp_mqtt_client_subscribe(client, ESP_MQTT_TOPIC_CONFIG, 1) < 0) {
+                ESP_LOGW(TAG, "Failed to subscribe to %s", ESP_MQTT_TOPIC_CONFIG);
+            }
+#endif
+#if CONFIG_ESP_OTA
+            if (esp_mqtt_client_subscribe(client, ESP_MQTT_TOPIC_OTA, 1) < 0) {
+                ESP_LOGW(TAG, "Failed to subscribe to %s", ESP_MQTT_TOPIC_OTA);
+            }
+            if (ota_report_due()) {
+                ota_report();
+            }
+#endif
+#if CONFIG_ESP_BINLOG
+            if (esp_mqtt_client_subscribe(client, ESP_MQTT_TOPIC_LOG, 1) < 0) {
+                ESP_LOGW(TAG, "Failed to subscribe to %s", ESP_MQTT_TOPIC_LOG);
+            }
+#endif
+#if !CONFIG_ESP_STORE_FORWARD
+            if (mqtt_task_handle != NULL) {
+                vTaskResume(mqtt_task_handle);
+            }
+#endif
             break;
         case MQTT_EVENT_ANY:
             break;
@@ -48,15 +255,47 @@ static void event_handler(void *args, esp_event_base_t base, int32_t event_id, v
             break;
         case MQTT_EVENT_DISCONNECTED:
             ESP_LOGI(TAG, "MQTT_EVENT_DISCONNECTED");
-            vTaskSuspend(mqtt_task_handle);
+#if CONFIG_ESP_STORE_FORWARD
+            // before the bit: a task that sees the client disconnected also sees the batch in flight lost
+            atomic_fetch_add(&connection_losses, 1);
+#endif
+            xEventGroupClearBits(mqtt_event_group, MQTT_CONNECTED_BIT);
+            // in-flight messages are not going to be acknowledged on this connection
+            atomic_store(&pending_acks, 0);
+#if CONFIG_ESP_MQTT_TOPIC_ALIAS
+            atomic_store(&topic_aliases_stale, true);
+#endif
+            connectivity_notify(CONN_EVENT_MQTT_DOWN);
+#if !CONFIG_ESP_STORE_FORWARD
+            if (mqtt_task_handle != NULL) {
+                vTaskSuspend(mqtt_task_handle);
+            }
+#endif
             break;
         case MQTT_EVENT_SUBSCRIBED:
             break;
         case MQTT_EVENT_UNSUBSCRIBED:
             break;
         case MQTT_EVENT_PUBLISHED:
+            if (atomic_load(&pending_acks) > 0) {
+                atomic_fetch_sub(&pending_acks, 1);
+            }
+            diag_publish_acked(event->msg_id);
+#if CONFIG_ESP_STORE_FORWARD
+            atomic_store(&publish_acks[event->msg_id & (BACKLOG_ACK_SLOTS - 1)], event->msg_id);
+#endif
+            if (diag_milestone(DIAG_MILESTONE_FIRST_PUBACK)) {
+                ESP_LOGI(TAG, "Boot to first PUBACK: %" PRIu32 " ms", diag_milestone_ms(DIAG_MILESTONE_FIRST_PUBACK));
+            }
+#if CONFIG_ESP_OTA
+            // a new image that gets its publishes through to the broker is good enough to keep
+            if (ota_confirm()) {
+                ota_report();
+            }
+#endif
             break;
         case MQTT_EVENT_DATA:
+            data_received(event);
             break;
         case MQTT_EVENT_BEFORE_CONNECT:
             break;
@@ -70,92 +309,675 @@ static void event_handler(void *args, esp_event_base_t base, int32_t event_id, v
     }
 }
 
-static inline bool is_queue_created(QueueHandle_t queue)
+#if CONFIG_ESP_MQTT_TOPIC_ALIAS
+/*
+ * Every publish goes through client_publish() and only one task publishes (mqtt_task, or app_main in duty-cycle
+ * mode), so the publish property set here always applies to the publish right after it.
+ *
+ * Only QoS0 publishes use an alias. esp-mqtt keeps QoS1 publishes in its outbox until their PUBACK and sends the
+ * ones a disconnect left there again after the next connect, packet as it was: an alias from the old connection
+ * means nothing to the broker then, and a publish with only the alias would cost the node its new connection.
+ */
+static int client_publish(const char *topic, const char *data, int len, int qos, int retain)
+{
+    if (atomic_exchange(&topic_aliases_stale, false)) {
+        topic_alias_reset(&topic_aliases, ESP_MQTT_TOPIC_ALIAS_MAX);
+    }
+
+    bool established = false;
+    uint16_t alias = qos == 0 ? topic_alias_get(&topic_aliases, topic, &established) : 0;
+
+    if (alias > 0) {
+        esp_mqtt5_publish_property_config_t property = { .topic_alias = alias };
+
+        // the client refuses aliases above the Topic Alias Maximum of the CONNACK
+        if (esp_mqtt5_client_set_publish_property(client, &property) != ESP_OK) {
+            ESP_LOGI(TAG, "Broker accepts fewer than %u topic aliases", alias);
+            topic_alias_reject(&topic_aliases, alias);
+            alias = 0;
+            established = false;
+        }
+    }
+
+    int msg_id = esp_mqtt_client_publish(client, established ? "" : topic, data, len, qos, retain);
+    if (msg_id >= 0 && alias > 0 && !established) {
+        topic_alias_confirm(&topic_aliases, alias);
+    }
+
+    return msg_id;
+}
+#else
+static int client_publish(const char *topic, const char *data, int len, int qos, int retain)
+{
+    return esp_mqtt_client_publish(client, topic, data, len, qos, retain);
+}
+#endif
+
+static void publish_retained(const char *topic, const char *data, int len, int qos)
+{
+    int msg_id = client_publish(topic, data, len, qos, 1);
+    if (msg_id < 0) {
+        ESP_LOGW(TAG, "Failed to publish to %s", topic);
+    } else if (qos > 0) {
+        atomic_fetch_add(&pending_acks, 1);
+        diag_publish_sent(msg_id);
+    }
+}
+
+/* Live values at the QoS of the settings, QoS0 with topic aliases and QoS1 without unless changed over MQTT */
+static void publish_live(const char *topic, const char *data, int len)
+{
+    publish_retained(topic, data, len, (int)remote_config_get()->qos);
+}
+
+static void publish_value(const char *topic, int32_t raw, uint32_t den)
+{
+    char string[FIXED_STRING_SIZE];
+    int len = fixed_format(raw, den, string, sizeof(string));
+    publish_live(topic, string, len);
+}
+
+/* Sensor 0 keeps the configured topics, every further DHT22 appends its suffix */
+typedef struct {
+    const char *temperature;
+    const char *humidity;
+#if ESP_MQTT_DHT_STATS
+    const char *stats;
+#endif
+} dht_topics_t;
+
+#if ESP_MQTT_DHT_STATS
+#define DHT_TOPICS(suffix) { \
+        CONFIG_ESP_MQTT_TOPIC_TEMPERATURE suffix, CONFIG_ESP_MQTT_TOPIC_HUMIDITY suffix, \
+        ESP_MQTT_TOPIC_DHT_STATS suffix }
+#else
+#define DHT_TOPICS(suffix) { CONFIG_ESP_MQTT_TOPIC_TEMPERATURE suffix, CONFIG_ESP_MQTT_TOPIC_HUMIDITY suffix }
+#endif
+
+static const dht_topics_t dht_topics[ESP_DHT_SENSOR_COUNT] = {
+        DHT_TOPICS(""),
+#if ESP_DHT_SENSOR_COUNT >= 2
+        DHT_TOPICS(CONFIG_ESP_DHT_TOPIC_SUFFIX_1),
+#endif
+#if ESP_DHT_SENSOR_COUNT >= 3
+        DHT_TOPICS(CONFIG_ESP_DHT_TOPIC_SUFFIX_2),
+#endif
+#if ESP_DHT_SENSOR_COUNT >= 4
+        DHT_TOPICS(CONFIG_ESP_DHT_TOPIC_SUFFIX_3),
+#endif
+};
+
+static void publish_dht_values(const sensor_frame_t *frame, uint8_t mask)
+{
+    const dht_topics_t *topics = &dht_topics[PAYLOAD_DHT_SENSOR(frame->flags)];
+
+    BINLOG(PUBLISH_DHT, frame->humidity, frame->temperature);
+    if (mask & DEADBAND_BIT(DEADBAND_HUMIDITY)) {
+        publish_value(topics->humidity, frame->humidity, FIXED_DHT_DEN);
+    }
+    if (mask & DEADBAND_BIT(DEADBAND_TEMPERATURE)) {
+        publish_value(topics->temperature, frame->temperature, FIXED_DHT_DEN);
+    }
+}
+
+static void publish_battery_values(const sensor_frame_t *frame, uint8_t mask)
+{
+    BINLOG(PUBLISH_BATTERY, frame->voltage, frame->soc);
+    if (mask & DEADBAND_BIT(DEADBAND_VOLTAGE)) {
+        publish_value(CONFIG_ESP_MQTT_TOPIC_BATTERY_VOLTAGE, frame->voltage, FIXED_VCELL_DEN);
+    }
+    if (mask & DEADBAND_BIT(DEADBAND_SOC)) {
+        publish_value(CONFIG_ESP_MQTT_TOPIC_BATTERY_SOC, frame->soc, FIXED_SOC_DEN);
+    }
+}
+
+#if CONFIG_ESP_MQTT_FRAME
+static void publish_frame(const sensor_frame_t *frame)
+{
+    uint8_t payload[PAYLOAD_MAX_SIZE];
+    int len = payload_encode(ESP_MQTT_FRAME_FORMAT, frame, payload, sizeof(payload));
+    if (len < 0) {
+        ESP_LOGE(TAG, "Failed to encode frame %" PRIu32, frame->seq);
+        return;
+    }
+
+    BINLOG(PUBLISH_FRAME, (int32_t)frame->seq, len);
+    publish_live(ESP_MQTT_TOPIC_FRAME, (const char *)payload, len);
+}
+#endif
+
+static void make_frame(sensor_frame_t *frame, uint32_t seq, const dht_reading_t *dht_reading,
+                       const battery_reading_t *battery_reading)
+{
+    *frame = (sensor_frame_t) {
+            .seq = seq,
+            .timestamp = (uint32_t)time(NULL),
+    };
+
+    if (dht_reading != NULL) {
+        frame->flags |= PAYLOAD_HAS_DHT | PAYLOAD_DHT_SENSOR_FLAGS(dht_reading->sensor);
+        frame->temperature = dht_reading->temperature;
+        frame->humidity = dht_reading->humidity;
+    }
+
+    if (battery_reading != NULL) {
+        frame->flags |= PAYLOAD_HAS_BATTERY;
+        frame->voltage = battery_reading->voltage;
+        frame->soc = battery_reading->soc;
+    }
+}
+
+/* Publishes one sample as a frame and/or as individual per-value topics, mask selects the per-value topics */
+static void publish_sample(const sensor_frame_t *frame, uint8_t mask)
+{
+    if (frame->flags == 0) {
+        return;
+    }
+
+#if CONFIG_ESP_MQTT_FRAME
+    publish_frame(frame);
+#if !CONFIG_ESP_MQTT_FRAME_KEEP_TOPICS
+    return;
+#endif
+#endif
+
+    if (frame->flags & PAYLOAD_HAS_DHT) {
+        publish_dht_values(frame, mask);
+    }
+
+    if (frame->flags & PAYLOAD_HAS_BATTERY) {
+        publish_battery_values(frame, mask);
+    }
+}
+
+#if ESP_MQTT_DHT_STATS
+/* The statistics of a closed DHT22 window go out next to its mean, which the deadband may hold back */
+static void publish_dht_stats(void)
+{
+    dht_window_stats_t stats;
+    uint8_t payload[PAYLOAD_STATS_MAX_SIZE];
+
+    for (uint8_t sensor = 0; sensor < ESP_DHT_SENSOR_COUNT; sensor++) {
+        if (!dht_take_window_stats(sensor, &stats)) {
+            continue;
+        }
+
+        int len = payload_encode_dht_stats((uint32_t)time(NULL), CONFIG_ESP_DHT_FILTER_WINDOW_SEC,
+                                           &stats.temperature, &stats.humidity, payload, sizeof(payload));
+        if (len < 0) {
+            ESP_LOGE(TAG, "Failed to encode DHT statistics of sensor %u", sensor);
+            continue;
+        }
+
+        publish_live(dht_topics[sensor].stats, (const char *)payload, len);
+    }
+}
+#endif
+
+/* The deadband and the periodic diagnostics run in mqtt_task, a duty-cycle wake publishes every reading */
+#if !CONFIG_ESP_DUTY_CYCLE_MODE
+#if CONFIG_ESP_MQTT_DEADBAND
+/* One per DHT22 sensor, the battery values are tracked in the first */
+static deadband_t deadband[ESP_DHT_SENSOR_COUNT];
+
+static void deadband_config_from(const node_config_t *config, deadband_config_t deadband_config[DEADBAND_METRIC_COUNT])
+{
+    uint32_t heartbeat_ms = config->heartbeat_sec * 1000;
+
+    deadband_config[DEADBAND_TEMPERATURE] = (deadband_config_t) {
+            ESP_MQTT_DEADBAND_TEMPERATURE(config->deadband_temperature), heartbeat_ms };
+    deadband_config[DEADBAND_HUMIDITY] = (deadband_config_t) {
+            ESP_MQTT_DEADBAND_HUMIDITY(config->deadband_humidity), heartbeat_ms };
+    deadband_config[DEADBAND_VOLTAGE] = (deadband_config_t) {
+            ESP_MQTT_DEADBAND_BATTERY_VOLTAGE(config->deadband_battery_voltage), heartbeat_ms };
+    deadband_config[DEADBAND_SOC] = (deadband_config_t) {
+            ESP_MQTT_DEADBAND_BATTERY_SOC(config->deadband_battery_soc), heartbeat_ms };
+}
+
+/*
+ * Drops the sensor groups of a frame in which no value moved past its deadband. A frame carries a whole group
+ * when one of its values changed, the returned mask selects the individual per-value topics.
+ */
+static uint8_t filter_sample(sensor_frame_t *frame)
+{
+    uint8_t offered = (frame->flags & PAYLOAD_HAS_DHT ? DEADBAND_DHT_MASK : 0) |
+                      (frame->flags & PAYLOAD_HAS_BATTERY ? DEADBAND_BATTERY_MASK : 0);
+    deadband_t *state = &deadband[frame->flags & PAYLOAD_HAS_DHT ? PAYLOAD_DHT_SENSOR(frame->flags) : 0];
+    uint8_t mask = deadband_filter(state, frame, pdTICKS_TO_MS(xTaskGetTickCount()));
+
+    for (uint8_t suppressed = offered & ~mask; suppressed != 0; suppressed &= suppressed - 1) {
+        diag_count(DIAG_COUNTER_DEADBAND_SUPPRESSED);
+    }
+
+    if (!(mask & DEADBAND_DHT_MASK)) {
+        frame->flags &= ~(PAYLOAD_HAS_DHT | PAYLOAD_DHT_SENSOR_MASK);
+    }
+
+    if (!(mask & DEADBAND_BATTERY_MASK)) {
+        frame->flags &= ~PAYLOAD_HAS_BATTERY;
+    }
+
+    return mask;
+}
+#else
+static uint8_t filter_sample(sensor_frame_t *frame)
+{
+    return DEADBAND_DHT_MASK | DEADBAND_BATTERY_MASK;
+}
+#endif
+#endif
+
+#if CONFIG_ESP_STORE_FORWARD
+/*
+ * Removes the batch in flight from the store once the broker acknowledged it. One lost with its connection stays at
+ * the head of the store and goes again. Returns false while the batch still waits for its PUBACK.
+ */
+static bool backlog_settle(void)
 {
-    return queue != NULL ? true : false;
+    if (backlog_in_flight.count == 0) {
+        return true;
+    }
+
+    atomic_int *ack = &publish_acks[backlog_in_flight.msg_id & (BACKLOG_ACK_SLOTS - 1)];
+    if (atomic_load(ack) == backlog_in_flight.msg_id) {
+        atomic_store(ack, 0);
+        backlog_consume(backlog_in_flight.count);
+        ESP_LOGI(TAG, "Uploaded %u backlog samples, %" PRIu32 " left", (unsigned)backlog_in_flight.count,
+                 backlog_count());
+    } else if (backlog_in_flight.connection == atomic_load(&connection_losses)) {
+        return false;
+    } else {
+        ESP_LOGW(TAG, "Backlog batch of %u samples not acknowledged, sending it again",
+                 (unsigned)backlog_in_flight.count);
+    }
+
+    backlog_in_flight.count = 0;
+    return true;
+}
+
+/* Buffers a sample, after settling the batch in flight: a push may drop the oldest samples, the batch among them */
+static void store_sample(const sensor_frame_t *frame)
+{
+    backlog_settle();
+    backlog_push(frame);
 }
 
-static const char* float_to_string(float number, char *string)
+/* Uploads one batch of buffered samples, but only while live data is not waiting for its own PUBACKs */
+static void publish_backlog(void)
 {
-    sprintf(string, "%.2f", number);
-    return string;
+    static sensor_frame_t frames[ESP_STORE_DRAIN_BATCH];
+    static uint8_t payload[PAYLOAD_MAX_SIZE * ESP_STORE_DRAIN_BATCH + 2];
+
+    if (!backlog_settle() || atomic_load(&pending_acks) > ESP_STORE_MAX_IN_FLIGHT) {
+        return;
+    }
+
+    size_t count = backlog_peek(frames, ESP_STORE_DRAIN_BATCH);
+    if (count == 0) {
+        return;
+    }
+
+    int len = payload_encode_batch(ESP_MQTT_BACKLOG_FORMAT, frames, count, payload, sizeof(payload));
+    if (len < 0) {
+        ESP_LOGE(TAG, "Failed to encode %u backlog samples", (unsigned)count);
+        return;
+    }
+
+    // not retained, the backlog is history and must not replace the live values
+    unsigned connection = atomic_load(&connection_losses);
+    int msg_id = client_publish(ESP_MQTT_TOPIC_BACKLOG, (const char *)payload, len, 1, 0);
+    if (msg_id > 0) {
+        atomic_fetch_add(&pending_acks, 1);
+        diag_publish_sent(msg_id);
+        backlog_in_flight.msg_id = msg_id;
+        backlog_in_flight.connection = connection;
+        backlog_in_flight.count = count;
+    }
 }
+#endif
+
+#if CONFIG_ESP_MQTT_DIAG && !CONFIG_ESP_DUTY_CYCLE_MODE
+/* Diagnostics are best effort: QoS0, not retained and not buffered while disconnected */
+static void publish_diag(void)
+{
+    diag_snapshot_t snapshot;
+    uint8_t payload[PAYLOAD_DIAG_MAX_SIZE];
+
+    diag_snapshot(&snapshot);
+    if (!mqtt5_is_connected()) {
+        return;
+    }
+
+    int len = payload_encode_diag(&snapshot, payload, sizeof(payload));
+    if (len < 0) {
+        ESP_LOGE(TAG, "Failed to encode diagnostics");
+        return;
+    }
+
+    client_publish(ESP_MQTT_TOPIC_DIAG, (const char *)payload, len, 0, 0);
+}
+#endif
+
+#if CONFIG_ESP_REMOTE_CONFIG
+/* The outcome goes out retained with the settings in effect, also for a message that changed nothing */
+static void publish_config_state(const char *error)
+{
+    char payload[NODE_CONFIG_STATE_MAX_SIZE];
+
+    int len = node_config_encode_state(remote_config_get(), error, payload, sizeof(payload));
+    if (len < 0) {
+        ESP_LOGE(TAG, "Failed to encode the configuration state");
+        return;
+    }
+
+    publish_retained(ESP_MQTT_TOPIC_CONFIG_STATE, payload, len, 1);
+}
+
+static void handle_config_message(const control_message_t *message)
+{
+    char error[NODE_CONFIG_ERROR_SIZE];
+
+    if (message->too_large) {
+        ESP_LOGW(TAG, "Configuration message above %d bytes rejected", NODE_CONFIG_MESSAGE_MAX_SIZE);
+        publish_config_state("message too large");
+        return;
+    }
+
+    if (!remote_config_update(message->data, message->len, error, sizeof(error))) {
+        publish_config_state(error);
+        return;
+    }
+
+#if CONFIG_ESP_MQTT_DEADBAND
+    // values published so far stay the reference, the new thresholds apply from the next sample
+    deadband_config_t deadband_config[DEADBAND_METRIC_COUNT];
+    deadband_config_from(remote_config_get(), deadband_config);
+    for (uint8_t sensor = 0; sensor < ESP_DHT_SENSOR_COUNT; sensor++) {
+        deadband_set_config(&deadband[sensor], deadband_config);
+    }
+#endif
+    publish_config_state(NULL);
+}
+#endif
+
+#if CONFIG_ESP_OTA
+#define OTA_RESTART_ACK_TIMEOUT_MS  5000
+
+static void publish_ota_state(void)
+{
+    char payload[OTA_STATE_MAX_SIZE];
+
+    if (!ota_report_due()) {
+        return;
+    }
+
+    int len = ota_encode_state(payload, sizeof(payload));
+    if (len < 0) {
+        ESP_LOGE(TAG, "Failed to encode the OTA state");
+        return;
+    }
+    publish_retained(ESP_MQTT_TOPIC_OTA_STATE, payload, len, 1);
+
+    if (ota_restart_pending()) {
+        // a reboot right away would lose the report
+        for (uint32_t waited = 0; atomic_load(&pending_acks) > 0 && waited < OTA_RESTART_ACK_TIMEOUT_MS;
+             waited += 100) {
+            vTaskDelay(pdMS_TO_TICKS(100));
+        }
+        ESP_LOGI(TAG, "Rebooting into the new image");
+        esp_restart();
+    }
+}
+#endif
+
+#if CONFIG_ESP_BINLOG
+/* The records up to the request, in chunks of whole records, not retained: a dump is a snapshot, not a state */
+static void publish_log_dump(void)
+{
+    static uint8_t payload[BINLOG_DUMP_CHUNK_SIZE];
+    uint32_t next = 0;
+    uint32_t end = binlog_written();
+    uint32_t chunks = 0;
+    size_t len;
 
+    while ((len = binlog_dump(&next, end, payload, sizeof(payload))) > 0) {
+        int msg_id = client_publish(ESP_MQTT_TOPIC_LOG_DUMP, (const char *)payload, (int)len, 1, 0);
+        if (msg_id < 0) {
+            ESP_LOGW(TAG, "Failed to publish to %s", ESP_MQTT_TOPIC_LOG_DUMP);
+            return;
+        }
+        atomic_fetch_add(&pending_acks, 1);
+        diag_publish_sent(msg_id);
+        chunks++;
+    }
+
+    ESP_LOGI(TAG, "Log dumped in %" PRIu32 " messages", chunks);
+}
+#endif
+
+#if ESP_MQTT_CONTROL
+static void handle_control_messages(void)
+{
+    static control_message_t message;
+
+    while (xQueueReceive(control_queue, &message, 0) == pdPASS) {
+        switch (message.kind) {
+#if CONFIG_ESP_REMOTE_CONFIG
+            case CONTROL_CONFIG:
+                handle_config_message(&message);
+                break;
+#endif
+#if CONFIG_ESP_OTA
+            case CONTROL_OTA_STATE:
+                publish_ota_state();
+                break;
+#endif
+#if CONFIG_ESP_BINLOG
+            case CONTROL_LOG_DUMP:
+                publish_log_dump();
+                break;
+#endif
+            default:
+                break;
+        }
+    }
+}
+#endif
+
+#if !CONFIG_ESP_DUTY_CYCLE_MODE
 _Noreturn static void mqtt_task(void *params)
 {
+#if CONFIG_ESP_MQTT_DEADBAND
+    deadband_config_t deadband_config[DEADBAND_METRIC_COUNT];
+
+    deadband_config_from(remote_config_get(), deadband_config);
+    for (uint8_t sensor = 0; sensor < ESP_DHT_SENSOR_COUNT; sensor++) {
+        deadband_init(&deadband[sensor], deadband_config);
+    }
+#endif
+#if CONFIG_ESP_MQTT_DIAG
+    TickType_t diag_due = xTaskGetTickCount() + pdMS_TO_TICKS(ESP_MQTT_DIAG_INTERVAL_MS);
+#endif
+
     while (true) {
-        if (!is_queue_created(dht_reading_queue)) {
-            ESP_LOGE(TAG, "The dht_reading_queue has not been created yet");
-            vTaskDelay(pdMS_TO_TICKS(1000));
-            continue;
+        sensor_frame_t frame;
+        TickType_t timeout = portMAX_DELAY;
+
+#if CONFIG_ESP_MQTT_DIAG
+        TickType_t now = xTaskGetTickCount();
+        if ((int32_t)(diag_due - now) <= 0) {
+            publish_diag();
+            diag_due = now + pdMS_TO_TICKS(ESP_MQTT_DIAG_INTERVAL_MS);
         }
+        timeout = diag_due - now;
+#endif
 
-        if (!is_queue_created(battery_reading_queue)) {
-            ESP_LOGE(TAG, "The battery_reading_queue has not been created yet");
-            vTaskDelay(pdMS_TO_TICKS(1000));
+        // whichever source has a sample ready, a stalled sensor does not hold back the others
+        int64_t wait_start = diag_start();
+        bool received = publisher_receive(&frame, timeout);
+        diag_record(DIAG_STAGE_QUEUE_WAIT, wait_start);
+
+        if (!received) {
+#if ESP_MQTT_CONTROL
+            handle_control_messages();
+#endif
             continue;
         }
 
-        dht_reading_t dht_reading;
-        battery_reading_t battery_reading;
-
-        const esp_mqtt_client_handle_t client = *(esp_mqtt_client_handle_t*)params;
-
-        BaseType_t dht_status = xQueueReceive(dht_reading_queue, &dht_reading, portMAX_DELAY);
-        if (dht_status == pdPASS) {
-            char string[20];  // 20 - maximum number of characters for a float: -[sign][d].[d...]e[sign]d
-            ESP_LOGD(TAG, "Publish humidity: %.2f, temperature: %.2f", dht_reading.humidity, dht_reading.temperature);
-            esp_mqtt_client_publish(client, CONFIG_ESP_MQTT_TOPIC_HUMIDITY,
-                                    float_to_string(dht_reading.humidity, string), 0, 1, 1);
-            esp_mqtt_client_publish(client, CONFIG_ESP_MQTT_TOPIC_TEMPERATURE,
-                                    float_to_string(dht_reading.temperature, string), 0, 1, 1);
-        } else {
-            ESP_LOGE(TAG, "mqtt_task(): Failed to receive the message from the dht_reading_queue");
+        // a frame left without values is not published, but still gives the backlog a chance to drain
+        uint8_t mask = filter_sample(&frame);
+        if (frame.flags != 0) {
+            frame.seq = ++sample_seq;
+            frame.timestamp = (uint32_t)time(NULL);
         }
 
-        BaseType_t battery_status = xQueueReceive(battery_reading_queue, &battery_reading, portMAX_DELAY);
-        if (battery_status == pdPASS) {
-            char string[20];  // 20 - maximum number of characters for a float: -[sign][d].[d...]e[sign]d
-            ESP_LOGD(TAG, "Publish voltage: %.2f, SOC: %.2f%%", battery_reading.voltage, battery_reading.soc);
-            esp_mqtt_client_publish(client, CONFIG_ESP_MQTT_TOPIC_BATTERY_VOLTAGE,
-                                    float_to_string(battery_reading.voltage, string), 0, 1, 1);
-            esp_mqtt_client_publish(client, CONFIG_ESP_MQTT_TOPIC_BATTERY_SOC,
-                                    float_to_string(battery_reading.soc, string), 0, 1, 1);
-        } else {
-            ESP_LOGE(TAG, "mqtt_task(): Failed to receive the message from the battery_reading_queue");
+#if CONFIG_ESP_STORE_FORWARD
+        if (!mqtt5_is_connected()) {
+            if (frame.flags != 0) {
+                store_sample(&frame);
+            }
+            continue;
         }
+
+        publish_sample(&frame, mask);
+#if ESP_MQTT_DHT_STATS
+        publish_dht_stats();
+#endif
+        publish_backlog();
+#else
+        publish_sample(&frame, mask);
+#if ESP_MQTT_DHT_STATS
+        publish_dht_stats();
+#endif
+#endif
+    }
+}
+#endif
+
+bool mqtt5_is_connected(void)
+{
+    if (mqtt_event_group == NULL) {
+        return false;
+    }
+
+    return (xEventGroupGetBits(mqtt_event_group) & MQTT_CONNECTED_BIT) != 0;
+}
+
+bool mqtt5_wait_connected(TickType_t timeout)
+{
+    EventBits_t bits = xEventGroupWaitBits(mqtt_event_group, MQTT_CONNECTED_BIT, pdFALSE, pdFALSE, timeout);
+    return (bits & MQTT_CONNECTED_BIT) != 0;
+}
+
+void mqtt5_publish_readings(uint32_t seq, const dht_reading_t *dht_reading, const battery_reading_t *battery_reading)
+{
+    sensor_frame_t frame;
+    make_frame(&frame, seq, dht_reading, battery_reading);
+    publish_sample(&frame, DEADBAND_DHT_MASK | DEADBAND_BATTERY_MASK);
+}
+
+#if CONFIG_ESP_STORE_FORWARD
+void mqtt5_store_readings(uint32_t seq, const dht_reading_t *dht_reading, const battery_reading_t *battery_reading)
+{
+    sensor_frame_t frame;
+    make_frame(&frame, seq, dht_reading, battery_reading);
+    if (frame.flags != 0) {
+        store_sample(&frame);
+    }
+}
+
+void mqtt5_publish_backlog(void)
+{
+    if (mqtt5_is_connected()) {
+        publish_backlog();
+    }
+}
+#endif
+
+int mqtt5_pending_acks(void)
+{
+#if CONFIG_ESP_STORE_FORWARD
+    // an acknowledged batch leaves the store before the node goes to sleep
+    backlog_settle();
+#endif
+    return atomic_load(&pending_acks);
+}
+
+void mqtt5_connect(void)
+{
+    esp_err_t err;
+
+    if (!atomic_exchange(&client_started, true)) {
+        ESP_LOGI(TAG, "Connecting to the broker");
+        err = esp_mqtt_client_start(client);
+    } else {
+        ESP_LOGI(TAG, "Reconnecting to the broker");
+        err = esp_mqtt_client_reconnect(client);
+    }
+
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "Connect attempt failed: %s", esp_err_to_name(err));
+        connectivity_notify(CONN_EVENT_MQTT_DOWN);
     }
 }
 
+void mqtt5_stop(void)
+{
+    if (client == NULL || !atomic_load(&client_started)) {
+        return;
+    }
+
+    // a clean DISCONNECT keeps the broker from publishing the will message
+    esp_mqtt_client_disconnect(client);
+    esp_mqtt_client_stop(client);
+}
+
 esp_err_t mqtt5_init(void) {
     ESP_LOGI(TAG, "Init");
     esp_mqtt5_connection_property_config_t connect_property = {
-            .session_expiry_interval = 10,
-            .maximum_packet_size = 1024,
-            .receive_maximum = 65535,
-            .topic_alias_maximum = 2,
-            .request_resp_info = true,
-            .request_problem_info = true,
-            .will_delay_interval = 10,
-            .payload_format_indicator = true,
-            .message_expiry_interval = 10,
+            .session_expiry_interval = MQTT_SESSION_EXPIRY_INTERVAL_SEC,
+            .maximum_packet_size = MQTT_SESSION_MAXIMUM_PACKET_SIZE,
+            .receive_maximum = MQTT_SESSION_RECEIVE_MAXIMUM,
+            .topic_alias_maximum = MQTT_SESSION_TOPIC_ALIAS_MAXIMUM,
+            .request_resp_info = MQTT_SESSION_REQUEST_RESP_INFO,
+            .request_problem_info = MQTT_SESSION_REQUEST_PROBLEM_INFO,
+            .will_delay_interval = MQTT_SESSION_WILL_DELAY_SEC,
+            .payload_format_indicator = MQTT_SESSION_WILL_PAYLOAD_FORMAT,
+            .message_expiry_interval = MQTT_SESSION_WILL_MESSAGE_EXPIRY_SEC,
     };
 
+#if CONFIG_ESP_STATIC_ALLOCATION
+    mqtt_event_group = xEventGroupCreateStatic(&mqtt_event_group_buffer);
+#else
+    mqtt_event_group = xEventGroupCreate();
+    if (mqtt_event_group == NULL) {
+        ESP_LOGE(TAG, "mqtt_event_group: Event group was not created. Could not allocate required memory");
+        return ESP_ERR_NO_MEM;
+    }
+#endif
+
     esp_mqtt_client_config_t mqtt5_cfg = {
             .broker.address.uri = CONFIG_ESP_BROKER_URL,
             .session.protocol_ver = MQTT_PROTOCOL_V_5,
             .network.disable_auto_reconnect = true,
             .credentials.username = CONFIG_ESP_MQTT_USERNAME,
             .credentials.authentication.password = CONFIG_ESP_MQTT_PASSWORD,
-            .session.last_will.topic = "/topic/will",
-            .session.last_will.msg = "i will leave",
-            .session.last_will.msg_len = 12,
-            .session.last_will.qos = 1,
-            .session.last_will.retain = true,
+            .session.keepalive = MQTT_SESSION_KEEPALIVE_SEC,
+            .session.last_will.topic = MQTT_SESSION_WILL_TOPIC,
+            .session.last_will.msg = MQTT_SESSION_WILL_MESSAGE,
+            .session.last_will.msg_len = sizeof(MQTT_SESSION_WILL_MESSAGE) - 1,
+            .session.last_will.qos = MQTT_SESSION_WILL_QOS,
+            .session.last_will.retain = MQTT_SESSION_WILL_RETAIN,
     };
 
-    // NOTE: The parameter "client" must still exist when the created task executes. It must be static.
-    static esp_mqtt_client_handle_t client;
+#if CONFIG_ESP_MQTT_TLS
+    // the handshake resumes the session of the previous connection, also across deep sleep
+    mqtt5_cfg.network.transport = tls_transport_create();
+    if (mqtt5_cfg.network.transport == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+#endif
+
     client = esp_mqtt_client_init(&mqtt5_cfg);
 
     /* Set connection properties and user properties */
@@ -169,19 +991,46 @@ esp_err_t mqtt5_init(void) {
     esp_mqtt5_client_delete_user_property(connect_property.user_property);
     esp_mqtt5_client_delete_user_property(connect_property.will_user_property);
 
+#if ESP_MQTT_CONTROL
+#if CONFIG_ESP_STATIC_ALLOCATION
+    control_queue = xQueueCreateStatic(CONTROL_QUEUE_DEPTH, sizeof(control_message_t), control_queue_storage,
+                                       &control_queue_buffer);
+#else
+    control_queue = xQueueCreate(CONTROL_QUEUE_DEPTH, sizeof(control_message_t));
+    if (control_queue == NULL) {
+        ESP_LOGE(TAG, "control_queue: Queue was not created. Could not allocate required memory");
+        return ESP_ERR_NO_MEM;
+    }
+#endif
+    ESP_ERROR_CHECK(publisher_set_control(control_queue, CONTROL_QUEUE_DEPTH));
+#endif
+
     /* The last argument may be used to pass data to the event handler, in this example mqtt_event_handler */
     ESP_ERROR_CHECK(esp_mqtt_client_register_event(client, ESP_EVENT_ANY_ID, event_handler, NULL));
-    ESP_ERROR_CHECK(esp_mqtt_client_start(client));
 
-    BaseType_t status = xTaskCreate(mqtt_task, "mqtt_task", configMINIMAL_STACK_SIZE * 4, &client, 3,
-                                    &mqtt_task_handle);
+#if !CONFIG_ESP_DUTY_CYCLE_MODE
+    // the duty cycle publishes its single sample itself, see mqtt5_publish_readings()
+#if CONFIG_ESP_STATIC_ALLOCATION
+    mqtt_task_handle = xTaskCreateStaticPinnedToCore(mqtt_task, "mqtt_task", ESP_MQTT_TASK_STACK_SIZE, NULL,
+                                                     TASK_PRIORITY_MQTT, mqtt_task_stack, &mqtt_task_tcb,
+                                                     TASK_CORE_MQTT);
+#else
+    BaseType_t status = xTaskCreatePinnedToCore(mqtt_task, "mqtt_task", ESP_MQTT_TASK_STACK_SIZE, NULL,
+                                                TASK_PRIORITY_MQTT, &mqtt_task_handle, TASK_CORE_MQTT);
 
     if (status != pdPASS) {
         ESP_LOGE(TAG, "mqtt_task(): Task was not created. Could not allocate required memory");
         return ESP_ERR_NO_MEM;
     }
+#endif
 
+    mem_report_task(mqtt_task_handle, ESP_MQTT_TASK_STACK_SIZE, MEM_STATIC_ALLOCATION);
+
+#if !CONFIG_ESP_STORE_FORWARD
     vTaskSuspend(mqtt_task_handle);
+#endif
+#endif
+
     ESP_LOGI(TAG, "mqtt_init() finished successfully");
 
     return ESP_OK;
@@ -1,16 +1,131 @@
 #ifndef __MQTT_H__
 #define __MQTT_H__
 
+#include <stdbool.h>
 #include <esp_err.h>
 
+#include "freertos/FreeRTOS.h"
+#include "dht22.h"
+#include "battery.h"
+
 #define ESP_MQTT_USERNAME           CONFIG_ESP_MQTT_USERNAME
 #define ESP_MQTT_PASSWORD           CONFIG_ESP_MQTT_PASSWORD
+#define ESP_MQTT_TASK_STACK_SIZE    CONFIG_ESP_MQTT_TASK_STACK_SIZE
 
 #define ESP_MQTT_TOPIC_TEMPERATURE      CONFIG_ESP_MQTT_TOPIC_TEMPERATURE
 #define ESP_MQTT_TOPIC_HUMIDITY         CONFIG_ESP_MQTT_TOPIC_HUMIDITY
 #define ESP_MQTT_TOPIC_BATTERY_VOLTAGE  CONFIG_ESP_MQTT_TOPIC_BATTERY_VOLTAGE
 #define ESP_MQTT_TOPIC_BATTERY_SOC      CONFIG_ESP_MQTT_TOPIC_BATTERY_SOC
 
+#if CONFIG_ESP_MQTT_FRAME
+#define ESP_MQTT_TOPIC_FRAME            CONFIG_ESP_MQTT_TOPIC_FRAME
+#if CONFIG_ESP_MQTT_FRAME_FORMAT_JSON
+#define ESP_MQTT_FRAME_FORMAT           PAYLOAD_FORMAT_JSON
+#elif CONFIG_ESP_MQTT_FRAME_FORMAT_CBOR
+#define ESP_MQTT_FRAME_FORMAT           PAYLOAD_FORMAT_CBOR
+#elif CONFIG_ESP_MQTT_FRAME_FORMAT_BINARY
+#define ESP_MQTT_FRAME_FORMAT           PAYLOAD_FORMAT_BINARY
+#endif
+#endif
+
+#if CONFIG_ESP_MQTT_TOPIC_ALIAS
+#define ESP_MQTT_TOPIC_ALIAS_MAX        CONFIG_ESP_MQTT_TOPIC_ALIAS_MAX
+#endif
+
+#if CONFIG_ESP_MQTT_DEADBAND
+/*
+ * Thresholds from the units of the settings (see node_config.h) to the units of the readings (see fixed.h), below
+ * the DHT22 resolution of 0.1 rounds down
+ */
+#define ESP_MQTT_DEADBAND_TEMPERATURE(centi)        ((centi) / 10)          /*!< 0.1 °C */
+#define ESP_MQTT_DEADBAND_HUMIDITY(centi)           ((centi) / 10)          /*!< 0.1 % */
+#define ESP_MQTT_DEADBAND_BATTERY_VOLTAGE(mv)       ((mv) * 64 / 5)         /*!< 78.125 uV */
+#define ESP_MQTT_DEADBAND_BATTERY_SOC(centi)        ((centi) * 256 / 100)   /*!< 1/256 % */
+#endif
+
+#if CONFIG_ESP_DHT_FILTER && CONFIG_ESP_DHT_FILTER_WINDOW_SEC > 0
+#define ESP_MQTT_DHT_STATS              1
+#define ESP_MQTT_TOPIC_DHT_STATS        CONFIG_ESP_MQTT_TOPIC_DHT_STATS
+#endif
+
+#if CONFIG_ESP_MQTT_DIAG
+#define ESP_MQTT_TOPIC_DIAG             CONFIG_ESP_MQTT_TOPIC_DIAG
+#define ESP_MQTT_DIAG_INTERVAL_MS       (CONFIG_ESP_MQTT_DIAG_INTERVAL_SEC * 1000)
+#endif
+
+#if CONFIG_ESP_REMOTE_CONFIG
+#define ESP_MQTT_TOPIC_CONFIG           CONFIG_ESP_MQTT_TOPIC_CONFIG
+#define ESP_MQTT_TOPIC_CONFIG_STATE     CONFIG_ESP_MQTT_TOPIC_CONFIG_STATE
+#endif
+
+#if CONFIG_ESP_BINLOG
+#define ESP_MQTT_TOPIC_LOG              CONFIG_ESP_MQTT_TOPIC_LOG
+#define ESP_MQTT_TOPIC_LOG_DUMP         CONFIG_ESP_MQTT_TOPIC_LOG_DUMP
+#endif
+
+#if CONFIG_ESP_OTA
+#define ESP_MQTT_TOPIC_OTA              CONFIG_ESP_MQTT_TOPIC_OTA
+#define ESP_MQTT_TOPIC_OTA_STATE        CONFIG_ESP_MQTT_TOPIC_OTA_STATE
+#endif
+
+#if CONFIG_ESP_STORE_FORWARD
+#define ESP_MQTT_TOPIC_BACKLOG          CONFIG_ESP_MQTT_TOPIC_BACKLOG
+#define ESP_STORE_DRAIN_BATCH           CONFIG_ESP_STORE_DRAIN_BATCH
+#define ESP_STORE_MAX_IN_FLIGHT         CONFIG_ESP_STORE_MAX_IN_FLIGHT
+#if CONFIG_ESP_MQTT_FRAME
+#define ESP_MQTT_BACKLOG_FORMAT         ESP_MQTT_FRAME_FORMAT
+#else
+#define ESP_MQTT_BACKLOG_FORMAT         PAYLOAD_FORMAT_JSON
+#endif
+#endif
+
 esp_err_t mqtt5_init(void);
 
+/**
+ * @brief Block until the client is connected to the broker or the timeout expires
+ */
+bool mqtt5_wait_connected(TickType_t timeout);
+
+/**
+ * @brief Publish one sample directly, bypassing the reader queues. NULL readings are skipped.
+ */
+void mqtt5_publish_readings(uint32_t seq, const dht_reading_t *dht_reading, const battery_reading_t *battery_reading);
+
+/**
+ * @brief Whether the client is currently connected to the broker
+ */
+bool mqtt5_is_connected(void);
+
+#if CONFIG_ESP_STORE_FORWARD
+/**
+ * @brief Buffer one sample in the backlog instead of publishing it. NULL readings are skipped.
+ */
+void mqtt5_store_readings(uint32_t seq, const dht_reading_t *dht_reading, const battery_reading_t *battery_reading);
+
+/**
+ * @brief Upload one batch of buffered samples if connected and live data is not waiting for PUBACKs
+ *
+ * A batch stays in the backlog until its PUBACK, the next batch goes out after that.
+ */
+void mqtt5_publish_backlog(void);
+#endif
+
+/**
+ * @brief Number of QoS1 publishes still waiting for their PUBACK
+ *
+ * With store and forward, also removes an acknowledged backlog batch from the store: call it from the publishing
+ * task only.
+ */
+int mqtt5_pending_acks(void);
+
+/**
+ * @brief Start one connect attempt to the broker, the result arrives as MQTT_EVENT_CONNECTED or _DISCONNECTED
+ */
+void mqtt5_connect(void);
+
+/**
+ * @brief Disconnect cleanly and stop the client
+ */
+void mqtt5_stop(void);
+
 #endif // __MQTT_H__
\ No newline at end of file
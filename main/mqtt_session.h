@@ -0,0 +1,32 @@
+#ifndef __MQTT_SESSION_H__
+#define __MQTT_SESSION_H__
+
+/*
+ * MQTT5 session of a node as the broker sees it: the CONNECT properties, the will and the user properties sent
+ * with both. mqtt5_init() hands them to esp-mqtt, host/fleet_sim encodes them itself so its virtual nodes cost the
+ * broker what a real one does.
+ */
+
+#define MQTT_SESSION_KEEPALIVE_SEC              120     /*!< esp-mqtt default */
+#define MQTT_SESSION_EXPIRY_INTERVAL_SEC        10
+#define MQTT_SESSION_MAXIMUM_PACKET_SIZE        1024
+#define MQTT_SESSION_RECEIVE_MAXIMUM            65535
+#define MQTT_SESSION_TOPIC_ALIAS_MAXIMUM        2       /*!< aliases the broker may use towards the node */
+#define MQTT_SESSION_REQUEST_RESP_INFO          1
+#define MQTT_SESSION_REQUEST_PROBLEM_INFO       1
+
+#define MQTT_SESSION_WILL_TOPIC                 "/topic/will"
+#define MQTT_SESSION_WILL_MESSAGE               "i will leave"
+#define MQTT_SESSION_WILL_QOS                   1
+#define MQTT_SESSION_WILL_RETAIN                1
+#define MQTT_SESSION_WILL_DELAY_SEC             10
+#define MQTT_SESSION_WILL_PAYLOAD_FORMAT        1       /*!< the will message is UTF-8 */
+#define MQTT_SESSION_WILL_MESSAGE_EXPIRY_SEC    10
+
+/* { key, value } pairs for the CONNECT and the will, an initializer for esp_mqtt5_user_property_item_t[] */
+#define MQTT_SESSION_USER_PROPERTIES \
+        { "board", "esp32" }, \
+        { "u", "user" }, \
+        { "p", "password" }
+
+#endif // __MQTT_SESSION_H__
@@ -0,0 +1,247 @@
+#include <inttypes.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "node_config.h"
+
+#define KEY_MAX_SIZE    32
+
+typedef struct {
+    const char *key;
+    size_t offset;
+    uint32_t min;
+    uint32_t max;
+} setting_t;
+
+/* The ranges of the Kconfig options, whatever the defaults can be must pass node_config_valid() */
+static const setting_t settings[] = {
+        { "dht_period_ms", offsetof(node_config_t, dht_period_ms), 2000, 3600000 },
+        { "battery_period_ms", offsetof(node_config_t, battery_period_ms), 0, 86400000 },
+        { "dht_min_interval_ms", offsetof(node_config_t, dht_min_interval_ms), 0, 86400000 },
+        { "battery_min_interval_ms", offsetof(node_config_t, battery_min_interval_ms), 0, 86400000 },
+        { "qos", offsetof(node_config_t, qos), 0, 1 },
+        { "deadband_temperature", offsetof(node_config_t, deadband_temperature), 0, 10000 },
+        { "deadband_humidity", offsetof(node_config_t, deadband_humidity), 0, 10000 },
+        { "deadband_battery_voltage", offsetof(node_config_t, deadband_battery_voltage), 0, 5000 },
+        { "deadband_battery_soc", offsetof(node_config_t, deadband_battery_soc), 0, 10000 },
+        { "heartbeat_sec", offsetof(node_config_t, heartbeat_sec), 0, 86400 },
+};
+
+#define SETTING_COUNT   (sizeof(settings) / sizeof(settings[0]))
+
+typedef enum {
+    VALUE_OK = 0,
+    VALUE_NOT_INTEGER,
+    VALUE_OUT_OF_RANGE,
+    VALUE_MISSING,              /*!< the message ends before the value */
+} value_result_t;
+
+typedef struct {
+    const char *json;
+    size_t len;
+    size_t pos;
+} reader_t;
+
+static uint32_t *setting_value(node_config_t *config, const setting_t *setting)
+{
+    return (uint32_t *)((uint8_t *)config + setting->offset);
+}
+
+static uint32_t setting_get(const node_config_t *config, const setting_t *setting)
+{
+    return *(const uint32_t *)((const uint8_t *)config + setting->offset);
+}
+
+static const setting_t *find_setting(const char *key)
+{
+    for (size_t i = 0; i < SETTING_COUNT; i++) {
+        if (strcmp(settings[i].key, key) == 0) {
+            return &settings[i];
+        }
+    }
+
+    return NULL;
+}
+
+static bool reject(char *error, size_t size, const char *format, ...)
+{
+    va_list args;
+
+    if (size > 0) {
+        va_start(args, format);
+        vsnprintf(error, size, format, args);
+        va_end(args);
+    }
+
+    return false;
+}
+
+static void skip_space(reader_t *r)
+{
+    while (r->pos < r->len && (r->json[r->pos] == ' ' || r->json[r->pos] == '\t' || r->json[r->pos] == '\n' ||
+                               r->json[r->pos] == '\r')) {
+        r->pos++;
+    }
+}
+
+static bool take(reader_t *r, char c)
+{
+    skip_space(r);
+    if (r->pos < r->len && r->json[r->pos] == c) {
+        r->pos++;
+        return true;
+    }
+
+    return false;
+}
+
+/* A key without escapes, longer ones are cut to size and match no setting. Only such keys are echoed in errors. */
+static bool read_key(reader_t *r, char *key, size_t size)
+{
+    size_t len = 0;
+
+    if (!take(r, '"')) {
+        return false;
+    }
+
+    while (r->pos < r->len && r->json[r->pos] != '"') {
+        char c = r->json[r->pos];
+
+        if (c == '\\' || (unsigned char)c < 0x20) {
+            return false;
+        }
+        if (len < size - 1) {
+            key[len++] = c;
+        }
+        r->pos++;
+    }
+    key[len] = '\0';
+
+    return take(r, '"');
+}
+
+static value_result_t read_value(reader_t *r, uint32_t *value)
+{
+    uint64_t number = 0;
+    bool negative = false;
+    size_t digits = 0;
+
+    skip_space(r);
+    if (r->pos == r->len) {
+        return VALUE_MISSING;
+    }
+    if (r->json[r->pos] == '-') {
+        negative = true;
+        r->pos++;
+    }
+
+    for (; r->pos < r->len && r->json[r->pos] >= '0' && r->json[r->pos] <= '9'; r->pos++, digits++) {
+        if (number <= UINT32_MAX) {
+            number = number * 10 + (uint64_t)(r->json[r->pos] - '0');
+        }
+    }
+
+    // fractions and exponents are not settings
+    if (digits == 0 || (r->pos < r->len && (r->json[r->pos] == '.' || r->json[r->pos] == 'e' ||
+                                            r->json[r->pos] == 'E'))) {
+        return VALUE_NOT_INTEGER;
+    }
+    if (negative || number > UINT32_MAX) {
+        return VALUE_OUT_OF_RANGE;
+    }
+
+    *value = (uint32_t)number;
+    return VALUE_OK;
+}
+
+bool node_config_parse(node_config_t *config, const char *json, size_t len, char *error, size_t error_size)
+{
+    reader_t r = { .json = json, .len = len };
+    node_config_t parsed = *config;
+
+    if (error_size > 0) {
+        error[0] = '\0';
+    }
+
+    if (!take(&r, '{')) {
+        return reject(error, error_size, "malformed JSON at offset %u", (unsigned)r.pos);
+    }
+
+    if (!take(&r, '}')) {
+        do {
+            char key[KEY_MAX_SIZE];
+            uint32_t value;
+
+            if (!read_key(&r, key, sizeof(key)) || !take(&r, ':')) {
+                return reject(error, error_size, "malformed JSON at offset %u", (unsigned)r.pos);
+            }
+
+            const setting_t *setting = find_setting(key);
+            if (setting == NULL) {
+                return reject(error, error_size, "unknown key: %s", key);
+            }
+
+            value_result_t result = read_value(&r, &value);
+            if (result == VALUE_MISSING) {
+                return reject(error, error_size, "malformed JSON at offset %u", (unsigned)r.pos);
+            }
+            if (result == VALUE_NOT_INTEGER) {
+                return reject(error, error_size, "%s: not an integer", key);
+            }
+            if (result == VALUE_OUT_OF_RANGE || value < setting->min || value > setting->max) {
+                return reject(error, error_size, "%s: out of range", key);
+            }
+
+            *setting_value(&parsed, setting) = value;
+        } while (take(&r, ','));
+
+        if (!take(&r, '}')) {
+            return reject(error, error_size, "malformed JSON at offset %u", (unsigned)r.pos);
+        }
+    }
+
+    skip_space(&r);
+    if (r.pos != r.len) {
+        return reject(error, error_size, "malformed JSON at offset %u", (unsigned)r.pos);
+    }
+
+    *config = parsed;
+    return true;
+}
+
+bool node_config_valid(const node_config_t *config)
+{
+    for (size_t i = 0; i < SETTING_COUNT; i++) {
+        uint32_t value = setting_get(config, &settings[i]);
+
+        if (value < settings[i].min || value > settings[i].max) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+int node_config_encode_state(const node_config_t *config, const char *error, char *json, size_t size)
+{
+    int len;
+
+    // error only ever holds the messages above, keys in it have no quotes, backslashes or control characters
+    if (error == NULL) {
+        len = snprintf(json, size, "{\"applied\":true");
+    } else {
+        len = snprintf(json, size, "{\"applied\":false,\"error\":\"%s\"", error);
+    }
+
+    for (size_t i = 0; i < SETTING_COUNT && len >= 0 && (size_t)len < size; i++) {
+        len += snprintf(json + len, size - (size_t)len, ",\"%s\":%" PRIu32, settings[i].key,
+                        setting_get(config, &settings[i]));
+    }
+
+    if (len >= 0 && (size_t)len < size) {
+        len += snprintf(json + len, size - (size_t)len, "}");
+    }
+
+    return len >= 0 && (size_t)len < size ? len : -1;
+}
@@ -0,0 +1,60 @@
+#ifndef __NODE_CONFIG_H__
+#define __NODE_CONFIG_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Settings that can change at runtime: sampling periods, publish intervals, deadbands and the QoS of the live values.
+ * Kconfig gives the defaults, a JSON object on the configuration topic changes any subset of them, e.g.
+ *
+ *   {"dht_period_ms":30000,"qos":0,"deadband_temperature":20}
+ *
+ * Values are non-negative integers in the units of the Kconfig options of the same name. A message is applied
+ * whole or not at all: an unknown key, a value out of range or malformed JSON rejects it. No ESP-IDF dependencies,
+ * remote_config.c keeps the settings in NVS and applies them, host/config_sim.c drives messages through it.
+ */
+
+#define NODE_CONFIG_MESSAGE_MAX_SIZE    384     /*!< longest configuration message accepted */
+#define NODE_CONFIG_STATE_MAX_SIZE      448     /*!< node_config_encode_state() with an error always fits */
+#define NODE_CONFIG_ERROR_SIZE          48
+
+typedef struct {
+    uint32_t dht_period_ms;             /*!< DHT22 sampling period */
+    uint32_t battery_period_ms;         /*!< MAX17048 sampling period (the fallback period with the ALERT pin), 0
+                                             samples only on ALERT */
+    uint32_t dht_min_interval_ms;       /*!< publish DHT22 samples at most once per interval, 0 = every sample */
+    uint32_t battery_min_interval_ms;   /*!< publish battery samples at most once per interval, 0 = every sample */
+    uint32_t qos;                       /*!< QoS of the live values, 0 or 1 */
+    uint32_t deadband_temperature;      /*!< 0.01 °C */
+    uint32_t deadband_humidity;         /*!< 0.01 % */
+    uint32_t deadband_battery_voltage;  /*!< mV */
+    uint32_t deadband_battery_soc;      /*!< 0.01 % */
+    uint32_t heartbeat_sec;             /*!< publish unchanged values at least this often, 0 = never */
+} node_config_t;
+
+/**
+ * @brief Apply a JSON object of settings, all of it or nothing
+ *
+ * @param config settings to change, left as they were if the message is rejected
+ * @param json message, not NUL terminated
+ * @param error output, why the message was rejected, e.g. "qos: out of range"
+ * @return false if the message was rejected
+ */
+bool node_config_parse(node_config_t *config, const char *json, size_t len, char *error, size_t error_size);
+
+/**
+ * @brief Whether every setting is in range, e.g. for settings read back from flash
+ */
+bool node_config_valid(const node_config_t *config);
+
+/**
+ * @brief Encode the settings in effect as a JSON object, with the outcome of the last message
+ *
+ * @param error NULL if the last message was applied, otherwise why it was rejected
+ * @return length of the JSON, or -1 if json is too small
+ */
+int node_config_encode_state(const node_config_t *config, const char *error, char *json, size_t size);
+
+#endif // __NODE_CONFIG_H__
@@ -0,0 +1,334 @@
+#include <inttypes.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/timers.h"
+#include "esp_app_desc.h"
+#include "esp_log.h"
+#include "esp_ota_ops.h"
+#include "esp_partition.h"
+#include "esp_timer.h"
+#include "delta.h"
+#include "ota.h"
+
+static const char *TAG = "OTA";
+
+#define OTA_CONFIRM_TIMEOUT_MS  (CONFIG_ESP_OTA_CONFIRM_TIMEOUT_SEC * 1000)
+
+typedef enum {
+    OTA_IDLE = 0,               /*!< nothing received since the boot */
+    OTA_RECEIVING,
+    OTA_APPLIED,                /*!< new image in place, reboot pending */
+    OTA_FAILED,
+} ota_phase_t;
+
+/* Written by the MQTT client task, read by mqtt_task after report_due says there is something new */
+static struct {
+    ota_phase_t phase;
+    const esp_partition_t *running;
+    const esp_partition_t *update;
+    esp_ota_handle_t handle;
+    size_t patch_bytes;
+    size_t received;
+    int64_t start_us;
+    int64_t apply_us;           /*!< time in the decoder and flash writes, the rest of the receive time is network */
+    uint32_t receive_ms;
+    uint32_t image_bytes;
+    bool full_image;
+    bool confirmed;
+    bool rolled_back;           /*!< the last update did not confirm and was rolled back */
+    const char *error;
+} ota;
+
+static atomic_bool pending_verify = false;
+static atomic_bool report_due = false;
+
+static TimerHandle_t confirm_timer = NULL;
+#if CONFIG_ESP_STATIC_ALLOCATION
+static StaticTimer_t confirm_timer_buffer;
+#endif
+
+/* 5 KiB, one update at a time */
+static delta_t delta;
+
+/* The key of the release signatures, from the hex of ESP_OTA_PUBLIC_KEY */
+static uint8_t public_key[ED25519_PUBLIC_KEY_SIZE];
+static bool public_key_valid = false;
+
+static void confirm_timeout(TimerHandle_t timer)
+{
+    if (atomic_load(&pending_verify)) {
+        ESP_LOGE(TAG, "Image not confirmed within %d s, rolling back", CONFIG_ESP_OTA_CONFIRM_TIMEOUT_SEC);
+        esp_ota_mark_app_invalid_rollback_and_reboot();
+    }
+}
+
+static int hex_value(char c)
+{
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+static bool parse_public_key(const char *hex)
+{
+    if (strlen(hex) != 2 * ED25519_PUBLIC_KEY_SIZE) {
+        return false;
+    }
+
+    for (size_t i = 0; i < ED25519_PUBLIC_KEY_SIZE; i++) {
+        int high = hex_value(hex[2 * i]);
+        int low = hex_value(hex[2 * i + 1]);
+
+        if (high < 0 || low < 0) {
+            return false;
+        }
+        public_key[i] = (uint8_t)(high << 4 | low);
+    }
+
+    return true;
+}
+
+esp_err_t ota_init(void)
+{
+    esp_ota_img_states_t state;
+
+    public_key_valid = parse_public_key(CONFIG_ESP_OTA_PUBLIC_KEY);
+    if (!public_key_valid) {
+        ESP_LOGE(TAG, "ESP_OTA_PUBLIC_KEY is not 64 hex digits, every update will be rejected");
+    }
+
+    ota.running = esp_ota_get_running_partition();
+    ota.rolled_back = esp_ota_get_last_invalid_partition() != NULL;
+    ESP_LOGI(TAG, "Running %s from %s", esp_app_get_description()->version, ota.running->label);
+
+    // the version that runs goes out on the first connect, also after a rollback
+    atomic_store(&report_due, true);
+
+    if (esp_ota_get_state_partition(ota.running, &state) != ESP_OK || state != ESP_OTA_IMG_PENDING_VERIFY) {
+        return ESP_OK;
+    }
+
+    atomic_store(&pending_verify, true);
+#if CONFIG_ESP_STATIC_ALLOCATION
+    confirm_timer = xTimerCreateStatic("ota_confirm", pdMS_TO_TICKS(OTA_CONFIRM_TIMEOUT_MS), pdFALSE, NULL,
+                                       confirm_timeout, &confirm_timer_buffer);
+#else
+    confirm_timer = xTimerCreate("ota_confirm", pdMS_TO_TICKS(OTA_CONFIRM_TIMEOUT_MS), pdFALSE, NULL,
+                                 confirm_timeout);
+#endif
+    if (confirm_timer == NULL || xTimerStart(confirm_timer, 0) != pdPASS) {
+        ESP_LOGE(TAG, "ota_confirm: Timer was not started");
+        return ESP_FAIL;
+    }
+
+    ESP_LOGI(TAG, "New image, confirmed by the first PUBACK within %d s", CONFIG_ESP_OTA_CONFIRM_TIMEOUT_SEC);
+    return ESP_OK;
+}
+
+bool ota_confirm(void)
+{
+    if (!atomic_exchange(&pending_verify, false)) {
+        return false;
+    }
+
+    xTimerStop(confirm_timer, 0);
+    esp_err_t err = esp_ota_mark_app_valid_cancel_rollback();
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Image not confirmed: %s", esp_err_to_name(err));
+        return false;
+    }
+
+    ESP_LOGI(TAG, "Image %s confirmed", esp_app_get_description()->version);
+    ota.confirmed = true;
+    atomic_store(&report_due, true);
+    return true;
+}
+
+static int read_running(void *ctx, uint32_t offset, void *dst, size_t len)
+{
+    return esp_partition_read(ota.running, offset, dst, len) == ESP_OK ? 0 : -1;
+}
+
+static int write_update(void *ctx, const void *src, size_t len)
+{
+    return esp_ota_write(ota.handle, src, len) == ESP_OK ? 0 : -1;
+}
+
+static bool update_failed(const char *error, bool abort)
+{
+    if (abort) {
+        esp_ota_abort(ota.handle);
+    }
+
+    ota.phase = OTA_FAILED;
+    ota.error = error;
+    ESP_LOGE(TAG, "Update failed after %zu of %zu bytes: %s", ota.received, ota.patch_bytes, error);
+    atomic_store(&report_due, true);
+    return true;
+}
+
+static bool update_start(size_t total)
+{
+    if (ota.phase == OTA_RECEIVING) {
+        // the broker sends the message again after a reconnect
+        ESP_LOGW(TAG, "Update restarted");
+        esp_ota_abort(ota.handle);
+    }
+
+    ota.update = esp_ota_get_next_update_partition(NULL);
+    ota.patch_bytes = total;
+    ota.received = 0;
+    ota.start_us = esp_timer_get_time();
+    ota.apply_us = 0;
+    ota.image_bytes = 0;
+    ota.error = NULL;
+
+    // sequential writes erase sector by sector as the image grows, not the whole partition up front
+    if (!public_key_valid) {
+        return update_failed("no public key to check the signature", false);
+    }
+    if (ota.update == NULL || esp_ota_begin(ota.update, OTA_WITH_SEQUENTIAL_WRITES, &ota.handle) != ESP_OK) {
+        return update_failed("no partition to update", false);
+    }
+
+    delta_init(&delta, public_key, read_running, write_update, NULL);
+    ota.phase = OTA_RECEIVING;
+    ESP_LOGI(TAG, "Receiving a %zu byte patch into %s", total, ota.update->label);
+    return false;
+}
+
+/* Nothing reaches the boot partition before delta_finish() checked the image against the CRC and the signature */
+static bool update_finish(void)
+{
+    int64_t start = esp_timer_get_time();
+    delta_result_t result = delta_finish(&delta);
+    if (result != DELTA_OK) {
+        return update_failed(delta_result_name(result), true);
+    }
+
+    // checks the image as the bootloader would, the handle is released either way
+    esp_err_t err = esp_ota_end(ota.handle);
+    if (err == ESP_OK) {
+        err = esp_ota_set_boot_partition(ota.update);
+    }
+    ota.apply_us += esp_timer_get_time() - start;
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "New image rejected: %s", esp_err_to_name(err));
+        return update_failed("image not valid", false);
+    }
+
+    ota.phase = OTA_APPLIED;
+    ESP_LOGI(TAG, "Applied: %zu byte patch to a %" PRIu32 " byte image, received in %" PRIu32 " ms, %" PRIu32
+             " ms of it applying", ota.patch_bytes, ota.image_bytes, ota.receive_ms, (uint32_t)(ota.apply_us / 1000));
+    atomic_store(&report_due, true);
+    return true;
+}
+
+bool ota_receive(const void *data, size_t len, size_t offset, size_t total)
+{
+    if (ota.phase == OTA_APPLIED) {
+        if (offset == 0) {
+            ESP_LOGW(TAG, "Update ignored, the node is about to reboot into the last one");
+        }
+        return false;
+    }
+
+    if (offset == 0 && update_start(total)) {
+        return true;
+    }
+
+    // the rest of a failed message
+    if (ota.phase != OTA_RECEIVING) {
+        return false;
+    }
+    if (offset != ota.received || total != ota.patch_bytes) {
+        return update_failed("message incomplete", true);
+    }
+
+    int64_t start = esp_timer_get_time();
+    delta_result_t result = delta_feed(&delta, data, len);
+    ota.apply_us += esp_timer_get_time() - start;
+    ota.received += len;
+    if (result != DELTA_OK) {
+        return update_failed(delta_result_name(result), true);
+    }
+
+    const delta_header_t *header = delta_header(&delta);
+    if (header != NULL && ota.image_bytes == 0) {
+        if (header->target_size > ota.update->size) {
+            return update_failed("image larger than the partition", true);
+        }
+        ota.image_bytes = header->target_size;
+        ota.full_image = header->source_size == 0;
+    }
+
+    if (ota.received < total) {
+        return false;
+    }
+
+    ota.receive_ms = (uint32_t)((esp_timer_get_time() - ota.start_us) / 1000);
+    return update_finish();
+}
+
+bool ota_report_due(void)
+{
+    return atomic_load(&report_due);
+}
+
+bool ota_restart_pending(void)
+{
+    return ota.phase == OTA_APPLIED;
+}
+
+int ota_encode_state(char *json, size_t size)
+{
+    const char *state;
+    int len;
+
+    atomic_store(&report_due, false);
+
+    switch (ota.phase) {
+        case OTA_APPLIED:
+            state = "applied";
+            break;
+        case OTA_FAILED:
+            state = "failed";
+            break;
+        default:
+            state = ota.confirmed ? "confirmed" : atomic_load(&pending_verify) ? "pending" : "running";
+            break;
+    }
+
+    len = snprintf(json, size, "{\"state\":\"%s\",\"version\":\"%s\",\"partition\":\"%s\"", state,
+                   esp_app_get_description()->version, ota.running->label);
+
+    if ((ota.phase == OTA_APPLIED || ota.phase == OTA_FAILED) && len >= 0 && (size_t)len < size) {
+        len += snprintf(json + len, size - (size_t)len, ",\"patch_bytes\":%zu,\"receive_ms\":%" PRIu32
+                        ",\"apply_ms\":%" PRIu32, ota.patch_bytes, ota.receive_ms, (uint32_t)(ota.apply_us / 1000));
+    }
+    if (ota.phase == OTA_APPLIED && len >= 0 && (size_t)len < size) {
+        len += snprintf(json + len, size - (size_t)len, ",\"image_bytes\":%" PRIu32 ",\"full_image\":%s",
+                        ota.image_bytes, ota.full_image ? "true" : "false");
+    }
+    if (ota.phase == OTA_FAILED && len >= 0 && (size_t)len < size) {
+        len += snprintf(json + len, size - (size_t)len, ",\"error\":\"%s\"", ota.error);
+    }
+    if (ota.rolled_back && len >= 0 && (size_t)len < size) {
+        len += snprintf(json + len, size - (size_t)len, ",\"rolled_back\":true");
+    }
+    if (len >= 0 && (size_t)len < size) {
+        len += snprintf(json + len, size - (size_t)len, "}");
+    }
+
+    return len >= 0 && (size_t)len < size ? len : -1;
+}
@@ -0,0 +1,57 @@
+#ifndef __OTA_H__
+#define __OTA_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <esp_err.h>
+
+/*
+ * Firmware updates over MQTT. A patch (delta.h, made with tools/delta_make.c) published on the OTA topic is applied
+ * to the passive app partition while it arrives, piece by piece from the MQTT client task, and the node reboots
+ * into the new image. That image boots pending verification: the first PUBACK after its boot confirms it, a reset
+ * before that (bootloader) or no PUBACK within ESP_OTA_CONFIRM_TIMEOUT_SEC (ota_init()) rolls back to the previous
+ * image. The outcome of every update and the version running after a boot go out on the OTA state topic, see
+ * ota_encode_state(); mqtt_task publishes them, as it does everything else.
+ */
+
+#define OTA_STATE_MAX_SIZE      256
+
+/**
+ * @brief Look at the image that booted, start the rollback timer if it is pending verification
+ */
+esp_err_t ota_init(void);
+
+/**
+ * @brief One piece of a patch received on the OTA topic
+ *
+ * @param offset position of data in the message, a message that starts again at 0 restarts the update
+ * @param total size of the whole message
+ * @return true if the update ended with this piece, applied or failed: a state report is due
+ */
+bool ota_receive(const void *data, size_t len, size_t offset, size_t total);
+
+/**
+ * @brief The node published successfully: an image pending verification is confirmed and stays
+ *
+ * @return true if this confirmed the image, a state report is then due
+ */
+bool ota_confirm(void);
+
+/**
+ * @brief Whether a state report is waiting to be published
+ */
+bool ota_report_due(void);
+
+/**
+ * @brief Encode the state report as JSON and mark it published
+ *
+ * @return length of the JSON, or -1 if json is too small
+ */
+int ota_encode_state(char *json, size_t size);
+
+/**
+ * @brief Whether a new image is in place and the node should reboot into it once the report went out
+ */
+bool ota_restart_pending(void);
+
+#endif // __OTA_H__
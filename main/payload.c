@@ -0,0 +1,345 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "payload.h"
+
+typedef struct {
+    uint8_t *data;
+    size_t size;
+    size_t len;
+    int overflow;
+} writer_t;
+
+static void put(writer_t *w, const void *src, size_t len)
+{
+    if (w->len + len > w->size) {
+        w->overflow = 1;
+        return;
+    }
+
+    memcpy(w->data + w->len, src, len);
+    w->len += len;
+}
+
+static void put_u8(writer_t *w, uint8_t value)
+{
+    put(w, &value, 1);
+}
+
+static void put_le16(writer_t *w, uint16_t value)
+{
+    uint8_t bytes[2] = { value & 0xFF, value >> 8 };
+    put(w, bytes, sizeof(bytes));
+}
+
+static void put_le32(writer_t *w, uint32_t value)
+{
+    uint8_t bytes[4] = { value & 0xFF, (value >> 8) & 0xFF, (value >> 16) & 0xFF, value >> 24 };
+    put(w, bytes, sizeof(bytes));
+}
+
+static void put_be32(writer_t *w, uint32_t value)
+{
+    uint8_t bytes[4] = { value >> 24, (value >> 16) & 0xFF, (value >> 8) & 0xFF, value & 0xFF };
+    put(w, bytes, sizeof(bytes));
+}
+
+static uint16_t scale_u16(int32_t raw, uint32_t den, uint32_t scale)
+{
+    int32_t scaled = fixed_rescale(raw, den, scale);
+
+    if (scaled < 0) {
+        return 0;
+    }
+
+    return scaled > UINT16_MAX ? UINT16_MAX : (uint16_t)scaled;
+}
+
+static int16_t scale_i16(int32_t raw, uint32_t den, uint32_t scale)
+{
+    int32_t scaled = fixed_rescale(raw, den, scale);
+
+    if (scaled < INT16_MIN) {
+        return INT16_MIN;
+    }
+
+    return scaled > INT16_MAX ? INT16_MAX : (int16_t)scaled;
+}
+
+/* == JSON ================================================================ */
+
+static void put_value(writer_t *w, const char *key, int32_t raw, uint32_t den)
+{
+    char string[FIXED_STRING_SIZE];
+    int len = fixed_format(raw, den, string, sizeof(string));
+
+    put(w, key, strlen(key));
+    put(w, string, (size_t)len);
+}
+
+static int encode_json(const sensor_frame_t *frame, uint8_t *buffer, size_t size)
+{
+    writer_t w = { .data = buffer, .size = size };
+    int len = snprintf((char *)buffer, size, "{\"seq\":%lu,\"ts\":%lu", (unsigned long)frame->seq,
+                       (unsigned long)frame->timestamp);
+
+    if (len < 0 || (size_t)len >= size) {
+        return -1;
+    }
+    w.len = len;
+
+    if (frame->flags & PAYLOAD_HAS_DHT) {
+        uint8_t sensor = PAYLOAD_DHT_SENSOR(frame->flags);
+
+        if (sensor > 0) {
+            char field[12];
+            put(&w, field, (size_t)snprintf(field, sizeof(field), ",\"dht\":%u", sensor));
+        }
+        put_value(&w, ",\"t\":", frame->temperature, FIXED_DHT_DEN);
+        put_value(&w, ",\"h\":", frame->humidity, FIXED_DHT_DEN);
+    }
+
+    if (frame->flags & PAYLOAD_HAS_BATTERY) {
+        put_value(&w, ",\"v\":", frame->voltage, FIXED_VCELL_DEN);
+        put_value(&w, ",\"soc\":", frame->soc, FIXED_SOC_DEN);
+    }
+
+    put_u8(&w, '}');
+
+    return w.overflow ? -1 : (int)w.len;
+}
+
+static void put_stats(writer_t *w, const char *key, const filter_stats_t *stats)
+{
+    char count[8];
+    int len = snprintf(count, sizeof(count), "%u", stats->count);
+
+    put(w, key, strlen(key));
+    put(w, "{\"n\":", 5);
+    put(w, count, (size_t)len);
+    put_value(w, ",\"min\":", stats->min, FIXED_DHT_DEN);
+    put_value(w, ",\"max\":", stats->max, FIXED_DHT_DEN);
+    put_value(w, ",\"mean\":", stats->mean, FIXED_DHT_DEN * FILTER_STATS_SCALE);
+    put_value(w, ",\"sd\":", stats->stddev, FIXED_DHT_DEN * FILTER_STATS_SCALE);
+    put_u8(w, '}');
+}
+
+int payload_encode_dht_stats(uint32_t timestamp, uint32_t window_sec, const filter_stats_t *temperature,
+                             const filter_stats_t *humidity, uint8_t *buffer, size_t size)
+{
+    writer_t w = { .data = buffer, .size = size };
+    int len = snprintf((char *)buffer, size, "{\"ts\":%lu,\"s\":%lu", (unsigned long)timestamp,
+                       (unsigned long)window_sec);
+
+    if (len < 0 || (size_t)len >= size) {
+        return -1;
+    }
+    w.len = len;
+
+    put_stats(&w, ",\"t\":", temperature);
+    put_stats(&w, ",\"h\":", humidity);
+    put_u8(&w, '}');
+
+    return w.overflow ? -1 : (int)w.len;
+}
+
+/* == CBOR (RFC 8949) ===================================================== */
+
+#define CBOR_MAJOR_UINT     0x00
+#define CBOR_MAJOR_ARRAY    0x80
+#define CBOR_MAJOR_MAP      0xA0
+#define CBOR_FLOAT32        0xFA
+
+static void cbor_put_head(writer_t *w, uint8_t major, uint32_t value)
+{
+    if (value < 24) {
+        put_u8(w, major | value);
+    } else if (value <= UINT8_MAX) {
+        put_u8(w, major | 24);
+        put_u8(w, value);
+    } else if (value <= UINT16_MAX) {
+        put_u8(w, major | 25);
+        put_u8(w, value >> 8);
+        put_u8(w, value & 0xFF);
+    } else {
+        put_u8(w, major | 26);
+        put_be32(w, value);
+    }
+}
+
+static void cbor_put_float(writer_t *w, uint8_t key, int32_t raw, uint32_t den)
+{
+    float value = (float)raw / (float)den;
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+
+    cbor_put_head(w, CBOR_MAJOR_UINT, key);
+    put_u8(w, CBOR_FLOAT32);
+    put_be32(w, bits);
+}
+
+static int encode_cbor(const sensor_frame_t *frame, uint8_t *buffer, size_t size)
+{
+    writer_t w = { .data = buffer, .size = size };
+    uint8_t entries = 2;
+
+    if (frame->flags & PAYLOAD_HAS_DHT) {
+        entries += PAYLOAD_DHT_SENSOR(frame->flags) > 0 ? 3 : 2;
+    }
+
+    if (frame->flags & PAYLOAD_HAS_BATTERY) {
+        entries += 2;
+    }
+
+    cbor_put_head(&w, CBOR_MAJOR_MAP, entries);
+    cbor_put_head(&w, CBOR_MAJOR_UINT, PAYLOAD_KEY_SEQ);
+    cbor_put_head(&w, CBOR_MAJOR_UINT, frame->seq);
+    cbor_put_head(&w, CBOR_MAJOR_UINT, PAYLOAD_KEY_TIMESTAMP);
+    cbor_put_head(&w, CBOR_MAJOR_UINT, frame->timestamp);
+
+    if (frame->flags & PAYLOAD_HAS_DHT) {
+        cbor_put_float(&w, PAYLOAD_KEY_TEMPERATURE, frame->temperature, FIXED_DHT_DEN);
+        cbor_put_float(&w, PAYLOAD_KEY_HUMIDITY, frame->humidity, FIXED_DHT_DEN);
+        if (PAYLOAD_DHT_SENSOR(frame->flags) > 0) {
+            cbor_put_head(&w, CBOR_MAJOR_UINT, PAYLOAD_KEY_DHT_SENSOR);
+            cbor_put_head(&w, CBOR_MAJOR_UINT, PAYLOAD_DHT_SENSOR(frame->flags));
+        }
+    }
+
+    if (frame->flags & PAYLOAD_HAS_BATTERY) {
+        cbor_put_float(&w, PAYLOAD_KEY_VOLTAGE, frame->voltage, FIXED_VCELL_DEN);
+        cbor_put_float(&w, PAYLOAD_KEY_SOC, frame->soc, FIXED_SOC_DEN);
+    }
+
+    return w.overflow ? -1 : (int)w.len;
+}
+
+static void cbor_put_histogram(writer_t *w, const diag_histogram_t *histogram)
+{
+    size_t used = DIAG_BUCKETS;
+    while (used > 0 && histogram->buckets[used - 1] == 0) {
+        used--;
+    }
+
+    cbor_put_head(w, CBOR_MAJOR_ARRAY, 4);
+    cbor_put_head(w, CBOR_MAJOR_UINT, histogram->count);
+    cbor_put_head(w, CBOR_MAJOR_UINT, histogram->max_us);
+    cbor_put_head(w, CBOR_MAJOR_UINT, histogram->count ? (uint32_t)(histogram->sum_us / histogram->count) : 0);
+    cbor_put_head(w, CBOR_MAJOR_ARRAY, (uint32_t)used);
+    for (size_t i = 0; i < used; i++) {
+        cbor_put_head(w, CBOR_MAJOR_UINT, histogram->buckets[i]);
+    }
+}
+
+int payload_encode_diag(const diag_snapshot_t *snapshot, uint8_t *buffer, size_t size)
+{
+    writer_t w = { .data = buffer, .size = size };
+
+    cbor_put_head(&w, CBOR_MAJOR_MAP, 8);
+    cbor_put_head(&w, CBOR_MAJOR_UINT, PAYLOAD_DIAG_KEY_UPTIME);
+    cbor_put_head(&w, CBOR_MAJOR_UINT, snapshot->uptime_s);
+    cbor_put_head(&w, CBOR_MAJOR_UINT, PAYLOAD_DIAG_KEY_FREE_HEAP);
+    cbor_put_head(&w, CBOR_MAJOR_UINT, snapshot->free_heap);
+    cbor_put_head(&w, CBOR_MAJOR_UINT, PAYLOAD_DIAG_KEY_MIN_FREE_HEAP);
+    cbor_put_head(&w, CBOR_MAJOR_UINT, snapshot->min_free_heap);
+
+    cbor_put_head(&w, CBOR_MAJOR_UINT, PAYLOAD_DIAG_KEY_COUNTERS);
+    cbor_put_head(&w, CBOR_MAJOR_ARRAY, DIAG_COUNTER_COUNT);
+    for (size_t i = 0; i < DIAG_COUNTER_COUNT; i++) {
+        cbor_put_head(&w, CBOR_MAJOR_UINT, snapshot->counters[i]);
+    }
+
+    cbor_put_head(&w, CBOR_MAJOR_UINT, PAYLOAD_DIAG_KEY_STAGES);
+    cbor_put_head(&w, CBOR_MAJOR_ARRAY, DIAG_STAGE_COUNT);
+    for (size_t i = 0; i < DIAG_STAGE_COUNT; i++) {
+        cbor_put_histogram(&w, &snapshot->stages[i]);
+    }
+
+    cbor_put_head(&w, CBOR_MAJOR_UINT, PAYLOAD_DIAG_KEY_MILESTONES);
+    cbor_put_head(&w, CBOR_MAJOR_ARRAY, DIAG_MILESTONE_COUNT);
+    for (size_t i = 0; i < DIAG_MILESTONE_COUNT; i++) {
+        cbor_put_head(&w, CBOR_MAJOR_UINT, snapshot->milestones_ms[i]);
+    }
+
+    cbor_put_head(&w, CBOR_MAJOR_UINT, PAYLOAD_DIAG_KEY_GAUGES);
+    cbor_put_head(&w, CBOR_MAJOR_ARRAY, DIAG_GAUGE_COUNT);
+    for (size_t i = 0; i < DIAG_GAUGE_COUNT; i++) {
+        cbor_put_head(&w, CBOR_MAJOR_UINT, snapshot->gauges[i]);
+    }
+
+    cbor_put_head(&w, CBOR_MAJOR_UINT, PAYLOAD_DIAG_KEY_DHT_ERRORS);
+    size_t sensors = snapshot->dht_sensors < DIAG_DHT_SENSORS_MAX ? snapshot->dht_sensors : DIAG_DHT_SENSORS_MAX;
+    cbor_put_head(&w, CBOR_MAJOR_ARRAY, (uint32_t)sensors);
+    for (size_t i = 0; i < sensors; i++) {
+        cbor_put_head(&w, CBOR_MAJOR_ARRAY, DIAG_DHT_ERROR_COUNT);
+        for (size_t k = 0; k < DIAG_DHT_ERROR_COUNT; k++) {
+            cbor_put_head(&w, CBOR_MAJOR_UINT, snapshot->dht_errors[i][k]);
+        }
+    }
+
+    return w.overflow ? -1 : (int)w.len;
+}
+
+/* == Packed binary ======================================================= */
+
+static int encode_binary(const sensor_frame_t *frame, uint8_t *buffer, size_t size)
+{
+    writer_t w = { .data = buffer, .size = size };
+    int has_dht = (frame->flags & PAYLOAD_HAS_DHT) != 0;
+    int has_battery = (frame->flags & PAYLOAD_HAS_BATTERY) != 0;
+
+    put_u8(&w, PAYLOAD_BINARY_VERSION);
+    put_u8(&w, frame->flags);
+    put_le32(&w, frame->seq);
+    put_le32(&w, frame->timestamp);
+    put_le16(&w, has_dht ? (uint16_t)scale_i16(frame->temperature, FIXED_DHT_DEN, 100) : 0);
+    put_le16(&w, has_dht ? scale_u16(frame->humidity, FIXED_DHT_DEN, 100) : 0);
+    put_le16(&w, has_battery ? scale_u16(frame->voltage, FIXED_VCELL_DEN, 1000) : 0);
+    put_le16(&w, has_battery ? scale_u16(frame->soc, FIXED_SOC_DEN, 100) : 0);
+
+    return w.overflow ? -1 : (int)w.len;
+}
+
+int payload_encode(payload_format_t format, const sensor_frame_t *frame, uint8_t *buffer, size_t size)
+{
+    switch (format) {
+        case PAYLOAD_FORMAT_JSON:
+            return encode_json(frame, buffer, size);
+        case PAYLOAD_FORMAT_CBOR:
+            return encode_cbor(frame, buffer, size);
+        case PAYLOAD_FORMAT_BINARY:
+            return encode_binary(frame, buffer, size);
+        default:
+            return -1;
+    }
+}
+
+int payload_encode_batch(payload_format_t format, const sensor_frame_t *frames, size_t count, uint8_t *buffer,
+                         size_t size)
+{
+    writer_t w = { .data = buffer, .size = size };
+
+    if (format == PAYLOAD_FORMAT_JSON) {
+        put_u8(&w, '[');
+    } else if (format == PAYLOAD_FORMAT_CBOR) {
+        cbor_put_head(&w, CBOR_MAJOR_ARRAY, (uint32_t)count);
+    }
+
+    for (size_t i = 0; i < count && !w.overflow; i++) {
+        if (format == PAYLOAD_FORMAT_JSON && i > 0) {
+            put_u8(&w, ',');
+        }
+
+        int len = payload_encode(format, &frames[i], buffer + w.len, w.size - w.len);
+        if (len < 0) {
+            return -1;
+        }
+        w.len += len;
+    }
+
+    if (format == PAYLOAD_FORMAT_JSON) {
+        put_u8(&w, ']');
+    }
+
+    return w.overflow ? -1 : (int)w.len;
+}
@@ -0,0 +1,129 @@
+#ifndef __PAYLOAD_H__
+#define __PAYLOAD_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "diag.h"
+#include "filter.h"
+#include "fixed.h"
+
+/*
+ * Encoders for the batched "frame" payload that carries one complete sample (all sensor values, sequence number and
+ * timestamp) in a single publish. No ESP-IDF dependencies, so encoders can be built and compared on the host.
+ *
+ * JSON:   {"seq":12,"ts":1700000000,"t":21.30,"h":45.20,"v":3.91,"soc":87.50}
+ * CBOR:   map with integer keys, see PAYLOAD_KEY_*, integers as CBOR uint, values as float32
+ * BINARY: packed little-endian, PAYLOAD_BINARY_SIZE bytes:
+ *         u8 version, u8 flags, u32 seq, u32 ts, i16 t [0.01 °C], u16 h [0.01 %], u16 v [mV], u16 soc [0.01 %]
+ *
+ * Values whose PAYLOAD_HAS_* flag is not set are omitted from JSON and CBOR and zeroed in BINARY. With several
+ * DHT22 sensors the index of the one that took t and h is added as "dht":n in JSON and PAYLOAD_KEY_DHT_SENSOR in
+ * CBOR, and carried in the flags byte in BINARY. Sensor 0 adds nothing, so single-sensor frames are unchanged.
+ */
+
+#define PAYLOAD_HAS_DHT         (1 << 0)    /*!< temperature and humidity are valid */
+#define PAYLOAD_HAS_BATTERY     (1 << 1)    /*!< voltage and soc are valid */
+#define PAYLOAD_DHT_SENSOR_SHIFT    4
+#define PAYLOAD_DHT_SENSOR_MASK     (0x3 << PAYLOAD_DHT_SENSOR_SHIFT)   /*!< index of the DHT22 sensor */
+
+#define PAYLOAD_DHT_SENSOR_FLAGS(sensor)    (((sensor) << PAYLOAD_DHT_SENSOR_SHIFT) & PAYLOAD_DHT_SENSOR_MASK)
+#define PAYLOAD_DHT_SENSOR(flags)           (((flags) & PAYLOAD_DHT_SENSOR_MASK) >> PAYLOAD_DHT_SENSOR_SHIFT)
+
+#define PAYLOAD_BINARY_VERSION  1
+#define PAYLOAD_BINARY_SIZE     18
+#define PAYLOAD_MAX_SIZE        96          /*!< large enough for any format */
+
+enum {
+    PAYLOAD_KEY_SEQ = 0,
+    PAYLOAD_KEY_TIMESTAMP,
+    PAYLOAD_KEY_TEMPERATURE,
+    PAYLOAD_KEY_HUMIDITY,
+    PAYLOAD_KEY_VOLTAGE,
+    PAYLOAD_KEY_SOC,
+    PAYLOAD_KEY_DHT_SENSOR,
+};
+
+/*
+ * Diagnostics snapshot, always CBOR: map with integer keys, see PAYLOAD_DIAG_KEY_*
+ *   uptime, free heap, minimum free heap: uint
+ *   counters: array indexed by diag_counter_t
+ *   gauges: array indexed by diag_gauge_t
+ *   milestones: array indexed by diag_milestone_t, ms since boot, 0 if not reached
+ *   stages: array indexed by diag_stage_t, each [count, max us, mean us, [buckets]], trailing empty buckets omitted
+ *   dht errors: array with one [timeouts, checksum errors, rejected] per DHT22 sensor
+ */
+#define PAYLOAD_DIAG_MAX_SIZE   576
+
+enum {
+    PAYLOAD_DIAG_KEY_UPTIME = 0,
+    PAYLOAD_DIAG_KEY_FREE_HEAP,
+    PAYLOAD_DIAG_KEY_MIN_FREE_HEAP,
+    PAYLOAD_DIAG_KEY_COUNTERS,
+    PAYLOAD_DIAG_KEY_STAGES,
+    PAYLOAD_DIAG_KEY_MILESTONES,
+    PAYLOAD_DIAG_KEY_GAUGES,
+    PAYLOAD_DIAG_KEY_DHT_ERRORS,
+};
+
+/*
+ * Windowed DHT22 statistics, always JSON, values in °C and %:
+ *   {"ts":1700000000,"s":60,"t":{"n":30,"min":21.20,"max":21.40,"mean":21.31,"sd":0.06},"h":{...}}
+ */
+#define PAYLOAD_STATS_MAX_SIZE  192
+
+typedef enum {
+    PAYLOAD_FORMAT_JSON = 0,
+    PAYLOAD_FORMAT_CBOR,
+    PAYLOAD_FORMAT_BINARY,
+} payload_format_t;
+
+typedef struct {
+    uint8_t flags;          /*!< PAYLOAD_HAS_* and the DHT22 sensor index */
+    uint32_t seq;
+    uint32_t timestamp;     /*!< seconds, time(NULL) on the device */
+    int16_t temperature;    /*!< 0.1 °C, see fixed.h */
+    uint16_t humidity;      /*!< 0.1 % */
+    uint16_t voltage;       /*!< 78.125 uV */
+    uint16_t soc;           /*!< 1/256 % */
+} sensor_frame_t;
+
+/**
+ * @brief Encode a frame
+ *
+ * @param format payload format
+ * @param frame frame to encode
+ * @param buffer output buffer
+ * @param size size of buffer, PAYLOAD_MAX_SIZE always fits
+ * @return number of bytes written, or -1 if the buffer is too small
+ */
+int payload_encode(payload_format_t format, const sensor_frame_t *frame, uint8_t *buffer, size_t size);
+
+/**
+ * @brief Encode several frames into one payload
+ *
+ * JSON and CBOR produce an array of frames, BINARY concatenates PAYLOAD_BINARY_SIZE byte records.
+ *
+ * @return number of bytes written, or -1 if the buffer is too small
+ */
+int payload_encode_batch(payload_format_t format, const sensor_frame_t *frames, size_t count, uint8_t *buffer,
+                         size_t size);
+
+/**
+ * @brief Encode a diagnostics snapshot as CBOR
+ *
+ * @return number of bytes written, or -1 if the buffer is too small
+ */
+int payload_encode_diag(const diag_snapshot_t *snapshot, uint8_t *buffer, size_t size);
+
+/**
+ * @brief Encode the statistics of one DHT22 aggregation window as JSON
+ *
+ * @param timestamp end of the window, seconds
+ * @param window_sec length of the window
+ * @return number of bytes written, or -1 if the buffer is too small
+ */
+int payload_encode_dht_stats(uint32_t timestamp, uint32_t window_sec, const filter_stats_t *temperature,
+                             const filter_stats_t *humidity, uint8_t *buffer, size_t size);
+
+#endif // __PAYLOAD_H__
@@ -0,0 +1,227 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp_log.h"
+#include "publisher.h"
+#include "diag.h"
+
+static const char *TAG = "PUBLISHER";
+
+static QueueSetHandle_t queue_set = NULL;
+static publisher_source_t *sources[PUBLISHER_MAX_SOURCES];
+static size_t source_count = 0;
+static UBaseType_t set_used = 0;
+static QueueHandle_t control = NULL;
+
+#if CONFIG_ESP_STATIC_ALLOCATION
+static StaticQueue_t queue_set_buffer;
+static uint8_t queue_set_storage[(PUBLISHER_SET_LENGTH + PUBLISHER_CONTROL_DEPTH) * sizeof(QueueSetMemberHandle_t)];
+
+/* Sources are only ever added, never removed: carve their queues and buffers off one static arena */
+static uint8_t storage[PUBLISHER_STORAGE_SIZE] __attribute__((aligned(4)));
+static size_t storage_used = 0;
+
+static uint8_t *storage_take(size_t size)
+{
+    size = (size + 3) & ~(size_t)3;
+    if (storage_used + size > sizeof(storage)) {
+        return NULL;
+    }
+
+    uint8_t *block = storage + storage_used;
+    storage_used += size;
+    return block;
+}
+#endif
+
+static inline uint8_t *item_buffer(publisher_source_t *source)
+{
+    return source->buffer;
+}
+
+static inline uint8_t *pending_buffer(publisher_source_t *source)
+{
+    return source->buffer + source->item_size;
+}
+
+static publisher_source_t *find_source(QueueSetMemberHandle_t member)
+{
+    for (size_t i = 0; i < source_count; i++) {
+        if (sources[i]->queue == member) {
+            return sources[i];
+        }
+    }
+
+    return NULL;
+}
+
+static void emit(publisher_source_t *source, const void *item, sensor_frame_t *frame, TickType_t now)
+{
+    memset(frame, 0, sizeof(*frame));
+    source->to_frame(item, frame);
+    source->published = true;
+    source->last_publish = now;
+}
+
+static bool interval_elapsed(const publisher_source_t *source, TickType_t now)
+{
+    return !source->published || source->min_interval_ms == 0 ||
+           now - source->last_publish >= pdMS_TO_TICKS(source->min_interval_ms);
+}
+
+esp_err_t publisher_init(void)
+{
+#if CONFIG_ESP_STATIC_ALLOCATION
+    // what xQueueCreateSet() does, with caller provided storage
+    queue_set = xQueueGenericCreateStatic(PUBLISHER_SET_LENGTH + PUBLISHER_CONTROL_DEPTH,
+                                          sizeof(QueueSetMemberHandle_t), queue_set_storage, &queue_set_buffer,
+                                          queueQUEUE_TYPE_SET);
+#else
+    queue_set = xQueueCreateSet(PUBLISHER_SET_LENGTH + PUBLISHER_CONTROL_DEPTH);
+#endif
+    if (queue_set == NULL) {
+        ESP_LOGE(TAG, "queue_set: Queue set was not created. Could not allocate required memory");
+        return ESP_ERR_NO_MEM;
+    }
+
+    return ESP_OK;
+}
+
+esp_err_t publisher_add_source(publisher_source_t *source)
+{
+    UBaseType_t depth = source->policy == PUBLISHER_POLICY_LATEST ? 1 : source->depth;
+
+    if (queue_set == NULL || source_count == PUBLISHER_MAX_SOURCES || set_used + depth > PUBLISHER_SET_LENGTH ||
+        source->item_size > PUBLISHER_MAX_ITEM_SIZE) {
+        ESP_LOGE(TAG, "%s: No room left in the queue set", source->name);
+        return ESP_ERR_INVALID_STATE;
+    }
+
+#if CONFIG_ESP_STATIC_ALLOCATION
+    source->buffer = storage_take(source->item_size * 2);
+    uint8_t *queue_storage = storage_take(depth * source->item_size);
+    source->queue = NULL;
+    if (queue_storage != NULL) {
+        source->queue = xQueueCreateStatic(depth, source->item_size, queue_storage, &source->queue_buffer);
+    }
+#else
+    source->buffer = malloc(source->item_size * 2);
+    source->queue = xQueueCreate(depth, source->item_size);
+#endif
+    if (source->buffer == NULL || source->queue == NULL) {
+        ESP_LOGE(TAG, "%s: Queue was not created. Could not allocate required memory", source->name);
+        return ESP_ERR_NO_MEM;
+    }
+
+    if (xQueueAddToSet(source->queue, queue_set) != pdPASS) {
+        ESP_LOGE(TAG, "%s: Failed to add the queue to the set", source->name);
+        return ESP_FAIL;
+    }
+
+    set_used += depth;
+    sources[source_count++] = source;
+    ESP_LOGI(TAG, "Source %s added, depth %u, min interval %" PRIu32 " ms", source->name, (unsigned)depth,
+             source->min_interval_ms);
+
+    return ESP_OK;
+}
+
+esp_err_t publisher_set_control(QueueHandle_t queue, UBaseType_t depth)
+{
+    if (queue_set == NULL || control != NULL || depth > PUBLISHER_CONTROL_DEPTH) {
+        ESP_LOGE(TAG, "Control queue can not be added");
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    if (xQueueAddToSet(queue, queue_set) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to add the control queue to the set");
+        return ESP_FAIL;
+    }
+
+    control = queue;
+    return ESP_OK;
+}
+
+bool publisher_send(publisher_source_t *source, const void *item)
+{
+    if (source->policy == PUBLISHER_POLICY_LATEST) {
+        xQueueOverwrite(source->queue, item);
+        return true;
+    }
+
+    if (xQueueSend(source->queue, item, 0) != pdPASS) {
+        source->dropped++;
+        diag_count(DIAG_COUNTER_QUEUE_DROP);
+        return false;
+    }
+
+    return true;
+}
+
+bool publisher_receive(sensor_frame_t *frame, TickType_t timeout)
+{
+    TickType_t start = xTaskGetTickCount();
+
+    while (true) {
+        TickType_t now = xTaskGetTickCount();
+        TickType_t wait = portMAX_DELAY;
+
+        if (timeout != portMAX_DELAY) {
+            TickType_t elapsed = now - start;
+            wait = elapsed < timeout ? timeout - elapsed : 0;
+        }
+
+        // rate-limited samples whose interval has passed go first
+        for (size_t i = 0; i < source_count; i++) {
+            publisher_source_t *source = sources[i];
+
+            if (!source->has_pending) {
+                continue;
+            }
+
+            if (interval_elapsed(source, now)) {
+                source->has_pending = false;
+                emit(source, pending_buffer(source), frame, now);
+                return true;
+            }
+
+            TickType_t left = pdMS_TO_TICKS(source->min_interval_ms) - (now - source->last_publish);
+            wait = left < wait ? left : wait;
+        }
+
+        QueueSetMemberHandle_t member = xQueueSelectFromSet(queue_set, wait);
+        now = xTaskGetTickCount();
+
+        if (member == NULL) {
+            if (timeout != portMAX_DELAY && now - start >= timeout) {
+                return false;
+            }
+            continue;
+        }
+
+        if (member == control) {
+            return false;
+        }
+
+        publisher_source_t *source = find_source(member);
+        if (source == NULL || xQueueReceive(member, item_buffer(source), 0) != pdPASS) {
+            continue;
+        }
+
+        if (interval_elapsed(source, now)) {
+            if (source->has_pending) {
+                source->coalesced++;
+                source->has_pending = false;
+            }
+            emit(source, item_buffer(source), frame, now);
+            return true;
+        }
+
+        if (source->has_pending) {
+            source->coalesced++;
+        }
+
+        memcpy(pending_buffer(source), item_buffer(source), source->item_size);
+        source->has_pending = true;
+    }
+}
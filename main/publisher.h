@@ -0,0 +1,86 @@
+#ifndef __PUBLISHER_H__
+#define __PUBLISHER_H__
+
+#include <stdbool.h>
+#include <esp_err.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "payload.h"
+
+/*
+ * Multiplexes any number of sensor sample streams into the MQTT publisher. Every source gets its own queue, which is
+ * a member of one FreeRTOS queue set, so mqtt_task takes whichever sample is ready instead of waiting on the sources
+ * in a fixed order. A missing or slow sensor therefore never holds back the others.
+ */
+
+#define PUBLISHER_SET_LENGTH    32      /*!< sum of all source queue depths must fit */
+#define PUBLISHER_CONTROL_DEPTH 2       /*!< deepest control queue, its slots come on top of the sources' */
+#define PUBLISHER_MAX_SOURCES   8
+#define PUBLISHER_MAX_ITEM_SIZE 32
+
+#if CONFIG_ESP_STATIC_ALLOCATION
+/* queue storage for every slot of the set plus the item and pending buffers of every source */
+#define PUBLISHER_STORAGE_SIZE  ((PUBLISHER_SET_LENGTH + PUBLISHER_MAX_SOURCES * 2) * PUBLISHER_MAX_ITEM_SIZE)
+#endif
+
+typedef enum {
+    PUBLISHER_POLICY_FIFO = 0,  /*!< keep every sample, drop the newest one when the queue is full */
+    PUBLISHER_POLICY_LATEST,    /*!< depth-1 mailbox, a new sample replaces one that was not published yet */
+} publisher_policy_t;
+
+typedef struct {
+    /* configuration, set by the sensor module */
+    const char *name;
+    publisher_policy_t policy;
+    UBaseType_t depth;              /*!< FIFO queue length, ignored for PUBLISHER_POLICY_LATEST */
+    size_t item_size;
+    uint32_t min_interval_ms;       /*!< publish at most once per interval (latest sample wins), 0 = no limit */
+    void (*to_frame)(const void *item, sensor_frame_t *frame);  /*!< fills flags and values of the frame */
+
+    /* runtime state, owned by the publisher */
+    QueueHandle_t queue;
+#if CONFIG_ESP_STATIC_ALLOCATION
+    StaticQueue_t queue_buffer;
+#endif
+    uint8_t *buffer;                /*!< received item followed by the rate-limited pending item */
+    bool has_pending;
+    bool published;
+    TickType_t last_publish;
+    uint32_t dropped;               /*!< samples lost to backpressure */
+    uint32_t coalesced;             /*!< samples replaced by a newer one because of the rate limit */
+} publisher_source_t;
+
+/**
+ * @brief Create the queue set. Must run before any source is added.
+ */
+esp_err_t publisher_init(void);
+
+/**
+ * @brief Create the queue of a source and add it to the set. Must run before the source sends its first sample.
+ */
+esp_err_t publisher_add_source(publisher_source_t *source);
+
+/**
+ * @brief Add a queue of the consumer's own to the set, e.g. for commands: publisher_receive() then returns as soon
+ * as it holds an item and leaves the item to the caller. At most one, of at most PUBLISHER_CONTROL_DEPTH items.
+ */
+esp_err_t publisher_set_control(QueueHandle_t queue, UBaseType_t depth);
+
+/**
+ * @brief Producer side: hand a sample to the publisher according to the source's backpressure policy
+ *
+ * @return false if the sample was dropped
+ */
+bool publisher_send(publisher_source_t *source, const void *item);
+
+/**
+ * @brief Consumer side: wait for the next sample of any source, honouring the per-source rate limits
+ *
+ * @param frame output, flags and values only; seq and timestamp are left to the caller
+ * @param timeout maximum time to wait
+ * @return false on timeout, or when the control queue has an item
+ */
+bool publisher_receive(sensor_frame_t *frame, TickType_t timeout);
+
+#endif // __PUBLISHER_H__
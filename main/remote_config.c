@@ -0,0 +1,141 @@
+#include <inttypes.h>
+#include <string.h>
+
+#include "esp_log.h"
+#include "nvs.h"
+#include "dht22.h"
+#include "battery.h"
+#include "sensor.h"
+#include "remote_config.h"
+
+static const char *TAG = "CONFIG";
+
+#define CONFIG_STORE_MAGIC      0x4E434647  // "NCFG"
+#define CONFIG_STORE_NAMESPACE  "config"
+
+/*
+ * Topic aliases only go on QoS0 publishes (client_publish() in mqtt.c), so with them the live values start at QoS0.
+ * Not in duty-cycle mode: a wake is one connection that sends every topic once, and the node waits for the PUBACKs
+ * before it sleeps.
+ */
+#if CONFIG_ESP_MQTT_TOPIC_ALIAS && !CONFIG_ESP_DUTY_CYCLE_MODE
+#define LIVE_QOS_DEFAULT        0
+#else
+#define LIVE_QOS_DEFAULT        1
+#endif
+#define CONFIG_STORE_KEY        "node"
+
+/* A blob of another layout, e.g. of an older firmware, has another size and is not loaded */
+typedef struct {
+    uint32_t magic;
+    node_config_t config;
+} config_store_t;
+
+static const node_config_t defaults = {
+        .dht_period_ms = CONFIG_ESP_DHT_SAMPLE_PERIOD_MS,
+        .battery_period_ms = ESP_BATTERY_SAMPLE_PERIOD_MS,
+        .dht_min_interval_ms = CONFIG_ESP_DHT_MIN_PUBLISH_INTERVAL_MS,
+        .battery_min_interval_ms = CONFIG_ESP_BATTERY_MIN_PUBLISH_INTERVAL_MS,
+        .qos = LIVE_QOS_DEFAULT,
+#if CONFIG_ESP_MQTT_DEADBAND
+        .deadband_temperature = CONFIG_ESP_MQTT_DEADBAND_TEMPERATURE,
+        .deadband_humidity = CONFIG_ESP_MQTT_DEADBAND_HUMIDITY,
+        .deadband_battery_voltage = CONFIG_ESP_MQTT_DEADBAND_BATTERY_VOLTAGE,
+        .deadband_battery_soc = CONFIG_ESP_MQTT_DEADBAND_BATTERY_SOC,
+        .heartbeat_sec = CONFIG_ESP_MQTT_HEARTBEAT_SEC,
+#endif
+};
+
+static node_config_t current;
+
+static bool config_load(node_config_t *config)
+{
+    nvs_handle_t handle;
+    config_store_t store;
+    size_t size = sizeof(store);
+    bool loaded = false;
+
+    if (nvs_open(CONFIG_STORE_NAMESPACE, NVS_READONLY, &handle) != ESP_OK) {
+        return false;
+    }
+
+    if (nvs_get_blob(handle, CONFIG_STORE_KEY, &store, &size) == ESP_OK && size == sizeof(store) &&
+        store.magic == CONFIG_STORE_MAGIC && node_config_valid(&store.config)) {
+        *config = store.config;
+        loaded = true;
+    }
+
+    nvs_close(handle);
+    return loaded;
+}
+
+static void config_store(const node_config_t *config)
+{
+    config_store_t store = { .magic = CONFIG_STORE_MAGIC, .config = *config };
+    nvs_handle_t handle;
+    esp_err_t err = nvs_open(CONFIG_STORE_NAMESPACE, NVS_READWRITE, &handle);
+
+    if (err == ESP_OK) {
+        err = nvs_set_blob(handle, CONFIG_STORE_KEY, &store, sizeof(store));
+        if (err == ESP_OK) {
+            err = nvs_commit(handle);
+        }
+        nvs_close(handle);
+    }
+
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "Settings not stored (%s), they last until the next reboot", esp_err_to_name(err));
+    }
+}
+
+/* Before the scheduler runs this only sets the periods, afterwards the next readings move to the new ones */
+static void config_apply(const node_config_t *config)
+{
+    for (size_t i = 0; i < ESP_DHT_SENSOR_COUNT; i++) {
+        sensor_set_period(&dht22_drivers[i], config->dht_period_ms);
+        dht22_drivers[i].source.min_interval_ms = config->dht_min_interval_ms;
+    }
+
+    sensor_set_period(&max17048_driver, config->battery_period_ms);
+    max17048_driver.source.min_interval_ms = config->battery_min_interval_ms;
+}
+
+esp_err_t remote_config_init(void)
+{
+    current = defaults;
+
+    if (config_load(&current)) {
+        ESP_LOGI(TAG, "Stored settings loaded");
+    }
+
+    config_apply(&current);
+    return ESP_OK;
+}
+
+const node_config_t *remote_config_get(void)
+{
+    return &current;
+}
+
+bool remote_config_update(const char *json, size_t len, char *error, size_t error_size)
+{
+    node_config_t config = current;
+
+    if (!node_config_parse(&config, json, len, error, error_size)) {
+        ESP_LOGW(TAG, "Configuration rejected: %s", error);
+        return false;
+    }
+
+    // the retained message comes again on every connect, flash is only written on a change
+    if (memcmp(&config, &current, sizeof(config)) == 0) {
+        return true;
+    }
+
+    current = config;
+    config_apply(&current);
+    config_store(&current);
+
+    ESP_LOGI(TAG, "Applied: DHT %" PRIu32 " ms, battery %" PRIu32 " ms, QoS %" PRIu32, current.dht_period_ms,
+             current.battery_period_ms, current.qos);
+    return true;
+}
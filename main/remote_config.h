@@ -0,0 +1,35 @@
+#ifndef __REMOTE_CONFIG_H__
+#define __REMOTE_CONFIG_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <esp_err.h>
+
+#include "node_config.h"
+
+/*
+ * Device glue for node_config: the settings in effect, kept in the "config" NVS namespace so a change made over MQTT
+ * (CONFIG_ESP_REMOTE_CONFIG) survives reboots. Applies the sampling periods and publish intervals to the sensor
+ * drivers, mqtt.c takes the QoS and the deadbands from remote_config_get(). Updated from mqtt_task only.
+ */
+
+/**
+ * @brief Load the stored settings, or the Kconfig defaults, and apply them to the sensor drivers
+ *
+ * Runs after nvs_flash_init() and before the drivers are registered.
+ */
+esp_err_t remote_config_init(void);
+
+/**
+ * @brief The settings in effect
+ */
+const node_config_t *remote_config_get(void);
+
+/**
+ * @brief Apply a configuration message, see node_config_parse(), and store the result
+ *
+ * @return false if the message was rejected, the settings are unchanged then
+ */
+bool remote_config_update(const char *json, size_t len, char *error, size_t error_size);
+
+#endif // __REMOTE_CONFIG_H__
@@ -0,0 +1,351 @@
+#include <string.h>
+
+#include "sample_store.h"
+
+#define STORE_MAGIC         0x53544F32  // "STO2", marks a valid RAM state of this layout
+#define PAGE_MAGIC          0x50414746  // "PAGF", pages of fixed-point frames; "PAGE" float pages are ignored
+#define PAGE_PENDING        0xFFFFFFFF  // erased state word: page not drained yet
+#define PAGE_DRAINED        0x00000000  // written in place once the page is drained
+
+typedef struct {
+    uint32_t magic;
+    uint32_t sequence;      /*!< page number, increases by one per page written */
+    uint16_t count;         /*!< records in the page */
+    uint16_t crc;           /*!< CRC-16/CCITT over sequence, count and records */
+    uint32_t state;         /*!< PAGE_PENDING or PAGE_DRAINED, last so it can be cleared on its own */
+} page_header_t;
+
+typedef struct {
+    page_header_t header;
+    sensor_frame_t records[SAMPLE_STORE_PAGE_RECORDS];
+} page_t;
+
+/* scratch page, kept off the task stack */
+static page_t page_buffer;
+
+static uint16_t crc16(uint16_t crc, const void *data, size_t len)
+{
+    const uint8_t *bytes = data;
+
+    for (size_t i = 0; i < len; i++) {
+        crc ^= (uint16_t)bytes[i] << 8;
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ 0x1021) : (uint16_t)(crc << 1);
+        }
+    }
+
+    return crc;
+}
+
+static uint16_t page_crc(const page_t *page)
+{
+    uint16_t crc = 0xFFFF;
+    crc = crc16(crc, &page->header.sequence, sizeof(page->header.sequence));
+    crc = crc16(crc, &page->header.count, sizeof(page->header.count));
+    return crc16(crc, page->records, page->header.count * sizeof(sensor_frame_t));
+}
+
+static inline size_t pages_per_sector(const store_flash_t *flash)
+{
+    return flash->sector_size / sizeof(page_t);
+}
+
+static size_t slot_offset(const sample_store_t *store, uint32_t slot)
+{
+    size_t pps = pages_per_sector(store->flash);
+    return (slot / pps) * store->flash->sector_size + (slot % pps) * sizeof(page_t);
+}
+
+static size_t page_bytes(uint16_t count)
+{
+    return sizeof(page_header_t) + count * sizeof(sensor_frame_t);
+}
+
+/* Reads the page in slot into page_buffer, returns true if it holds a complete page */
+static bool read_page(const sample_store_t *store, uint32_t slot)
+{
+    const store_flash_t *flash = store->flash;
+    page_header_t *header = &page_buffer.header;
+
+    if (flash->read(flash->ctx, slot_offset(store, slot), header, sizeof(*header)) != 0) {
+        return false;
+    }
+
+    if (header->magic != PAGE_MAGIC || header->count == 0 || header->count > SAMPLE_STORE_PAGE_RECORDS) {
+        return false;
+    }
+
+    if (flash->read(flash->ctx, slot_offset(store, slot) + sizeof(*header), page_buffer.records,
+                    header->count * sizeof(sensor_frame_t)) != 0) {
+        return false;
+    }
+
+    return header->crc == page_crc(&page_buffer);
+}
+
+/* Moves the head to the next pending page after the current one was drained or dropped */
+static void advance_head(sample_store_t *store)
+{
+    store->flash_pages--;
+    store->head_offset = 0;
+    store->head_count = 0;
+
+    for (uint32_t i = 0; store->flash_pages > 0 && i < store->slot_count; i++) {
+        store->head_slot = (store->head_slot + 1) % store->slot_count;
+
+        if (read_page(store, store->head_slot) && page_buffer.header.state == PAGE_PENDING) {
+            store->head_seq = page_buffer.header.sequence;
+            store->head_count = page_buffer.header.count;
+            return;
+        }
+    }
+
+    // log is inconsistent with the counters, start over from the tail
+    store->flash_pages = 0;
+    store->flash_records = 0;
+}
+
+static void drop_head_page(sample_store_t *store)
+{
+    uint16_t left = store->head_count - store->head_offset;
+    store->stats.dropped += left;
+    store->flash_records -= left;
+    advance_head(store);
+}
+
+static bool write_page(sample_store_t *store, const sensor_frame_t *records, uint16_t count)
+{
+    const store_flash_t *flash = store->flash;
+    size_t pps = pages_per_sector(flash);
+    uint32_t slot = store->tail_slot;
+
+    if (slot % pps == 0) {
+        // entering a sector: anything still pending in it is the oldest data in the log and gets dropped
+        size_t sector = slot / pps;
+        while (store->flash_pages > 0 && store->head_slot / pps == sector) {
+            drop_head_page(store);
+        }
+
+        if (flash->erase_sector(flash->ctx, sector * flash->sector_size) != 0) {
+            return false;
+        }
+        store->stats.sector_erases++;
+    }
+
+    page_buffer.header = (page_header_t) {
+            .magic = PAGE_MAGIC,
+            .sequence = store->next_page_seq,
+            .count = count,
+            .state = PAGE_PENDING,
+    };
+    memcpy(page_buffer.records, records, count * sizeof(sensor_frame_t));
+    page_buffer.header.crc = page_crc(&page_buffer);
+
+    store->tail_slot = (slot + 1) % store->slot_count;
+    store->next_page_seq++;
+
+    if (flash->write(flash->ctx, slot_offset(store, slot), &page_buffer, page_bytes(count)) != 0) {
+        return false;
+    }
+
+    store->stats.page_writes++;
+    store->flash_pages++;
+    store->flash_records += count;
+
+    if (store->flash_pages == 1) {
+        store->head_slot = slot;
+        store->head_seq = page_buffer.header.sequence;
+        store->head_count = count;
+        store->head_offset = 0;
+    }
+
+    return true;
+}
+
+/* Moves the oldest RAM samples into one flash page */
+static bool spill(sample_store_t *store)
+{
+    sensor_frame_t records[SAMPLE_STORE_PAGE_RECORDS];
+    uint16_t count = store->ram_count < SAMPLE_STORE_PAGE_RECORDS ? store->ram_count : SAMPLE_STORE_PAGE_RECORDS;
+
+    if (store->flash == NULL || count == 0) {
+        return false;
+    }
+
+    for (uint16_t i = 0; i < count; i++) {
+        records[i] = store->ram[(store->ram_head + i) % SAMPLE_STORE_RAM_SLOTS];
+    }
+
+    if (!write_page(store, records, count)) {
+        return false;
+    }
+
+    store->ram_head = (store->ram_head + count) % SAMPLE_STORE_RAM_SLOTS;
+    store->ram_count -= count;
+    return true;
+}
+
+static void recover(sample_store_t *store)
+{
+    const store_flash_t *flash = store->flash;
+    size_t pps = pages_per_sector(flash);
+    bool found = false;
+    bool pending = false;
+    uint32_t newest_seq = 0;
+    uint32_t newest_slot = 0;
+    uint32_t oldest_seq = 0;
+
+    for (uint32_t slot = 0; slot < store->slot_count; slot++) {
+        if (!read_page(store, slot)) {
+            continue;
+        }
+
+        const page_header_t *header = &page_buffer.header;
+
+        if (!found || (int32_t)(header->sequence - newest_seq) > 0) {
+            found = true;
+            newest_seq = header->sequence;
+            newest_slot = slot;
+        }
+
+        if (header->state != PAGE_PENDING) {
+            continue;
+        }
+
+        store->flash_pages++;
+        store->flash_records += header->count;
+
+        if (!pending || (int32_t)(header->sequence - oldest_seq) < 0) {
+            pending = true;
+            oldest_seq = header->sequence;
+            store->head_slot = slot;
+            store->head_seq = header->sequence;
+            store->head_count = header->count;
+        }
+    }
+
+    if (!found) {
+        return;
+    }
+
+    store->next_page_seq = newest_seq + 1;
+    store->tail_slot = (newest_slot + 1) % store->slot_count;
+
+    // a torn write leaves the next slot dirty, continue in the next sector which will be erased first
+    uint32_t magic = 0;
+    if (store->tail_slot % pps != 0 &&
+        (flash->read(flash->ctx, slot_offset(store, store->tail_slot), &magic, sizeof(magic)) != 0 ||
+         magic != PAGE_PENDING)) {
+        store->tail_slot = (uint32_t)(((store->tail_slot / pps + 1) * pps) % store->slot_count);
+    }
+}
+
+void sample_store_init(sample_store_t *store, const store_flash_t *flash)
+{
+    if (store->magic != STORE_MAGIC || store->ram_count > SAMPLE_STORE_RAM_SLOTS ||
+        store->ram_head >= SAMPLE_STORE_RAM_SLOTS) {
+        memset(store, 0, sizeof(*store));
+        store->magic = STORE_MAGIC;
+    }
+
+    // a page is only marked drained when it is drained completely, the records before head_offset are gone too
+    uint32_t drained_seq = store->head_seq;
+    uint16_t drained = store->flash_pages > 0 ? store->head_offset : 0;
+
+    store->flash = NULL;
+    store->slot_count = 0;
+    store->head_slot = 0;
+    store->tail_slot = 0;
+    store->flash_pages = 0;
+    store->flash_records = 0;
+    store->next_page_seq = 0;
+    store->head_seq = 0;
+    store->head_count = 0;
+    store->head_offset = 0;
+
+    if (flash == NULL || flash->sector_count < 2 || pages_per_sector(flash) == 0) {
+        return;
+    }
+
+    store->flash = flash;
+    store->slot_count = (uint32_t)(flash->sector_count * pages_per_sector(flash));
+    recover(store);
+
+    if (drained > 0 && store->flash_pages > 0 && store->head_seq == drained_seq && drained < store->head_count) {
+        store->head_offset = drained;
+        store->flash_records -= drained;
+    }
+}
+
+void sample_store_push(sample_store_t *store, const sensor_frame_t *frame)
+{
+    if (store->ram_count == SAMPLE_STORE_RAM_SLOTS && !spill(store)) {
+        // no flash, or the write failed: drop the oldest sample
+        store->ram_head = (store->ram_head + 1) % SAMPLE_STORE_RAM_SLOTS;
+        store->ram_count--;
+        store->stats.dropped++;
+    }
+
+    store->ram[(store->ram_head + store->ram_count) % SAMPLE_STORE_RAM_SLOTS] = *frame;
+    store->ram_count++;
+}
+
+size_t sample_store_peek(sample_store_t *store, sensor_frame_t *frames, size_t max)
+{
+    size_t count;
+
+    if (store->flash_pages > 0) {
+        if (!read_page(store, store->head_slot)) {
+            return 0;
+        }
+
+        count = store->head_count - store->head_offset;
+        count = count < max ? count : max;
+        memcpy(frames, &page_buffer.records[store->head_offset], count * sizeof(sensor_frame_t));
+        return count;
+    }
+
+    count = store->ram_count < max ? store->ram_count : max;
+    for (size_t i = 0; i < count; i++) {
+        frames[i] = store->ram[(store->ram_head + i) % SAMPLE_STORE_RAM_SLOTS];
+    }
+
+    return count;
+}
+
+void sample_store_consume(sample_store_t *store, size_t count)
+{
+    while (count > 0) {
+        if (store->flash_pages > 0) {
+            size_t left = store->head_count - store->head_offset;
+            size_t n = count < left ? count : left;
+
+            store->head_offset += n;
+            store->flash_records -= n;
+            count -= n;
+
+            if (store->head_offset >= store->head_count) {
+                uint32_t drained = PAGE_DRAINED;
+                store->flash->write(store->flash->ctx,
+                                    slot_offset(store, store->head_slot) + offsetof(page_header_t, state),
+                                    &drained, sizeof(drained));
+                advance_head(store);
+            }
+        } else {
+            size_t n = count < store->ram_count ? count : store->ram_count;
+
+            if (n == 0) {
+                return;
+            }
+
+            store->ram_head = (store->ram_head + n) % SAMPLE_STORE_RAM_SLOTS;
+            store->ram_count -= n;
+            count -= n;
+        }
+    }
+}
+
+uint32_t sample_store_count(const sample_store_t *store)
+{
+    return store->flash_records + store->ram_count;
+}
@@ -0,0 +1,97 @@
+#ifndef __SAMPLE_STORE_H__
+#define __SAMPLE_STORE_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "payload.h"
+
+/*
+ * Store-and-forward buffer for samples that could not be published. New samples go into a small RAM ring (meant to
+ * live in RTC RAM so it survives deep sleep). When the ring is full its oldest SAMPLE_STORE_PAGE_RECORDS samples are
+ * spilled as one page into a circular log on flash. Samples are always drained oldest first.
+ *
+ * Flash writes are bounded and wear is spread evenly: pages are appended round-robin over all sectors, a sector is
+ * erased only when the log wraps into it, and a drained page is retired by clearing its state word in place (a
+ * 1 -> 0 bit write, no erase). When the log is full the oldest sector is dropped.
+ *
+ * The flash is accessed only through store_flash_t, so the logic runs on the host: host/sample_store_test.c drives it
+ * against a NOR flash stand-in with torn writes. Not thread safe.
+ */
+
+#define SAMPLE_STORE_RAM_SLOTS      32
+#define SAMPLE_STORE_PAGE_RECORDS   16
+
+typedef struct {
+    void *ctx;
+    size_t sector_size;     /*!< erase unit in bytes */
+    size_t sector_count;
+    /* All callbacks return 0 on success. Offsets are relative to the start of the storage area. */
+    int (*read)(void *ctx, size_t offset, void *dst, size_t len);
+    int (*write)(void *ctx, size_t offset, const void *src, size_t len);
+    int (*erase_sector)(void *ctx, size_t offset);
+} store_flash_t;
+
+typedef struct {
+    uint32_t dropped;           /*!< samples lost because both RAM and flash were full */
+    uint32_t page_writes;
+    uint32_t sector_erases;
+} store_stats_t;
+
+typedef struct {
+    uint32_t magic;
+
+    sensor_frame_t ram[SAMPLE_STORE_RAM_SLOTS];
+    uint16_t ram_head;
+    uint16_t ram_count;
+
+    /* flash log state, rebuilt from the page headers by sample_store_init() */
+    uint32_t slot_count;
+    uint32_t head_slot;         /*!< oldest page not drained yet */
+    uint32_t tail_slot;         /*!< next slot to write */
+    uint32_t flash_pages;       /*!< pages not drained yet */
+    uint32_t flash_records;
+    uint32_t next_page_seq;
+    uint32_t head_seq;          /*!< page number of the head page */
+    uint16_t head_count;        /*!< records in the head page */
+    uint16_t head_offset;       /*!< records of the head page already drained, only kept in RAM */
+
+    store_stats_t stats;
+    const store_flash_t *flash;
+} sample_store_t;
+
+/**
+ * @brief Attach the flash and recover the log from it
+ *
+ * The RAM ring and the drain progress of the oldest flash page are kept when store already holds a valid state
+ * (e.g. from RTC RAM after deep sleep) and cleared otherwise. Without it the drained part of that page goes again.
+ *
+ * @param store store state
+ * @param flash flash area for spilled pages, NULL to keep samples in RAM only
+ */
+void sample_store_init(sample_store_t *store, const store_flash_t *flash);
+
+/**
+ * @brief Append a sample, spilling or dropping the oldest ones when full
+ */
+void sample_store_push(sample_store_t *store, const sensor_frame_t *frame);
+
+/**
+ * @brief Copy up to max of the oldest samples without removing them
+ *
+ * @return number of samples copied, never more than one flash page at a time
+ */
+size_t sample_store_peek(sample_store_t *store, sensor_frame_t *frames, size_t max);
+
+/**
+ * @brief Remove count samples previously returned by sample_store_peek()
+ */
+void sample_store_consume(sample_store_t *store, size_t count);
+
+/**
+ * @brief Number of samples waiting in RAM and on flash
+ */
+uint32_t sample_store_count(const sample_store_t *store);
+
+#endif // __SAMPLE_STORE_H__
@@ -0,0 +1,64 @@
+#ifndef __SENSOR_H__
+#define __SENSOR_H__
+
+#include <esp_err.h>
+
+#include "publisher.h"
+
+/*
+ * Sensor driver interface. A driver only knows how to bring its hardware up, take one reading and turn that reading
+ * into frame values; one scheduler task samples every registered driver at its own period and hands the readings
+ * to the publisher. Adding a sensor costs a driver struct and a publisher queue, not another task stack.
+ */
+
+#define SENSOR_MAX_DRIVERS          PUBLISHER_MAX_SOURCES
+#define SENSOR_MAX_READING_SIZE     PUBLISHER_MAX_ITEM_SIZE
+#define SENSOR_TASK_STACK_SIZE      CONFIG_ESP_SENSOR_TASK_STACK_SIZE
+
+typedef struct {
+    const char *name;
+    uint32_t period_ms;                                     /*!< sampling period, 0 samples only on sensor_trigger */
+    size_t reading_size;                                    /*!< at most SENSOR_MAX_READING_SIZE */
+    esp_err_t (*init)(void);                                /*!< bring up the hardware, ESP_OK if the sensor is present */
+    esp_err_t (*sample)(void *reading);                     /*!< take one reading, ESP_ERR_NOT_FINISHED if the
+                                                                 reading only fed a filter and there is nothing
+                                                                 to publish this time */
+    void (*format)(const void *reading, sensor_frame_t *frame); /*!< fill the frame flags and values */
+
+    /* publishing policy (policy, depth, min_interval_ms); name, item_size and to_frame are filled in on register */
+    publisher_source_t source;
+
+    /* scheduler state */
+    TickType_t next_due;
+    volatile bool triggered;
+    volatile bool rescheduled;                              /*!< period_ms changed, see sensor_set_period() */
+    uint32_t errors;
+} sensor_driver_t;
+
+/**
+ * @brief Initialise a driver and add it to the schedule
+ *
+ * @return ESP_OK, or the error of the driver's init callback in which case the driver is not scheduled
+ */
+esp_err_t sensor_register(sensor_driver_t *driver);
+
+/**
+ * @brief Start the scheduler task that samples all registered drivers
+ */
+esp_err_t sensor_scheduler_start(void);
+
+/**
+ * @brief Have the scheduler sample a driver as soon as possible, e.g. from an alert pin interrupt
+ *
+ * Safe to call from an ISR. Does not move the driver's periodic schedule.
+ */
+void sensor_trigger_from_isr(sensor_driver_t *driver);
+
+/**
+ * @brief Change the sampling period of a driver, e.g. on a configuration message
+ *
+ * Once the scheduler runs, the next reading is due one new period from now. 0 samples only on sensor_trigger.
+ */
+void sensor_set_period(sensor_driver_t *driver, uint32_t period_ms);
+
+#endif // __SENSOR_H__
@@ -0,0 +1,172 @@
+#include <sys/cdefs.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "sensor.h"
+#include "mem_report.h"
+#include "task_plan.h"
+
+static const char *TAG = "SENSORS";
+
+static sensor_driver_t *drivers[SENSOR_MAX_DRIVERS];
+static size_t driver_count = 0;
+static TaskHandle_t scheduler_task = NULL;
+
+#if CONFIG_ESP_STATIC_ALLOCATION
+static StackType_t scheduler_stack[SENSOR_TASK_STACK_SIZE];
+static StaticTask_t scheduler_tcb;
+#endif
+
+esp_err_t sensor_register(sensor_driver_t *driver)
+{
+    if (driver_count == SENSOR_MAX_DRIVERS || driver->reading_size > SENSOR_MAX_READING_SIZE) {
+        ESP_LOGE(TAG, "%s: Driver can not be registered", driver->name);
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    esp_err_t err = driver->init();
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "%s: Init failed (%s), not scheduled", driver->name, esp_err_to_name(err));
+        return err;
+    }
+
+    driver->source.name = driver->name;
+    driver->source.item_size = driver->reading_size;
+    driver->source.to_frame = driver->format;
+
+    err = publisher_add_source(&driver->source);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    driver->next_due = xTaskGetTickCount();
+    drivers[driver_count++] = driver;
+    if (driver->period_ms > 0) {
+        ESP_LOGI(TAG, "%s: Registered, period %" PRIu32 " ms", driver->name, driver->period_ms);
+    } else {
+        ESP_LOGI(TAG, "%s: Registered, sampled on trigger only", driver->name);
+    }
+
+    return ESP_OK;
+}
+
+static void sensor_sample(sensor_driver_t *driver, void *reading)
+{
+    esp_err_t err = driver->sample(reading);
+
+    if (err == ESP_ERR_NOT_FINISHED) {
+        return;
+    }
+    if (err != ESP_OK) {
+        driver->errors++;
+        return;
+    }
+
+    if (!publisher_send(&driver->source, reading)) {
+        ESP_LOGW(TAG, "%s: Failed to send the reading", driver->name);
+    }
+}
+
+/*
+ * Earliest deadline first over absolute due times: a late sample does not shift the following ones. Triggered
+ * drivers are sampled first, the wait for the next deadline is a task notification so a trigger or a new period
+ * cuts it short.
+ */
+_Noreturn static void sensor_scheduler_task(void *params)
+{
+    uint8_t reading[SENSOR_MAX_READING_SIZE];
+
+    while (true) {
+        sensor_driver_t *next = NULL;
+
+        for (size_t i = 0; i < driver_count; i++) {
+            if (drivers[i]->rescheduled) {
+                drivers[i]->rescheduled = false;
+                drivers[i]->next_due = xTaskGetTickCount() + pdMS_TO_TICKS(drivers[i]->period_ms);
+            }
+            if (drivers[i]->triggered) {
+                drivers[i]->triggered = false;
+                sensor_sample(drivers[i], reading);
+            }
+        }
+
+        for (size_t i = 0; i < driver_count; i++) {
+            if (drivers[i]->period_ms == 0) {
+                continue;
+            }
+            if (next == NULL || (int32_t)(drivers[i]->next_due - next->next_due) < 0) {
+                next = drivers[i];
+            }
+        }
+
+        TickType_t now = xTaskGetTickCount();
+        TickType_t wait = portMAX_DELAY;
+
+        if (next != NULL) {
+            wait = (int32_t)(next->next_due - now) > 0 ? next->next_due - now : 0;
+        }
+
+        if (wait > 0 && ulTaskNotifyTake(pdTRUE, wait) > 0) {
+            continue;
+        }
+
+        if (next == NULL) {
+            continue;
+        }
+
+        next->next_due += pdMS_TO_TICKS(next->period_ms);
+
+        // after a long stall skip the missed periods instead of sampling in a burst
+        now = xTaskGetTickCount();
+        if ((int32_t)(next->next_due - now) < 0) {
+            next->next_due = now + pdMS_TO_TICKS(next->period_ms);
+        }
+
+        sensor_sample(next, reading);
+    }
+}
+
+void sensor_trigger_from_isr(sensor_driver_t *driver)
+{
+    BaseType_t high_task_wakeup = pdFALSE;
+
+    driver->triggered = true;
+    if (scheduler_task != NULL) {
+        vTaskNotifyGiveFromISR(scheduler_task, &high_task_wakeup);
+    }
+
+    portYIELD_FROM_ISR(high_task_wakeup);
+}
+
+void sensor_set_period(sensor_driver_t *driver, uint32_t period_ms)
+{
+    driver->period_ms = period_ms;
+
+    // before the scheduler runs the first reading stays due right away
+    if (scheduler_task != NULL) {
+        driver->rescheduled = true;
+        xTaskNotifyGive(scheduler_task);
+    }
+}
+
+esp_err_t sensor_scheduler_start(void)
+{
+#if CONFIG_ESP_STATIC_ALLOCATION
+    scheduler_task = xTaskCreateStaticPinnedToCore(sensor_scheduler_task, "sensor_scheduler", SENSOR_TASK_STACK_SIZE,
+                                                   NULL, TASK_PRIORITY_SENSOR, scheduler_stack, &scheduler_tcb,
+                                                   TASK_CORE_SENSOR);
+#else
+    BaseType_t status = xTaskCreatePinnedToCore(sensor_scheduler_task, "sensor_scheduler", SENSOR_TASK_STACK_SIZE,
+                                                NULL, TASK_PRIORITY_SENSOR, &scheduler_task, TASK_CORE_SENSOR);
+
+    if (status != pdPASS) {
+        ESP_LOGE(TAG, "sensor_scheduler_task(): Task was not created. Could not allocate required memory");
+        return ESP_ERR_NO_MEM;
+    }
+#endif
+
+    mem_report_task(scheduler_task, SENSOR_TASK_STACK_SIZE, MEM_STATIC_ALLOCATION);
+
+    return ESP_OK;
+}
@@ -0,0 +1,33 @@
+#ifndef __TASK_PLAN_H__
+#define __TASK_PLAN_H__
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+/*
+ * Priority and core of every application task, in one place. The ESP-IDF system tasks sit above all of them: the
+ * WiFi task (23) and esp_timer (22) on the protocol core (core 0), LwIP (18) pinned there by sdkconfig.defaults.
+ * Application tasks never preempt the radio, so what protects a DHT22 capture is the core it runs on, not its
+ * priority: the sensor scheduler goes to the app core (core 1) where nothing of the radio runs, and the GPIO
+ * backend additionally holds the scheduler of that core for the ~5 ms of the frame (CONFIG_ESP_DHT_CAPTURE_GUARD).
+ *
+ * Among the application tasks the sensor scheduler is highest so a reading is taken on time, the connectivity
+ * manager next so a reconnect is never stuck behind a publish, and the publisher last: it only drains queues.
+ */
+
+#define TASK_PRIORITY_SENSOR        6
+#define TASK_PRIORITY_CONN          5
+#define TASK_PRIORITY_MQTT          3
+
+/* Kconfig uses -1 for no affinity, a single-core chip has nothing to pin to */
+#if portNUM_PROCESSORS > 1
+#define TASK_CORE(config)           ((config) < 0 ? tskNO_AFFINITY : (config))
+#else
+#define TASK_CORE(config)           tskNO_AFFINITY
+#endif
+
+#define TASK_CORE_SENSOR            TASK_CORE(CONFIG_ESP_TASK_SENSOR_CORE)
+#define TASK_CORE_CONN              TASK_CORE(CONFIG_ESP_TASK_CONN_CORE)
+#define TASK_CORE_MQTT              TASK_CORE(CONFIG_ESP_TASK_MQTT_CORE)
+
+#endif // __TASK_PLAN_H__
@@ -0,0 +1,310 @@
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp_log.h"
+#include "esp_attr.h"
+#include "esp_timer.h"
+#include "esp_transport.h"
+#include "esp_transport_tcp.h"
+#include "mbedtls/ssl.h"
+#include "mbedtls/net_sockets.h"
+#include "mbedtls/entropy.h"
+#include "mbedtls/ctr_drbg.h"
+#include "mbedtls/x509_crt.h"
+#include "diag.h"
+#include "tls_transport.h"
+
+static const char *TAG = "TLS";
+
+#define TLS_DEFAULT_PORT        8883
+#define TLS_SESSION_MAGIC       0x544C5353  // "TLSS"
+
+/* CA of the broker, EMBED_TXTFILES in main/CMakeLists.txt, NUL terminated as the PEM parser wants it */
+extern const char ca_crt_start[] asm("_binary_ca_crt_start");
+extern const char ca_crt_end[] asm("_binary_ca_crt_end");
+
+/* Session of the last handshake, serialized. RTC RAM survives deep sleep, a power cycle starts with a full one. */
+typedef struct {
+    uint32_t magic;
+    uint16_t size;
+    uint8_t data[TLS_SESSION_MAX_SIZE];
+} tls_session_cache_t;
+
+RTC_DATA_ATTR static tls_session_cache_t rtc_session;
+
+typedef struct {
+    esp_transport_handle_t tcp;     /*!< owns the socket, connect with timeout and polling */
+    mbedtls_net_context net;        /*!< the socket of tcp for the mbedtls I/O callbacks */
+    mbedtls_ssl_context ssl;
+    mbedtls_ssl_config conf;
+    mbedtls_x509_crt ca;
+    mbedtls_entropy_context entropy;
+    mbedtls_ctr_drbg_context ctr_drbg;
+    bool ssl_ready;                 /*!< ssl is set up for the current connection */
+    bool chain_verified;            /*!< the handshake verified the certificate chain, so it was a full one */
+} tls_transport_t;
+
+static bool session_offer(mbedtls_ssl_context *ssl)
+{
+#if CONFIG_ESP_MQTT_TLS_RESUME
+    if (rtc_session.magic != TLS_SESSION_MAGIC) {
+        return false;
+    }
+
+    mbedtls_ssl_session session;
+    mbedtls_ssl_session_init(&session);
+
+    // a session of another mbedtls build does not load, it is dropped and the handshake is a full one
+    bool offered = mbedtls_ssl_session_load(&session, rtc_session.data, rtc_session.size) == 0 &&
+                   mbedtls_ssl_set_session(ssl, &session) == 0;
+    if (!offered) {
+        rtc_session.magic = 0;
+    }
+
+    mbedtls_ssl_session_free(&session);
+    return offered;
+#else
+    return false;
+#endif
+}
+
+static void session_store(mbedtls_ssl_context *ssl)
+{
+#if CONFIG_ESP_MQTT_TLS_RESUME
+    mbedtls_ssl_session session;
+    size_t size = 0;
+
+    mbedtls_ssl_session_init(&session);
+    rtc_session.magic = 0;
+
+    // the broker may have renewed the ticket, the last one is kept
+    if (mbedtls_ssl_get_session(ssl, &session) == 0) {
+        int ret = mbedtls_ssl_session_save(&session, rtc_session.data, sizeof(rtc_session.data), &size);
+        if (ret == 0) {
+            rtc_session.size = (uint16_t)size;
+            rtc_session.magic = TLS_SESSION_MAGIC;
+        } else {
+            ESP_LOGW(TAG, "session of %u bytes not kept, TLS_SESSION_MAX_SIZE is %u", (unsigned)size,
+                     (unsigned)TLS_SESSION_MAX_SIZE);
+        }
+    }
+
+    mbedtls_ssl_session_free(&session);
+#endif
+}
+
+/* Only called while a certificate chain is verified, never in a resumed handshake */
+static int verify_callback(void *ctx, mbedtls_x509_crt *crt, int depth, uint32_t *flags)
+{
+    tls_transport_t *tls = ctx;
+
+    tls->chain_verified = true;
+    return 0;
+}
+
+static int tls_close(esp_transport_handle_t t)
+{
+    tls_transport_t *tls = esp_transport_get_context_data(t);
+
+    if (tls->ssl_ready) {
+        mbedtls_ssl_close_notify(&tls->ssl);
+        mbedtls_ssl_free(&tls->ssl);
+        tls->ssl_ready = false;
+    }
+
+    // the socket belongs to tcp
+    tls->net.fd = -1;
+    return esp_transport_close(tls->tcp);
+}
+
+static int tls_connect(esp_transport_handle_t t, const char *host, int port, int timeout_ms)
+{
+    tls_transport_t *tls = esp_transport_get_context_data(t);
+
+    if (esp_transport_connect(tls->tcp, host, port, timeout_ms) < 0) {
+        return -1;
+    }
+
+    int64_t start = diag_start();
+
+    tls->net.fd = esp_transport_get_socket(tls->tcp);
+    mbedtls_ssl_conf_read_timeout(&tls->conf, timeout_ms);
+    mbedtls_ssl_init(&tls->ssl);
+    tls->ssl_ready = true;
+
+    int ret = mbedtls_ssl_setup(&tls->ssl, &tls->conf);
+    if (ret == 0) {
+        ret = mbedtls_ssl_set_hostname(&tls->ssl, host);
+    }
+    if (ret != 0) {
+        ESP_LOGE(TAG, "setup failed: -0x%04x", (unsigned)-ret);
+        tls_close(t);
+        return -1;
+    }
+
+    mbedtls_ssl_set_bio(&tls->ssl, &tls->net, mbedtls_net_send, NULL, mbedtls_net_recv_timeout);
+    bool offered = session_offer(&tls->ssl);
+    tls->chain_verified = false;
+
+    // a blocking socket with a read timeout, the handshake runs to completion or fails
+    ret = mbedtls_ssl_handshake(&tls->ssl);
+    if (ret != 0) {
+        ESP_LOGW(TAG, "handshake with %s:%d failed: -0x%04x", host, port, (unsigned)-ret);
+        tls_close(t);
+        return -1;
+    }
+
+    bool resumed = !tls->chain_verified;
+    int64_t elapsed_ms = (esp_timer_get_time() - start) / 1000;
+
+    diag_record(resumed ? DIAG_STAGE_TLS_RESUMED : DIAG_STAGE_TLS_FULL, start);
+    ESP_LOGI(TAG, "%s handshake in %" PRId64 " ms%s", resumed ? "resumed" : "full", elapsed_ms,
+             offered && !resumed ? ", the broker did not accept the session" : "");
+
+    session_store(&tls->ssl);
+    return 0;
+}
+
+static int tls_poll_read(esp_transport_handle_t t, int timeout_ms)
+{
+    tls_transport_t *tls = esp_transport_get_context_data(t);
+
+    // a record decrypted earlier may hold more than the last read took
+    if (mbedtls_ssl_get_bytes_avail(&tls->ssl) > 0) {
+        return 1;
+    }
+
+    return esp_transport_poll_read(tls->tcp, timeout_ms);
+}
+
+static int tls_poll_write(esp_transport_handle_t t, int timeout_ms)
+{
+    tls_transport_t *tls = esp_transport_get_context_data(t);
+
+    return esp_transport_poll_write(tls->tcp, timeout_ms);
+}
+
+static int tls_read(esp_transport_handle_t t, char *buffer, int len, int timeout_ms)
+{
+    tls_transport_t *tls = esp_transport_get_context_data(t);
+
+    int poll = tls_poll_read(t, timeout_ms);
+    if (poll <= 0) {
+        return poll;
+    }
+
+    int ret = mbedtls_ssl_read(&tls->ssl, (unsigned char *)buffer, len);
+    if (ret == MBEDTLS_ERR_SSL_WANT_READ || ret == MBEDTLS_ERR_SSL_WANT_WRITE || ret == MBEDTLS_ERR_SSL_TIMEOUT) {
+        // a record without application data, e.g. a renewed session ticket, or one that is still arriving
+        return ERR_TCP_TRANSPORT_CONNECTION_TIMEOUT;
+    }
+    if (ret == 0 || ret == MBEDTLS_ERR_SSL_PEER_CLOSE_NOTIFY) {
+        return ERR_TCP_TRANSPORT_CONNECTION_CLOSED_BY_FIN;
+    }
+    if (ret < 0) {
+        ESP_LOGW(TAG, "read failed: -0x%04x", (unsigned)-ret);
+        return ERR_TCP_TRANSPORT_CONNECTION_FAILED;
+    }
+
+    return ret;
+}
+
+static int tls_write(esp_transport_handle_t t, const char *buffer, int len, int timeout_ms)
+{
+    tls_transport_t *tls = esp_transport_get_context_data(t);
+
+    int poll = tls_poll_write(t, timeout_ms);
+    if (poll <= 0) {
+        return poll;
+    }
+
+    int ret = mbedtls_ssl_write(&tls->ssl, (const unsigned char *)buffer, len);
+    if (ret == MBEDTLS_ERR_SSL_WANT_READ || ret == MBEDTLS_ERR_SSL_WANT_WRITE) {
+        return ERR_TCP_TRANSPORT_CONNECTION_TIMEOUT;
+    }
+    if (ret < 0) {
+        ESP_LOGW(TAG, "write failed: -0x%04x", (unsigned)-ret);
+        return ERR_TCP_TRANSPORT_CONNECTION_FAILED;
+    }
+
+    return ret;
+}
+
+static void tls_free(tls_transport_t *tls)
+{
+    mbedtls_ssl_config_free(&tls->conf);
+    mbedtls_x509_crt_free(&tls->ca);
+    mbedtls_ctr_drbg_free(&tls->ctr_drbg);
+    mbedtls_entropy_free(&tls->entropy);
+    if (tls->tcp != NULL) {
+        esp_transport_destroy(tls->tcp);
+    }
+    free(tls);
+}
+
+static int tls_destroy(esp_transport_handle_t t)
+{
+    tls_transport_t *tls = esp_transport_get_context_data(t);
+
+    tls_close(t);
+    tls_free(tls);
+    return 0;
+}
+
+esp_transport_handle_t tls_transport_create(void)
+{
+    tls_transport_t *tls = calloc(1, sizeof(tls_transport_t));
+    if (tls == NULL) {
+        return NULL;
+    }
+
+    mbedtls_net_init(&tls->net);
+    mbedtls_ssl_config_init(&tls->conf);
+    mbedtls_x509_crt_init(&tls->ca);
+    mbedtls_entropy_init(&tls->entropy);
+    mbedtls_ctr_drbg_init(&tls->ctr_drbg);
+
+    tls->tcp = esp_transport_tcp_init();
+    esp_transport_handle_t t = esp_transport_init();
+    if (tls->tcp == NULL || t == NULL) {
+        if (t != NULL) {
+            esp_transport_destroy(t);
+        }
+        tls_free(tls);
+        return NULL;
+    }
+
+    int ret = mbedtls_ctr_drbg_seed(&tls->ctr_drbg, mbedtls_entropy_func, &tls->entropy, NULL, 0);
+    if (ret == 0) {
+        ret = mbedtls_x509_crt_parse(&tls->ca, (const unsigned char *)ca_crt_start, ca_crt_end - ca_crt_start);
+    }
+    if (ret == 0) {
+        ret = mbedtls_ssl_config_defaults(&tls->conf, MBEDTLS_SSL_IS_CLIENT, MBEDTLS_SSL_TRANSPORT_STREAM,
+                                          MBEDTLS_SSL_PRESET_DEFAULT);
+    }
+    if (ret != 0) {
+        ESP_LOGE(TAG, "init failed: -0x%04x", (unsigned)-ret);
+        esp_transport_destroy(t);
+        tls_free(tls);
+        return NULL;
+    }
+
+    mbedtls_ssl_conf_authmode(&tls->conf, MBEDTLS_SSL_VERIFY_REQUIRED);
+    mbedtls_ssl_conf_ca_chain(&tls->conf, &tls->ca, NULL);
+    mbedtls_ssl_conf_rng(&tls->conf, mbedtls_ctr_drbg_random, &tls->ctr_drbg);
+    mbedtls_ssl_conf_verify(&tls->conf, verify_callback, tls);
+    // TLS 1.3 sends its tickets after the handshake, the session kept here is a TLS 1.2 one
+    mbedtls_ssl_conf_max_tls_version(&tls->conf, MBEDTLS_SSL_VERSION_TLS1_2);
+#if defined(MBEDTLS_SSL_SESSION_TICKETS)
+    mbedtls_ssl_conf_session_tickets(&tls->conf, MBEDTLS_SSL_SESSION_TICKETS_ENABLED);
+#endif
+
+    esp_transport_set_context_data(t, tls);
+    esp_transport_set_func(t, tls_connect, tls_read, tls_write, tls_close, tls_poll_read, tls_poll_write,
+                           tls_destroy);
+    esp_transport_set_default_port(t, TLS_DEFAULT_PORT);
+
+    return t;
+}
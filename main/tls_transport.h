@@ -0,0 +1,27 @@
+#ifndef __TLS_TRANSPORT_H__
+#define __TLS_TRANSPORT_H__
+
+#include "esp_transport.h"
+
+/*
+ * TLS 1.2 transport for esp-mqtt (CONFIG_ESP_MQTT_TLS) that resumes the session of the previous connection. The
+ * built-in SSL transport does a full handshake on every connect: an ECDHE key exchange and a certificate chain
+ * verification, the bulk of the connect time and energy of a wake. Here the session the broker issued (a session
+ * ticket, or its session ID) is kept in RTC RAM, which survives reconnects and deep sleep, and offered in the next
+ * ClientHello (CONFIG_ESP_MQTT_TLS_RESUME). A resumed handshake is one round trip of symmetric crypto. A broker
+ * that no longer accepts the session answers with a full handshake.
+ *
+ * The broker certificate is verified against the CA embedded from main/certs/ca.crt, the host name of
+ * CONFIG_ESP_BROKER_URL must match it. Handshake times go to DIAG_STAGE_TLS_FULL and DIAG_STAGE_TLS_RESUMED.
+ */
+
+#define TLS_SESSION_MAX_SIZE    512     /*!< serialized session kept in RTC RAM, ticket included */
+
+/**
+ * @brief Create the transport for network.transport of the esp-mqtt config, the client destroys it
+ *
+ * @return NULL if out of memory or the embedded CA does not parse
+ */
+esp_transport_handle_t tls_transport_create(void);
+
+#endif // __TLS_TRANSPORT_H__
@@ -0,0 +1,50 @@
+#include <string.h>
+
+#include "topic_alias.h"
+
+void topic_alias_reset(topic_alias_t *aliases, uint16_t limit)
+{
+    memset(aliases, 0, sizeof(*aliases));
+    aliases->limit = limit < TOPIC_ALIAS_MAX ? limit : TOPIC_ALIAS_MAX;
+}
+
+uint16_t topic_alias_get(topic_alias_t *aliases, const char *topic, bool *established)
+{
+    *established = false;
+
+    for (uint16_t i = 0; i < aliases->used; i++) {
+        if (strcmp(aliases->topics[i], topic) == 0) {
+            *established = aliases->established[i];
+            return i + 1;
+        }
+    }
+
+    if (aliases->used >= aliases->limit) {
+        return 0;
+    }
+
+    aliases->topics[aliases->used] = topic;
+    aliases->established[aliases->used] = false;
+    aliases->used++;
+
+    return aliases->used;
+}
+
+void topic_alias_confirm(topic_alias_t *aliases, uint16_t alias)
+{
+    if (alias > 0 && alias <= aliases->used) {
+        aliases->established[alias - 1] = true;
+    }
+}
+
+void topic_alias_reject(topic_alias_t *aliases, uint16_t alias)
+{
+    if (alias == 0) {
+        return;
+    }
+
+    aliases->limit = alias - 1;
+    if (aliases->used > aliases->limit) {
+        aliases->used = aliases->limit;
+    }
+}
@@ -0,0 +1,47 @@
+#ifndef __TOPIC_ALIAS_H__
+#define __TOPIC_ALIAS_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Client-to-broker MQTT5 topic aliases. The first publish on a topic carries the full topic and a newly assigned
+ * alias, later publishes carry the alias and an empty topic. Aliases only live as long as one network connection,
+ * so the table is reset on every (re)connect. No ESP-IDF dependencies.
+ */
+
+#define TOPIC_ALIAS_MAX     8       /*!< table size, at least the number of configured publish topics */
+
+typedef struct {
+    const char *topics[TOPIC_ALIAS_MAX];    /*!< topics[n] uses alias n + 1 */
+    bool established[TOPIC_ALIAS_MAX];      /*!< the broker has seen the topic together with its alias */
+    uint16_t limit;                         /*!< aliases the broker accepts on this connection */
+    uint16_t used;
+} topic_alias_t;
+
+/**
+ * @brief Forget all aliases, used on every new connection
+ *
+ * @param limit highest alias the broker is expected to accept, capped at TOPIC_ALIAS_MAX
+ */
+void topic_alias_reset(topic_alias_t *aliases, uint16_t limit);
+
+/**
+ * @brief Alias for a topic, assigning the next free one on first use
+ *
+ * @param established output, true if the publish may leave the topic empty
+ * @return alias, or 0 if none is available and the full topic has to be sent without one
+ */
+uint16_t topic_alias_get(topic_alias_t *aliases, const char *topic, bool *established);
+
+/**
+ * @brief Mark an alias as known to the broker after the publish that introduced it was sent
+ */
+void topic_alias_confirm(topic_alias_t *aliases, uint16_t alias);
+
+/**
+ * @brief The broker refused this alias: lower the limit below it and drop the aliases from there on
+ */
+void topic_alias_reject(topic_alias_t *aliases, uint16_t alias);
+
+#endif // __TOPIC_ALIAS_H__
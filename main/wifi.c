@@ -1,44 +1,194 @@
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
 #include "esp_system.h"
 #include "esp_wifi.h"
 #include "esp_log.h"
+#include "esp_attr.h"
+#include "esp_mac.h"
+#include "nvs.h"
 #include "wifi.h"
+#include "diag.h"
+#include "connectivity.h"
 
 static const char *TAG = "WiFi";
-static int s_retry_num = 0;
 
 /* FreeRTOS event group to signal when we are connected*/
 static EventGroupHandle_t s_wifi_event_group;
+#if CONFIG_ESP_STATIC_ALLOCATION
+static StaticEventGroup_t s_wifi_event_group_buffer;
+#endif
+
+#define WIFI_CACHE_MAGIC        0x57494649  // "WIFI"
+#define WIFI_CACHE_NAMESPACE    "wifi"
+#define WIFI_CACHE_KEY          "ap"
+
+/* Last AP we got an IP from. RTC RAM survives deep sleep, NVS survives power cycles. */
+typedef struct {
+    uint32_t magic;
+    char ssid[33];
+    uint8_t bssid[6];
+    uint8_t channel;
+} wifi_cache_t;
+
+RTC_DATA_ATTR static wifi_cache_t rtc_cache;
+
+/* Whether the current connect attempt targets the cached AP */
+static bool s_use_cache = false;
+
+/* The radio is switched off while the connectivity manager waits a long backoff */
+static bool s_radio_on = false;
+
+static bool wifi_cache_valid(const wifi_cache_t *cache)
+{
+    return cache->magic == WIFI_CACHE_MAGIC && strncmp(cache->ssid, ESP_WIFI_SSID, sizeof(cache->ssid)) == 0;
+}
+
+static void wifi_cache_load(void)
+{
+    if (wifi_cache_valid(&rtc_cache)) {
+        return;
+    }
+
+    nvs_handle_t handle;
+    size_t size = sizeof(rtc_cache);
+
+    if (nvs_open(WIFI_CACHE_NAMESPACE, NVS_READONLY, &handle) == ESP_OK) {
+        if (nvs_get_blob(handle, WIFI_CACHE_KEY, &rtc_cache, &size) != ESP_OK || size != sizeof(rtc_cache)) {
+            rtc_cache.magic = 0;
+        }
+        nvs_close(handle);
+    }
+}
+
+static void wifi_cache_store(void)
+{
+    wifi_ap_record_t ap;
+    if (esp_wifi_sta_get_ap_info(&ap) != ESP_OK) {
+        return;
+    }
+
+    wifi_cache_t cache = { .magic = WIFI_CACHE_MAGIC, .channel = ap.primary };
+    strncpy(cache.ssid, ESP_WIFI_SSID, sizeof(cache.ssid) - 1);
+    memcpy(cache.bssid, ap.bssid, sizeof(cache.bssid));
+
+    // flash is only written when the AP changed, not on every wake
+    if (memcmp(&cache, &rtc_cache, sizeof(cache)) == 0) {
+        return;
+    }
+
+    rtc_cache = cache;
+
+    nvs_handle_t handle;
+    if (nvs_open(WIFI_CACHE_NAMESPACE, NVS_READWRITE, &handle) == ESP_OK) {
+        if (nvs_set_blob(handle, WIFI_CACHE_KEY, &cache, sizeof(cache)) == ESP_OK) {
+            nvs_commit(handle);
+        }
+        nvs_close(handle);
+    }
+
+    ESP_LOGI(TAG, "cached AP " MACSTR " on channel %u", MAC2STR(cache.bssid), cache.channel);
+}
+
+/* Targeted connect to the cached BSSID and channel, or a regular scan for the SSID */
+static void wifi_set_sta_config(bool use_cache)
+{
+    wifi_config_t wifi_config = {
+            .sta = {
+                    .ssid = ESP_WIFI_SSID,
+                    .password = ESP_WIFI_PASS,
+                    /* Authmode threshold resets to WPA2 as default if password matches WPA2 standards (pasword len => 8).
+                     * If you want to connect the device to deprecated WEP/WPA networks, Please set the threshold value
+                     * to WIFI_AUTH_WEP/WIFI_AUTH_WPA_PSK and set the password with length and format matching to
+                     * WIFI_AUTH_WEP/WIFI_AUTH_WPA_PSK standards.
+                     */
+                    .threshold.authmode = ESP_WIFI_SCAN_AUTH_MODE_THRESHOLD,
+                    .sae_pwe_h2e = ESP_WIFI_SAE_MODE,
+                    .sae_h2e_identifier = EXAMPLE_H2E_IDENTIFIER,
+            },
+    };
+
+    if (use_cache) {
+        wifi_config.sta.bssid_set = true;
+        memcpy(wifi_config.sta.bssid, rtc_cache.bssid, sizeof(wifi_config.sta.bssid));
+        wifi_config.sta.channel = rtc_cache.channel;
+    }
+
+    s_use_cache = use_cache;
+    ESP_ERROR_CHECK(esp_wifi_set_config(WIFI_IF_STA, &wifi_config));
+}
+
+#if CONFIG_ESP_WIFI_STATIC_IP
+static void wifi_set_static_ip(esp_netif_t *netif)
+{
+    esp_netif_ip_info_t ip_info = { 0 };
+    esp_netif_dns_info_t dns_info = { .ip.type = ESP_IPADDR_TYPE_V4 };
+
+    ESP_ERROR_CHECK(esp_netif_dhcpc_stop(netif));
+    ESP_ERROR_CHECK(esp_netif_str_to_ip4(ESP_WIFI_STATIC_IP_ADDR, &ip_info.ip));
+    ESP_ERROR_CHECK(esp_netif_str_to_ip4(ESP_WIFI_STATIC_NETMASK, &ip_info.netmask));
+    ESP_ERROR_CHECK(esp_netif_str_to_ip4(ESP_WIFI_STATIC_GATEWAY, &ip_info.gw));
+    ESP_ERROR_CHECK(esp_netif_set_ip_info(netif, &ip_info));
+
+    ESP_ERROR_CHECK(esp_netif_str_to_ip4(ESP_WIFI_STATIC_DNS, &dns_info.ip.u_addr.ip4));
+    ESP_ERROR_CHECK(esp_netif_set_dns_info(netif, ESP_NETIF_DNS_MAIN, &dns_info));
+}
+#endif
 
 static void event_handler(void* args, esp_event_base_t base,
                           int32_t event_id, void* event_data)
 {
-    if (base == WIFI_EVENT && event_id == WIFI_EVENT_STA_START) {
-        esp_wifi_connect();
-    } else if (base == WIFI_EVENT && event_id == WIFI_EVENT_STA_DISCONNECTED) {
-        if (s_retry_num < ESP_MAXIMUM_RETRY) {
+    if (base == WIFI_EVENT && event_id == WIFI_EVENT_STA_DISCONNECTED) {
+        bool was_connected = wifi_is_connected();
+
+        xEventGroupClearBits(s_wifi_event_group, WIFI_CONNECTED_BIT);
+        if (s_use_cache && !was_connected) {
+            // the cached AP is gone or moved to another channel, fall back to a scan within the same attempt
+            ESP_LOGI(TAG, "cached AP not reachable, scanning");
+            wifi_set_sta_config(false);
             esp_wifi_connect();
-            s_retry_num++;
-            ESP_LOGI(TAG, "retry to connect to the AP");
-        } else {
-            xEventGroupSetBits(s_wifi_event_group, WIFI_FAIL_BIT);
+            return;
         }
-        ESP_LOGI(TAG,"connect to the AP fail");
+
+        ESP_LOGI(TAG, was_connected ? "lost the AP" : "connect to the AP fail");
+        connectivity_notify(CONN_EVENT_WIFI_DOWN);
     } else if (base == IP_EVENT && event_id == IP_EVENT_STA_GOT_IP) {
         ip_event_got_ip_t* event = (ip_event_got_ip_t*) event_data;
         ESP_LOGI(TAG, "got ip:" IPSTR, IP2STR(&event->ip_info.ip));
-        s_retry_num = 0;
+        if (diag_milestone(DIAG_MILESTONE_IP)) {
+            ESP_LOGI(TAG, "Boot to IP: %" PRIu32 " ms", diag_milestone_ms(DIAG_MILESTONE_IP));
+        }
+        wifi_cache_store();
+        if (!s_use_cache && wifi_cache_valid(&rtc_cache)) {
+            // after a scan fallback, the next reconnect targets the AP just found rather than scanning again
+            wifi_set_sta_config(true);
+        }
         xEventGroupSetBits(s_wifi_event_group, WIFI_CONNECTED_BIT);
+        connectivity_notify(CONN_EVENT_WIFI_UP);
     }
 }
 
 esp_err_t wifi_init_sta(void)
 {
+#if CONFIG_ESP_STATIC_ALLOCATION
+    s_wifi_event_group = xEventGroupCreateStatic(&s_wifi_event_group_buffer);
+#else
     s_wifi_event_group = xEventGroupCreate();
+    if (s_wifi_event_group == NULL) {
+        ESP_LOGE(TAG, "wifi_init_sta(): Could not allocate required memory");
+        return ESP_ERR_NO_MEM;
+    }
+#endif
 
     ESP_ERROR_CHECK(esp_netif_init());
 
     ESP_ERROR_CHECK(esp_event_loop_create_default());
-    esp_netif_create_default_wifi_sta();
+    esp_netif_t *netif = esp_netif_create_default_wifi_sta();
+#if CONFIG_ESP_WIFI_STATIC_IP
+    wifi_set_static_ip(netif);
+#else
+    (void)netif;
+#endif
 
     wifi_init_config_t cfg = WIFI_INIT_CONFIG_DEFAULT();
     ESP_ERROR_CHECK(esp_wifi_init(&cfg));
@@ -58,45 +208,48 @@ esp_err_t wifi_init_sta(void)
                                                         NULL,
                                                         &instance_got_ip));
 
-    wifi_config_t wifi_config = {
-            .sta = {
-                    .ssid = ESP_WIFI_SSID,
-                    .password = ESP_WIFI_PASS,
-                    /* Authmode threshold resets to WPA2 as default if password matches WPA2 standards (pasword len => 8).
-                     * If you want to connect the device to deprecated WEP/WPA networks, Please set the threshold value
-                     * to WIFI_AUTH_WEP/WIFI_AUTH_WPA_PSK and set the password with length and format matching to
-                     * WIFI_AUTH_WEP/WIFI_AUTH_WPA_PSK standards.
-                     */
-                    .threshold.authmode = ESP_WIFI_SCAN_AUTH_MODE_THRESHOLD,
-                    .sae_pwe_h2e = ESP_WIFI_SAE_MODE,
-                    .sae_h2e_identifier = EXAMPLE_H2E_IDENTIFIER,
-            },
-    };
+    wifi_cache_load();
+
     ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_STA) );
-    ESP_ERROR_CHECK(esp_wifi_set_config(WIFI_IF_STA, &wifi_config) );
+    wifi_set_sta_config(wifi_cache_valid(&rtc_cache));
     ESP_ERROR_CHECK(esp_wifi_start());
+    s_radio_on = true;
 
+    /* The connectivity manager calls wifi_connect(), event_handler() sets WIFI_CONNECTED_BIT once we have an IP */
     ESP_LOGI(TAG, "wifi_init_sta finished.");
 
-    /* Waiting until either the connection is established (WIFI_CONNECTED_BIT) or connection failed for the maximum
-     * number of re-tries (WIFI_FAIL_BIT). The bits are set by event_handler() (see above) */
-    EventBits_t bits = xEventGroupWaitBits(s_wifi_event_group,
-                                           WIFI_CONNECTED_BIT | WIFI_FAIL_BIT,
-                                           pdFALSE,
-                                           pdFALSE,
-                                           portMAX_DELAY);
-
-    /* xEventGroupWaitBits() returns the bits before the call returned, hence we can test which event actually
-     * happened. */
-    if (bits & WIFI_CONNECTED_BIT) {
-        ESP_LOGI(TAG, "connected to ap SSID:%s password:%s",
-                 ESP_WIFI_SSID, ESP_WIFI_PASS);
-    } else if (bits & WIFI_FAIL_BIT) {
-        ESP_LOGI(TAG, "Failed to connect to SSID:%s, password:%s",
-                 ESP_WIFI_SSID, ESP_WIFI_PASS);
-    } else {
-        ESP_LOGE(TAG, "UNEXPECTED EVENT");
+    return ESP_OK;
+}
+
+void wifi_connect(void)
+{
+    if (!s_radio_on) {
+        ESP_ERROR_CHECK(esp_wifi_start());
+        s_radio_on = true;
+    }
+
+    ESP_LOGI(TAG, "connecting to SSID:%s", ESP_WIFI_SSID);
+    esp_err_t err = esp_wifi_connect();
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "esp_wifi_connect() failed: %s", esp_err_to_name(err));
+        connectivity_notify(CONN_EVENT_WIFI_DOWN);
     }
+}
 
-    return ESP_OK;
+void wifi_radio_off(void)
+{
+    if (s_radio_on && !wifi_is_connected()) {
+        ESP_LOGI(TAG, "radio off until the next attempt");
+        esp_wifi_stop();
+        s_radio_on = false;
+    }
+}
+
+bool wifi_is_connected(void)
+{
+    if (s_wifi_event_group == NULL) {
+        return false;
+    }
+
+    return (xEventGroupGetBits(s_wifi_event_group) & WIFI_CONNECTED_BIT) != 0;
 }
\ No newline at end of file
@@ -1,9 +1,11 @@
 #ifndef __WIFI_H__
 #define __WIFI_H__
 
+#include <stdbool.h>
+#include <esp_err.h>
+
 #define ESP_WIFI_SSID      CONFIG_ESP_WIFI_SSID
 #define ESP_WIFI_PASS      CONFIG_ESP_WIFI_PASSWORD
-#define ESP_MAXIMUM_RETRY  CONFIG_ESP_MAXIMUM_RETRY
 
 #if CONFIG_ESP_WPA3_SAE_PWE_HUNT_AND_PECK
 #define ESP_WIFI_SAE_MODE WPA3_SAE_PWE_HUNT_AND_PECK
@@ -33,9 +35,33 @@
 #define ESP_WIFI_SCAN_AUTH_MODE_THRESHOLD WIFI_AUTH_WAPI_PSK
 #endif
 
+#if CONFIG_ESP_WIFI_STATIC_IP
+#define ESP_WIFI_STATIC_IP_ADDR     CONFIG_ESP_WIFI_STATIC_IP_ADDR
+#define ESP_WIFI_STATIC_NETMASK     CONFIG_ESP_WIFI_STATIC_NETMASK
+#define ESP_WIFI_STATIC_GATEWAY     CONFIG_ESP_WIFI_STATIC_GATEWAY
+#define ESP_WIFI_STATIC_DNS         CONFIG_ESP_WIFI_STATIC_DNS
+#endif
+
 #define WIFI_CONNECTED_BIT BIT0
-#define WIFI_FAIL_BIT      BIT1
 
+/**
+ * @brief Bring up the station without connecting, the connectivity manager starts the attempts
+ */
 esp_err_t wifi_init_sta(void);
 
+/**
+ * @brief Start one connect attempt, switching the radio back on if needed. Returns without waiting.
+ */
+void wifi_connect(void);
+
+/**
+ * @brief Stop the radio while not associated, the next wifi_connect() starts it again
+ */
+void wifi_radio_off(void);
+
+/**
+ * @brief Whether the station is associated and has an IP address
+ */
+bool wifi_is_connected(void);
+
 #endif // __WIFI_H__
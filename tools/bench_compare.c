@@ -0,0 +1,209 @@
+/*
+ * Compares two runs of the hot path micro-benchmarks of main/bench.c, e.g. the last release against a change, and
+ * flags every benchmark that got slower or produces more bytes.
+ *
+ * Build and run on the host:
+ *   cc -O2 -o bench_compare tools/bench_compare.c
+ *   ./bench_compare [-t 5] baseline.jsonl current.jsonl
+ *
+ * The inputs are the JSON lines of host/hotpath_bench or a captured device console (CONFIG_ESP_BENCHMARK), other
+ * lines are skipped. Medians are compared: a benchmark regressed when its median grew by more than the threshold
+ * (percent, 5 by default) or when its bytes or wire_bytes grew at all. Only runs in the same unit compare, cycles
+ * on the device, nanoseconds on the host.
+ *
+ * Exits with 1 on a regression or a benchmark of the baseline missing from the current run.
+ */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define MAX_RESULTS     64
+#define NAME_SIZE       48
+
+typedef struct {
+    char name[NAME_SIZE];
+    char unit[16];
+    char version[48];
+    double min;
+    double median;
+    unsigned long bytes;
+    unsigned long wire_bytes;
+} result_t;
+
+typedef struct {
+    result_t results[MAX_RESULTS];
+    size_t count;
+} run_t;
+
+/* The value of "key": in a line written by bench_measure(), no escapes and no nesting */
+static const char *find_value(const char *line, const char *key)
+{
+    char pattern[32];
+
+    snprintf(pattern, sizeof(pattern), "\"%s\":", key);
+    const char *value = strstr(line, pattern);
+    return value != NULL ? value + strlen(pattern) : NULL;
+}
+
+static int parse_string(const char *line, const char *key, char *string, size_t size)
+{
+    const char *value = find_value(line, key);
+    if (value == NULL || *value != '"') {
+        return -1;
+    }
+
+    const char *end = strchr(++value, '"');
+    if (end == NULL || (size_t)(end - value) >= size) {
+        return -1;
+    }
+    memcpy(string, value, end - value);
+    string[end - value] = '\0';
+    return 0;
+}
+
+static int parse_number(const char *line, const char *key, double *number)
+{
+    const char *value = find_value(line, key);
+    char *end;
+
+    if (value == NULL) {
+        return -1;
+    }
+    *number = strtod(value, &end);
+    return end == value ? -1 : 0;
+}
+
+static int load_run(const char *path, run_t *run)
+{
+    FILE *file = fopen(path, "r");
+    char buffer[512];
+
+    if (file == NULL) {
+        perror(path);
+        return -1;
+    }
+
+    run->count = 0;
+    while (fgets(buffer, sizeof(buffer), file) != NULL) {
+        // the line may follow a prefix of the serial monitor or the log of a capture tool
+        const char *line = strstr(buffer, "{\"bench\":");
+        result_t *result = &run->results[run->count];
+        double bytes;
+        double wire_bytes;
+
+        if (line == NULL) {
+            continue;
+        }
+        if (run->count == MAX_RESULTS) {
+            fprintf(stderr, "%s: more than %d results\n", path, MAX_RESULTS);
+            break;
+        }
+        if (parse_string(line, "bench", result->name, sizeof(result->name)) != 0 ||
+            parse_string(line, "unit", result->unit, sizeof(result->unit)) != 0 ||
+            parse_number(line, "min", &result->min) != 0 ||
+            parse_number(line, "median", &result->median) != 0 ||
+            parse_number(line, "bytes", &bytes) != 0 ||
+            parse_number(line, "wire_bytes", &wire_bytes) != 0) {
+            fprintf(stderr, "%s: skipping malformed line: %s", path, line);
+            continue;
+        }
+        if (parse_string(line, "version", result->version, sizeof(result->version)) != 0) {
+            strcpy(result->version, "?");
+        }
+        result->bytes = (unsigned long)bytes;
+        result->wire_bytes = (unsigned long)wire_bytes;
+        run->count++;
+    }
+
+    fclose(file);
+    if (run->count == 0) {
+        fprintf(stderr, "%s: no benchmark results\n", path);
+        return -1;
+    }
+    return 0;
+}
+
+static const result_t *find_result(const run_t *run, const char *name)
+{
+    for (size_t i = 0; i < run->count; i++) {
+        if (strcmp(run->results[i].name, name) == 0) {
+            return &run->results[i];
+        }
+    }
+    return NULL;
+}
+
+int main(int argc, char **argv)
+{
+    static run_t baseline;
+    static run_t current;
+    double threshold = 5;
+    int regressions = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "t:")) != -1) {
+        switch (opt) {
+            case 't':
+                threshold = atof(optarg);
+                break;
+            default:
+                goto usage;
+        }
+    }
+    if (argc - optind != 2) {
+        goto usage;
+    }
+    if (load_run(argv[optind], &baseline) != 0 || load_run(argv[optind + 1], &current) != 0) {
+        return 2;
+    }
+    if (strcmp(baseline.results[0].unit, current.results[0].unit) != 0) {
+        fprintf(stderr, "Cannot compare %s with %s\n", baseline.results[0].unit, current.results[0].unit);
+        return 2;
+    }
+
+    printf("%s -> %s, median %s per operation, threshold %.1f %%\n", baseline.results[0].version,
+           current.results[0].version, current.results[0].unit, threshold);
+    printf("%-28s %12s %12s %8s %14s\n", "benchmark", "baseline", "current", "change", "bytes (wire)");
+
+    for (size_t i = 0; i < baseline.count; i++) {
+        const result_t *before = &baseline.results[i];
+        const result_t *after = find_result(&current, before->name);
+
+        if (after == NULL) {
+            printf("%-28s %12.1f %12s %8s %14s  MISSING\n", before->name, before->median, "-", "-", "-");
+            regressions++;
+            continue;
+        }
+
+        double change = before->median > 0 ? (after->median - before->median) * 100 / before->median : 0;
+        bool slower = change > threshold;
+        bool larger = after->bytes > before->bytes || after->wire_bytes > before->wire_bytes;
+        char bytes[32];
+
+        if (after->bytes == before->bytes && after->wire_bytes == before->wire_bytes) {
+            snprintf(bytes, sizeof(bytes), "%lu (%lu)", after->bytes, after->wire_bytes);
+        } else {
+            snprintf(bytes, sizeof(bytes), "%lu->%lu (%lu)", before->bytes, after->bytes, after->wire_bytes);
+        }
+        printf("%-28s %12.1f %12.1f %+7.1f%% %14s%s%s\n", before->name, before->median, after->median, change, bytes,
+               slower ? "  SLOWER" : "", larger ? "  LARGER" : "");
+        regressions += slower || larger;
+    }
+
+    for (size_t i = 0; i < current.count; i++) {
+        if (find_result(&baseline, current.results[i].name) == NULL) {
+            printf("%-28s %12s %12.1f %8s %14lu  NEW\n", current.results[i].name, "-", current.results[i].median,
+                   "-", current.results[i].bytes);
+        }
+    }
+
+    printf("%d regression(s)\n", regressions);
+    return regressions > 0 ? 1 : 0;
+
+usage:
+    fprintf(stderr, "usage: %s [-t percent] baseline.jsonl current.jsonl\n", argv[0]);
+    return 2;
+}
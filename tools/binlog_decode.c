@@ -0,0 +1,156 @@
+/*
+ * Turns a dump of the deferred log (main/binlog.h) into the ESP_LOG lines the node did not format, one per record,
+ * oldest first. The formats come from the message table of main/binlog.h: build the decoder from the sources of
+ * the firmware that made the dump.
+ *
+ * Build and run on the host (the host build in host/ builds it too):
+ *   cc -O2 -I main -o binlog_decode tools/binlog_decode.c main/binlog_format.c main/fixed.c
+ *   mosquitto_sub -t dt/hub/barn/esp32dhtA/log -N > dump.bin &
+ *   mosquitto_pub -t cmd/hub/barn/esp32dhtA/log -n
+ *   ./binlog_decode dump.bin           # or the chunks on stdin
+ *
+ * The chunks of a dump are read back to back, as mosquitto_sub -N writes them. Records the ring overwrote before
+ * the dump, and sequence numbers missing between two chunks, are reported in the output.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "binlog.h"
+
+static const char letters[] = "NEWIDV";
+
+static uint32_t get_u32(const uint8_t *data)
+{
+    return (uint32_t)data[0] | (uint32_t)data[1] << 8 | (uint32_t)data[2] << 16 | (uint32_t)data[3] << 24;
+}
+
+static uint16_t get_u16(const uint8_t *data)
+{
+    return (uint16_t)(data[0] | data[1] << 8);
+}
+
+static uint8_t *read_all(FILE *file, size_t *len)
+{
+    size_t capacity = 4096;
+    uint8_t *data = malloc(capacity);
+
+    *len = 0;
+    while (data != NULL) {
+        size_t n = fread(data + *len, 1, capacity - *len, file);
+
+        *len += n;
+        if (n == 0) {
+            break;
+        }
+        if (*len == capacity) {
+            uint8_t *larger = realloc(data, capacity * 2);
+
+            if (larger == NULL) {
+                free(data);
+                return NULL;
+            }
+            data = larger;
+            capacity *= 2;
+        }
+    }
+    return data;
+}
+
+/**
+ * @return bytes of the chunk at data, 0 if it is not one
+ */
+static size_t decode_chunk(const uint8_t *data, size_t len, uint32_t *expected)
+{
+    size_t offset = sizeof(binlog_dump_header_t);
+
+    if (len < offset || get_u32(data) != BINLOG_MAGIC) {
+        return 0;
+    }
+
+    uint16_t messages = get_u16(data + 4);
+    uint16_t records = get_u16(data + 6);
+    uint32_t first = get_u32(data + 8);
+    uint32_t overwritten = get_u32(data + 12);
+
+    if (messages != BINLOG_MESSAGE_COUNT) {
+        fprintf(stderr, "dump of a firmware with %u messages, this decoder knows %u: rebuild it from the sources "
+                "of that firmware\n", messages, BINLOG_MESSAGE_COUNT);
+    }
+    // the ring wrapped, or a chunk of the dump was lost
+    if (first > *expected) {
+        printf("-- %u records lost (%u overwritten since boot)\n", first - *expected, overwritten);
+    }
+
+    for (uint16_t i = 0; i < records; i++) {
+        if (offset + 8 > len) {
+            return 0;
+        }
+
+        uint32_t time_ms = get_u32(data + offset);
+        uint32_t word = get_u32(data + offset + 4);
+        uint16_t id = word & 0xffff;
+        size_t argc = (word >> 16) & 0xff;
+        int32_t args[BINLOG_MAX_ARGS];
+        char text[160];
+
+        offset += 8;
+        if (argc > BINLOG_MAX_ARGS || offset + argc * 4 > len) {
+            return 0;
+        }
+        for (size_t arg = 0; arg < argc; arg++, offset += 4) {
+            args[arg] = (int32_t)get_u32(data + offset);
+        }
+
+        if (binlog_format(id, args, argc, text, sizeof(text)) < 0) {
+            printf("? (%u) message %u, %zu arguments\n", time_ms, id, argc);
+            continue;
+        }
+        const binlog_message_t *message = &binlog_messages[id];
+        printf("%c (%u) %s: %s\n", letters[message->level], time_ms, message->tag, text);
+    }
+
+    *expected = first + records;
+    return offset;
+}
+
+int main(int argc, char **argv)
+{
+    FILE *file = stdin;
+    size_t len;
+    size_t offset = 0;
+    uint32_t expected = 0;
+
+    if (argc > 2) {
+        fprintf(stderr, "usage: %s [dump.bin]\n", argv[0]);
+        return 2;
+    }
+    if (argc == 2 && (file = fopen(argv[1], "rb")) == NULL) {
+        perror(argv[1]);
+        return 1;
+    }
+
+    uint8_t *data = read_all(file, &len);
+    if (file != stdin) {
+        fclose(file);
+    }
+    if (data == NULL) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+
+    while (offset < len) {
+        size_t chunk = decode_chunk(data + offset, len - offset, &expected);
+
+        if (chunk == 0) {
+            fprintf(stderr, "no dump chunk at byte %zu\n", offset);
+            free(data);
+            return 1;
+        }
+        offset += chunk;
+    }
+
+    free(data);
+    return 0;
+}
@@ -0,0 +1,185 @@
+/*
+ * Replays a recorded trace through the deadband filter of main/deadband.c and reports how many messages it
+ * suppresses compared to publishing every sample on the per-value topics.
+ *
+ * Build and run on the host:
+ *   cc -O2 -I main -o deadband_replay tools/deadband_replay.c main/deadband.c -lm
+ *   ./deadband_replay [-t 0.10] [-h 0.50] [-v 0.020] [-s 1.00] [-b 900] trace.csv
+ *
+ * Trace format, one sample per line, '#' starts a comment:
+ *   time_ms,temperature,humidity,voltage,soc
+ * Leave temperature/humidity or voltage/soc empty when that sensor had no reading.
+ *
+ * Thresholds use the units of the values (°C, %, V, %), the heartbeat is in seconds. The defaults match the
+ * Kconfig defaults. Values and thresholds are converted to the fixed-point units of the readings (see fixed.h)
+ * before they reach the filter, as on the device.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "deadband.h"
+#include "fixed.h"
+
+static const char *metric_names[DEADBAND_METRIC_COUNT] = {
+        [DEADBAND_TEMPERATURE] = "temperature",
+        [DEADBAND_HUMIDITY] = "humidity",
+        [DEADBAND_VOLTAGE] = "voltage",
+        [DEADBAND_SOC] = "soc",
+};
+
+/* Parses a value in its unit into 1/den units */
+static int32_t parse_fixed(const char *string, uint32_t den)
+{
+    return (int32_t)lround(strtod(string, NULL) * den);
+}
+
+/* Splits one CSV field off *line, returns NULL for an empty field */
+static char *next_field(char **line)
+{
+    char *field = *line;
+
+    if (field == NULL) {
+        return NULL;
+    }
+
+    char *comma = strchr(field, ',');
+    if (comma != NULL) {
+        *comma = '\0';
+        *line = comma + 1;
+    } else {
+        *line = NULL;
+    }
+
+    field[strcspn(field, "\r\n")] = '\0';
+    return *field ? field : NULL;
+}
+
+static bool parse_sample(char *line, uint32_t *time_ms, sensor_frame_t *frame)
+{
+    char *fields[5];
+
+    for (size_t i = 0; i < 5; i++) {
+        fields[i] = next_field(&line);
+    }
+
+    if (fields[0] == NULL) {
+        return false;
+    }
+
+    *time_ms = (uint32_t)strtoul(fields[0], NULL, 10);
+    *frame = (sensor_frame_t) { 0 };
+
+    if (fields[1] != NULL && fields[2] != NULL) {
+        frame->flags |= PAYLOAD_HAS_DHT;
+        frame->temperature = (int16_t)parse_fixed(fields[1], FIXED_DHT_DEN);
+        frame->humidity = (uint16_t)parse_fixed(fields[2], FIXED_DHT_DEN);
+    }
+
+    if (fields[3] != NULL && fields[4] != NULL) {
+        frame->flags |= PAYLOAD_HAS_BATTERY;
+        frame->voltage = (uint16_t)parse_fixed(fields[3], FIXED_VCELL_DEN);
+        frame->soc = (uint16_t)parse_fixed(fields[4], FIXED_SOC_DEN);
+    }
+
+    return true;
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr, "usage: %s [-t temperature] [-h humidity] [-v voltage] [-s soc] [-b heartbeat_s] trace.csv\n",
+            name);
+}
+
+int main(int argc, char **argv)
+{
+    deadband_config_t config[DEADBAND_METRIC_COUNT] = {
+            [DEADBAND_TEMPERATURE] = { 1, 900000 },         /* 0.10 °C */
+            [DEADBAND_HUMIDITY] = { 5, 900000 },            /* 0.50 % */
+            [DEADBAND_VOLTAGE] = { 256, 900000 },           /* 0.020 V */
+            [DEADBAND_SOC] = { 256, 900000 },               /* 1.00 % */
+    };
+    int opt;
+
+    while ((opt = getopt(argc, argv, "t:h:v:s:b:")) != -1) {
+        switch (opt) {
+            case 't':
+                config[DEADBAND_TEMPERATURE].threshold = (uint32_t)parse_fixed(optarg, FIXED_DHT_DEN);
+                break;
+            case 'h':
+                config[DEADBAND_HUMIDITY].threshold = (uint32_t)parse_fixed(optarg, FIXED_DHT_DEN);
+                break;
+            case 'v':
+                config[DEADBAND_VOLTAGE].threshold = (uint32_t)parse_fixed(optarg, FIXED_VCELL_DEN);
+                break;
+            case 's':
+                config[DEADBAND_SOC].threshold = (uint32_t)parse_fixed(optarg, FIXED_SOC_DEN);
+                break;
+            case 'b':
+                for (size_t i = 0; i < DEADBAND_METRIC_COUNT; i++) {
+                    config[i].heartbeat_ms = (uint32_t)strtoul(optarg, NULL, 10) * 1000;
+                }
+                break;
+            default:
+                usage(argv[0]);
+                return 2;
+        }
+    }
+
+    if (optind != argc - 1) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    FILE *trace = fopen(argv[optind], "r");
+    if (trace == NULL) {
+        perror(argv[optind]);
+        return 1;
+    }
+
+    deadband_t deadband;
+    deadband_init(&deadband, config);
+
+    char line[256];
+    uint32_t samples = 0;
+    while (fgets(line, sizeof(line), trace) != NULL) {
+        uint32_t time_ms;
+        sensor_frame_t frame;
+
+        if (line[0] == '#' || !parse_sample(line, &time_ms, &frame)) {
+            continue;
+        }
+
+        deadband_filter(&deadband, &frame, time_ms);
+        samples++;
+    }
+    fclose(trace);
+
+    uint32_t total_offered = 0;
+    uint32_t total_published = 0;
+
+    printf("%u samples\n", samples);
+    printf("%-12s %9s %9s %10s %10s %11s\n", "metric", "offered", "changes", "heartbeats", "published",
+           "suppressed");
+
+    for (size_t i = 0; i < DEADBAND_METRIC_COUNT; i++) {
+        const deadband_stats_t *stats = &deadband.stats[i];
+        uint32_t published = stats->changes + stats->heartbeats;
+        uint32_t suppressed = stats->samples - published;
+
+        printf("%-12s %9u %9u %10u %10u %10.1f%%\n", metric_names[i], stats->samples, stats->changes,
+               stats->heartbeats, published, stats->samples ? 100.0 * suppressed / stats->samples : 0.0);
+
+        total_offered += stats->samples;
+        total_published += published;
+    }
+
+    printf("messages: %u without deadband, %u with, %u suppressed (%.1f%%)\n", total_offered, total_published,
+           total_offered - total_published,
+           total_offered ? 100.0 * (total_offered - total_published) / total_offered : 0.0);
+
+    return 0;
+}
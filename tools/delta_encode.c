@@ -0,0 +1,379 @@
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "delta.h"
+#include "delta_encode.h"
+
+#define MATCH_KEY           8       /*!< bytes hashed to find match candidates in the source */
+#define MATCH_HASH_BITS     18
+#define MATCH_CANDIDATES    64
+#define ALIGNMENT_SLACK     8       /*!< a new match must beat the current alignment by this many bytes */
+
+#define LZSS_HASH_BITS      15
+#define LZSS_CANDIDATES     256
+
+typedef struct {
+    uint8_t *data;
+    size_t len;
+    size_t capacity;
+    bool failed;
+} buffer_t;
+
+typedef struct {
+    const uint8_t *source;
+    int64_t source_len;
+    const uint8_t *target;
+    int64_t target_len;
+    int32_t *head;
+    int32_t *prev;
+} matcher_t;
+
+static void buffer_put(buffer_t *buffer, const void *data, size_t len)
+{
+    if (buffer->failed) {
+        return;
+    }
+
+    if (buffer->len + len > buffer->capacity) {
+        size_t capacity = buffer->capacity ? buffer->capacity : 4096;
+
+        while (capacity < buffer->len + len) {
+            capacity *= 2;
+        }
+        uint8_t *data_new = realloc(buffer->data, capacity);
+        if (data_new == NULL) {
+            buffer->failed = true;
+            return;
+        }
+        buffer->data = data_new;
+        buffer->capacity = capacity;
+    }
+
+    memcpy(buffer->data + buffer->len, data, len);
+    buffer->len += len;
+}
+
+static void buffer_byte(buffer_t *buffer, uint8_t byte)
+{
+    buffer_put(buffer, &byte, 1);
+}
+
+static void put_varint(buffer_t *buffer, uint32_t value)
+{
+    while (value >= 0x80) {
+        buffer_byte(buffer, (uint8_t)(value | 0x80));
+        value >>= 7;
+    }
+    buffer_byte(buffer, (uint8_t)value);
+}
+
+static void put_le32(uint8_t *bytes, uint32_t value)
+{
+    bytes[0] = (uint8_t)value;
+    bytes[1] = (uint8_t)(value >> 8);
+    bytes[2] = (uint8_t)(value >> 16);
+    bytes[3] = (uint8_t)(value >> 24);
+}
+
+static uint32_t hash_key(const uint8_t *bytes)
+{
+    uint64_t key;
+
+    memcpy(&key, bytes, sizeof(key));
+    return (uint32_t)((key * 0x9E3779B97F4A7C15ULL) >> (64 - MATCH_HASH_BITS));
+}
+
+static int64_t common_length(const uint8_t *a, const uint8_t *b, int64_t max)
+{
+    int64_t len = 0;
+
+    while (len < max && a[len] == b[len]) {
+        len++;
+    }
+
+    return len;
+}
+
+/* Longest exact match of the target at scan among the source positions with the same key */
+static int64_t find_match(const matcher_t *m, int64_t scan, int64_t *pos)
+{
+    int64_t best = 0;
+    int candidates = 0;
+
+    if (m->head == NULL || scan + MATCH_KEY > m->target_len) {
+        return 0;
+    }
+
+    for (int32_t candidate = m->head[hash_key(m->target + scan)]; candidate >= 0 && candidates < MATCH_CANDIDATES;
+         candidate = m->prev[candidate], candidates++) {
+        int64_t max = m->source_len - candidate < m->target_len - scan ? m->source_len - candidate :
+                      m->target_len - scan;
+        int64_t len = common_length(m->source + candidate, m->target + scan, max);
+
+        if (len > best) {
+            best = len;
+            *pos = candidate;
+        }
+    }
+
+    return best;
+}
+
+static bool source_matches(const matcher_t *m, int64_t source_pos, int64_t target_pos)
+{
+    return source_pos >= 0 && source_pos < m->source_len && m->source[source_pos] == m->target[target_pos];
+}
+
+static void put_block(buffer_t *raw, const matcher_t *m, int64_t last_scan, int64_t last_pos, int64_t lenf,
+                      int64_t extra_len, int64_t seek, delta_encode_stats_t *stats)
+{
+    uint32_t zigzag = seek >= 0 ? (uint32_t)(seek * 2) : (uint32_t)(-seek * 2 - 1);
+
+    put_varint(raw, (uint32_t)lenf);
+    put_varint(raw, (uint32_t)extra_len);
+    put_varint(raw, zigzag);
+    for (int64_t i = 0; i < lenf; i++) {
+        buffer_byte(raw, (uint8_t)(m->target[last_scan + i] - m->source[last_pos + i]));
+    }
+    buffer_put(raw, m->target + last_scan + lenf, (size_t)extra_len);
+
+    stats->blocks++;
+    stats->diff_bytes += (size_t)lenf;
+    stats->extra_bytes += (size_t)extra_len;
+}
+
+/* The block search of bsdiff, with hashed exact matches in place of its suffix array */
+static void make_blocks(const matcher_t *m, buffer_t *raw, delta_encode_stats_t *stats)
+{
+    int64_t scan = 0, len = 0, pos = 0;
+    int64_t last_scan = 0, last_pos = 0, last_offset = 0;
+
+    while (scan < m->target_len) {
+        int64_t old_score = 0;
+        int64_t scsc;
+
+        // look for a match the current alignment does not already explain
+        for (scsc = scan += len; scan < m->target_len; scan++) {
+            len = find_match(m, scan, &pos);
+
+            for (; scsc < scan + len; scsc++) {
+                if (source_matches(m, scsc + last_offset, scsc)) {
+                    old_score++;
+                }
+            }
+            if ((len == old_score && len != 0) || len > old_score + ALIGNMENT_SLACK) {
+                break;
+            }
+            if (source_matches(m, scan + last_offset, scan)) {
+                old_score--;
+            }
+        }
+
+        if (len == old_score && scan != m->target_len) {
+            continue;
+        }
+
+        // how far the previous alignment carries forward and the new one reaches back
+        int64_t s = 0, best = 0, lenf = 0, lenb = 0;
+        for (int64_t i = 0; last_scan + i < scan && last_pos + i < m->source_len;) {
+            if (m->source[last_pos + i] == m->target[last_scan + i]) {
+                s++;
+            }
+            i++;
+            if (s * 2 - i > best * 2 - lenf) {
+                best = s;
+                lenf = i;
+            }
+        }
+
+        if (scan < m->target_len) {
+            s = 0;
+            best = 0;
+            for (int64_t i = 1; scan >= last_scan + i && pos >= i; i++) {
+                if (m->source[pos - i] == m->target[scan - i]) {
+                    s++;
+                }
+                if (s * 2 - i > best * 2 - lenb) {
+                    best = s;
+                    lenb = i;
+                }
+            }
+        }
+
+        if (last_scan + lenf > scan - lenb) {
+            int64_t overlap = (last_scan + lenf) - (scan - lenb);
+            int64_t split = 0;
+
+            s = 0;
+            best = 0;
+            for (int64_t i = 0; i < overlap; i++) {
+                if (m->target[last_scan + lenf - overlap + i] == m->source[last_pos + lenf - overlap + i]) {
+                    s++;
+                }
+                if (m->target[scan - lenb + i] == m->source[pos - lenb + i]) {
+                    s--;
+                }
+                if (s > best) {
+                    best = s;
+                    split = i + 1;
+                }
+            }
+            lenf += split - overlap;
+            lenb -= split;
+        }
+
+        int64_t extra_len = (scan - lenb) - (last_scan + lenf);
+        int64_t seek = scan < m->target_len ? (pos - lenb) - (last_pos + lenf) : 0;
+        put_block(raw, m, last_scan, last_pos, lenf, extra_len, seek, stats);
+
+        last_scan = scan - lenb;
+        last_pos = pos - lenb;
+        last_offset = pos - scan;
+    }
+}
+
+static uint32_t hash3(const uint8_t *bytes)
+{
+    uint32_t key = (uint32_t)bytes[0] | (uint32_t)bytes[1] << 8 | (uint32_t)bytes[2] << 16;
+
+    return (key * 2654435761U) >> (32 - LZSS_HASH_BITS);
+}
+
+/* Greedy LZSS in the format delta.c decodes, matches may overlap their own output */
+static void lzss_compress(const uint8_t *in, size_t len, buffer_t *out)
+{
+    int32_t *head = malloc(sizeof(int32_t) << LZSS_HASH_BITS);
+    int32_t *prev = malloc(sizeof(int32_t) * (len > 0 ? len : 1));
+    size_t pos = 0;
+
+    if (head == NULL || prev == NULL) {
+        out->failed = true;
+        free(head);
+        free(prev);
+        return;
+    }
+    memset(head, 0xff, sizeof(int32_t) << LZSS_HASH_BITS);
+
+    while (pos < len) {
+        size_t flag_index = out->len;
+        uint8_t flags = 0;
+
+        buffer_byte(out, 0);
+        for (int bit = 0; bit < 8 && pos < len; bit++) {
+            size_t best_len = 0, best_distance = 0;
+            size_t max = len - pos < DELTA_MAX_MATCH ? len - pos : DELTA_MAX_MATCH;
+
+            if (max >= DELTA_MIN_MATCH) {
+                int candidates = 0;
+
+                for (int32_t candidate = head[hash3(in + pos)];
+                     candidate >= 0 && pos - (size_t)candidate <= DELTA_WINDOW_SIZE && candidates < LZSS_CANDIDATES;
+                     candidate = prev[candidate], candidates++) {
+                    size_t match = (size_t)common_length(in + candidate, in + pos, (int64_t)max);
+
+                    if (match > best_len) {
+                        best_len = match;
+                        best_distance = pos - (size_t)candidate;
+                        if (match == max) {
+                            break;
+                        }
+                    }
+                }
+            }
+
+            size_t advance = best_len >= DELTA_MIN_MATCH ? best_len : 1;
+            if (best_len >= DELTA_MIN_MATCH) {
+                size_t code = best_len - DELTA_MIN_MATCH;
+
+                buffer_byte(out, (uint8_t)(best_distance - 1));
+                buffer_byte(out, (uint8_t)(((best_distance - 1) >> 8) | (code < 15 ? code : 15) << 4));
+                if (code >= 15) {
+                    buffer_byte(out, (uint8_t)(code - 15));
+                }
+            } else {
+                flags |= (uint8_t)(1 << bit);
+                buffer_byte(out, in[pos]);
+            }
+
+            for (size_t end = pos + advance; pos < end; pos++) {
+                if (pos + DELTA_MIN_MATCH <= len) {
+                    uint32_t h = hash3(in + pos);
+
+                    prev[pos] = head[h];
+                    head[h] = (int32_t)pos;
+                }
+            }
+        }
+
+        if (!out->failed) {
+            out->data[flag_index] = flags;
+        }
+    }
+
+    free(head);
+    free(prev);
+}
+
+uint8_t *delta_encode(const uint8_t *source, size_t source_len, const uint8_t *target, size_t target_len,
+                      const uint8_t *seed, size_t *patch_len, delta_encode_stats_t *stats)
+{
+    delta_encode_stats_t local_stats;
+    matcher_t m = {
+            .source = source,
+            .source_len = (int64_t)source_len,
+            .target = target,
+            .target_len = (int64_t)target_len,
+    };
+    buffer_t raw = { 0 };
+    buffer_t patch = { 0 };
+    uint8_t header[DELTA_HEADER_SIZE];
+
+    if (stats == NULL) {
+        stats = &local_stats;
+    }
+    memset(stats, 0, sizeof(*stats));
+
+    if (source_len >= MATCH_KEY) {
+        m.head = malloc(sizeof(int32_t) << MATCH_HASH_BITS);
+        m.prev = malloc(sizeof(int32_t) * source_len);
+        if (m.head == NULL || m.prev == NULL) {
+            free(m.head);
+            free(m.prev);
+            return NULL;
+        }
+        memset(m.head, 0xff, sizeof(int32_t) << MATCH_HASH_BITS);
+        // later positions first in a chain, after the earlier ones are pushed down
+        for (size_t i = 0; i + MATCH_KEY <= source_len; i++) {
+            uint32_t h = hash_key(source + i);
+
+            m.prev[i] = m.head[h];
+            m.head[h] = (int32_t)i;
+        }
+    }
+
+    make_blocks(&m, &raw, stats);
+    free(m.head);
+    free(m.prev);
+
+    put_le32(&header[0], DELTA_MAGIC);
+    put_le32(&header[4], (uint32_t)source_len);
+    put_le32(&header[8], delta_crc32(0, source, source_len));
+    put_le32(&header[12], (uint32_t)target_len);
+    put_le32(&header[16], delta_crc32(0, target, target_len));
+    ed25519_sign(&header[20], seed, target, target_len);
+    buffer_put(&patch, header, sizeof(header));
+    lzss_compress(raw.data, raw.len, &patch);
+
+    stats->raw_size = raw.len;
+    stats->patch_size = patch.len;
+    free(raw.data);
+
+    if (raw.failed || patch.failed) {
+        free(patch.data);
+        return NULL;
+    }
+
+    *patch_len = patch.len;
+    return patch.data;
+}
@@ -0,0 +1,32 @@
+#ifndef __DELTA_ENCODE_H__
+#define __DELTA_ENCODE_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Writes the update patches of main/delta.h, on the host only. The block search follows bsdiff: exact matches of
+ * the target in the source are found through a hash of 8 bytes, and each is extended forward and backward as long
+ * as more bytes match than differ. Shared by tools/delta_make.c and host/ota_sim.c.
+ */
+
+typedef struct {
+    size_t blocks;
+    size_t diff_bytes;          /*!< target bytes sent as a difference to the source */
+    size_t extra_bytes;         /*!< target bytes sent as they are */
+    size_t raw_size;            /*!< block stream before the compression */
+    size_t patch_size;          /*!< header and compressed block stream */
+} delta_encode_stats_t;
+
+/**
+ * @brief Make the patch from source to target
+ *
+ * @param source running image, NULL with source_len 0 for a patch of the whole target
+ * @param seed ED25519_SEED_SIZE byte private key the target is signed with
+ * @param stats output, may be NULL
+ * @return the patch in a malloc() buffer of *patch_len bytes, NULL if out of memory
+ */
+uint8_t *delta_encode(const uint8_t *source, size_t source_len, const uint8_t *target, size_t target_len,
+                      const uint8_t *seed, size_t *patch_len, delta_encode_stats_t *stats);
+
+#endif // __DELTA_ENCODE_H__
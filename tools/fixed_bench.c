@@ -0,0 +1,182 @@
+/*
+ * Compares the integer-only value formatter of main/fixed.c with the sprintf("%.2f") path it replaced: checks the
+ * output for every raw value of every metric and times both.
+ *
+ * Build and run on the host:
+ *   cc -O2 -I main -o fixed_bench tools/fixed_bench.c main/fixed.c
+ *   ./fixed_bench [-n rounds]
+ *
+ * The reference converts a raw value to float exactly as dht22.c and battery.c used to. The output is byte
+ * identical for every DHT22 and SOC value. VCELL values that lie exactly halfway between two hundredths
+ * (VCELL % 128 == 64) are the exception: the float quotient lands on either side of the tie, so sprintf rounded
+ * them either way. fixed_format() rounds them half to even. Those values are counted separately and checked to be
+ * one hundredth off at most. The sign-and-magnitude DHT22 "minus zero" (0x8000) has no int16_t encoding and prints
+ * as 0.00 instead of -0.00.
+ *
+ * Exits with 1 on any other difference.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "fixed.h"
+
+typedef struct {
+    const char *name;
+    int32_t min;
+    int32_t max;
+    uint32_t den;
+    float (*to_float)(int32_t raw);     /*!< the conversion the firmware used before */
+} metric_t;
+
+static float dht_to_float(int32_t raw)
+{
+    // dht_decode_values(): magnitude / 10, negated when the sign bit is set
+    float value = (float)(raw < 0 ? -raw : raw) / 10;
+    return raw < 0 ? value * -1 : value;
+}
+
+static float vcell_to_float(int32_t raw)
+{
+    float _full_scale = 5.12f;
+    float divider = 65536.0f / _full_scale;
+    return ((float)raw) / divider;
+}
+
+static float soc_to_float(int32_t raw)
+{
+    float soc = (float)(raw >> 8);
+    return soc + ((float)(raw & 0xFF)) / 256.0f;
+}
+
+static const metric_t metrics[] = {
+        { "temperature", -32767, 32767, FIXED_DHT_DEN, dht_to_float },
+        { "humidity", 0, 65535, FIXED_DHT_DEN, dht_to_float },
+        { "voltage", 0, 65535, FIXED_VCELL_DEN, vcell_to_float },
+        { "soc", 0, 65535, FIXED_SOC_DEN, soc_to_float },
+};
+
+#define METRIC_COUNT (sizeof(metrics) / sizeof(metrics[0]))
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* A raw value that lies exactly halfway between two hundredths */
+static int is_tie(int32_t raw, uint32_t den)
+{
+    uint64_t product = (uint64_t)(raw < 0 ? -raw : raw) * 100;
+    return 2 * (product % den) == den;
+}
+
+/* Parses "%.2f" output back into hundredths */
+static long hundredths(const char *string)
+{
+    char *dot;
+    long whole = strtol(string, &dot, 10);
+    long fraction = strtol(dot + 1, NULL, 10);
+    return string[0] == '-' ? whole * 100 - fraction : whole * 100 + fraction;
+}
+
+static int check(const metric_t *metric, uint32_t *ties)
+{
+    int failures = 0;
+
+    for (int32_t raw = metric->min; raw <= metric->max; raw++) {
+        char expected[32];
+        char actual[FIXED_STRING_SIZE];
+
+        sprintf(expected, "%.2f", metric->to_float(raw));
+        fixed_format(raw, metric->den, actual, sizeof(actual));
+
+        if (strcmp(expected, actual) == 0) {
+            continue;
+        }
+
+        if (is_tie(raw, metric->den) && labs(hundredths(expected) - hundredths(actual)) == 1) {
+            (*ties)++;
+            continue;
+        }
+
+        if (failures++ < 10) {
+            fprintf(stderr, "%s %d: sprintf \"%s\", fixed \"%s\"\n", metric->name, raw, expected, actual);
+        }
+    }
+
+    return failures;
+}
+
+static volatile char sink;
+
+static double time_sprintf(const metric_t *metric, int rounds)
+{
+    char string[32];
+    double start = now_ns();
+
+    for (int round = 0; round < rounds; round++) {
+        for (int32_t raw = metric->min; raw <= metric->max; raw++) {
+            sprintf(string, "%.2f", metric->to_float(raw));
+            sink = string[0];
+        }
+    }
+
+    return (now_ns() - start) / ((double)rounds * (metric->max - metric->min + 1));
+}
+
+static double time_fixed(const metric_t *metric, int rounds)
+{
+    char string[FIXED_STRING_SIZE];
+    double start = now_ns();
+
+    for (int round = 0; round < rounds; round++) {
+        for (int32_t raw = metric->min; raw <= metric->max; raw++) {
+            fixed_format(raw, metric->den, string, sizeof(string));
+            sink = string[0];
+        }
+    }
+
+    return (now_ns() - start) / ((double)rounds * (metric->max - metric->min + 1));
+}
+
+int main(int argc, char **argv)
+{
+    int rounds = 20;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:")) != -1) {
+        switch (opt) {
+            case 'n':
+                rounds = atoi(optarg);
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-n rounds]\n", argv[0]);
+                return 2;
+        }
+    }
+
+    int failures = 0;
+
+    printf("%-12s %8s %6s %9s %14s %12s %8s\n", "metric", "values", "ties", "failures", "sprintf ns", "fixed ns",
+           "speedup");
+
+    for (size_t i = 0; i < METRIC_COUNT; i++) {
+        const metric_t *metric = &metrics[i];
+        uint32_t ties = 0;
+        int metric_failures = check(metric, &ties);
+        double sprintf_ns = time_sprintf(metric, rounds);
+        double fixed_ns = time_fixed(metric, rounds);
+
+        printf("%-12s %8d %6u %9d %14.1f %12.1f %7.1fx\n", metric->name, metric->max - metric->min + 1, ties,
+               metric_failures, sprintf_ns, fixed_ns, sprintf_ns / fixed_ns);
+        failures += metric_failures;
+    }
+
+    return failures ? 1 : 0;
+}